@@ -99,7 +99,17 @@ function DrawFrame()
 	gl.Enable("TEXTURE_2D")
 	gl.BindTexture( "TEXTURE_2D", tid )
 
-	local frame = vpl:frame_acquire()
+	local frame = vpl:frame_acquire_due()
+	if frame and not profiled then
+		-- where the time to the first frame went, in milliseconds since vlc.new
+		local startup = vpl:startup_profile()
+		for _, stage in ipairs{"instance", "player", "media", "play", "opening", "buffering", "playing", "vout", "first_lock", "first_unlock", "first_acquire"} do
+			if startup[stage] then
+				print(string.format("%-14s %8.1f ms", stage, startup[stage]))
+			end
+		end
+		profiled = true
+	end
 	if frame then
 		if not once then
 			gl.TexImageS(0, 4, "RGBA", HEIGHT, frame, WIDTH*HEIGHT*4)
@@ -9,6 +9,7 @@
 
 #ifdef _WIN32
   #include <windows.h>
+  #include <malloc.h>
   #ifdef LUAVLC_BUILD
     #ifdef LUAVLC_DLL
       #define LUAVLC_API __declspec(dllexport)
@@ -64,6 +65,7 @@ int stricmp(const char *s1, const char *s2)
 #define VMEM_PITCH_DEFAULT (4*VMEM_WIDTH_DEFAULT)
 #define VMEM_CHROMA_DEFAULT "RGBA"
 #define VERBOSITY_DEFAULT 0
+#define VMEM_PAGE_SIZE 4096
 
 #define LIBVLC_MT "LIBVLC_MT"
 #define LIBVLC_MP_MT "LIBVLC_MP_MT"
@@ -136,6 +138,7 @@ typedef struct
 {
 	libvlc_instance_t *vlc;
 	int verbose;
+	int video;
 	char* pix_buffer[QUEUE_SIZE];
 	int nfullbuffers;
 	int ridx, widx;
@@ -143,15 +146,121 @@ typedef struct
 	pthread_mutex_t mutex;
 	int width, height, pitch;
 	char chroma[5];
+	pthread_t owner;
+	int owned;
 } vlc_ctx_t;
 
+/* player values cached from the VLC events, read by info() without calling into libvlc */
+typedef struct
+{
+	libvlc_state_t state;
+	libvlc_time_t time;
+	libvlc_time_t length;
+	float position;
+	float fps;
+	int seekable;
+} vlc_mp_info_t;
+
 typedef struct
 {
 	libvlc_media_t *vlc_m;
 	libvlc_media_player_t *vlc_mp;
 	int vlc_ref;
+	pthread_t owner;
+	int owned;
+	pthread_mutex_t info_mutex;
+	vlc_mp_info_t info;
 } vlc_mp_ctx_t;
 
+/* events updating the cached player values */
+static const int info_events[] =
+{
+	libvlc_MediaPlayerOpening,
+	libvlc_MediaPlayerBuffering,
+	libvlc_MediaPlayerPlaying,
+	libvlc_MediaPlayerPaused,
+	libvlc_MediaPlayerStopped,
+	libvlc_MediaPlayerEndReached,
+	libvlc_MediaPlayerEncounteredError,
+	libvlc_MediaPlayerTimeChanged,
+	libvlc_MediaPlayerPositionChanged,
+	libvlc_MediaPlayerSeekableChanged,
+	libvlc_MediaPlayerLengthChanged
+};
+
+#define INFO_EVENTS (sizeof(info_events) / sizeof(info_events[0]))
+
+/* fields of info(), in the order of info_fields */
+#define INFO_TIME     (1 << 0)
+#define INFO_LENGTH   (1 << 1)
+#define INFO_POSITION (1 << 2)
+#define INFO_FPS      (1 << 3)
+#define INFO_STATE    (1 << 4)
+#define INFO_PLAYING  (1 << 5)
+#define INFO_SEEKABLE (1 << 6)
+#define INFO_ALL      0x7f
+
+static const char* const info_fields[] = { "time", "length", "position", "fps", "state", "playing", "seekable", NULL };
+
+/**
+ * Each Lua state, running on its own OS thread, owns the objects it creates.
+ * An object belongs to the thread that created it, calls from any other thread
+ * raise an error. A state moving to another thread calls detach() first on
+ * its objects, the next call adopts them on the calling thread.
+ */
+static void vlc_checkowner(lua_State* L, pthread_t* owner, int* owned)
+{
+	if (!*owned)
+	{
+		*owner = pthread_self();
+		*owned = 1;
+	}
+	else if (!pthread_equal(*owner, pthread_self()))
+		luaL_error(L, "vlc object used from a thread not owning it, see detach()");
+
+	/* errors are reported per call, not left over from another call */
+	libvlc_clearerr();
+}
+
+static vlc_ctx_t* vlc_checkctx(lua_State* L, int idx)
+{
+	vlc_ctx_t* vlc_ctx = (vlc_ctx_t*)luaL_checkudata(L, idx, LIBVLC_MT);
+	vlc_checkowner(L, &vlc_ctx->owner, &vlc_ctx->owned);
+	return vlc_ctx;
+}
+
+static vlc_mp_ctx_t* vlc_checkmp(lua_State* L, int idx)
+{
+	vlc_mp_ctx_t* vlc_mp_ctx = (vlc_mp_ctx_t*)luaL_checkudata(L, idx, LIBVLC_MP_MT);
+	vlc_checkowner(L, &vlc_mp_ctx->owner, &vlc_mp_ctx->owned);
+	return vlc_mp_ctx;
+}
+
+/* allocates a page aligned frame and faults its pages before the decoder writes it */
+static char* alloc_frame(size_t size)
+{
+	char* frame;
+	size_t off;
+#ifdef _WIN32
+	frame = (char*)_aligned_malloc(size, VMEM_PAGE_SIZE);
+#else
+	if (posix_memalign((void**)&frame, VMEM_PAGE_SIZE, size))
+		frame = NULL;
+#endif
+	for (off=0; frame && off<size; off+=VMEM_PAGE_SIZE)
+		frame[off] = 0;
+	return frame;
+}
+
+static void free_frame(char* frame)
+{
+#ifdef _WIN32
+	_aligned_free(frame);
+#else
+	free(frame);
+#endif
+}
+
 static int catch_error(lua_State* L)
 {
 	if (libvlc_errmsg())
@@ -198,6 +307,57 @@ static void display(void* opaque, void *picture)
 	/* VLC wants displaying video frame */
 }
 
+/* called by the VLC event thread */
+static void info_event(const struct libvlc_event_t* ev, void* opaque)
+{
+	vlc_mp_ctx_t* vlc_mp_ctx = (vlc_mp_ctx_t*)opaque;
+	vlc_mp_info_t* info = &vlc_mp_ctx->info;
+
+	pthread_mutex_lock(&(vlc_mp_ctx->info_mutex));
+	switch (ev->type)
+	{
+	case libvlc_MediaPlayerOpening:
+		info->state = libvlc_Opening;
+		info->fps = 0;
+		break;
+	case libvlc_MediaPlayerBuffering: info->state = libvlc_Buffering; break;
+	case libvlc_MediaPlayerPlaying: info->state = libvlc_Playing; break;
+	case libvlc_MediaPlayerPaused: info->state = libvlc_Paused; break;
+	case libvlc_MediaPlayerStopped:
+	case libvlc_MediaPlayerEndReached:
+	case libvlc_MediaPlayerEncounteredError:
+		info->state = ev->type == libvlc_MediaPlayerStopped ? libvlc_Stopped : (ev->type == libvlc_MediaPlayerEndReached ? libvlc_Ended : libvlc_Error);
+		/* as libvlc without an input */
+		info->time = info->length = -1;
+		info->position = -1.0f;
+		info->fps = 0;
+		info->seekable = 0;
+		break;
+	case libvlc_MediaPlayerTimeChanged: info->time = ev->u.media_player_time_changed.new_time; break;
+	case libvlc_MediaPlayerPositionChanged: info->position = ev->u.media_player_position_changed.new_position; break;
+	case libvlc_MediaPlayerSeekableChanged: info->seekable = ev->u.media_player_seekable_changed.new_seekable; break;
+	case libvlc_MediaPlayerLengthChanged: info->length = ev->u.media_player_length_changed.new_length; break;
+	default: break;
+	}
+	pthread_mutex_unlock(&(vlc_mp_ctx->info_mutex));
+}
+
+static void vlc_pushstate(lua_State* L, libvlc_state_t state)
+{
+	switch (state)
+	{
+	case libvlc_NothingSpecial: lua_pushliteral(L, "NothingSpecial"); break;
+	case libvlc_Opening: lua_pushliteral(L, "Opening"); break;
+	case libvlc_Buffering: lua_pushliteral(L, "Buffering"); break;
+	case libvlc_Playing: lua_pushliteral(L, "Playing"); break;
+	case libvlc_Paused: lua_pushliteral(L, "Paused"); break;
+	case libvlc_Stopped: lua_pushliteral(L, "Stopped"); break;
+	case libvlc_Ended: lua_pushliteral(L, "Ended"); break;
+	case libvlc_Error: lua_pushliteral(L, "Error"); break;
+	default: lua_pushliteral(L, "Unknown"); break;
+	}
+}
+
 static int vlc_new(lua_State* L)
 {
 	int r, rc;
@@ -210,9 +370,11 @@ static int vlc_new(lua_State* L)
 	vlc_ctx = (vlc_ctx_t*)lua_newuserdata(L, sizeof(vlc_ctx_t));
 	if (!vlc_ctx) return fail_allocate_exit(L, __LINE__);
 	vlc_ctx->verbose = VERBOSITY_DEFAULT;
-	vlc_ctx->pix_buffer[0] = vlc_ctx->pix_buffer[1] = NULL;
+	for (i=0; i<QUEUE_SIZE; i++) vlc_ctx->pix_buffer[i] = NULL;
 	vlc_ctx->ridx = vlc_ctx->widx = vlc_ctx->nfullbuffers = 0;
 	vlc_ctx->width = vlc_ctx->height = vlc_ctx->pitch = 0;
+	vlc_ctx->owner = pthread_self();
+	vlc_ctx->owned = 1;
 	luaL_getmetatable(L, LIBVLC_MT);
 	lua_setmetatable(L, -2);
 
@@ -234,20 +396,31 @@ static int vlc_new(lua_State* L)
 		}
 	}
 
-	vlc_ctx->width  = vlc_gettableint(L, 1, "vmem_width");
-	vlc_ctx->height = vlc_gettableint(L, 1, "vmem_height");
-	vlc_ctx->pitch  = vlc_gettableint(L, 1, "vmem_pitch");
-	strncpy(vlc_ctx->chroma, vlc_gettablestr(L, 1, "vmem_chroma"), 4);
+	/* video = false disables the video path for audio or metadata only use */
+	lua_getfield(L, 1, "video");
+	vlc_ctx->video = lua_isnil(L, -1) || lua_toboolean(L, -1);
+	lua_pop(L, 1);
+
+	if (vlc_ctx->video)
+	{
+		vlc_ctx->width  = vlc_gettableint(L, 1, "vmem_width");
+		vlc_ctx->height = vlc_gettableint(L, 1, "vmem_height");
+		/* packed rows by default, as uploaded by display_opengl */
+		lua_getfield(L, 1, "vmem_pitch");
+		vlc_ctx->pitch = lua_isnil(L, -1) ? 4 * vlc_ctx->width : (int)luaL_checkinteger(L, -1);
+		lua_pop(L, 1);
+		strncpy(vlc_ctx->chroma, vlc_gettablestr(L, 1, "vmem_chroma"), 4);
+	}
 	vlc_ctx->chroma[4] = '\0';
 
-	for (i=0; i<QUEUE_SIZE; i++)
+	for (i=0; vlc_ctx->video && i<QUEUE_SIZE; i++)
 	{
-		vlc_ctx->pix_buffer[i] = (char*)malloc(vlc_ctx->pitch * vlc_ctx->height);
+		vlc_ctx->pix_buffer[i] = alloc_frame((size_t)vlc_ctx->pitch * vlc_ctx->height);
 		if (!vlc_ctx->pix_buffer[i])
 		{
 			for (i=0; i<vlc_argc; i++) free(vlc_argv[i]);
 			free(vlc_argv);
-			if (i==1) { free(vlc_ctx->pix_buffer[0]); vlc_ctx->pix_buffer[0] = NULL; }
+			if (i==1) { free_frame(vlc_ctx->pix_buffer[0]); vlc_ctx->pix_buffer[0] = NULL; }
 			return fail_allocate_exit(L, __LINE__);
 		}
 	}
@@ -308,7 +481,7 @@ static int vlc_destroy(lua_State* L)
 		for (i=0; i<QUEUE_SIZE; i++)
 			if (vlc_ctx->pix_buffer[i])
 			{
-				free(vlc_ctx->pix_buffer[i]);
+				free_frame(vlc_ctx->pix_buffer[i]);
 				vlc_ctx->pix_buffer[i] = NULL;
 			}
 		pthread_mutex_destroy(&(vlc_ctx->mutex));
@@ -323,8 +496,10 @@ static int vlc_open(lua_State* L)
 	libvlc_media_t *m;
 	libvlc_media_player_t *vlc_mp;
 	vlc_mp_ctx_t* vlc_mp_ctx;
-	int r;
-	vlc_ctx_t* vlc_ctx = (vlc_ctx_t*)luaL_checkudata(L, 1, LIBVLC_MT);
+	libvlc_event_manager_t* em;
+	int r, rc;
+	unsigned int i;
+	vlc_ctx_t* vlc_ctx = vlc_checkctx(L, 1);
 	m = libvlc_media_new_path(vlc_ctx->vlc, luaL_checkstring(L, 2));
 	if ((r = catch_error(L))) return r;
 
@@ -343,8 +518,28 @@ static int vlc_open(lua_State* L)
 		return fail_allocate_exit(L, __LINE__);
 	}
 
-	libvlc_video_set_callbacks(vlc_mp, lock, unlock, display, vlc_ctx);
-	libvlc_video_set_format(vlc_mp, vlc_ctx->chroma, vlc_ctx->width, vlc_ctx->height, vlc_ctx->pitch);
+	if (vlc_ctx->video)
+	{
+		libvlc_video_set_callbacks(vlc_mp, lock, unlock, display, vlc_ctx);
+		libvlc_video_set_format(vlc_mp, vlc_ctx->chroma, vlc_ctx->width, vlc_ctx->height, vlc_ctx->pitch);
+	}
+	else
+	{
+		/* no video decoding without the vmem video path */
+		libvlc_media_add_option(m, ":no-video");
+	}
+
+	if (0 != (rc = pthread_mutex_init(&(vlc_mp_ctx->info_mutex), 0)))
+	{
+		libvlc_media_player_release(vlc_mp);
+		libvlc_media_release(m);
+		return fail_pthread_exit(L, rc, __LINE__);
+	}
+	vlc_mp_ctx->info.state = libvlc_NothingSpecial;
+	vlc_mp_ctx->info.time = vlc_mp_ctx->info.length = -1;
+	vlc_mp_ctx->info.position = -1.0f;
+	vlc_mp_ctx->info.fps = 0;
+	vlc_mp_ctx->info.seekable = 0;
 
 	luaL_getmetatable(L, LIBVLC_MP_MT);
 	lua_setmetatable(L, -2);
@@ -352,12 +547,32 @@ static int vlc_open(lua_State* L)
 	vlc_mp_ctx->vlc_ref = luaL_ref(L, LUA_REGISTRYINDEX);
 	vlc_mp_ctx->vlc_m = m;
 	vlc_mp_ctx->vlc_mp = vlc_mp;
+	vlc_mp_ctx->owner = pthread_self();
+	vlc_mp_ctx->owned = 1;
+
+	/* the userdata does not move, the events keep its address until __gc */
+	em = libvlc_media_player_event_manager(vlc_mp);
+	for (i=0; i<INFO_EVENTS; i++)
+		libvlc_event_attach(em, info_events[i], info_event, vlc_mp_ctx);
 	return 1;
 }
 
+/* releases the ownership, the next call adopts the object on the calling thread */
+static int vlc_detach(lua_State* L)
+{
+	vlc_checkctx(L, 1)->owned = 0;
+	return 0;
+}
+
+static int vlc_mp_detach(lua_State* L)
+{
+	vlc_checkmp(L, 1)->owned = 0;
+	return 0;
+}
+
 static int vlc_wait(lua_State* L)
 {
-	vlc_ctx_t* vlc_ctx = (vlc_ctx_t*)luaL_checkudata(L, 1, LIBVLC_MT);
+	vlc_ctx_t* vlc_ctx = vlc_checkctx(L, 1);
 	libvlc_wait(vlc_ctx->vlc);
 	return 0;
 }
@@ -376,7 +591,7 @@ static int vlc_get_compiler(lua_State* L)
 
 static int vlc_get_video_frame_size(lua_State* L)
 {
-	vlc_ctx_t* vlc_ctx = (vlc_ctx_t*)luaL_checkudata(L, 1, LIBVLC_MT);
+	vlc_ctx_t* vlc_ctx = vlc_checkctx(L, 1);
 	lua_pushinteger(L, vlc_ctx->width);
 	lua_pushinteger(L, vlc_ctx->height);
 	lua_pushinteger(L, vlc_ctx->pitch);
@@ -386,7 +601,7 @@ static int vlc_get_video_frame_size(lua_State* L)
 static int vlc_has_video_frame(lua_State* L)
 {
 	int has;
-	vlc_ctx_t* vlc_ctx = (vlc_ctx_t*)luaL_checkudata(L, 1, LIBVLC_MT);
+	vlc_ctx_t* vlc_ctx = vlc_checkctx(L, 1);
 	pthread_mutex_lock(&(vlc_ctx->mutex));
 	has = vlc_ctx->nfullbuffers > 0;
 	pthread_mutex_unlock(&(vlc_ctx->mutex));
@@ -396,7 +611,8 @@ static int vlc_has_video_frame(lua_State* L)
 
 static int vlc_get_video_frame(lua_State* L)
 {
-	vlc_ctx_t* vlc_ctx = (vlc_ctx_t*)luaL_checkudata(L, 1, LIBVLC_MT);
+	vlc_ctx_t* vlc_ctx = vlc_checkctx(L, 1);
+	if (!vlc_ctx->video) return fail_error_exit(L, "video is disabled");
 	pthread_mutex_lock(&(vlc_ctx->mutex));
 	if (vlc_ctx->verbose) printf("vlc_get_video_frame buffer %d (%d)\n", vlc_ctx->ridx, vlc_ctx->widx);
 	lua_pushlstring(L, vlc_ctx->pix_buffer[vlc_ctx->ridx], vlc_ctx->pitch * vlc_ctx->height);
@@ -406,7 +622,7 @@ static int vlc_get_video_frame(lua_State* L)
 
 static int vlc_next_video_frame(lua_State* L)
 {
-	vlc_ctx_t* vlc_ctx = (vlc_ctx_t*)luaL_checkudata(L, 1, LIBVLC_MT);
+	vlc_ctx_t* vlc_ctx = vlc_checkctx(L, 1);
 	pthread_mutex_lock(&(vlc_ctx->mutex));
 	if (vlc_ctx->nfullbuffers > 0)
 	{
@@ -421,7 +637,8 @@ static int vlc_next_video_frame(lua_State* L)
 
 static int vlc_wait_video_frame(lua_State* L)
 {
-	vlc_ctx_t* vlc_ctx = (vlc_ctx_t*)luaL_checkudata(L, 1, LIBVLC_MT);
+	vlc_ctx_t* vlc_ctx = vlc_checkctx(L, 1);
+	if (!vlc_ctx->video) return fail_error_exit(L, "video is disabled");
 	pthread_mutex_lock(&(vlc_ctx->mutex));
 	while (vlc_ctx->nfullbuffers == 0)
 	{
@@ -450,7 +667,14 @@ static int vlc_mp_destroy(lua_State* L)
 		if (vlc_mp_ctx->vlc_m)
 			libvlc_media_release(vlc_mp_ctx->vlc_m);
 		if (vlc_mp_ctx->vlc_mp)
+		{
+			libvlc_event_manager_t* em = libvlc_media_player_event_manager(vlc_mp_ctx->vlc_mp);
+			unsigned int i;
+			for (i=0; i<INFO_EVENTS; i++)
+				libvlc_event_detach(em, info_events[i], info_event, vlc_mp_ctx);
 			libvlc_media_player_release(vlc_mp_ctx->vlc_mp);
+			pthread_mutex_destroy(&(vlc_mp_ctx->info_mutex));
+		}
 	}
 	return 0;
 }
@@ -458,7 +682,7 @@ static int vlc_mp_destroy(lua_State* L)
 static int vlc_mp_play(lua_State* L)
 {
 	int r;
-	vlc_mp_ctx_t* vlc_mp_ctx = (vlc_mp_ctx_t*)luaL_checkudata(L, 1, LIBVLC_MP_MT);
+	vlc_mp_ctx_t* vlc_mp_ctx = vlc_checkmp(L, 1);
 	libvlc_media_player_play(vlc_mp_ctx->vlc_mp);
 	if ((r = catch_error(L))) return r;
 	lua_pushboolean(L, 1);
@@ -468,7 +692,7 @@ static int vlc_mp_play(lua_State* L)
 static int vlc_mp_is_playing(lua_State* L)
 {
 	int r, status;
-	vlc_mp_ctx_t* vlc_mp_ctx = (vlc_mp_ctx_t*)luaL_checkudata(L, 1, LIBVLC_MP_MT);
+	vlc_mp_ctx_t* vlc_mp_ctx = vlc_checkmp(L, 1);
 	status = libvlc_media_player_is_playing(vlc_mp_ctx->vlc_mp);
 	if ((r = catch_error(L))) return r;
 	lua_pushboolean(L, status);
@@ -478,7 +702,7 @@ static int vlc_mp_is_playing(lua_State* L)
 static int vlc_mp_pause(lua_State* L)
 {
 	int r;
-	vlc_mp_ctx_t* vlc_mp_ctx = (vlc_mp_ctx_t*)luaL_checkudata(L, 1, LIBVLC_MP_MT);
+	vlc_mp_ctx_t* vlc_mp_ctx = vlc_checkmp(L, 1);
 	libvlc_media_player_pause(vlc_mp_ctx->vlc_mp);
 	if ((r = catch_error(L))) return r;
 	lua_pushboolean(L, 1);
@@ -488,7 +712,7 @@ static int vlc_mp_pause(lua_State* L)
 static int vlc_mp_stop(lua_State* L)
 {
 	int r;
-	vlc_mp_ctx_t* vlc_mp_ctx = (vlc_mp_ctx_t*)luaL_checkudata(L, 1, LIBVLC_MP_MT);
+	vlc_mp_ctx_t* vlc_mp_ctx = vlc_checkmp(L, 1);
 	libvlc_media_player_stop(vlc_mp_ctx->vlc_mp);
 	if ((r = catch_error(L))) return r;
 	lua_pushboolean(L, 1);
@@ -499,21 +723,10 @@ static int vlc_mp_get_state(lua_State* L)
 {
 	int r;
 	libvlc_state_t state;
-	vlc_mp_ctx_t* vlc_mp_ctx = (vlc_mp_ctx_t*)luaL_checkudata(L, 1, LIBVLC_MP_MT);
+	vlc_mp_ctx_t* vlc_mp_ctx = vlc_checkmp(L, 1);
 	state = libvlc_media_get_state(vlc_mp_ctx->vlc_m);
 	if ((r = catch_error(L))) return r;
-	switch (state)
-	{
-	case libvlc_NothingSpecial: lua_pushliteral(L, "NothingSpecial"); break;
-	case libvlc_Opening: lua_pushliteral(L, "Opening"); break;
-	case libvlc_Buffering: lua_pushliteral(L, "Buffering"); break;
-	case libvlc_Playing: lua_pushliteral(L, "Playing"); break;
-	case libvlc_Paused: lua_pushliteral(L, "Paused"); break;
-	case libvlc_Stopped: lua_pushliteral(L, "Stopped"); break;
-	case libvlc_Ended: lua_pushliteral(L, "Ended"); break;
-	case libvlc_Error: lua_pushliteral(L, "Error"); break;
-	default: lua_pushliteral(L, "Unknown"); break;
-	}
+	vlc_pushstate(L, state);
 	return 1;
 }
 
@@ -521,7 +734,7 @@ static int vlc_mp_get_duration(lua_State* L)
 {
 	int r;
 	libvlc_time_t duration;
-	vlc_mp_ctx_t* vlc_mp_ctx = (vlc_mp_ctx_t*)luaL_checkudata(L, 1, LIBVLC_MP_MT);
+	vlc_mp_ctx_t* vlc_mp_ctx = vlc_checkmp(L, 1);
 	duration = libvlc_media_get_duration(vlc_mp_ctx->vlc_m);
 	if ((r = catch_error(L))) return r;
 	lua_pushinteger(L, (lua_Integer)duration);
@@ -532,7 +745,7 @@ static int vlc_mp_get_length(lua_State* L)
 {
 	int r;
 	libvlc_time_t len;
-	vlc_mp_ctx_t* vlc_mp_ctx = (vlc_mp_ctx_t*)luaL_checkudata(L, 1, LIBVLC_MP_MT);
+	vlc_mp_ctx_t* vlc_mp_ctx = vlc_checkmp(L, 1);
 	len = libvlc_media_player_get_length(vlc_mp_ctx->vlc_mp);
 	if ((r = catch_error(L))) return r;
 	lua_pushinteger(L, (lua_Integer)len);
@@ -543,7 +756,7 @@ static int vlc_mp_get_time(lua_State* L)
 {
 	int r;
 	libvlc_time_t atime;
-	vlc_mp_ctx_t* vlc_mp_ctx = (vlc_mp_ctx_t*)luaL_checkudata(L, 1, LIBVLC_MP_MT);
+	vlc_mp_ctx_t* vlc_mp_ctx = vlc_checkmp(L, 1);
 	atime = libvlc_media_player_get_time(vlc_mp_ctx->vlc_mp);
 	if ((r = catch_error(L))) return r;
 	lua_pushinteger(L, (lua_Integer)atime);
@@ -554,7 +767,7 @@ static int vlc_mp_set_time(lua_State* L)
 {
 	int r;
 	libvlc_time_t atime;
-	vlc_mp_ctx_t* vlc_mp_ctx = (vlc_mp_ctx_t*)luaL_checkudata(L, 1, LIBVLC_MP_MT);
+	vlc_mp_ctx_t* vlc_mp_ctx = vlc_checkmp(L, 1);
 	atime = luaL_checkinteger(L, 2);
 	libvlc_media_player_set_time(vlc_mp_ctx->vlc_mp, atime);
 	if ((r = catch_error(L))) return r;
@@ -566,7 +779,7 @@ static int vlc_mp_get_position(lua_State* L)
 {
 	int r;
 	float position;
-	vlc_mp_ctx_t* vlc_mp_ctx = (vlc_mp_ctx_t*)luaL_checkudata(L, 1, LIBVLC_MP_MT);
+	vlc_mp_ctx_t* vlc_mp_ctx = vlc_checkmp(L, 1);
 	position = libvlc_media_player_get_position(vlc_mp_ctx->vlc_mp);
 	if ((r = catch_error(L))) return r;
 	lua_pushnumber(L, (lua_Number)position);
@@ -577,7 +790,7 @@ static int vlc_mp_set_position(lua_State* L)
 {
 	int r;
 	float position;
-	vlc_mp_ctx_t* vlc_mp_ctx = (vlc_mp_ctx_t*)luaL_checkudata(L, 1, LIBVLC_MP_MT);
+	vlc_mp_ctx_t* vlc_mp_ctx = vlc_checkmp(L, 1);
 	position = (float)luaL_checknumber(L, 2);
 	libvlc_media_player_set_position(vlc_mp_ctx->vlc_mp, position);
 	if ((r = catch_error(L))) return r;
@@ -589,7 +802,7 @@ static int vlc_mp_is_parsed(lua_State* L)
 {
 	int r;
 	int preparsed;
-	vlc_mp_ctx_t* vlc_mp_ctx = (vlc_mp_ctx_t*)luaL_checkudata(L, 1, LIBVLC_MP_MT);
+	vlc_mp_ctx_t* vlc_mp_ctx = vlc_checkmp(L, 1);
 	preparsed = libvlc_media_is_parsed(vlc_mp_ctx->vlc_m);
 	if ((r = catch_error(L))) return r;
 	lua_pushboolean(L, preparsed);
@@ -624,7 +837,7 @@ static int vlc_mp_get_meta(lua_State* L)
 		{ 0, NULL}
 	};
 	struct meta_str_t* pmeta_str = meta_str;
-	vlc_mp_ctx_t* vlc_mp_ctx = (vlc_mp_ctx_t*)luaL_checkudata(L, 1, LIBVLC_MP_MT);
+	vlc_mp_ctx_t* vlc_mp_ctx = vlc_checkmp(L, 1);
 	const char* meta_desc = luaL_checkstring(L, 2);
 	while (pmeta_str->str)
 	{
@@ -649,7 +862,7 @@ static int vlc_mp_get_fps(lua_State* L)
 {
 	int r;
 	float fps;
-	vlc_mp_ctx_t* vlc_mp_ctx = (vlc_mp_ctx_t*)luaL_checkudata(L, 1, LIBVLC_MP_MT);
+	vlc_mp_ctx_t* vlc_mp_ctx = vlc_checkmp(L, 1);
 	fps = libvlc_media_player_get_fps(vlc_mp_ctx->vlc_mp);
 	if ((r = catch_error(L))) return r;
 	lua_pushnumber(L, (lua_Number)fps);
@@ -660,7 +873,7 @@ static int vlc_mp_is_seekable(lua_State* L)
 {
 	int r;
 	int seekable;
-	vlc_mp_ctx_t* vlc_mp_ctx = (vlc_mp_ctx_t*)luaL_checkudata(L, 1, LIBVLC_MP_MT);
+	vlc_mp_ctx_t* vlc_mp_ctx = vlc_checkmp(L, 1);
 	seekable = libvlc_media_player_is_seekable(vlc_mp_ctx->vlc_mp);
 	if ((r = catch_error(L))) return r;
 	lua_pushboolean(L, seekable);
@@ -671,7 +884,7 @@ static int vlc_mp_can_pause(lua_State* L)
 {
 	int r;
 	int can_pause;
-	vlc_mp_ctx_t* vlc_mp_ctx = (vlc_mp_ctx_t*)luaL_checkudata(L, 1, LIBVLC_MP_MT);
+	vlc_mp_ctx_t* vlc_mp_ctx = vlc_checkmp(L, 1);
 	can_pause = libvlc_media_player_can_pause(vlc_mp_ctx->vlc_mp);
 	if ((r = catch_error(L))) return r;
 	lua_pushboolean(L, can_pause);
@@ -682,7 +895,7 @@ static int vlc_mp_video_get_scale(lua_State* L)
 {
 	int r;
 	float scale;
-	vlc_mp_ctx_t* vlc_mp_ctx = (vlc_mp_ctx_t*)luaL_checkudata(L, 1, LIBVLC_MP_MT);
+	vlc_mp_ctx_t* vlc_mp_ctx = vlc_checkmp(L, 1);
 	scale = libvlc_video_get_scale(vlc_mp_ctx->vlc_mp);
 	if ((r = catch_error(L))) return r;
 	lua_pushnumber(L, scale);
@@ -693,7 +906,7 @@ static int vlc_mp_video_set_scale(lua_State* L)
 {
 	int r;
 	float scale;
-	vlc_mp_ctx_t* vlc_mp_ctx = (vlc_mp_ctx_t*)luaL_checkudata(L, 1, LIBVLC_MP_MT);
+	vlc_mp_ctx_t* vlc_mp_ctx = vlc_checkmp(L, 1);
 	scale = (float)luaL_checknumber(L, 2);
 	libvlc_video_set_scale(vlc_mp_ctx->vlc_mp, scale);
 	if ((r = catch_error(L))) return r;
@@ -705,7 +918,7 @@ static int vlc_mp_video_get_aspect_ratio(lua_State* L)
 {
 	int r;
 	const char* aspect_ratio;
-	vlc_mp_ctx_t* vlc_mp_ctx = (vlc_mp_ctx_t*)luaL_checkudata(L, 1, LIBVLC_MP_MT);
+	vlc_mp_ctx_t* vlc_mp_ctx = vlc_checkmp(L, 1);
 	aspect_ratio = libvlc_video_get_aspect_ratio(vlc_mp_ctx->vlc_mp);
 	if ((r = catch_error(L))) return r;
 	lua_pushstring(L, aspect_ratio);
@@ -716,7 +929,7 @@ static int vlc_mp_video_set_aspect_ratio(lua_State* L)
 {
 	int r;
 	const char* aspect_ratio;
-	vlc_mp_ctx_t* vlc_mp_ctx = (vlc_mp_ctx_t*)luaL_checkudata(L, 1, LIBVLC_MP_MT);
+	vlc_mp_ctx_t* vlc_mp_ctx = vlc_checkmp(L, 1);
 	aspect_ratio = luaL_checkstring(L, 2);
 	libvlc_video_set_aspect_ratio(vlc_mp_ctx->vlc_mp, (char*)aspect_ratio);
 	if ((r = catch_error(L))) return r;
@@ -724,11 +937,148 @@ static int vlc_mp_video_set_aspect_ratio(lua_State* L)
 	return 1;
 }
 
+/* reads the optional list of info() fields at index, all the fields if nil */
+static int vlc_checkinfofields(lua_State* L, int index)
+{
+	int fields = 0, i;
+	if (lua_isnoneornil(L, index))
+		return INFO_ALL;
+	luaL_checktype(L, index, LUA_TTABLE);
+	for (i=1; ; i++)
+	{
+		lua_rawgeti(L, index, i);
+		if (lua_isnil(L, -1))
+		{
+			lua_pop(L, 1);
+			break;
+		}
+		fields |= 1 << luaL_checkoption(L, -1, NULL, info_fields);
+		lua_pop(L, 1);
+	}
+	return fields;
+}
+
+/* fills the table on top of the stack with the cached values of the player */
+static void vlc_fillinfo(lua_State* L, vlc_mp_ctx_t* vlc_mp_ctx, int fields)
+{
+	vlc_mp_info_t info;
+
+	pthread_mutex_lock(&(vlc_mp_ctx->info_mutex));
+	info = vlc_mp_ctx->info;
+	pthread_mutex_unlock(&(vlc_mp_ctx->info_mutex));
+
+	/* the frame rate has no event, it is taken once per media while playing */
+	if ((fields & INFO_FPS) && info.fps == 0 && info.state == libvlc_Playing)
+	{
+		info.fps = libvlc_media_player_get_fps(vlc_mp_ctx->vlc_mp);
+		libvlc_clearerr();
+		pthread_mutex_lock(&(vlc_mp_ctx->info_mutex));
+		if (vlc_mp_ctx->info.state == libvlc_Playing)
+			vlc_mp_ctx->info.fps = info.fps;
+		pthread_mutex_unlock(&(vlc_mp_ctx->info_mutex));
+	}
+
+	if (fields & INFO_TIME)
+	{
+		lua_pushinteger(L, (lua_Integer)info.time);
+		lua_setfield(L, -2, "time");
+	}
+	if (fields & INFO_LENGTH)
+	{
+		lua_pushinteger(L, (lua_Integer)info.length);
+		lua_setfield(L, -2, "length");
+	}
+	if (fields & INFO_POSITION)
+	{
+		lua_pushnumber(L, (lua_Number)info.position);
+		lua_setfield(L, -2, "position");
+	}
+	if (fields & INFO_FPS)
+	{
+		lua_pushnumber(L, (lua_Number)info.fps);
+		lua_setfield(L, -2, "fps");
+	}
+	if (fields & INFO_STATE)
+	{
+		vlc_pushstate(L, info.state);
+		lua_setfield(L, -2, "state");
+	}
+	if (fields & INFO_PLAYING)
+	{
+		lua_pushboolean(L, info.state == libvlc_Playing);
+		lua_setfield(L, -2, "playing");
+	}
+	if (fields & INFO_SEEKABLE)
+	{
+		lua_pushboolean(L, info.seekable);
+		lua_setfield(L, -2, "seekable");
+	}
+}
+
+/*
+ * info([fields [, t]]), the values of get_time, get_length, get_position,
+ * get_fps, get_state, is_playing and is_seekable in one call, read from
+ * the values cached on the VLC events, t is filled and returned if given
+ */
+static int vlc_mp_info(lua_State* L)
+{
+	vlc_mp_ctx_t* vlc_mp_ctx = vlc_checkmp(L, 1);
+	int fields = vlc_checkinfofields(L, 2);
+	if (lua_isnoneornil(L, 3))
+		lua_newtable(L);
+	else
+	{
+		luaL_checktype(L, 3, LUA_TTABLE);
+		lua_pushvalue(L, 3);
+	}
+	vlc_fillinfo(L, vlc_mp_ctx, fields);
+	return 1;
+}
+
+/* info_all(players [, fields [, out]]), out[i] is the info() table of players[i], tables of out are reused */
+static int vlc_info_all(lua_State* L)
+{
+	int fields, n, i;
+
+	luaL_checktype(L, 1, LUA_TTABLE);
+	fields = vlc_checkinfofields(L, 2);
+	n = luaL_getn(L, 1);
+	if (lua_isnoneornil(L, 3))
+		lua_createtable(L, n, 0);
+	else
+	{
+		luaL_checktype(L, 3, LUA_TTABLE);
+		lua_pushvalue(L, 3);
+	}
+	for (i=1; i<=n; i++)
+	{
+		vlc_mp_ctx_t* vlc_mp_ctx;
+		lua_rawgeti(L, 1, i);
+		vlc_mp_ctx = vlc_checkmp(L, -1);
+		lua_pop(L, 1);
+		lua_rawgeti(L, -1, i);
+		if (!lua_istable(L, -1))
+		{
+			lua_pop(L, 1);
+			lua_createtable(L, 0, 7);
+			lua_pushvalue(L, -1);
+			lua_rawseti(L, -3, i);
+		}
+		vlc_fillinfo(L, vlc_mp_ctx, fields);
+		lua_pop(L, 1);
+	}
+	return 1;
+}
+
 static int vlc_display_opengl(lua_State* L)
 {
-	vlc_ctx_t* vlc_ctx = (vlc_ctx_t*)luaL_checkudata(L, 1, LIBVLC_MT);
+	vlc_ctx_t* vlc_ctx = vlc_checkctx(L, 1);
+	if (!vlc_ctx->video) return 0;
 	pthread_mutex_lock(&(vlc_ctx->mutex));
+	/* a vmem_pitch wider than the rows is skipped by the upload */
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, vlc_ctx->pitch / 4);
 	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, vlc_ctx->width, vlc_ctx->height, GL_RGBA, GL_UNSIGNED_BYTE, vlc_ctx->pix_buffer[vlc_ctx->ridx]);
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
 	pthread_mutex_unlock(&(vlc_ctx->mutex));
 
 	glBegin(GL_QUADS);
@@ -744,11 +1094,13 @@ static const luaL_reg vlc_funcs[] = {
 	{"new", vlc_new},
 	{"get_version", vlc_get_version},
 	{"get_compiler", vlc_get_compiler},
+	{"info_all", vlc_info_all},
 	{NULL, NULL},
 };
 
 static const luaL_reg vlc_meths[] = {
 	{"__gc", vlc_destroy},
+	{"detach", vlc_detach},
 	{"open", vlc_open},
 	{"wait", vlc_wait},
 	{"get_video_frame_size", vlc_get_video_frame_size},
@@ -762,6 +1114,7 @@ static const luaL_reg vlc_meths[] = {
 
 static const luaL_reg vlc_mp_meths[] = {
 	{"__gc", vlc_mp_destroy},
+	{"detach", vlc_mp_detach},
 	{"play", vlc_mp_play},
 	{"is_playing", vlc_mp_is_playing},
 	{"pause", vlc_mp_pause},
@@ -777,6 +1130,7 @@ static const luaL_reg vlc_mp_meths[] = {
 	{"get_meta", vlc_mp_get_meta},
 	{"get_fps", vlc_mp_get_fps},
 	{"is_seekable", vlc_mp_is_seekable},
+	{"info", vlc_mp_info},
 	{"can_pause", vlc_mp_can_pause},
 	{"get_scale", vlc_mp_video_get_scale},
 	{"set_scale", vlc_mp_video_set_scale},
@@ -30,14 +30,19 @@
 
 #include <stdlib.h>
 #include <stdarg.h>
+#include <pthread.h>
 #include <lua.h>
 #include <lauxlib.h>
 #include <lualib.h>
 #include <vlcwrp.h>
 #include <ctype.h>
+#include <string.h>
 char *strdup(const char *);
 
 #define LIBVLC_MT "LIBVLC_MT"
+#define RECORDING_MT "VLCWRP_RECORDING_MT"
+#define EXPORT_MT "VLCWRP_EXPORT_MT"
+#define SCHEDULER_MT "VLCWRP_SCHEDULER_MT"
 LUAVLCWRP_API int luaopen_vlcwrp(lua_State *L);
 
 static int fail_error_exit(lua_State* L, const char* fmt, ...)
@@ -93,17 +98,70 @@ static int vlc_gettableint(lua_State* L, int index, const char* key)
 	return res;
 }
 
+static lua_Number vlc_opttablenumber(lua_State* L, int index, const char* key, lua_Number def)
+{
+	lua_Number res;
+	luaL_argcheck(L, lua_istable(L, index), index, "table argument expected");
+	lua_getfield(L, index, key);
+	res = luaL_optnumber(L, -1, def);
+	lua_pop(L, 1);
+	return res;
+}
+
+/**
+ * player userdata
+ *
+ * Each Lua state, running on its own OS thread, owns the players it creates.
+ * A player belongs to the thread that created it, calls from any other thread
+ * raise an error instead of racing the owner. A state moving to another
+ * thread calls player:detach() first, the next call adopts the player.
+ */
+typedef struct
+{
+	/* first so the methods use the userdata as struct vlcwrp_ctx_t** */
+	struct vlcwrp_ctx_t* ctx;
+
+	/* owning thread, valid if owned is non zero */
+	pthread_t owner;
+	int owned;
+} vlc_player_t;
+
+/* checks the player at idx is used from its owning thread */
+static struct vlcwrp_ctx_t** vlc_checkplayer(lua_State* L, int idx)
+{
+	vlc_player_t* player = (vlc_player_t*)luaL_checkudata(L, idx, LIBVLC_MT);
+	if (!player->owned)
+	{
+		player->owner = pthread_self();
+		player->owned = 1;
+	}
+	else if (!pthread_equal(player->owner, pthread_self()))
+		luaL_error(L, "player used from a thread not owning it, see player:detach()");
+
+	/* errors are reported per call, not left over from another call */
+	vlcwrp_error_clear();
+	return &player->ctx;
+}
+
+/* names of the performance profiles in vlcwrp_profile_t order */
+static const char* const profile_names[] = { "default", "low-latency", "throughput", "thumbnail", NULL };
+
 static int vlc_new(lua_State* L)
 {
 	int i;
-	int width, height;
+	int width, height, video;
 	int vlc_argc;
 	char **vlc_argv;
+	vlc_player_t* player;
 	struct vlcwrp_ctx_t** pctx;
 
 	luaL_checktype(L, 1, LUA_TTABLE);
-	pctx = (struct vlcwrp_ctx_t**)lua_newuserdata(L, sizeof(struct vlcwrp_ctx_t*));
-	if (!pctx) return fail_allocate_exit(L, __LINE__);
+	player = (vlc_player_t*)lua_newuserdata(L, sizeof(vlc_player_t));
+	if (!player) return fail_allocate_exit(L, __LINE__);
+	player->ctx = NULL;
+	player->owner = pthread_self();
+	player->owned = 1;
+	pctx = &player->ctx;
 	luaL_getmetatable(L, LIBVLC_MT);
 	lua_setmetatable(L, -2);
 
@@ -125,44 +183,196 @@ static int vlc_new(lua_State* L)
 		}
 	}
 
-	width  = vlc_gettableint(L, 1, "vmem_width");
-	height = vlc_gettableint(L, 1, "vmem_height");
-	*pctx = vlcwrp_create(vlc_argc, (const char * const*)vlc_argv, width, height);
+	lua_getfield(L, 1, "video");
+	video = lua_isnil(L, -1) || lua_toboolean(L, -1);
+	lua_pop(L, 1);
+	if (video)
+	{
+		vlcwrp_buffer_config_t buffers;
+		width  = vlc_gettableint(L, 1, "vmem_width");
+		height = vlc_gettableint(L, 1, "vmem_height");
+		vlcwrp_buffer_defaults(&buffers);
+		lua_getfield(L, 1, "buffers");
+		if (lua_istable(L, -1))
+		{
+			/* hugepages = "off" | "transparent" | "explicit", prefault = boolean, numa = boolean, reserve = frames, pitch_align = bytes */
+			int index = lua_gettop(L);
+			const char* hugepages;
+			lua_getfield(L, index, "hugepages");
+			hugepages = lua_tostring(L, -1);
+			if (hugepages && !strcmp(hugepages, "off"))
+				buffers.hugepages = VLCWRP_HUGEPAGES_OFF;
+			else if (hugepages && !strcmp(hugepages, "explicit"))
+				buffers.hugepages = VLCWRP_HUGEPAGES_EXPLICIT;
+			lua_pop(L, 1);
+			lua_getfield(L, index, "prefault");
+			if (!lua_isnil(L, -1))
+				buffers.prefault = lua_toboolean(L, -1);
+			lua_pop(L, 1);
+			lua_getfield(L, index, "numa");
+			if (!lua_isnil(L, -1))
+				buffers.numa = lua_toboolean(L, -1);
+			lua_pop(L, 1);
+			buffers.reserve = (int)vlc_opttablenumber(L, index, "reserve", buffers.reserve);
+			buffers.pitch_align = (int)vlc_opttablenumber(L, index, "pitch_align", buffers.pitch_align);
+		}
+		lua_pop(L, 1);
+		*pctx = vlcwrp_create_ex(vlc_argc, (const char * const*)vlc_argv, width, height, &buffers);
+	}
+	else
+	{
+		/* audio or metadata only, optionally with audio callbacks */
+		vlcwrp_audio_config_t audio;
+		int has_audio;
+		vlcwrp_audio_defaults(&audio);
+		lua_getfield(L, 1, "audio");
+		has_audio = lua_istable(L, -1);
+		if (has_audio)
+		{
+			int index = lua_gettop(L);
+			audio.rate           = (unsigned int)vlc_opttablenumber(L, index, "rate", audio.rate);
+			audio.channels       = (unsigned int)vlc_opttablenumber(L, index, "channels", audio.channels);
+			audio.buffer_samples = (unsigned int)vlc_opttablenumber(L, index, "buffer_samples", audio.buffer_samples);
+			audio.buffers        = (unsigned int)vlc_opttablenumber(L, index, "buffers", audio.buffers);
+		}
+		lua_pop(L, 1);
+		*pctx = vlcwrp_create_no_video(vlc_argc, (const char * const*)vlc_argv, has_audio ? &audio : NULL);
+	}
 	for (i=0; i<vlc_argc; i++) free(vlc_argv[i]);
 	free(vlc_argv);
 	if (*pctx)
 	{
+		/* profile = "default" | "low-latency" | "throughput" | "thumbnail" */
+		lua_getfield(L, 1, "profile");
+		if (!lua_isnil(L, -1))
+			vlcwrp_set_profile(*pctx, (vlcwrp_profile_t)luaL_checkoption(L, -1, NULL, profile_names));
+		lua_pop(L, 1);
 		return 1;
 	}
 	return fail_error_exit(L, "VLC init error");
 }
 
+/* keeps the value at index alive while the player reads it, nil releases it */
+static void vlc_setinputref(lua_State* L, struct vlcwrp_ctx_t* ctx, int index)
+{
+	lua_pushlightuserdata(L, ctx);
+	if (index)
+		lua_pushvalue(L, index);
+	else
+		lua_pushnil(L);
+	lua_rawset(L, LUA_REGISTRYINDEX);
+}
+
 static int vlc_destroy(lua_State* L)
 {
+	/* the collector runs on whichever thread runs the state */
 	struct vlcwrp_ctx_t** pctx = (struct vlcwrp_ctx_t**)luaL_checkudata(L, 1, LIBVLC_MT);
 	if (pctx && *pctx)
 	{
 		vlcwrp_destroy(*pctx);
+		vlc_setinputref(L, *pctx, 0);
 		*pctx = 0;
 	}
 	return 0;
 }
 
+/* releases the ownership of the player, the next call adopts it on the calling thread */
+static int vlc_detach(lua_State* L)
+{
+	vlc_player_t* player = (vlc_player_t*)vlc_checkplayer(L, 1);
+	player->owned = 0;
+	return 0;
+}
+
 static int vlc_play(lua_State* L)
 {
-	struct vlcwrp_ctx_t** pctx = (struct vlcwrp_ctx_t**)luaL_checkudata(L, 1, LIBVLC_MT);
+	struct vlcwrp_ctx_t** pctx = vlc_checkplayer(L, 1);
 	const char* url = luaL_optstring(L, 2, NULL);
 	if (pctx)
 	{
 		vlcwrp_play(*pctx, url);
+		if (url)
+			vlc_setinputref(L, *pctx, 0);
+		return catch_vlc_error(L);
+	}
+	return 0;
+}
+
+/* plays a string, a full userdata or a lightuserdata with size in place */
+static int vlc_play_memory(lua_State* L)
+{
+	struct vlcwrp_ctx_t** pctx = vlc_checkplayer(L, 1);
+	const void* data;
+	size_t size;
+	switch (lua_type(L, 2))
+	{
+	case LUA_TSTRING:
+		data = lua_tolstring(L, 2, &size);
+		break;
+	case LUA_TUSERDATA:
+		data = lua_touserdata(L, 2);
+		size = lua_objlen(L, 2);
+		break;
+	case LUA_TLIGHTUSERDATA:
+		data = lua_touserdata(L, 2);
+		size = (size_t)luaL_checkinteger(L, 3);
+		break;
+	default:
+		return luaL_typerror(L, 2, "string or userdata");
+	}
+	if (pctx && *pctx)
+	{
+		if (vlcwrp_play_memory(*pctx, data, size))
+			return fail_error_exit(L, "unable to play memory");
+		vlc_setinputref(L, *pctx, 2);
+		return catch_vlc_error(L);
+	}
+	return 0;
+}
+
+static int vlc_play_mmap(lua_State* L)
+{
+	struct vlcwrp_ctx_t** pctx = vlc_checkplayer(L, 1);
+	const char* path = luaL_checkstring(L, 2);
+	if (pctx && *pctx)
+	{
+		vlc_setinputref(L, *pctx, 0);
+		if (vlcwrp_play_mmap(*pctx, path))
+			return fail_error_exit(L, "unable to map `%s'", path);
 		return catch_vlc_error(L);
 	}
 	return 0;
 }
 
+static int vlc_input_stats(lua_State* L)
+{
+	struct vlcwrp_ctx_t** pctx = vlc_checkplayer(L, 1);
+	vlcwrp_input_stats_t stats;
+	if (pctx && *pctx && vlcwrp_input_stats(*pctx, &stats))
+	{
+		lua_newtable(L);
+		lua_pushnumber(L, (lua_Number)stats.size);
+		lua_setfield(L, -2, "size");
+		lua_pushnumber(L, (lua_Number)stats.position);
+		lua_setfield(L, -2, "position");
+		lua_pushnumber(L, (lua_Number)stats.bytes_read);
+		lua_setfield(L, -2, "bytes_read");
+		lua_pushnumber(L, (lua_Number)stats.reads);
+		lua_setfield(L, -2, "reads");
+		lua_pushnumber(L, (lua_Number)stats.seeks);
+		lua_setfield(L, -2, "seeks");
+		lua_pushnumber(L, (lua_Number)stats.read_time);
+		lua_setfield(L, -2, "read_time");
+		lua_pushnumber(L, (lua_Number)stats.max_read_time);
+		lua_setfield(L, -2, "max_read_time");
+		return 1;
+	}
+	return 0;
+}
+
 static int vlc_stop(lua_State* L)
 {
-	struct vlcwrp_ctx_t** pctx = (struct vlcwrp_ctx_t**)luaL_checkudata(L, 1, LIBVLC_MT);
+	struct vlcwrp_ctx_t** pctx = vlc_checkplayer(L, 1);
 	if (pctx)
 	{
 		vlcwrp_stop(*pctx);
@@ -173,7 +383,7 @@ static int vlc_stop(lua_State* L)
 
 static int vlc_pause(lua_State* L)
 {
-	struct vlcwrp_ctx_t** pctx = (struct vlcwrp_ctx_t**)luaL_checkudata(L, 1, LIBVLC_MT);
+	struct vlcwrp_ctx_t** pctx = vlc_checkplayer(L, 1);
 	if (pctx)
 	{
 		vlcwrp_pause(*pctx);
@@ -184,7 +394,7 @@ static int vlc_pause(lua_State* L)
 
 static int vlc_get_state(lua_State* L)
 {
-	struct vlcwrp_ctx_t** pctx = (struct vlcwrp_ctx_t**)luaL_checkudata(L, 1, LIBVLC_MT);
+	struct vlcwrp_ctx_t** pctx = vlc_checkplayer(L, 1);
 	if (pctx)
 	{
 		switch (vlcwrp_get_state(*pctx))
@@ -202,9 +412,21 @@ static int vlc_get_state(lua_State* L)
 	return 0;
 }
 
+/* the player context as lightuserdata for the FFI bindings, valid while the player is alive */
+static int vlc_handle(lua_State* L)
+{
+	struct vlcwrp_ctx_t** pctx = vlc_checkplayer(L, 1);
+	if (pctx && *pctx)
+	{
+		lua_pushlightuserdata(L, *pctx);
+		return 1;
+	}
+	return 0;
+}
+
 static int vlc_frame_acquire(lua_State* L)
 {
-	struct vlcwrp_ctx_t** pctx = (struct vlcwrp_ctx_t**)luaL_checkudata(L, 1, LIBVLC_MT);
+	struct vlcwrp_ctx_t** pctx = vlc_checkplayer(L, 1);
 	if (pctx)
 	{
 		void* pframe = vlcwrp_frame_acquire(*pctx);
@@ -217,9 +439,25 @@ static int vlc_frame_acquire(lua_State* L)
 	return 0;
 }
 
+static int vlc_frame_acquire_due(lua_State* L)
+{
+	struct vlcwrp_ctx_t** pctx = vlc_checkplayer(L, 1);
+	if (pctx)
+	{
+		void* pframe = vlcwrp_frame_acquire_due(*pctx);
+		if (pframe)
+		{
+			lua_pushlightuserdata(L, pframe);
+			lua_pushnumber(L, (lua_Number)vlcwrp_frame_info(*pctx)->due_delay);
+			return 2;
+		}
+	}
+	return 0;
+}
+
 static int vlc_frame_release(lua_State* L)
 {
-	struct vlcwrp_ctx_t** pctx = (struct vlcwrp_ctx_t**)luaL_checkudata(L, 1, LIBVLC_MT);
+	struct vlcwrp_ctx_t** pctx = vlc_checkplayer(L, 1);
 	if (pctx)
 	{
 		vlcwrp_frame_release(*pctx);
@@ -227,28 +465,1946 @@ static int vlc_frame_release(lua_State* L)
 	return 0;
 }
 
-static const luaL_reg vlc_funcs[] =
+/* returns the row pitch of the frames in bytes */
+static int vlc_frame_pitch(lua_State* L)
 {
-	{"new", vlc_new},
-	{NULL, NULL},
-};
+	struct vlcwrp_ctx_t** pctx = vlc_checkplayer(L, 1);
+	if (pctx && *pctx)
+	{
+		lua_pushinteger(L, vlcwrp_frame_pitch(*pctx));
+		return 1;
+	}
+	return 0;
+}
 
-static const luaL_reg vlc_meths[] =
+static int vlc_frame_info(lua_State* L)
 {
-	{"__gc", vlc_destroy},
-	{"play", vlc_play},
-	{"stop", vlc_stop},
-	{"pause", vlc_pause},
-	{"get_state", vlc_get_state},
-	{"frame_acquire", vlc_frame_acquire},
-	{"frame_release", vlc_frame_release},
-	{NULL, NULL},
-};
+	struct vlcwrp_ctx_t** pctx = vlc_checkplayer(L, 1);
+	if (pctx)
+	{
+		const vlcwrp_frame_info_t* info = vlcwrp_frame_info(*pctx);
+		if (info)
+		{
+			lua_newtable(L);
+			lua_pushinteger(L, info->seq);
+			lua_setfield(L, -2, "seq");
+			lua_pushnumber(L, (lua_Number)info->timestamp);
+			lua_setfield(L, -2, "timestamp");
+			lua_pushnumber(L, (lua_Number)info->displayed);
+			lua_setfield(L, -2, "displayed");
+			lua_pushnumber(L, (lua_Number)info->due_delay);
+			lua_setfield(L, -2, "due_delay");
+			lua_pushnumber(L, (lua_Number)info->time);
+			lua_setfield(L, -2, "time");
+			if (vlcwrp_playlist_item(*pctx) >= 0)
+			{
+				lua_pushinteger(L, info->item + 1);
+				lua_setfield(L, -2, "item");
+				lua_pushboolean(L, info->item_start);
+				lua_setfield(L, -2, "item_start");
+			}
+			if (info->analytics.analyzed)
+			{
+				int i;
+				lua_pushnumber(L, info->analytics.luma_mean);
+				lua_setfield(L, -2, "luma_mean");
+				lua_pushnumber(L, info->analytics.luma_variance);
+				lua_setfield(L, -2, "luma_variance");
+				lua_pushnumber(L, info->analytics.diff);
+				lua_setfield(L, -2, "diff");
+				lua_pushnumber(L, info->analytics.hist_distance);
+				lua_setfield(L, -2, "hist_distance");
+				lua_pushboolean(L, info->analytics.black);
+				lua_setfield(L, -2, "black");
+				lua_pushboolean(L, info->analytics.frozen);
+				lua_setfield(L, -2, "frozen");
+				lua_pushboolean(L, info->analytics.scene_change);
+				lua_setfield(L, -2, "scene_change");
+				lua_createtable(L, VLCWRP_HISTOGRAM_BINS, 0);
+				for (i=0; i<VLCWRP_HISTOGRAM_BINS; i++)
+				{
+					lua_pushinteger(L, info->analytics.histogram[i]);
+					lua_rawseti(L, -2, i+1);
+				}
+				lua_setfield(L, -2, "histogram");
+			}
+			return 1;
+		}
+	}
+	return 0;
+}
 
-LUAVLCWRP_API int luaopen_vlcwrp(lua_State *L)
+static int vlc_analytics_start(lua_State* L)
 {
-	createmeta(L, LIBVLC_MT);
-	luaL_openlib(L, 0, vlc_meths, 0);
+	struct vlcwrp_ctx_t** pctx = vlc_checkplayer(L, 1);
+	vlcwrp_analytics_config_t config;
+	vlcwrp_analytics_defaults(&config);
+	if (!lua_isnoneornil(L, 2))
+	{
+		config.workers        = (int)vlc_opttablenumber(L, 2, "workers", config.workers);
+		config.step           = (int)vlc_opttablenumber(L, 2, "step", config.step);
+		config.black_luma     = (float)vlc_opttablenumber(L, 2, "black_luma", config.black_luma);
+		config.black_ratio    = (float)vlc_opttablenumber(L, 2, "black_ratio", config.black_ratio);
+		config.freeze_diff    = (float)vlc_opttablenumber(L, 2, "freeze_diff", config.freeze_diff);
+		config.scene_distance = (float)vlc_opttablenumber(L, 2, "scene_distance", config.scene_distance);
+	}
+	if (pctx && *pctx)
+	{
+		if (vlcwrp_analytics_start(*pctx, &config))
+			return fail_error_exit(L, "unable to start analytics");
+		lua_pushboolean(L, 1);
+		return 1;
+	}
+	return 0;
+}
+
+static int vlc_analytics_stop(lua_State* L)
+{
+	struct vlcwrp_ctx_t** pctx = vlc_checkplayer(L, 1);
+	if (pctx && *pctx)
+	{
+		vlcwrp_analytics_stop(*pctx);
+	}
+	return 0;
+}
+
+static int vlc_analytics(lua_State* L)
+{
+	struct vlcwrp_ctx_t** pctx = vlc_checkplayer(L, 1);
+	vlcwrp_analytics_t analytics;
+	if (pctx && *pctx && vlcwrp_analytics(*pctx, &analytics))
+	{
+		lua_newtable(L);
+		lua_pushnumber(L, (lua_Number)analytics.frames);
+		lua_setfield(L, -2, "frames");
+		lua_pushnumber(L, (lua_Number)analytics.black_frames);
+		lua_setfield(L, -2, "black_frames");
+		lua_pushnumber(L, (lua_Number)analytics.frozen_frames);
+		lua_setfield(L, -2, "frozen_frames");
+		lua_pushnumber(L, (lua_Number)analytics.scene_changes);
+		lua_setfield(L, -2, "scene_changes");
+		lua_pushnumber(L, (lua_Number)analytics.black_run);
+		lua_setfield(L, -2, "black_run");
+		lua_pushnumber(L, (lua_Number)analytics.frozen_run);
+		lua_setfield(L, -2, "frozen_run");
+		lua_pushinteger(L, analytics.last_scene_change);
+		lua_setfield(L, -2, "last_scene_change");
+		lua_pushnumber(L, analytics.luma_mean);
+		lua_setfield(L, -2, "luma_mean");
+		lua_pushnumber(L, analytics.luma_variance);
+		lua_setfield(L, -2, "luma_variance");
+		lua_pushnumber(L, analytics.diff);
+		lua_setfield(L, -2, "diff");
+		lua_pushnumber(L, (lua_Number)analytics.busy_time);
+		lua_setfield(L, -2, "busy_time");
+		return 1;
+	}
+	return 0;
+}
+
+static int vlc_clock(lua_State* L)
+{
+	struct vlcwrp_ctx_t** pctx = vlc_checkplayer(L, 1);
+	vlcwrp_clock_stats_t stats;
+	if (pctx && *pctx)
+	{
+		stats.version = VLCWRP_ABI_VERSION;
+		vlcwrp_clock_stats(*pctx, &stats);
+		lua_newtable(L);
+		lua_pushnumber(L, (lua_Number)stats.time);
+		lua_setfield(L, -2, "time");
+		lua_pushstring(L, stats.audio ? "audio" : "monotonic");
+		lua_setfield(L, -2, "source");
+		lua_pushnumber(L, (lua_Number)stats.audio_lag);
+		lua_setfield(L, -2, "audio_lag");
+		lua_pushnumber(L, (lua_Number)stats.due_delay);
+		lua_setfield(L, -2, "due_delay");
+		lua_pushnumber(L, (lua_Number)stats.late_frames);
+		lua_setfield(L, -2, "late_frames");
+		return 1;
+	}
+	return 0;
+}
+
+/* sets the stage time in milliseconds since the creation of the player, unreached stages are left nil */
+static void vlc_setstage(lua_State* L, const char* name, long long stage, long long create)
+{
+	if (stage)
+	{
+		lua_pushnumber(L, (lua_Number)(stage - create) / 1000);
+		lua_setfield(L, -2, name);
+	}
+}
+
+static int vlc_startup_profile(lua_State* L)
+{
+	struct vlcwrp_ctx_t** pctx = vlc_checkplayer(L, 1);
+	vlcwrp_startup_t startup;
+	if (pctx && *pctx)
+	{
+		vlcwrp_startup_profile(*pctx, &startup);
+		lua_newtable(L);
+		vlc_setstage(L, "instance", startup.instance, startup.create);
+		vlc_setstage(L, "player", startup.player, startup.create);
+		vlc_setstage(L, "media", startup.media, startup.create);
+		vlc_setstage(L, "play", startup.play, startup.create);
+		vlc_setstage(L, "opening", startup.opening, startup.create);
+		vlc_setstage(L, "buffering", startup.buffering, startup.create);
+		vlc_setstage(L, "playing", startup.playing, startup.create);
+		vlc_setstage(L, "vout", startup.vout, startup.create);
+		vlc_setstage(L, "first_lock", startup.first_lock, startup.create);
+		vlc_setstage(L, "first_unlock", startup.first_unlock, startup.create);
+		vlc_setstage(L, "first_acquire", startup.first_acquire, startup.create);
+		return 1;
+	}
+	return 0;
+}
+
+static void vlc_pushlevels(lua_State* L, const float* levels, unsigned int channels)
+{
+	unsigned int i;
+	lua_createtable(L, channels, 0);
+	for (i=0; i<channels; i++)
+	{
+		lua_pushnumber(L, levels[i]);
+		lua_rawseti(L, -2, i+1);
+	}
+}
+
+static int vlc_audio_start(lua_State* L)
+{
+	struct vlcwrp_ctx_t** pctx = vlc_checkplayer(L, 1);
+	vlcwrp_audio_config_t config;
+	vlcwrp_audio_defaults(&config);
+	if (!lua_isnoneornil(L, 2))
+	{
+		config.rate           = (unsigned int)vlc_opttablenumber(L, 2, "rate", config.rate);
+		config.channels       = (unsigned int)vlc_opttablenumber(L, 2, "channels", config.channels);
+		config.buffer_samples = (unsigned int)vlc_opttablenumber(L, 2, "buffer_samples", config.buffer_samples);
+		config.buffers        = (unsigned int)vlc_opttablenumber(L, 2, "buffers", config.buffers);
+	}
+	if (pctx && *pctx)
+	{
+		if (vlcwrp_audio_start(*pctx, &config))
+			return fail_error_exit(L, "unable to start audio");
+		lua_pushboolean(L, 1);
+		return 1;
+	}
+	return 0;
+}
+
+/* returns samples pointer, size in bytes, samples per channel and pts of the oldest audio buffer */
+static int vlc_audio_acquire(lua_State* L)
+{
+	struct vlcwrp_ctx_t** pctx = vlc_checkplayer(L, 1);
+	if (pctx && *pctx)
+	{
+		const vlcwrp_audio_buffer_t* buf = vlcwrp_audio_acquire(*pctx);
+		if (buf)
+		{
+			lua_pushlightuserdata(L, (void*)buf->samples);
+			lua_pushinteger(L, buf->nsamples * buf->channels * sizeof(short));
+			lua_pushinteger(L, buf->nsamples);
+			lua_pushnumber(L, (lua_Number)buf->pts);
+			return 4;
+		}
+	}
+	return 0;
+}
+
+static int vlc_audio_release(lua_State* L)
+{
+	struct vlcwrp_ctx_t** pctx = vlc_checkplayer(L, 1);
+	if (pctx && *pctx)
+	{
+		vlcwrp_audio_release(*pctx);
+	}
+	return 0;
+}
+
+static int vlc_audio_stats(lua_State* L)
+{
+	struct vlcwrp_ctx_t** pctx = vlc_checkplayer(L, 1);
+	vlcwrp_audio_stats_t stats;
+	if (pctx && *pctx && vlcwrp_audio_stats(*pctx, &stats))
+	{
+		lua_newtable(L);
+		lua_pushnumber(L, (lua_Number)stats.written);
+		lua_setfield(L, -2, "written");
+		lua_pushnumber(L, (lua_Number)stats.read);
+		lua_setfield(L, -2, "read");
+		lua_pushnumber(L, (lua_Number)stats.dropped);
+		lua_setfield(L, -2, "dropped");
+		lua_pushinteger(L, stats.queued);
+		lua_setfield(L, -2, "queued");
+		vlc_pushlevels(L, stats.peak, stats.channels);
+		lua_setfield(L, -2, "peak");
+		vlc_pushlevels(L, stats.rms, stats.channels);
+		lua_setfield(L, -2, "rms");
+		return 1;
+	}
+	return 0;
+}
+
+/* pushes a fourcc code as a string, nil if there is none */
+static void vlc_pushfourcc(lua_State* L, unsigned int fourcc)
+{
+	char s[4];
+	if (!fourcc)
+	{
+		lua_pushnil(L);
+		return;
+	}
+	s[0] = (char)(fourcc & 0xff);
+	s[1] = (char)((fourcc >> 8) & 0xff);
+	s[2] = (char)((fourcc >> 16) & 0xff);
+	s[3] = (char)((fourcc >> 24) & 0xff);
+	lua_pushlstring(L, s, 4);
+}
+
+static int vlc_snapshot(lua_State* L)
+{
+	struct vlcwrp_ctx_t** pctx = vlc_checkplayer(L, 1);
+	const char* path = luaL_checkstring(L, 2);
+	const char* format = luaL_optstring(L, 3, NULL);
+	int quality = (int)luaL_optinteger(L, 4, 90);
+	vlcwrp_snapshot_format_t fmt;
+	int id;
+
+	/* the format defaults to the path extension */
+	if (!format)
+	{
+		format = strrchr(path, '.');
+		format = format ? format + 1 : "png";
+	}
+	if (!strcmp(format, "png"))
+		fmt = VLCWRP_SNAPSHOT_PNG;
+	else if (!strcmp(format, "jpeg") || !strcmp(format, "jpg"))
+		fmt = VLCWRP_SNAPSHOT_JPEG;
+	else
+		return fail_error_exit(L, "unsupported snapshot format %s", format);
+
+	if (pctx && *pctx)
+	{
+		id = vlcwrp_snapshot(*pctx, path, fmt, quality);
+		if (id < 0)
+			return fail_error_exit(L, "snapshot queue full");
+		lua_pushinteger(L, id);
+		return 1;
+	}
+	return 0;
+}
+
+static int vlc_snapshot_stats(lua_State* L)
+{
+	struct vlcwrp_ctx_t** pctx = vlc_checkplayer(L, 1);
+	vlcwrp_snapshot_stats_t stats;
+	if (pctx && *pctx && vlcwrp_snapshot_stats(*pctx, &stats))
+	{
+		lua_newtable(L);
+		lua_pushnumber(L, (lua_Number)stats.requested);
+		lua_setfield(L, -2, "requested");
+		lua_pushnumber(L, (lua_Number)stats.rejected);
+		lua_setfield(L, -2, "rejected");
+		lua_pushnumber(L, (lua_Number)stats.encoded);
+		lua_setfield(L, -2, "encoded");
+		lua_pushnumber(L, (lua_Number)stats.failed);
+		lua_setfield(L, -2, "failed");
+		lua_pushinteger(L, stats.queued);
+		lua_setfield(L, -2, "queued");
+		lua_pushnumber(L, (lua_Number)stats.encode_time);
+		lua_setfield(L, -2, "encode_time");
+		return 1;
+	}
+	return 0;
+}
+
+/* pushes an event as a table */
+static void vlc_pushevent(lua_State* L, const vlcwrp_event_t* ev)
+{
+	static const char* type_names[] = { "snapshot", "seek", "quality", "health" };
+	lua_newtable(L);
+	lua_pushstring(L, type_names[ev->type]);
+	lua_setfield(L, -2, "type");
+	lua_pushnumber(L, (lua_Number)ev->time);
+	lua_setfield(L, -2, "time");
+	lua_pushboolean(L, !ev->status);
+	lua_setfield(L, -2, "ok");
+	lua_pushnumber(L, (lua_Number)ev->value);
+	lua_setfield(L, -2, "value");
+	lua_pushstring(L, ev->text);
+	lua_setfield(L, -2, "text");
+	if (ev->type == VLCWRP_EVENT_HEALTH)
+	{
+		lua_pushstring(L, vlcwrp_health_name((vlcwrp_health_state_t)ev->value));
+		lua_setfield(L, -2, "state");
+	}
+}
+
+static int vlc_events(lua_State* L)
+{
+	struct vlcwrp_ctx_t** pctx = vlc_checkplayer(L, 1);
+	vlcwrp_event_t ev;
+	int n = 0;
+	if (pctx && *pctx)
+	{
+		lua_newtable(L);
+		while (vlcwrp_event_poll(*pctx, &ev))
+		{
+			vlc_pushevent(L, &ev);
+			lua_rawseti(L, -2, ++n);
+		}
+		return 1;
+	}
+	return 0;
+}
+
+static int vlc_record_start(lua_State* L)
+{
+	struct vlcwrp_ctx_t** pctx = vlc_checkplayer(L, 1);
+	const char* path = luaL_checkstring(L, 2);
+	vlcwrp_record_config_t config;
+
+	vlcwrp_record_defaults(&config);
+	if (!lua_isnoneornil(L, 3))
+	{
+		const char* policy;
+		lua_getfield(L, 3, "policy");
+		policy = luaL_optstring(L, -1, "drop");
+		lua_pop(L, 1);
+		if (!strcmp(policy, "block"))
+			config.policy = VLCWRP_RECORD_BLOCK;
+		else if (!strcmp(policy, "drop"))
+			config.policy = VLCWRP_RECORD_DROP;
+		else
+			return fail_error_exit(L, "unsupported record policy %s", policy);
+		config.buffers = (int)vlc_opttablenumber(L, 3, "buffers", config.buffers);
+		config.batch   = (int)vlc_opttablenumber(L, 3, "batch", config.batch);
+	}
+	if (pctx && *pctx)
+	{
+		if (vlcwrp_record_start(*pctx, path, &config))
+			return fail_error_exit(L, "cannot record to %s", path);
+		lua_pushboolean(L, 1);
+		return 1;
+	}
+	return 0;
+}
+
+static int vlc_record_stop(lua_State* L)
+{
+	struct vlcwrp_ctx_t** pctx = vlc_checkplayer(L, 1);
+	if (pctx && *pctx)
+	{
+		if (vlcwrp_record_stop(*pctx))
+			return fail_error_exit(L, "recording incomplete");
+		lua_pushboolean(L, 1);
+		return 1;
+	}
+	return 0;
+}
+
+static int vlc_record_stats(lua_State* L)
+{
+	struct vlcwrp_ctx_t** pctx = vlc_checkplayer(L, 1);
+	vlcwrp_record_stats_t stats;
+	if (pctx && *pctx && vlcwrp_record_stats(*pctx, &stats))
+	{
+		lua_newtable(L);
+		lua_pushnumber(L, (lua_Number)stats.written);
+		lua_setfield(L, -2, "written");
+		lua_pushnumber(L, (lua_Number)stats.dropped);
+		lua_setfield(L, -2, "dropped");
+		lua_pushnumber(L, (lua_Number)stats.bytes);
+		lua_setfield(L, -2, "bytes");
+		lua_pushnumber(L, (lua_Number)stats.write_time);
+		lua_setfield(L, -2, "write_time");
+		lua_pushinteger(L, stats.queued);
+		lua_setfield(L, -2, "queued");
+		lua_pushboolean(L, stats.io_uring);
+		lua_setfield(L, -2, "io_uring");
+		return 1;
+	}
+	return 0;
+}
+
+static int vlc_recording_open(lua_State* L)
+{
+	const char* path = luaL_checkstring(L, 1);
+	vlcwrp_recording_t* rec = (vlcwrp_recording_t*)lua_newuserdata(L, sizeof(vlcwrp_recording_t));
+	if (!rec) return fail_allocate_exit(L, __LINE__);
+	if (vlcwrp_recording_open(path, rec))
+		return fail_error_exit(L, "cannot open recording %s", path);
+	luaL_getmetatable(L, RECORDING_MT);
+	lua_setmetatable(L, -2);
+	return 1;
+}
+
+static int vlc_recording_close(lua_State* L)
+{
+	vlcwrp_recording_t* rec = (vlcwrp_recording_t*)luaL_checkudata(L, 1, RECORDING_MT);
+	vlcwrp_recording_close(rec);
+	return 0;
+}
+
+static int vlc_recording_info(lua_State* L)
+{
+	vlcwrp_recording_t* rec = (vlcwrp_recording_t*)luaL_checkudata(L, 1, RECORDING_MT);
+	lua_newtable(L);
+	lua_pushinteger(L, rec->width);
+	lua_setfield(L, -2, "width");
+	lua_pushinteger(L, rec->height);
+	lua_setfield(L, -2, "height");
+	lua_pushinteger(L, rec->pitch);
+	lua_setfield(L, -2, "pitch");
+	lua_pushnumber(L, (lua_Number)rec->count);
+	lua_setfield(L, -2, "count");
+	return 1;
+}
+
+/* returns frame i (1-based) as lightuserdata, its sequence number and timestamp */
+static int vlc_recording_frame(lua_State* L)
+{
+	vlcwrp_recording_t* rec = (vlcwrp_recording_t*)luaL_checkudata(L, 1, RECORDING_MT);
+	lua_Number i = luaL_checknumber(L, 2);
+	unsigned int seq;
+	long long timestamp;
+	const void* frame = i >= 1 ? vlcwrp_recording_frame(rec, (unsigned long long)i - 1, &seq, &timestamp) : NULL;
+	if (!frame)
+		return 0;
+	lua_pushlightuserdata(L, (void*)frame);
+	lua_pushinteger(L, seq);
+	lua_pushnumber(L, (lua_Number)timestamp);
+	return 3;
+}
+
+static int vlc_export_start(lua_State* L)
+{
+	struct vlcwrp_ctx_t** pctx = vlc_checkplayer(L, 1);
+	const char* name = luaL_checkstring(L, 2);
+	if (pctx && *pctx)
+	{
+		if (vlcwrp_export_start(*pctx, name))
+			return fail_error_exit(L, "cannot export frames to %s", name);
+		lua_pushboolean(L, 1);
+		return 1;
+	}
+	return 0;
+}
+
+static int vlc_export_stop(lua_State* L)
+{
+	struct vlcwrp_ctx_t** pctx = vlc_checkplayer(L, 1);
+	if (pctx && *pctx)
+		vlcwrp_export_stop(*pctx);
+	return 0;
+}
+
+static int vlc_cache_start(lua_State* L)
+{
+	struct vlcwrp_ctx_t** pctx = vlc_checkplayer(L, 1);
+	vlcwrp_cache_config_t config;
+
+	vlcwrp_cache_defaults(&config);
+	if (!lua_isnoneornil(L, 2))
+	{
+		config.max_bytes = (unsigned long long)vlc_opttablenumber(L, 2, "max_bytes", (lua_Number)config.max_bytes);
+		lua_getfield(L, 2, "compress");
+		if (!lua_isnil(L, -1))
+			config.compress = lua_toboolean(L, -1);
+		lua_pop(L, 1);
+	}
+	if (pctx && *pctx)
+	{
+		if (vlcwrp_cache_start(*pctx, &config))
+			return fail_error_exit(L, "cannot start frame cache");
+		lua_pushboolean(L, 1);
+		return 1;
+	}
+	return 0;
+}
+
+static int vlc_cache_stop(lua_State* L)
+{
+	struct vlcwrp_ctx_t** pctx = vlc_checkplayer(L, 1);
+	if (pctx && *pctx)
+		vlcwrp_cache_stop(*pctx);
+	return 0;
+}
+
+/* returns the cached frame as lightuserdata and its media time, nothing if not cached */
+static int vlc_step(lua_State* L)
+{
+	struct vlcwrp_ctx_t** pctx = vlc_checkplayer(L, 1);
+	int delta = (int)luaL_optinteger(L, 2, 1);
+	vlcwrp_frame_info_t info;
+	if (pctx && *pctx)
+	{
+		const void* frame = vlcwrp_cache_step(*pctx, delta, &info);
+		if (frame)
+		{
+			lua_pushlightuserdata(L, (void*)frame);
+			lua_pushnumber(L, (lua_Number)info.time);
+			return 2;
+		}
+	}
+	return 0;
+}
+
+/* returns the cached frame displayed at time as lightuserdata and its media time */
+static int vlc_cache_seek(lua_State* L)
+{
+	struct vlcwrp_ctx_t** pctx = vlc_checkplayer(L, 1);
+	long long time = (long long)luaL_checknumber(L, 2);
+	vlcwrp_frame_info_t info;
+	if (pctx && *pctx)
+	{
+		const void* frame = vlcwrp_cache_seek(*pctx, time, &info);
+		if (frame)
+		{
+			lua_pushlightuserdata(L, (void*)frame);
+			lua_pushnumber(L, (lua_Number)info.time);
+			return 2;
+		}
+	}
+	return 0;
+}
+
+static int vlc_cache_stats(lua_State* L)
+{
+	struct vlcwrp_ctx_t** pctx = vlc_checkplayer(L, 1);
+	vlcwrp_cache_stats_t stats;
+	if (pctx && *pctx && vlcwrp_cache_stats(*pctx, &stats))
+	{
+		lua_newtable(L);
+		lua_pushinteger(L, stats.frames);
+		lua_setfield(L, -2, "frames");
+		lua_pushinteger(L, stats.pending);
+		lua_setfield(L, -2, "pending");
+		lua_pushnumber(L, (lua_Number)stats.bytes);
+		lua_setfield(L, -2, "bytes");
+		lua_pushnumber(L, (lua_Number)stats.first);
+		lua_setfield(L, -2, "first");
+		lua_pushnumber(L, (lua_Number)stats.last);
+		lua_setfield(L, -2, "last");
+		lua_pushnumber(L, (lua_Number)stats.hits);
+		lua_setfield(L, -2, "hits");
+		lua_pushnumber(L, (lua_Number)stats.misses);
+		lua_setfield(L, -2, "misses");
+		return 1;
+	}
+	return 0;
+}
+
+/* sets the performance profile of the media played next */
+static int vlc_profile(lua_State* L)
+{
+	struct vlcwrp_ctx_t** pctx = vlc_checkplayer(L, 1);
+	vlcwrp_profile_t profile = (vlcwrp_profile_t)luaL_checkoption(L, 2, NULL, profile_names);
+	if (pctx && *pctx)
+		vlcwrp_set_profile(*pctx, profile);
+	return 0;
+}
+
+static int vlc_adaptive_start(lua_State* L)
+{
+	struct vlcwrp_ctx_t** pctx = vlc_checkplayer(L, 1);
+	vlcwrp_adaptive_config_t config;
+
+	vlcwrp_adaptive_defaults(&config);
+	if (!lua_isnoneornil(L, 2))
+	{
+		config.window          = (int)vlc_opttablenumber(L, 2, "window", config.window);
+		config.block_ratio     = (float)vlc_opttablenumber(L, 2, "block_ratio", config.block_ratio);
+		config.degrade_windows = (int)vlc_opttablenumber(L, 2, "degrade_windows", config.degrade_windows);
+		config.recover_windows = (int)vlc_opttablenumber(L, 2, "recover_windows", config.recover_windows);
+		config.max_level       = (int)vlc_opttablenumber(L, 2, "max_level", config.max_level);
+		lua_getfield(L, 2, "drop");
+		if (!lua_isnil(L, -1))
+			config.drop = lua_toboolean(L, -1);
+		lua_pop(L, 1);
+	}
+	if (pctx && *pctx)
+	{
+		if (vlcwrp_adaptive_start(*pctx, &config))
+			return fail_error_exit(L, "cannot start adaptive quality");
+		lua_pushboolean(L, 1);
+		return 1;
+	}
+	return 0;
+}
+
+static int vlc_adaptive_stop(lua_State* L)
+{
+	struct vlcwrp_ctx_t** pctx = vlc_checkplayer(L, 1);
+	if (pctx && *pctx)
+		vlcwrp_adaptive_stop(*pctx);
+	return 0;
+}
+
+static int vlc_adaptive_stats(lua_State* L)
+{
+	struct vlcwrp_ctx_t** pctx = vlc_checkplayer(L, 1);
+	vlcwrp_adaptive_stats_t stats;
+	if (pctx && *pctx && vlcwrp_adaptive_stats(*pctx, &stats))
+	{
+		lua_newtable(L);
+		lua_pushinteger(L, stats.level);
+		lua_setfield(L, -2, "level");
+		lua_pushinteger(L, stats.max_level);
+		lua_setfield(L, -2, "max_level");
+		lua_pushnumber(L, stats.blocked);
+		lua_setfield(L, -2, "blocked");
+		lua_pushnumber(L, stats.occupancy);
+		lua_setfield(L, -2, "occupancy");
+		lua_pushnumber(L, (lua_Number)stats.skipped);
+		lua_setfield(L, -2, "skipped");
+		lua_pushnumber(L, (lua_Number)stats.dropped);
+		lua_setfield(L, -2, "dropped");
+		lua_pushnumber(L, (lua_Number)stats.transitions);
+		lua_setfield(L, -2, "transitions");
+		return 1;
+	}
+	return 0;
+}
+
+static int vlc_health_watch(lua_State* L)
+{
+	struct vlcwrp_ctx_t** pctx = vlc_checkplayer(L, 1);
+	vlcwrp_health_config_t config;
+
+	vlcwrp_health_defaults(&config);
+	if (!lua_isnoneornil(L, 2))
+	{
+		config.interval      = (int)vlc_opttablenumber(L, 2, "interval", config.interval);
+		config.grace         = (int)vlc_opttablenumber(L, 2, "grace", config.grace);
+		config.stall_timeout = (int)vlc_opttablenumber(L, 2, "stall_timeout", config.stall_timeout);
+		config.min_bitrate   = (int)vlc_opttablenumber(L, 2, "min_bitrate", config.min_bitrate);
+		config.max_errors    = (int)vlc_opttablenumber(L, 2, "max_errors", config.max_errors);
+		config.restart_delay = (int)vlc_opttablenumber(L, 2, "restart_delay", config.restart_delay);
+		lua_getfield(L, 2, "restart");
+		if (!lua_isnil(L, -1))
+			config.restart = lua_toboolean(L, -1);
+		lua_pop(L, 1);
+	}
+	if (pctx && *pctx)
+	{
+		if (vlcwrp_health_watch(*pctx, &config))
+			return fail_error_exit(L, "cannot watch health");
+		lua_pushboolean(L, 1);
+		return 1;
+	}
+	return 0;
+}
+
+static int vlc_health_unwatch(lua_State* L)
+{
+	struct vlcwrp_ctx_t** pctx = vlc_checkplayer(L, 1);
+	if (pctx && *pctx)
+		vlcwrp_health_unwatch(*pctx);
+	return 0;
+}
+
+static int vlc_health(lua_State* L)
+{
+	struct vlcwrp_ctx_t** pctx = vlc_checkplayer(L, 1);
+	vlcwrp_health_t health;
+	if (pctx && *pctx && vlcwrp_health(*pctx, &health))
+	{
+		lua_newtable(L);
+		lua_pushstring(L, vlcwrp_health_name(health.state));
+		lua_setfield(L, -2, "state");
+		lua_pushnumber(L, health.fps);
+		lua_setfield(L, -2, "fps");
+		lua_pushnumber(L, health.bitrate);
+		lua_setfield(L, -2, "bitrate");
+		lua_pushnumber(L, (lua_Number)health.corrupted);
+		lua_setfield(L, -2, "corrupted");
+		lua_pushnumber(L, (lua_Number)health.lost);
+		lua_setfield(L, -2, "lost");
+		lua_pushnumber(L, (lua_Number)health.restarts);
+		lua_setfield(L, -2, "restarts");
+		lua_pushnumber(L, (lua_Number)health.since);
+		lua_setfield(L, -2, "since");
+		return 1;
+	}
+	return 0;
+}
+
+static const char* const thread_role_names[] = { "video", "audio", NULL };
+
+/* reads a thread placement table, cpus is a list of CPU numbers */
+static void vlc_checkthreadconfig(lua_State* L, int index, vlcwrp_thread_config_t* config)
+{
+	int i;
+
+	vlcwrp_thread_defaults(config);
+	if (lua_isnoneornil(L, index))
+		return;
+	luaL_checktype(L, index, LUA_TTABLE);
+	lua_getfield(L, index, "cpus");
+	if (lua_istable(L, -1))
+	{
+		for (i=1; ; i++)
+		{
+			int cpu;
+			lua_rawgeti(L, -1, i);
+			if (lua_isnil(L, -1))
+			{
+				lua_pop(L, 1);
+				break;
+			}
+			cpu = (int)luaL_checkinteger(L, -1);
+			luaL_argcheck(L, cpu >= 0 && cpu < 64, index, "cpu out of range");
+			config->cpus |= 1ULL << cpu;
+			lua_pop(L, 1);
+		}
+	}
+	lua_pop(L, 1);
+	config->nice = (int)vlc_opttablenumber(L, index, "nice", config->nice);
+	config->fifo = (int)vlc_opttablenumber(L, index, "fifo", config->fifo);
+}
+
+static int vlc_thread_config(lua_State* L)
+{
+	struct vlcwrp_ctx_t** pctx = vlc_checkplayer(L, 1);
+	vlcwrp_thread_role_t role = (vlcwrp_thread_role_t)luaL_checkoption(L, 2, NULL, thread_role_names);
+	vlcwrp_thread_config_t config;
+
+	vlc_checkthreadconfig(L, 3, &config);
+	if (pctx && *pctx)
+		vlcwrp_thread_config(*pctx, role, &config);
+	return 0;
+}
+
+static int vlc_thread_stats(lua_State* L)
+{
+	struct vlcwrp_ctx_t** pctx = vlc_checkplayer(L, 1);
+	vlcwrp_thread_role_t role = (vlcwrp_thread_role_t)luaL_checkoption(L, 2, "video", thread_role_names);
+	vlcwrp_thread_stats_t stats;
+	if (pctx && *pctx)
+	{
+		vlcwrp_thread_stats(*pctx, role, &stats);
+		lua_newtable(L);
+		lua_pushinteger(L, stats.tid);
+		lua_setfield(L, -2, "tid");
+		lua_pushnumber(L, stats.cpu_time / 1000.0);
+		lua_setfield(L, -2, "cpu_time");
+		lua_pushinteger(L, stats.cpu);
+		lua_setfield(L, -2, "cpu");
+		lua_pushnumber(L, (lua_Number)stats.migrations);
+		lua_setfield(L, -2, "migrations");
+		lua_pushinteger(L, stats.status);
+		lua_setfield(L, -2, "status");
+		return 1;
+	}
+	return 0;
+}
+
+/* reads overlay pixels given as a string, a full userdata or a lightuserdata, checks the size when known */
+static const void* vlc_checkpixels(lua_State* L, int index, int pitch, int height)
+{
+	const void* pixels;
+	size_t size;
+	switch (lua_type(L, index))
+	{
+	case LUA_TSTRING:
+		pixels = lua_tolstring(L, index, &size);
+		break;
+	case LUA_TUSERDATA:
+		pixels = lua_touserdata(L, index);
+		size = lua_objlen(L, index);
+		break;
+	case LUA_TLIGHTUSERDATA:
+		return lua_touserdata(L, index);
+	default:
+		luaL_typerror(L, index, "string or userdata");
+		return NULL;
+	}
+	luaL_argcheck(L, size >= (size_t)pitch * height, index, "pixels smaller than pitch * height");
+	return pixels;
+}
+
+/* overlay(layer, pixels, width, height [, pitch]), layers are numbered from 1 */
+static int vlc_overlay(lua_State* L)
+{
+	struct vlcwrp_ctx_t** pctx = vlc_checkplayer(L, 1);
+	int layer = (int)luaL_checkinteger(L, 2) - 1;
+	int width = (int)luaL_checkinteger(L, 4);
+	int height = (int)luaL_checkinteger(L, 5);
+	int pitch = (int)luaL_optinteger(L, 6, width * 4);
+	const void* pixels = vlc_checkpixels(L, 3, pitch, height);
+	if (pctx && *pctx)
+	{
+		if (vlcwrp_overlay_set(*pctx, layer, pixels, width, height, pitch))
+			return fail_error_exit(L, "cannot set overlay %d", layer + 1);
+		lua_pushboolean(L, 1);
+		return 1;
+	}
+	return 0;
+}
+
+/* overlay_update(layer, x, y, width, height, pixels [, pitch]) */
+static int vlc_overlay_update(lua_State* L)
+{
+	struct vlcwrp_ctx_t** pctx = vlc_checkplayer(L, 1);
+	int layer = (int)luaL_checkinteger(L, 2) - 1;
+	int x = (int)luaL_checkinteger(L, 3);
+	int y = (int)luaL_checkinteger(L, 4);
+	int width = (int)luaL_checkinteger(L, 5);
+	int height = (int)luaL_checkinteger(L, 6);
+	int pitch = (int)luaL_optinteger(L, 8, width * 4);
+	const void* pixels = vlc_checkpixels(L, 7, pitch, height);
+	if (pctx && *pctx)
+	{
+		if (vlcwrp_overlay_update(*pctx, layer, pixels, pitch, x, y, width, height))
+			return fail_error_exit(L, "overlay %d not set", layer + 1);
+		lua_pushboolean(L, 1);
+		return 1;
+	}
+	return 0;
+}
+
+/* overlay_place(layer, x, y [, alpha]) */
+static int vlc_overlay_place(lua_State* L)
+{
+	struct vlcwrp_ctx_t** pctx = vlc_checkplayer(L, 1);
+	int layer = (int)luaL_checkinteger(L, 2) - 1;
+	int x = (int)luaL_checkinteger(L, 3);
+	int y = (int)luaL_checkinteger(L, 4);
+	float alpha = (float)luaL_optnumber(L, 5, 1.0);
+	if (pctx && *pctx)
+		vlcwrp_overlay_place(*pctx, layer, x, y, alpha);
+	return 0;
+}
+
+static int vlc_overlay_clear(lua_State* L)
+{
+	struct vlcwrp_ctx_t** pctx = vlc_checkplayer(L, 1);
+	int layer = (int)luaL_checkinteger(L, 2) - 1;
+	if (pctx && *pctx)
+		vlcwrp_overlay_clear(*pctx, layer);
+	return 0;
+}
+
+static int vlc_overlay_stats(lua_State* L)
+{
+	struct vlcwrp_ctx_t** pctx = vlc_checkplayer(L, 1);
+	vlcwrp_overlay_stats_t stats;
+	if (pctx && *pctx && vlcwrp_overlay_stats(*pctx, &stats))
+	{
+		lua_newtable(L);
+		lua_pushinteger(L, stats.layers);
+		lua_setfield(L, -2, "layers");
+		lua_pushnumber(L, (lua_Number)stats.frames);
+		lua_setfield(L, -2, "frames");
+		lua_pushnumber(L, stats.blend_time / 1000.0);
+		lua_setfield(L, -2, "blend_time");
+		lua_pushnumber(L, (lua_Number)stats.tiles_blended);
+		lua_setfield(L, -2, "tiles_blended");
+		lua_pushnumber(L, (lua_Number)stats.tiles_copied);
+		lua_setfield(L, -2, "tiles_copied");
+		lua_pushnumber(L, (lua_Number)stats.tiles_skipped);
+		lua_setfield(L, -2, "tiles_skipped");
+		return 1;
+	}
+	return 0;
+}
+
+static int vlc_seek_start(lua_State* L)
+{
+	struct vlcwrp_ctx_t** pctx = vlc_checkplayer(L, 1);
+	vlcwrp_seek_config_t config;
+
+	vlcwrp_seek_defaults(&config);
+	if (!lua_isnoneornil(L, 2))
+	{
+		lua_getfield(L, 2, "index");
+		if (!lua_isnil(L, -1))
+			config.index = lua_toboolean(L, -1);
+		lua_pop(L, 1);
+		lua_getfield(L, 2, "index_dir");
+		config.index_dir = lua_tostring(L, -1);
+		lua_pop(L, 1);
+	}
+	if (pctx && *pctx)
+	{
+		if (vlcwrp_seek_start(*pctx, &config))
+			return fail_error_exit(L, "cannot start seek thread");
+		lua_pushboolean(L, 1);
+		return 1;
+	}
+	return 0;
+}
+
+/* plays the array of paths without gaps, optionally looping */
+static int vlc_playlist(lua_State* L)
+{
+	struct vlcwrp_ctx_t** pctx = vlc_checkplayer(L, 1);
+	vlcwrp_playlist_mode_t mode = VLCWRP_PLAYLIST_ONCE;
+	const char** paths;
+	int i, npaths, rc;
+
+	luaL_checktype(L, 2, LUA_TTABLE);
+	if (!lua_isnoneornil(L, 3))
+	{
+		luaL_checktype(L, 3, LUA_TTABLE);
+		lua_getfield(L, 3, "loop");
+		if (!lua_isnil(L, -1) && lua_toboolean(L, -1))
+			mode = VLCWRP_PLAYLIST_LOOP;
+		lua_pop(L, 1);
+	}
+	npaths = luaL_getn(L, 2);
+	if (npaths == 0)
+		return luaL_argerror(L, 2, "empty playlist");
+	if (!pctx || !*pctx)
+		return 0;
+	paths = (const char**)malloc(npaths * sizeof(const char*));
+	if (!paths)
+		return fail_allocate_exit(L, __LINE__);
+	/* the strings stay referenced by the argument table during the call */
+	for (i=1; i<=npaths; i++)
+	{
+		lua_rawgeti(L, 2, i);
+		paths[i-1] = lua_tostring(L, -1);
+		lua_pop(L, 1);
+		if (!paths[i-1])
+		{
+			free(paths);
+			return luaL_argerror(L, 2, "array of paths expected");
+		}
+	}
+	rc = vlcwrp_play_playlist(*pctx, paths, npaths, mode);
+	free(paths);
+	vlc_setinputref(L, *pctx, 0);
+	if (rc)
+		return fail_error_exit(L, "cannot play playlist");
+	return catch_vlc_error(L);
+}
+
+/* returns the 1 based playlist item of the decoded frames */
+static int vlc_playlist_item(lua_State* L)
+{
+	struct vlcwrp_ctx_t** pctx = vlc_checkplayer(L, 1);
+	if (pctx && *pctx)
+	{
+		int item = vlcwrp_playlist_item(*pctx);
+		if (item < 0)
+			return 0;
+		lua_pushinteger(L, item + 1);
+		return 1;
+	}
+	return 0;
+}
+
+static int vlc_seek(lua_State* L)
+{
+	struct vlcwrp_ctx_t** pctx = vlc_checkplayer(L, 1);
+	long long time = (long long)luaL_checknumber(L, 2);
+	const char* mode = luaL_optstring(L, 3, "accurate");
+	vlcwrp_seek_mode_t seek_mode;
+
+	if (!strcmp(mode, "fast"))
+		seek_mode = VLCWRP_SEEK_FAST;
+	else if (!strcmp(mode, "accurate"))
+		seek_mode = VLCWRP_SEEK_ACCURATE;
+	else
+		return fail_error_exit(L, "unsupported seek mode %s", mode);
+	if (pctx && *pctx)
+	{
+		if (vlcwrp_seek(*pctx, time, seek_mode))
+			return fail_error_exit(L, "cannot seek");
+		lua_pushboolean(L, 1);
+		return 1;
+	}
+	return 0;
+}
+
+static int vlc_keyframe(lua_State* L)
+{
+	struct vlcwrp_ctx_t** pctx = vlc_checkplayer(L, 1);
+	long long time = (long long)luaL_checknumber(L, 2);
+	if (pctx && *pctx)
+	{
+		long long keyframe = vlcwrp_seek_keyframe(*pctx, time);
+		if (keyframe >= 0)
+		{
+			lua_pushnumber(L, (lua_Number)keyframe);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static int vlc_seek_stats(lua_State* L)
+{
+	struct vlcwrp_ctx_t** pctx = vlc_checkplayer(L, 1);
+	vlcwrp_seek_stats_t stats;
+	if (pctx && *pctx && vlcwrp_seek_stats(*pctx, &stats))
+	{
+		lua_newtable(L);
+		lua_pushnumber(L, (lua_Number)stats.requested);
+		lua_setfield(L, -2, "requested");
+		lua_pushnumber(L, (lua_Number)stats.executed);
+		lua_setfield(L, -2, "executed");
+		lua_pushnumber(L, (lua_Number)stats.coalesced);
+		lua_setfield(L, -2, "coalesced");
+		lua_pushnumber(L, (lua_Number)stats.seek_time);
+		lua_setfield(L, -2, "seek_time");
+		lua_pushinteger(L, stats.keyframes);
+		lua_setfield(L, -2, "keyframes");
+		lua_pushboolean(L, stats.scanning);
+		lua_setfield(L, -2, "scanning");
+		return 1;
+	}
+	return 0;
+}
+
+static int vlc_export_open(lua_State* L)
+{
+	const char* name = luaL_checkstring(L, 1);
+	vlcwrp_export_reader_t** preader = (vlcwrp_export_reader_t**)lua_newuserdata(L, sizeof(vlcwrp_export_reader_t*));
+	if (!preader) return fail_allocate_exit(L, __LINE__);
+	*preader = vlcwrp_export_open(name);
+	if (!*preader)
+		return fail_error_exit(L, "cannot open frame export %s", name);
+	luaL_getmetatable(L, EXPORT_MT);
+	lua_setmetatable(L, -2);
+	return 1;
+}
+
+static vlcwrp_export_reader_t* vlc_checkexport(lua_State* L)
+{
+	vlcwrp_export_reader_t** preader = (vlcwrp_export_reader_t**)luaL_checkudata(L, 1, EXPORT_MT);
+	if (!*preader)
+		luaL_error(L, "frame export is closed");
+	return *preader;
+}
+
+static int vlc_export_close(lua_State* L)
+{
+	vlcwrp_export_reader_t** preader = (vlcwrp_export_reader_t**)luaL_checkudata(L, 1, EXPORT_MT);
+	if (*preader)
+	{
+		vlcwrp_export_close(*preader);
+		*preader = NULL;
+	}
+	return 0;
+}
+
+/* returns true if there is a new frame, false on timeout, nil if the export stopped */
+static int vlc_export_wait(lua_State* L)
+{
+	vlcwrp_export_reader_t* reader = vlc_checkexport(L);
+	int rc = vlcwrp_export_wait(reader, (int)luaL_optinteger(L, 2, -1));
+	if (rc < 0)
+		return fail_error_exit(L, "frame export stopped");
+	lua_pushboolean(L, rc);
+	return 1;
+}
+
+/* returns the latest frame as lightuserdata, its sequence number and timestamp */
+static int vlc_export_acquire(lua_State* L)
+{
+	vlcwrp_export_reader_t* reader = vlc_checkexport(L);
+	vlcwrp_export_frame_t frame;
+	const void* pixels = vlcwrp_export_acquire(reader, &frame);
+	if (!pixels)
+		return 0;
+	lua_pushlightuserdata(L, (void*)pixels);
+	lua_pushinteger(L, frame.seq);
+	lua_pushnumber(L, (lua_Number)frame.timestamp);
+	return 3;
+}
+
+/* returns true if the acquired frame was not overwritten while processed */
+static int vlc_export_release(lua_State* L)
+{
+	vlcwrp_export_reader_t* reader = vlc_checkexport(L);
+	lua_pushboolean(L, vlcwrp_export_release(reader) == 0);
+	return 1;
+}
+
+static int vlc_export_info(lua_State* L)
+{
+	vlcwrp_export_reader_t* reader = vlc_checkexport(L);
+	vlcwrp_export_frame_t frame;
+	if (vlcwrp_export_acquire(reader, &frame))
+		vlcwrp_export_release(reader);
+	else
+		return 0;
+	lua_newtable(L);
+	lua_pushinteger(L, frame.width);
+	lua_setfield(L, -2, "width");
+	lua_pushinteger(L, frame.height);
+	lua_setfield(L, -2, "height");
+	lua_pushinteger(L, frame.pitch);
+	lua_setfield(L, -2, "pitch");
+	return 1;
+}
+
+static int vlc_probe(lua_State* L)
+{
+	static const char* status_names[] = { "missing", "cached", "parsed", "retry" };
+	vlcwrp_probe_config_t config;
+	vlcwrp_media_info_t* infos;
+	const char** paths;
+	const char** args = NULL;
+	int i, npaths, nargs = 0, rc;
+
+	luaL_checktype(L, 1, LUA_TTABLE);
+	vlcwrp_probe_defaults(&config);
+	if (!lua_isnoneornil(L, 2))
+	{
+		/* the array part holds the VLC arguments as in vlc.new */
+		luaL_checktype(L, 2, LUA_TTABLE);
+		lua_getfield(L, 2, "index");
+		config.index = lua_tostring(L, -1);
+		lua_pop(L, 1);
+		config.concurrency = (int)vlc_opttablenumber(L, 2, "concurrency", config.concurrency);
+		config.timeout     = (int)vlc_opttablenumber(L, 2, "timeout", config.timeout);
+		nargs = luaL_getn(L, 2);
+	}
+
+	npaths = luaL_getn(L, 1);
+	paths = (const char**)malloc((npaths + nargs + 1) * sizeof(const char*));
+	infos = (vlcwrp_media_info_t*)malloc((npaths ? npaths : 1) * sizeof(vlcwrp_media_info_t));
+	if (!paths || !infos)
+	{
+		free(paths);
+		free(infos);
+		return fail_allocate_exit(L, __LINE__);
+	}
+	/* the strings stay referenced by the argument tables during the call */
+	for (i=1; i<=npaths; i++)
+	{
+		lua_rawgeti(L, 1, i);
+		paths[i-1] = lua_tostring(L, -1);
+		lua_pop(L, 1);
+		if (!paths[i-1])
+		{
+			free(paths);
+			free(infos);
+			return luaL_argerror(L, 1, "array of paths expected");
+		}
+	}
+	if (nargs > 0)
+	{
+		args = paths + npaths;
+		for (i=1; i<=nargs; i++)
+		{
+			lua_rawgeti(L, 2, i);
+			args[i-1] = lua_tostring(L, -1);
+			lua_pop(L, 1);
+		}
+		config.argc = nargs;
+		config.argv = args;
+	}
+
+	rc = vlcwrp_probe(&config, paths, npaths, infos);
+	if (rc < 0)
+	{
+		free(paths);
+		free(infos);
+		return fail_error_exit(L, "VLC probe error");
+	}
+
+	lua_newtable(L);
+	for (i=0; i<npaths; i++)
+	{
+		lua_newtable(L);
+		lua_pushstring(L, paths[i]);
+		lua_setfield(L, -2, "path");
+		lua_pushstring(L, status_names[infos[i].status]);
+		lua_setfield(L, -2, "status");
+		if (infos[i].status != VLCWRP_PROBE_MISSING)
+		{
+			lua_pushboolean(L, infos[i].failed);
+			lua_setfield(L, -2, "failed");
+			lua_pushnumber(L, (lua_Number)infos[i].duration);
+			lua_setfield(L, -2, "duration");
+			lua_pushstring(L, infos[i].title);
+			lua_setfield(L, -2, "title");
+			lua_pushstring(L, infos[i].artist);
+			lua_setfield(L, -2, "artist");
+			lua_pushstring(L, infos[i].album);
+			lua_setfield(L, -2, "album");
+			vlc_pushfourcc(L, infos[i].video_codec);
+			lua_setfield(L, -2, "video_codec");
+			lua_pushinteger(L, infos[i].width);
+			lua_setfield(L, -2, "width");
+			lua_pushinteger(L, infos[i].height);
+			lua_setfield(L, -2, "height");
+			lua_pushnumber(L, infos[i].fps);
+			lua_setfield(L, -2, "fps");
+			vlc_pushfourcc(L, infos[i].audio_codec);
+			lua_setfield(L, -2, "audio_codec");
+			lua_pushinteger(L, infos[i].channels);
+			lua_setfield(L, -2, "channels");
+			lua_pushinteger(L, infos[i].rate);
+			lua_setfield(L, -2, "rate");
+			lua_pushinteger(L, infos[i].tracks);
+			lua_setfield(L, -2, "tracks");
+		}
+		lua_rawseti(L, -2, i+1);
+	}
+	free(paths);
+	free(infos);
+	lua_pushinteger(L, rc);
+	return 2;
+}
+
+static int vlc_thumbnails(lua_State* L)
+{
+	vlcwrp_thumbnail_config_t config;
+	vlcwrp_thumbnail_t* thumbs;
+	const char** files;
+	const char** args;
+	float* positions;
+	int i, count, nargs, rc;
+
+	luaL_checktype(L, 1, LUA_TTABLE);
+	vlcwrp_thumbnail_defaults(&config);
+	config.width   = (int)vlc_opttablenumber(L, 1, "width", config.width);
+	config.height  = (int)vlc_opttablenumber(L, 1, "height", config.height);
+	config.workers = (int)vlc_opttablenumber(L, 1, "workers", config.workers);
+	config.timeout = (int)vlc_opttablenumber(L, 1, "timeout", config.timeout);
+	lua_getfield(L, 1, "output");
+	config.output = lua_tostring(L, -1);
+	lua_pop(L, 1);
+
+	lua_getfield(L, 1, "files");
+	luaL_argcheck(L, lua_istable(L, -1), 1, "files array expected");
+	count = luaL_getn(L, -1);
+	nargs = luaL_getn(L, 1);
+	files = (const char**)malloc((count + nargs + 1) * sizeof(const char*));
+	positions = (float*)malloc((count + 1) * sizeof(float));
+	thumbs = (vlcwrp_thumbnail_t*)malloc((count + 1) * sizeof(vlcwrp_thumbnail_t));
+	if (!files || !positions || !thumbs)
+	{
+		free(files);
+		free(positions);
+		free(thumbs);
+		return fail_allocate_exit(L, __LINE__);
+	}
+	/* the strings stay referenced by the argument table during the call */
+	for (i=1; i<=count; i++)
+	{
+		lua_rawgeti(L, -1, i);
+		files[i-1] = lua_tostring(L, -1);
+		lua_pop(L, 1);
+		if (!files[i-1])
+		{
+			free(files);
+			free(positions);
+			free(thumbs);
+			return luaL_argerror(L, 1, "files must be strings");
+		}
+	}
+	lua_pop(L, 1);
+
+	/* positions is either one position for all files or one per file */
+	lua_getfield(L, 1, "positions");
+	for (i=0; i<count; i++)
+	{
+		if (lua_istable(L, -1))
+		{
+			lua_rawgeti(L, -1, i+1);
+			positions[i] = (float)luaL_optnumber(L, -1, 0);
+			lua_pop(L, 1);
+		}
+		else
+			positions[i] = (float)luaL_optnumber(L, -1, 0);
+	}
+	lua_pop(L, 1);
+
+	/* the array part holds the VLC arguments as in vlc.new */
+	args = files + count;
+	for (i=1; i<=nargs; i++)
+	{
+		lua_rawgeti(L, 1, i);
+		args[i-1] = lua_tostring(L, -1);
+		lua_pop(L, 1);
+	}
+	config.argc = nargs;
+	config.argv = args;
+
+	rc = vlcwrp_thumbnails(&config, files, positions, count, thumbs);
+	free(positions);
+	if (rc < 0)
+	{
+		free(files);
+		free(thumbs);
+		return fail_error_exit(L, "VLC thumbnails error");
+	}
+
+	lua_newtable(L);
+	for (i=0; i<count; i++)
+	{
+		lua_newtable(L);
+		lua_pushstring(L, files[i]);
+		lua_setfield(L, -2, "file");
+		lua_pushboolean(L, !thumbs[i].status);
+		lua_setfield(L, -2, "ok");
+		if (!thumbs[i].status)
+		{
+			lua_pushboolean(L, thumbs[i].exact);
+			lua_setfield(L, -2, "exact");
+			lua_pushnumber(L, (lua_Number)thumbs[i].time);
+			lua_setfield(L, -2, "time");
+			if (thumbs[i].pixels)
+			{
+				lua_pushlstring(L, (const char*)thumbs[i].pixels, (size_t)config.width * config.height * 4);
+				lua_setfield(L, -2, "data");
+			}
+		}
+		lua_rawseti(L, -2, i+1);
+	}
+	vlcwrp_thumbnails_free(thumbs, count);
+	free(thumbs);
+	free(files);
+	lua_pushinteger(L, rc);
+	return 2;
+}
+
+/* returns the player at idx or NULL if the value is not a player */
+static struct vlcwrp_ctx_t** vlc_toplayer(lua_State* L, int idx)
+{
+	struct vlcwrp_ctx_t** pctx = (struct vlcwrp_ctx_t**)lua_touserdata(L, idx);
+	if (pctx && lua_getmetatable(L, idx))
+	{
+		luaL_getmetatable(L, LIBVLC_MT);
+		if (!lua_rawequal(L, -1, -2))
+			pctx = NULL;
+		lua_pop(L, 2);
+		return pctx;
+	}
+	return NULL;
+}
+
+/* returns the ready token and whether a frame or an event is available, never blocks */
+static int vlc_frame_ready_token(lua_State* L)
+{
+	struct vlcwrp_ctx_t** pctx = vlc_checkplayer(L, 1);
+	if (pctx && *pctx)
+	{
+		int ready;
+		unsigned int token = vlcwrp_ready_token(*pctx, &ready);
+		lua_pushnumber(L, (lua_Number)token);
+		lua_pushboolean(L, ready);
+		return 2;
+	}
+	return 0;
+}
+
+/**
+ * waits for a frame or an event after token
+ * inside a coroutine the player and the token are yielded to the scheduler,
+ * the main thread cannot yield and blocks up to the optional timeout
+ */
+static int vlc_await(lua_State* L)
+{
+	struct vlcwrp_ctx_t** pctx = vlc_checkplayer(L, 1);
+	unsigned int token;
+	int ready;
+
+	if (!pctx || !*pctx)
+	{
+		lua_pushboolean(L, 0);
+		return 1;
+	}
+	if (lua_isnoneornil(L, 2))
+		token = vlcwrp_ready_token(*pctx, &ready);
+	else
+	{
+		token = (unsigned int)luaL_checknumber(L, 2);
+		ready = vlcwrp_ready_token(*pctx, NULL) != token;
+	}
+	if (ready)
+	{
+		lua_pushboolean(L, 1);
+		return 1;
+	}
+	if (lua_pushthread(L))
+	{
+		lua_pop(L, 1);
+		lua_pushboolean(L, vlcwrp_wait_ready(pctx, &token, 1, (int)luaL_optinteger(L, 3, -1)) > 0);
+		return 1;
+	}
+	lua_pop(L, 1);
+	lua_pushvalue(L, 1);
+	lua_pushnumber(L, (lua_Number)token);
+	return lua_yield(L, 2);
+}
+
+/* waits on a table of player tokens, returns the array of ready players, a destroyed player included */
+static int vlc_wait(lua_State* L)
+{
+	int timeout = (int)luaL_optinteger(L, 2, -1);
+	struct vlcwrp_ctx_t** ctxs;
+	unsigned int* tokens;
+	int i, n = 0, immediate = 0;
+
+	luaL_checktype(L, 1, LUA_TTABLE);
+	lua_settop(L, 1);
+	lua_pushnil(L);
+	while (lua_next(L, 1))
+	{
+		n++;
+		lua_pop(L, 1);
+	}
+	ctxs = (struct vlcwrp_ctx_t**)malloc((n ? n : 1) * sizeof(struct vlcwrp_ctx_t*));
+	tokens = (unsigned int*)malloc((n ? n : 1) * sizeof(unsigned int));
+	if (!ctxs || !tokens)
+	{
+		free(ctxs);
+		free(tokens);
+		return fail_allocate_exit(L, __LINE__);
+	}
+	i = 0;
+	lua_pushnil(L);
+	while (lua_next(L, 1))
+	{
+		struct vlcwrp_ctx_t** pctx = vlc_toplayer(L, -2);
+		if (!pctx || !lua_isnumber(L, -1))
+		{
+			free(ctxs);
+			free(tokens);
+			return luaL_argerror(L, 1, "table of player tokens expected");
+		}
+		ctxs[i] = *pctx;
+		tokens[i++] = (unsigned int)lua_tonumber(L, -1);
+		/* a destroyed player never changes its token, it is ready at once */
+		if (!*pctx)
+			immediate = 1;
+		lua_pop(L, 1);
+	}
+	vlcwrp_wait_ready(ctxs, tokens, n, immediate ? 0 : timeout);
+	free(ctxs);
+	free(tokens);
+
+	lua_newtable(L);
+	i = 0;
+	lua_pushnil(L);
+	while (lua_next(L, 1))
+	{
+		struct vlcwrp_ctx_t** pctx = (struct vlcwrp_ctx_t**)lua_touserdata(L, -2);
+		if (!*pctx || vlcwrp_ready_token(*pctx, NULL) != (unsigned int)lua_tonumber(L, -1))
+		{
+			lua_pushvalue(L, -2);
+			lua_rawseti(L, 2, ++i);
+		}
+		lua_pop(L, 1);
+	}
+	return 1;
+}
+
+/**
+ * resumes the coroutine co at index thread of the scheduler at index sched,
+ * parked is non zero if the coroutine is waiting in the scheduler
+ * a coroutine yielding a player and a token waits for the token to change,
+ * any other yield waits for the next step
+ * returns 0 or -1 with the error message pushed
+ */
+static int scheduler_resume(lua_State* L, int sched, int thread, lua_State* co, int nargs, int parked)
+{
+	int* count = (int*)lua_touserdata(L, sched);
+	int rc = lua_resume(co, nargs);
+
+	lua_getfenv(L, sched);
+	lua_pushvalue(L, thread);
+	if (rc == LUA_YIELD)
+	{
+		if (lua_gettop(co) >= 2 && vlc_toplayer(co, 1) && lua_isnumber(co, 2))
+		{
+			lua_createtable(L, 2, 0);
+			lua_pushvalue(co, 1);
+			lua_xmove(co, L, 1);
+			lua_rawseti(L, -2, 1);
+			lua_pushnumber(L, lua_tonumber(co, 2));
+			lua_rawseti(L, -2, 2);
+		}
+		else
+			lua_pushboolean(L, 1);
+		lua_settop(co, 0);
+		lua_rawset(L, -3);
+		lua_pop(L, 1);
+		if (!parked)
+			(*count)++;
+		return 0;
+	}
+	lua_pushnil(L);
+	lua_rawset(L, -3);
+	lua_pop(L, 1);
+	if (parked)
+		(*count)--;
+	if (rc)
+	{
+		/* the error message of the failed coroutine */
+		lua_xmove(co, L, 1);
+		return -1;
+	}
+	return 0;
+}
+
+/* creates a scheduler of coroutines waiting for players */
+static int vlc_scheduler(lua_State* L)
+{
+	int* count = (int*)lua_newuserdata(L, sizeof(int));
+	*count = 0;
+	luaL_getmetatable(L, SCHEDULER_MT);
+	lua_setmetatable(L, -2);
+
+	/* the waiting coroutines, keyed by thread */
+	lua_newtable(L);
+	lua_setfenv(L, -2);
+	return 1;
+}
+
+/* runs the function with the arguments in a new coroutine until its first wait */
+static int vlc_scheduler_spawn(lua_State* L)
+{
+	int nargs = lua_gettop(L) - 2;
+	lua_State* co;
+
+	luaL_checkudata(L, 1, SCHEDULER_MT);
+	luaL_checktype(L, 2, LUA_TFUNCTION);
+	co = lua_newthread(L);
+	lua_insert(L, 2);
+	lua_xmove(L, co, nargs + 1);
+	if (scheduler_resume(L, 1, 2, co, nargs, 0))
+	{
+		lua_pushnil(L);
+		lua_insert(L, -2);
+		return 2;
+	}
+	lua_pushboolean(L, 1);
+	return 1;
+}
+
+/**
+ * waits up to timeout milliseconds for any of the awaited players and
+ * resumes the ready coroutines, returns the number of coroutines left
+ */
+static int vlc_scheduler_step(lua_State* L)
+{
+	int* count = (int*)luaL_checkudata(L, 1, SCHEDULER_MT);
+	int timeout = (int)luaL_optinteger(L, 2, -1);
+	struct vlcwrp_ctx_t** ctxs;
+	unsigned int* tokens;
+	int i, n = 0, nready = 0, immediate = 0;
+
+	lua_settop(L, 1);
+	lua_getfenv(L, 1);
+	if (*count == 0)
+	{
+		lua_pushinteger(L, 0);
+		return 1;
+	}
+	ctxs = (struct vlcwrp_ctx_t**)malloc(*count * sizeof(struct vlcwrp_ctx_t*));
+	tokens = (unsigned int*)malloc(*count * sizeof(unsigned int));
+	if (!ctxs || !tokens)
+	{
+		free(ctxs);
+		free(tokens);
+		return fail_allocate_exit(L, __LINE__);
+	}
+
+	/* one wait over all the awaited players */
+	lua_pushnil(L);
+	while (lua_next(L, 2))
+	{
+		if (lua_istable(L, -1))
+		{
+			lua_rawgeti(L, -1, 1);
+			lua_rawgeti(L, -2, 2);
+			ctxs[n] = *(struct vlcwrp_ctx_t**)lua_touserdata(L, -2);
+			tokens[n] = (unsigned int)lua_tonumber(L, -1);
+			if (!ctxs[n++])
+				immediate = 1;
+			lua_pop(L, 2);
+		}
+		else
+			immediate = 1;
+		lua_pop(L, 1);
+	}
+	vlcwrp_wait_ready(ctxs, tokens, n, immediate ? 0 : timeout);
+	free(ctxs);
+	free(tokens);
+
+	/* the ready coroutines are collected first, resuming may spawn new ones */
+	lua_newtable(L);
+	lua_pushnil(L);
+	while (lua_next(L, 2))
+	{
+		int ready = 1;
+		if (lua_istable(L, -1))
+		{
+			struct vlcwrp_ctx_t** pctx;
+			lua_rawgeti(L, -1, 1);
+			lua_rawgeti(L, -2, 2);
+			pctx = (struct vlcwrp_ctx_t**)lua_touserdata(L, -2);
+			ready = !*pctx || vlcwrp_ready_token(*pctx, NULL) != (unsigned int)lua_tonumber(L, -1);
+			lua_pop(L, 2);
+		}
+		if (ready)
+		{
+			lua_pushvalue(L, -2);
+			lua_rawseti(L, 3, ++nready);
+		}
+		lua_pop(L, 1);
+	}
+	for (i=1; i<=nready; i++)
+	{
+		lua_State* co;
+		lua_rawgeti(L, 3, i);
+		co = lua_tothread(L, -1);
+		lua_pushboolean(co, 1);
+		if (scheduler_resume(L, 1, lua_gettop(L), co, 1, 1))
+		{
+			lua_pushnil(L);
+			lua_insert(L, -2);
+			return 2;
+		}
+		lua_pop(L, 1);
+	}
+	lua_pushinteger(L, *count);
+	return 1;
+}
+
+/* measures the latency of a generated stream, the array part holds the VLC arguments as in vlc.new */
+static int vlc_latency_probe(lua_State* L)
+{
+	vlcwrp_latency_config_t config;
+	vlcwrp_latency_t result;
+	const char** args;
+	int i, nargs, rc;
+
+	luaL_checktype(L, 1, LUA_TTABLE);
+	vlcwrp_latency_defaults(&config);
+	config.port     = (int)vlc_opttablenumber(L, 1, "port", config.port);
+	config.duration = (int)vlc_opttablenumber(L, 1, "duration", config.duration);
+	config.width    = (int)vlc_opttablenumber(L, 1, "width", config.width);
+	config.height   = (int)vlc_opttablenumber(L, 1, "height", config.height);
+	config.fps      = (int)vlc_opttablenumber(L, 1, "fps", config.fps);
+	config.bitrate  = (int)vlc_opttablenumber(L, 1, "bitrate", config.bitrate);
+	lua_getfield(L, 1, "vcodec");
+	if (!lua_isnil(L, -1))
+		config.vcodec = lua_tostring(L, -1);
+	lua_pop(L, 1);
+	lua_getfield(L, 1, "profile");
+	if (!lua_isnil(L, -1))
+		config.profile = (vlcwrp_profile_t)luaL_checkoption(L, -1, NULL, profile_names);
+	lua_pop(L, 1);
+
+	/* the strings stay referenced by the argument table during the call */
+	nargs = luaL_getn(L, 1);
+	args = (const char**)malloc((nargs + 1) * sizeof(const char*));
+	if (!args)
+		return fail_allocate_exit(L, __LINE__);
+	for (i=1; i<=nargs; i++)
+	{
+		lua_rawgeti(L, 1, i);
+		args[i-1] = lua_tostring(L, -1);
+		lua_pop(L, 1);
+	}
+	config.argc = nargs;
+	config.argv = args;
+
+	rc = vlcwrp_latency_probe(&config, &result);
+	free(args);
+	if (rc)
+		return fail_error_exit(L, "no frame measured");
+	lua_newtable(L);
+	lua_pushinteger(L, result.emitted);
+	lua_setfield(L, -2, "emitted");
+	lua_pushinteger(L, result.frames);
+	lua_setfield(L, -2, "frames");
+	lua_pushnumber(L, (lua_Number)result.first);
+	lua_setfield(L, -2, "first");
+	lua_pushnumber(L, (lua_Number)result.min);
+	lua_setfield(L, -2, "min");
+	lua_pushnumber(L, (lua_Number)result.mean);
+	lua_setfield(L, -2, "mean");
+	lua_pushnumber(L, (lua_Number)result.p50);
+	lua_setfield(L, -2, "p50");
+	lua_pushnumber(L, (lua_Number)result.p95);
+	lua_setfield(L, -2, "p95");
+	lua_pushnumber(L, (lua_Number)result.max);
+	lua_setfield(L, -2, "max");
+	return 1;
+}
+
+/* limits the bytes mapped for frames by all players, {budget = bytes}, 0 for no limit */
+static int vlc_arena(lua_State* L)
+{
+	luaL_checktype(L, 1, LUA_TTABLE);
+	vlcwrp_arena_configure((unsigned long long)vlc_opttablenumber(L, 1, "budget", 0));
+	return 0;
+}
+
+/* returns the process wide frame arena statistics */
+static int vlc_arena_stats(lua_State* L)
+{
+	vlcwrp_arena_stats_t stats;
+	vlcwrp_arena_stats(&stats);
+	lua_newtable(L);
+	lua_pushnumber(L, (lua_Number)stats.budget);
+	lua_setfield(L, -2, "budget");
+	lua_pushnumber(L, (lua_Number)stats.mapped);
+	lua_setfield(L, -2, "mapped");
+	lua_pushnumber(L, (lua_Number)stats.free_bytes);
+	lua_setfield(L, -2, "free_bytes");
+	lua_pushnumber(L, (lua_Number)stats.failed);
+	lua_setfield(L, -2, "failed");
+	lua_pushinteger(L, stats.classes);
+	lua_setfield(L, -2, "classes");
+	lua_pushinteger(L, stats.frames);
+	lua_setfield(L, -2, "frames");
+	lua_pushinteger(L, stats.free_frames);
+	lua_setfield(L, -2, "free_frames");
+	return 1;
+}
+
+/* places the calling thread, as the render thread */
+static int vlc_thread_apply(lua_State* L)
+{
+	vlcwrp_thread_config_t config;
+	vlc_checkthreadconfig(L, 1, &config);
+	if (vlcwrp_thread_apply(&config))
+		return fail_error_exit(L, "cannot apply thread placement");
+	lua_pushboolean(L, 1);
+	return 1;
+}
+
+/* CPU time of the calling thread in milliseconds */
+static int vlc_thread_cpu_time(lua_State* L)
+{
+	lua_pushnumber(L, vlcwrp_thread_cpu_time() / 1000.0);
+	return 1;
+}
+
+static const luaL_reg vlc_funcs[] =
+{
+	{"new", vlc_new},
+	{"probe", vlc_probe},
+	{"thumbnails", vlc_thumbnails},
+	{"recording_open", vlc_recording_open},
+	{"export_open", vlc_export_open},
+	{"wait", vlc_wait},
+	{"scheduler", vlc_scheduler},
+	{"arena", vlc_arena},
+	{"latency_probe", vlc_latency_probe},
+	{"arena_stats", vlc_arena_stats},
+	{"thread_apply", vlc_thread_apply},
+	{"thread_cpu_time", vlc_thread_cpu_time},
+	{NULL, NULL},
+};
+
+static const luaL_reg vlc_meths[] =
+{
+	{"__gc", vlc_destroy},
+	{"detach", vlc_detach},
+	{"play", vlc_play},
+	{"play_memory", vlc_play_memory},
+	{"play_mmap", vlc_play_mmap},
+	{"input_stats", vlc_input_stats},
+	{"stop", vlc_stop},
+	{"pause", vlc_pause},
+	{"get_state", vlc_get_state},
+	{"handle", vlc_handle},
+	{"frame_acquire", vlc_frame_acquire},
+	{"frame_acquire_due", vlc_frame_acquire_due},
+	{"frame_release", vlc_frame_release},
+	{"frame_info", vlc_frame_info},
+	{"frame_pitch", vlc_frame_pitch},
+	{"analytics_start", vlc_analytics_start},
+	{"analytics_stop", vlc_analytics_stop},
+	{"analytics", vlc_analytics},
+	{"audio_start", vlc_audio_start},
+	{"audio_acquire", vlc_audio_acquire},
+	{"audio_release", vlc_audio_release},
+	{"audio_stats", vlc_audio_stats},
+	{"clock", vlc_clock},
+	{"snapshot", vlc_snapshot},
+	{"snapshot_stats", vlc_snapshot_stats},
+	{"events", vlc_events},
+	{"record_start", vlc_record_start},
+	{"record_stop", vlc_record_stop},
+	{"record_stats", vlc_record_stats},
+	{"export_start", vlc_export_start},
+	{"export_stop", vlc_export_stop},
+	{"cache_start", vlc_cache_start},
+	{"cache_stop", vlc_cache_stop},
+	{"cache_seek", vlc_cache_seek},
+	{"cache_stats", vlc_cache_stats},
+	{"step", vlc_step},
+	{"profile", vlc_profile},
+	{"startup_profile", vlc_startup_profile},
+	{"adaptive_start", vlc_adaptive_start},
+	{"adaptive_stop", vlc_adaptive_stop},
+	{"adaptive_stats", vlc_adaptive_stats},
+	{"health_watch", vlc_health_watch},
+	{"health_unwatch", vlc_health_unwatch},
+	{"health", vlc_health},
+	{"thread_config", vlc_thread_config},
+	{"thread_stats", vlc_thread_stats},
+	{"overlay", vlc_overlay},
+	{"overlay_update", vlc_overlay_update},
+	{"overlay_place", vlc_overlay_place},
+	{"overlay_clear", vlc_overlay_clear},
+	{"overlay_stats", vlc_overlay_stats},
+	{"seek_start", vlc_seek_start},
+	{"seek", vlc_seek},
+	{"keyframe", vlc_keyframe},
+	{"seek_stats", vlc_seek_stats},
+	{"playlist", vlc_playlist},
+	{"playlist_item", vlc_playlist_item},
+	{"frame_ready_token", vlc_frame_ready_token},
+	{"await", vlc_await},
+	{NULL, NULL},
+};
+
+static const luaL_reg recording_meths[] =
+{
+	{"__gc", vlc_recording_close},
+	{"close", vlc_recording_close},
+	{"info", vlc_recording_info},
+	{"frame", vlc_recording_frame},
+	{NULL, NULL},
+};
+
+static const luaL_reg scheduler_meths[] =
+{
+	{"spawn", vlc_scheduler_spawn},
+	{"step", vlc_scheduler_step},
+	{NULL, NULL},
+};
+
+static const luaL_reg export_meths[] =
+{
+	{"__gc", vlc_export_close},
+	{"close", vlc_export_close},
+	{"wait", vlc_export_wait},
+	{"acquire", vlc_export_acquire},
+	{"release", vlc_export_release},
+	{"info", vlc_export_info},
+	{NULL, NULL},
+};
+
+LUAVLCWRP_API int luaopen_vlcwrp(lua_State *L)
+{
+	createmeta(L, LIBVLC_MT);
+	luaL_openlib(L, 0, vlc_meths, 0);
+	createmeta(L, RECORDING_MT);
+	luaL_openlib(L, 0, recording_meths, 0);
+	lua_pop(L, 1);
+	createmeta(L, EXPORT_MT);
+	luaL_openlib(L, 0, export_meths, 0);
+	lua_pop(L, 1);
+	createmeta(L, SCHEDULER_MT);
+	luaL_openlib(L, 0, scheduler_meths, 0);
+	lua_pop(L, 1);
 	luaL_openlib(L, "vlc", vlc_funcs, 0);
 	return 1;
 }
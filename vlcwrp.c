@@ -10,86 +10,90 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <time.h>
+#include <string.h>
 #include <GL/gl.h>
 #include <vlc/vlc.h>
 #include <pthread.h>
 #include <errno.h>
+#include <stdint.h>
 
-#include "vlcwrp.h"
-
-#define BPP 4
-#define CHROMA "RV32"
-
-/* must be >= 3 */
-#define QUEUE_SIZE 3
+#include "vlcwrp_priv.h"
 
 /* forward references to VLC media player callbacks */
-static void *lockcb(void *, void **);
-static void unlockcb(void *, void *, void *const *);
-static void displaycb(void *, void *);
+static void startupcb(const struct libvlc_event_t *, void *);
 
-#define log
-//printf
-
-/**
- * VLC wrapper context
- */
-struct vlcwrp_ctx_t
+/* monotonic clock in microseconds */
+long long vlcwrp_clock(void)
 {
-	/* VLC instance */
-    libvlc_instance_t *libvlc;
-
-	/* VLC media player instance */
-    libvlc_media_player_t *mp;
-
-	/* queue of frames */
-	unsigned char* frame_queue[QUEUE_SIZE];
-
-	/* frame width */
-	int width;
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
 
-	/* frame height */
-	int height;
+/* size of the per thread copy of the last VLC error message */
+#define ERROR_SIZE 256
 
-	/* number of decoded frames queued */
-	int nqueuedframes;
+/* milliseconds between the attempts to take a frame over the arena budget */
+#define BUFFERS_RETRY 10
 
-	/* read and write queue indecies */
-	int ridx, widx;
+/* frame duration in microseconds assumed until it is known */
+#define FRAME_INTERVAL 40000
 
-	/* condition the queue is empty */
-	pthread_cond_t* cond_empty;
+/* frames timed before the frame duration is measured from the input time */
+#define FRAME_MEASURE 25
 
-	/* condition the queue is full */
-	pthread_cond_t* cond_full;
+/* milliseconds the input time may differ from the extrapolated time before the frames are timed from it again */
+#define FRAME_RESYNC 1000
 
-	/* synchronizing mutex */
-	pthread_mutex_t* mutex;
+#ifdef _MSC_VER
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
 
-	/* flag indicating request stopping */
-	int requested_stop;
-};
+/* the message is copied before being cleared, each thread reads its own copy */
+static THREAD_LOCAL char error_message[ERROR_SIZE];
 
-/* get last VLC error message and clear the message, returns NULL if no error */
+/* get last VLC error message of the calling thread and clear the message, returns NULL if no error */
 const char* vlcwrp_error()
 {
 	const char* errmsg = libvlc_errmsg();
+	if (!errmsg)
+		return NULL;
+	strncpy(error_message, errmsg, ERROR_SIZE - 1);
+	error_message[ERROR_SIZE - 1] = '\0';
 	libvlc_clearerr();
-	return errmsg;
+	return error_message;
 }
 
-/* create VLC player instance */
-struct vlcwrp_ctx_t *vlcwrp_create(int argc, const char * const* argv, int width, int height)
+/* clear the VLC error message of the calling thread */
+void vlcwrp_error_clear()
 {
-	int i;
+	libvlc_clearerr();
+}
+
+/* takes the time of a startup stage the first time it is reached, called from any thread */
+static void startup_mark(long long* stage)
+{
+	if (!vlcwrp_atomic_load(stage))
+		vlcwrp_atomic_store(stage, vlcwrp_clock());
+}
+
+/* create VLC player instance, with the vmem video path if video is non zero */
+static struct vlcwrp_ctx_t *create(int argc, const char * const* argv, int width, int height, int video, const vlcwrp_buffer_config_t* buffers)
+{
+	vlcwrp_buffer_config_t defaults;
+	long long start = vlcwrp_clock();
 
 	/* allocates context */
-	struct vlcwrp_ctx_t* ctx = (struct vlcwrp_ctx_t*)malloc(sizeof(struct vlcwrp_ctx_t));
+	struct vlcwrp_ctx_t* ctx = (struct vlcwrp_ctx_t*)calloc(1, sizeof(struct vlcwrp_ctx_t));
 
 	if (!ctx)
 	{
 		return NULL;
 	}
+	ctx->startup.create = start;
 	
 	/* creates new VLC instance */
 	ctx->libvlc = libvlc_new(argc, argv);
@@ -98,6 +102,7 @@ struct vlcwrp_ctx_t *vlcwrp_create(int argc, const char * const* argv, int width
 		vlcwrp_destroy(ctx);
 		return NULL;
 	}
+	ctx->startup.instance = vlcwrp_clock();
 
 	/* creates new VLC media player instance */
 	ctx->mp = libvlc_media_player_new(ctx->libvlc);
@@ -106,10 +111,17 @@ struct vlcwrp_ctx_t *vlcwrp_create(int argc, const char * const* argv, int width
 		vlcwrp_destroy(ctx);
 		return NULL;
 	}
+	ctx->startup.player = vlcwrp_clock();
+
+	/* the state transitions and the video output creation are timed */
+	vlcwrp_startup_attach(ctx, ctx->mp);
 
 	/* sets media player callbacks and desired frame format */
-	libvlc_video_set_callbacks(ctx->mp, lockcb, unlockcb, displaycb, ctx);
-	libvlc_video_set_format(ctx->mp, CHROMA, width, height, width*BPP);
+	ctx->video = video;
+	if (video)
+	{
+		libvlc_video_set_callbacks(ctx->mp, vlcwrp_lockcb, vlcwrp_unlockcb, vlcwrp_displaycb, ctx);
+	}
 
 	/* creates mutex */
 	ctx->mutex = (pthread_mutex_t*)malloc(sizeof(pthread_mutex_t));
@@ -138,31 +150,115 @@ struct vlcwrp_ctx_t *vlcwrp_create(int argc, const char * const* argv, int width
 	}
 	pthread_cond_init(ctx->cond_full, 0);
 
+	/* creates event queue */
+	if (vlcwrp_events_init(ctx))
+	{
+		vlcwrp_destroy(ctx);
+		return NULL;
+	}
+
 	/* initialize queue data */
 	ctx->width = width;
 	ctx->height = height;
-	for (i=0; i<QUEUE_SIZE; i++)
+	if (video)
 	{
-		ctx->frame_queue[i] = (unsigned char*)malloc(width * height * BPP);
-		if (!ctx->frame_queue[i])
+		if (!buffers)
+		{
+			vlcwrp_buffer_defaults(&defaults);
+			buffers = &defaults;
+		}
+		if (vlcwrp_buffers_alloc(ctx, buffers))
 		{
 			vlcwrp_destroy(ctx);
 			return NULL;
 		}
+		libvlc_video_set_format(ctx->mp, CHROMA, width, height, ctx->pitch);
+	}
+	ctx->nqueuedframes = ctx->npendingframes = ctx->ridx = ctx->pidx = ctx->widx = 0;
+	ctx->time_base = -1;
+	return ctx;
+}
+
+/* create VLC player instance */
+struct vlcwrp_ctx_t *vlcwrp_create(int argc, const char * const* argv, int width, int height)
+{
+	return create(argc, argv, width, height, 1, NULL);
+}
+
+/* create VLC player instance with the frame buffers configuration */
+struct vlcwrp_ctx_t *vlcwrp_create_ex(int argc, const char * const* argv, int width, int height, const vlcwrp_buffer_config_t* buffers)
+{
+	return create(argc, argv, width, height, 1, buffers);
+}
+
+/* create VLC player instance without video */
+struct vlcwrp_ctx_t *vlcwrp_create_no_video(int argc, const char * const* argv, const vlcwrp_audio_config_t* audio)
+{
+	struct vlcwrp_ctx_t* ctx = create(argc, argv, 0, 0, 0, NULL);
+	if (ctx && audio && vlcwrp_audio_start(ctx, audio))
+	{
+		vlcwrp_destroy(ctx);
+		return NULL;
 	}
-	ctx->nqueuedframes = ctx->ridx = ctx->widx = 0;
 	return ctx;
 }
 
 /* destroy VLC player instance */
 void vlcwrp_destroy(struct vlcwrp_ctx_t* ctx)
 {
-	int i;
+	/* the health monitor no longer samples nor restarts the player */
+	vlcwrp_health_unwatch(ctx);
+
+	/* stop the seek thread and the playlist before the media player they drive */
+	vlcwrp_seek_stop(ctx);
+	if (ctx->mp)
+		vlcwrp_playlist_free(ctx);
+
+	/* discard media player object, no callbacks are invoked after that */
+	if (ctx->mp)
+		libvlc_media_player_release(ctx->mp);
+
+	/* discard VLC instance */
+	if (ctx->libvlc)
+		libvlc_release(ctx->libvlc);
+
+	/* stop frame analytics */
+	if (ctx->mutex)
+		vlcwrp_analytics_stop(ctx);
+
+	/* stop snapshot encoder */
+	vlcwrp_snapshot_free(ctx);
+
+	/* stop frame recorder */
+	if (ctx->recorder)
+		vlcwrp_record_stop(ctx);
+
+	/* stop frame export, the private frames are restored */
+	if (ctx->export)
+		vlcwrp_export_stop(ctx);
+
+	/* discard decoded frame cache */
+	if (ctx->mutex)
+		vlcwrp_cache_stop(ctx);
+
+	/* discard overlay layers */
+	vlcwrp_overlay_free(ctx);
+
+	/* discard adaptive quality controller */
+	if (ctx->mutex)
+		vlcwrp_adaptive_stop(ctx);
+
+	/* discard event queue */
+	vlcwrp_events_free(ctx);
+
+	/* discard audio ring */
+	vlcwrp_audio_free(ctx);
+
+	/* discard custom input */
+	vlcwrp_input_free(ctx);
 
 	/* discard frames queue */
-	for (i=0; i<QUEUE_SIZE; i++)
-		if (ctx->frame_queue[i])
-			free(ctx->frame_queue[i]);
+	vlcwrp_buffers_free(ctx);
 	
 	/* discard conditions and mutex  */
 	if (ctx->cond_full)
@@ -171,14 +267,9 @@ void vlcwrp_destroy(struct vlcwrp_ctx_t* ctx)
 	  pthread_cond_destroy(ctx->cond_empty);
 	if (ctx->mutex)
 	  pthread_mutex_destroy(ctx->mutex);
-
-	/* discard media player object */
-	if (ctx->mp)
-		libvlc_media_player_release(ctx->mp);
-
-	/* discard VLC instance */
-	if (ctx->libvlc)
-		libvlc_release(ctx->libvlc);
+	free(ctx->cond_full);
+	free(ctx->cond_empty);
+	free(ctx->mutex);
 
 	/* discard context */
 	free(ctx);
@@ -199,30 +290,82 @@ vlc_state_t vlcwrp_get_state(struct vlcwrp_ctx_t* ctx)
 	}
 }
 
+/* plays media m or the current media if m is NULL, takes over the reference to m */
+void vlcwrp_play_media(struct vlcwrp_ctx_t* ctx, libvlc_media_t* m)
+{
+	if (m)
+	{
+		/* no video decoding without the vmem video path */
+		if (!ctx->video)
+			libvlc_media_add_option(m, ":no-video");
+		vlcwrp_profile_apply(m, ctx->profile);
+		libvlc_media_player_set_media(ctx->mp, m);
+		libvlc_media_release(m);
+		ctx->startup.media = vlcwrp_clock();
+
+		/* frames and keyframes of the previous media are no longer relevant */
+		vlcwrp_cache_clear(ctx);
+		vlcwrp_seek_media(ctx, NULL);
+	}
+	log("vlcwrp_play\n");
+	vlcwrp_play_reset(ctx);
+	libvlc_media_player_play(ctx->mp);
+}
+
+/* resets the frame queue before the player starts */
+void vlcwrp_play_reset(struct vlcwrp_ctx_t* ctx)
+{
+	pthread_mutex_lock(ctx->mutex);
+	ctx->nqueuedframes = ctx->npendingframes = ctx->ridx = ctx->pidx = ctx->widx = ctx->requested_stop = 0;
+	ctx->seq = 0;
+	ctx->time_base = -1;
+	ctx->time_interval = 0;
+	ctx->time_fps = 0;
+	ctx->generation++;
+	ctx->clock_audio = 0;
+	ctx->buffers_bind = ctx->buffers_numa;
+	vlcwrp_threads_reset(ctx);
+	vlcwrp_atomic_store(&ctx->startup.opening, 0);
+	vlcwrp_atomic_store(&ctx->startup.buffering, 0);
+	vlcwrp_atomic_store(&ctx->startup.playing, 0);
+	vlcwrp_atomic_store(&ctx->startup.vout, 0);
+	vlcwrp_atomic_store(&ctx->startup.first_lock, 0);
+	vlcwrp_atomic_store(&ctx->startup.first_unlock, 0);
+	vlcwrp_atomic_store(&ctx->startup.first_acquire, 0);
+	vlcwrp_atomic_store(&ctx->startup.play, vlcwrp_clock());
+	if (ctx->analytics)
+		vlcwrp_analytics_reset(ctx);
+	if (ctx->adaptive)
+		vlcwrp_adaptive_reset(ctx);
+	pthread_mutex_unlock(ctx->mutex);
+}
+
 /* play media url */
 void vlcwrp_play(struct vlcwrp_ctx_t* ctx, const char* url)
 {
+	libvlc_media_t *m = NULL;
+
 	/* stop before start playing */
 	vlcwrp_stop(ctx);
 
 	if (url)
 	{
-		libvlc_media_t *m = libvlc_media_new_path(ctx->libvlc, url);
-		if (m)
-		{
-			libvlc_media_player_set_media(ctx->mp, m);
-		}
-		else
+		/* live sources are given as URLs, anything else is a local path */
+		m = strstr(url, "://") ? libvlc_media_new_location(ctx->libvlc, url) : libvlc_media_new_path(ctx->libvlc, url);
+		if (!m)
 		{
 			/* error occurred */
 			return ;
 		}
+
+		/* the previous custom input is no longer referenced */
+		vlcwrp_input_free(ctx);
 	}
-	log("vlcwrp_play\n");
-	pthread_mutex_lock(ctx->mutex);
-	ctx->nqueuedframes = ctx->ridx = ctx->widx = ctx->requested_stop = 0;
-	pthread_mutex_unlock(ctx->mutex);
-	libvlc_media_player_play(ctx->mp);
+	vlcwrp_play_media(ctx, m);
+
+	/* the keyframes of the file are indexed in the background */
+	if (url && !strstr(url, "://"))
+		vlcwrp_seek_media(ctx, url);
 }
 
 /* stop playing */
@@ -237,6 +380,7 @@ void vlcwrp_stop(struct vlcwrp_ctx_t* ctx)
 	ctx->requested_stop = 1;
 	pthread_cond_signal(ctx->cond_empty);
 	pthread_cond_signal(ctx->cond_full);
+	vlcwrp_wait_notify(ctx);
 
 	if (err_lock == 0)
 	{
@@ -244,7 +388,35 @@ void vlcwrp_stop(struct vlcwrp_ctx_t* ctx)
 	}
 
 	log("do real stop\n");
+	vlcwrp_playlist_free(ctx);
+	libvlc_media_player_stop(ctx->mp);
+
+	/* the frames beyond the reservation go back to the arena, unless a frame is acquired */
+	if (ctx->video && pthread_mutex_trylock(ctx->mutex) == 0)
+	{
+		vlcwrp_buffers_trim_idle(ctx);
+		pthread_mutex_unlock(ctx->mutex);
+	}
+}
+
+/* plays the current media again, called by the thread driving the player */
+void vlcwrp_restart(struct vlcwrp_ctx_t* ctx)
+{
+	int err_lock = pthread_mutex_trylock(ctx->mutex);
+
+	/* the decoder thread may be waiting on a full queue */
+	ctx->requested_stop = 1;
+	pthread_cond_signal(ctx->cond_empty);
+	pthread_cond_signal(ctx->cond_full);
+	if (err_lock == 0)
+	{
+		pthread_mutex_unlock(ctx->mutex);
+	}
+
+	/* the playlist keeps its current item */
 	libvlc_media_player_stop(ctx->mp);
+	vlcwrp_play_reset(ctx);
+	libvlc_media_player_play(ctx->mp);
 }
 
 /* toggle pause/play */
@@ -261,6 +433,7 @@ void* vlcwrp_frame_acquire(struct vlcwrp_ctx_t* ctx)
 {
 	void *pframe = NULL;
 	
+	vlcwrp_health_apply(ctx);
 	log("vlcwrp_frame_acquire lock\n");
 	pthread_mutex_lock(ctx->mutex);
 	if (ctx->nqueuedframes > 0)
@@ -268,6 +441,7 @@ void* vlcwrp_frame_acquire(struct vlcwrp_ctx_t* ctx)
 		/* get frame from read index */
 		log("vlcwrp_frame_acquire ridx=%d\n", ctx->ridx);
 		pframe = ctx->frame_queue[ctx->ridx];
+		startup_mark(&ctx->startup.first_acquire);
 	}
 	else
 	{
@@ -287,8 +461,20 @@ void vlcwrp_frame_release(struct vlcwrp_ctx_t* ctx)
 	log("vlcwrp_frame_release qf=%d\n", ctx->nqueuedframes);
 	if (ctx->nqueuedframes > 0)
 	{
+		/* copy the frame for the requested snapshots, the decoder is not held meanwhile */
+		if (vlcwrp_snapshot_pending(ctx))
+		{
+			unsigned char* pixels = ctx->frame_queue[ctx->ridx];
+			ctx->read_copy = 1;
+			pthread_mutex_unlock(ctx->mutex);
+			vlcwrp_snapshot_capture(ctx, pixels);
+			pthread_mutex_lock(ctx->mutex);
+			ctx->read_copy = 0;
+		}
+
 		/* advance the read index */
 		ctx->ridx = (ctx->ridx + 1) % QUEUE_SIZE;
+		ctx->try_acquired = 0;
 
 		/* decrement queued frames number */
 		ctx->nqueuedframes--;
@@ -299,48 +485,415 @@ void vlcwrp_frame_release(struct vlcwrp_ctx_t* ctx)
 	}
 }
 
+/* get the master clock time */
+long long vlcwrp_clock_time(struct vlcwrp_ctx_t* ctx, int* audio)
+{
+	int audio_driven = ctx->audio && vlcwrp_atomic_load(&ctx->clock_audio);
+	if (audio)
+		*audio = audio_driven;
+	if (audio_driven)
+		return libvlc_clock() + vlcwrp_atomic_load(&ctx->clock_audio_lag);
+	return libvlc_clock();
+}
+
+/*
+ * acquire the latest frame due according to the master clock,
+ * older due frames are dropped
+ */
+void* vlcwrp_frame_acquire_due(struct vlcwrp_ctx_t* ctx)
+{
+	long long now;
+	vlcwrp_frame_info_t* info;
+
+	vlcwrp_health_apply(ctx);
+	now = vlcwrp_clock_time(ctx, NULL);
+	pthread_mutex_lock(ctx->mutex);
+	/* skip frames superseded by a newer due frame, a frame dropped by VLC is never displayed */
+	while (ctx->nqueuedframes > 1)
+	{
+		info = &ctx->frame_info[(ctx->ridx + 1) % QUEUE_SIZE];
+		if (!info->displayed || info->displayed > now)
+			break;
+		ctx->ridx = (ctx->ridx + 1) % QUEUE_SIZE;
+		ctx->nqueuedframes--;
+		vlcwrp_atomic_store(&ctx->clock_late_frames, ctx->clock_late_frames + 1);
+		pthread_cond_signal(ctx->cond_empty);
+	}
+	if (ctx->nqueuedframes > 0)
+	{
+		info = &ctx->frame_info[ctx->ridx];
+		if (info->displayed && info->displayed <= now)
+		{
+			info->due_delay = now - info->displayed;
+			vlcwrp_atomic_store(&ctx->clock_due_delay, info->due_delay);
+			startup_mark(&ctx->startup.first_acquire);
+			return ctx->frame_queue[ctx->ridx];
+		}
+	}
+	pthread_mutex_unlock(ctx->mutex);
+	return NULL;
+}
+
+/* get VLCWRP_ABI_VERSION of the library */
+int vlcwrp_abi_version(void)
+{
+	return VLCWRP_ABI_VERSION;
+}
+
+/* acquire the next decoded frame without waiting for one and fill its descriptor */
+int vlcwrp_frame_try_acquire(struct vlcwrp_ctx_t* ctx, vlcwrp_frame_t* frame)
+{
+	const vlcwrp_frame_info_t* info;
+
+	if (frame->version != VLCWRP_ABI_VERSION || !ctx->video || ctx->try_acquired)
+		return 0;
+	vlcwrp_health_apply(ctx);
+
+	/* the decoder holds the lock only briefly, a queued frame is worth waiting for it */
+	if (vlcwrp_atomic_load(&ctx->nqueuedframes) == 0)
+		return 0;
+	pthread_mutex_lock(ctx->mutex);
+	if (ctx->nqueuedframes == 0)
+	{
+		pthread_mutex_unlock(ctx->mutex);
+		return 0;
+	}
+	ctx->try_acquired = 1;
+	info = &ctx->frame_info[ctx->ridx];
+	frame->pixels = ctx->frame_queue[ctx->ridx];
+	frame->width = ctx->width;
+	frame->height = ctx->height;
+	frame->pitch = ctx->pitch;
+	frame->format = VLCWRP_FORMAT_RV32;
+	frame->seq = info->seq;
+	frame->item = info->item;
+	frame->timestamp = info->timestamp;
+	frame->displayed = info->displayed;
+	frame->time = info->time;
+	startup_mark(&ctx->startup.first_acquire);
+	return 1;
+}
+
+/* get the frame queue statistics, without locking */
+void vlcwrp_frame_stats(struct vlcwrp_ctx_t* ctx, vlcwrp_frame_stats_t* stats)
+{
+	if (stats->version != VLCWRP_ABI_VERSION)
+		return;
+	stats->queued = vlcwrp_atomic_load(&ctx->nqueuedframes);
+	stats->seq = vlcwrp_atomic_load(&ctx->seq);
+	stats->dropped = vlcwrp_atomic_load(&ctx->buffers_dropped);
+	stats->late = vlcwrp_atomic_load(&ctx->clock_late_frames);
+}
+
+/* get master clock statistics */
+void vlcwrp_clock_stats(struct vlcwrp_ctx_t* ctx, vlcwrp_clock_stats_t* stats)
+{
+	int audio;
+
+	if (stats->version != VLCWRP_ABI_VERSION)
+		return;
+	stats->time = vlcwrp_clock_time(ctx, &audio);
+	stats->audio = audio;
+	stats->audio_lag = stats->audio ? vlcwrp_atomic_load(&ctx->clock_audio_lag) : 0;
+	stats->due_delay = vlcwrp_atomic_load(&ctx->clock_due_delay);
+	stats->late_frames = vlcwrp_atomic_load(&ctx->clock_late_frames);
+}
+
+/* get the startup timestamps of the player */
+void vlcwrp_startup_profile(struct vlcwrp_ctx_t* ctx, vlcwrp_startup_t* startup)
+{
+	startup->create = ctx->startup.create;
+	startup->instance = ctx->startup.instance;
+	startup->player = ctx->startup.player;
+	startup->media = vlcwrp_atomic_load(&ctx->startup.media);
+	startup->play = vlcwrp_atomic_load(&ctx->startup.play);
+	startup->opening = vlcwrp_atomic_load(&ctx->startup.opening);
+	startup->buffering = vlcwrp_atomic_load(&ctx->startup.buffering);
+	startup->playing = vlcwrp_atomic_load(&ctx->startup.playing);
+	startup->vout = vlcwrp_atomic_load(&ctx->startup.vout);
+	startup->first_lock = vlcwrp_atomic_load(&ctx->startup.first_lock);
+	startup->first_unlock = vlcwrp_atomic_load(&ctx->startup.first_unlock);
+	startup->first_acquire = vlcwrp_atomic_load(&ctx->startup.first_acquire);
+}
+
+/* get information of the acquired frame */
+const vlcwrp_frame_info_t* vlcwrp_frame_info(struct vlcwrp_ctx_t* ctx)
+{
+	if (ctx->nqueuedframes > 0)
+		return &ctx->frame_info[ctx->ridx];
+	return NULL;
+}
+
+/* queues the frame at the publish index, called with ctx->mutex locked */
+void vlcwrp_queue_frame(struct vlcwrp_ctx_t* ctx)
+{
+	/* publish to the out-of-process readers */
+	if (ctx->export)
+		vlcwrp_export_publish(ctx, ctx->pidx);
+
+	/* advance queue publish index */
+	ctx->pidx = (ctx->pidx + 1) % QUEUE_SIZE;
+
+	/* increment queued frames number */
+	if (ctx->nqueuedframes < QUEUE_SIZE)
+		ctx->nqueuedframes++;
+
+	/* signal the queue is not empty */
+	pthread_cond_signal(ctx->cond_full);
+	vlcwrp_wait_notify(ctx);
+}
+
+/*
+ * extrapolates the media time of frame seq from the input time, called with ctx->mutex locked
+ * libvlc_media_player_get_time advances every few frames only, the frames
+ * of a run are timed from its first one and the frame duration
+ */
+static long long frame_time(struct vlcwrp_ctx_t* ctx, unsigned int seq, long long time)
+{
+	long long interval = ctx->time_interval ? ctx->time_interval : FRAME_INTERVAL;
+	long long expected, input = ctx->time_input;
+
+	ctx->time_input = time;
+	if (ctx->time_base >= 0 && seq == ctx->time_last_seq + 1)
+	{
+		expected = ctx->time_base + ((long long)(seq - ctx->time_base_seq) * interval + 500) / 1000;
+		if (expected - time <= FRAME_RESYNC && time - expected <= FRAME_RESYNC)
+		{
+			if (time != input)
+			{
+				/* the input time just advanced, it is the freshest position of the media */
+				if (ctx->time_run < 0)
+				{
+					ctx->time_run = time;
+					ctx->time_run_seq = seq;
+				}
+				else if (!ctx->time_fps && seq - ctx->time_run_seq >= FRAME_MEASURE && time > ctx->time_run)
+				{
+					/* without the media frame rate the duration is measured between the advances,
+					   the frames timed with the assumed duration are timed again from the input time */
+					if (!ctx->time_interval)
+						expected = time;
+					ctx->time_interval = (time - ctx->time_run) * 1000 / (seq - ctx->time_run_seq);
+					ctx->time_base = expected;
+					ctx->time_base_seq = seq;
+				}
+				/* the extrapolation never trails the input time */
+				if (expected < time)
+				{
+					expected = ctx->time_base = time;
+					ctx->time_base_seq = seq;
+				}
+			}
+			if (expected <= ctx->time_last)
+				expected = ctx->time_last + 1;
+			ctx->time_last = expected;
+			ctx->time_last_seq = seq;
+			return expected;
+		}
+	}
+
+	/* a new play, a seek or a drift starts a new run, measured from the next input advance */
+	ctx->time_base = ctx->time_last = ctx->time_input = time;
+	ctx->time_base_seq = ctx->time_last_seq = seq;
+	ctx->time_run = -1;
+	return time;
+}
+
 /* VLC media player callbacks */
 
+/* startupcb called by the VLC event thread on the timed state transitions */
+static void startupcb(const struct libvlc_event_t *ev, void *opaque)
+{
+	struct vlcwrp_ctx_t *ctx = (struct vlcwrp_ctx_t *)opaque;
+	switch (ev->type)
+	{
+	case libvlc_MediaPlayerOpening: startup_mark(&ctx->startup.opening); break;
+	case libvlc_MediaPlayerBuffering: startup_mark(&ctx->startup.buffering); break;
+	case libvlc_MediaPlayerPlaying: startup_mark(&ctx->startup.playing); break;
+	case libvlc_MediaPlayerVout: startup_mark(&ctx->startup.vout); break;
+	default: break;
+	}
+}
+
+/* times the state transitions and the video output creation of mp */
+void vlcwrp_startup_attach(struct vlcwrp_ctx_t* ctx, libvlc_media_player_t* mp)
+{
+	libvlc_event_manager_t* events = libvlc_media_player_event_manager(mp);
+	libvlc_event_attach(events, libvlc_MediaPlayerOpening, startupcb, ctx);
+	libvlc_event_attach(events, libvlc_MediaPlayerBuffering, startupcb, ctx);
+	libvlc_event_attach(events, libvlc_MediaPlayerPlaying, startupcb, ctx);
+	libvlc_event_attach(events, libvlc_MediaPlayerVout, startupcb, ctx);
+}
+
+/* stops timing the state transitions of mp */
+void vlcwrp_startup_detach(struct vlcwrp_ctx_t* ctx, libvlc_media_player_t* mp)
+{
+	libvlc_event_manager_t* events = libvlc_media_player_event_manager(mp);
+	libvlc_event_detach(events, libvlc_MediaPlayerOpening, startupcb, ctx);
+	libvlc_event_detach(events, libvlc_MediaPlayerBuffering, startupcb, ctx);
+	libvlc_event_detach(events, libvlc_MediaPlayerPlaying, startupcb, ctx);
+	libvlc_event_detach(events, libvlc_MediaPlayerVout, startupcb, ctx);
+}
+
 /* lockcb called when VLC wants buffer to decode new video frame */
-static void *lockcb(void *opaque, void **p_pixels)
+void *vlcwrp_lockcb(void *opaque, void **p_pixels)
 {
 	struct vlcwrp_ctx_t *ctx = (struct vlcwrp_ctx_t *)opaque;
+	long long blocked = 0;
+	int occupancy;
 	log("lockcb lock stop=%d, qf=%d\n", ctx->requested_stop, ctx->nqueuedframes);
+
+	/* the decoder thread is placed before the frames are bound to its node */
+	vlcwrp_threads_enter(ctx, VLCWRP_THREAD_VIDEO);
+
+	/* the frames are moved next to the decoder once per play */
+	if (vlcwrp_atomic_load(&ctx->buffers_bind) && vlcwrp_atomic_exchange(&ctx->buffers_bind, 0))
+		vlcwrp_buffers_bind(ctx);
 	pthread_mutex_lock(ctx->mutex);
-	while (!ctx->requested_stop && ctx->nqueuedframes == QUEUE_SIZE)
+	occupancy = ctx->nqueuedframes + ctx->npendingframes;
+	while (!ctx->requested_stop && ctx->nqueuedframes + ctx->npendingframes == QUEUE_SIZE)
 	{
+		if (ctx->adaptive && vlcwrp_adaptive_drop(ctx))
+			break;
+		if (ctx->adaptive && !blocked)
+			blocked = vlcwrp_clock();
 		printf("waiting on cond_empty\n");
 		pthread_cond_wait(ctx->cond_empty, ctx->mutex);
 		printf("cond_empty signaled stop=%d qf=%d\n", ctx->requested_stop, ctx->nqueuedframes);
 	}
+	/* the time blocked on the consumer drives the decode quality */
+	if (ctx->adaptive)
+		vlcwrp_adaptive_sample(ctx, occupancy, blocked ? vlcwrp_clock() - blocked : 0);
+	/* over the arena budget the decoder waits for a frame to be released, unless stopping */
+	while (vlcwrp_buffers_get(ctx, ctx->widx, ctx->requested_stop))
+	{
+		struct timespec deadline;
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_nsec += BUFFERS_RETRY * 1000000L;
+		if (deadline.tv_nsec >= 1000000000)
+		{
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000;
+		}
+		pthread_cond_timedwait(ctx->cond_empty, ctx->mutex, &deadline);
+	}
+	startup_mark(&ctx->startup.first_lock);
+
 	/* get buffer from queue at the current write index */
 	*p_pixels = ctx->frame_queue[ctx->widx];
+	ctx->frame_info[ctx->widx].displayed = 0;
+	if (ctx->export)
+		vlcwrp_export_begin(ctx, ctx->widx);
 	log("lockcb lock\n");
 	pthread_mutex_unlock(ctx->mutex);
-	return NULL;
+
+	/* the picture id identifies the slot in displaycb */
+	return (void*)(intptr_t)(ctx->widx + 1);
 }
 
 /* unlockcb called when VLC finished decoding new video frame */
-static void unlockcb(void *opaque, void *id, void *const *p_pixels)
+void vlcwrp_unlockcb(void *opaque, void *id, void *const *p_pixels)
 {
 	struct vlcwrp_ctx_t *ctx = (struct vlcwrp_ctx_t *)opaque;
+	struct vlcwrp_recorder_ctx_t* rec;
+	struct vlcwrp_cache_ctx_t* cache;
+	vlcwrp_frame_info_t* info;
+	unsigned char* pixels;
+	unsigned int seq;
+	long long timestamp, time;
+	float fps;
+	int idx, settled = 0;
+
+	startup_mark(&ctx->startup.first_unlock);
+
+	/* the slot is only written by this thread until queued, the overlays are blended unlocked */
+	if (vlcwrp_atomic_load(&ctx->overlay))
+		vlcwrp_overlay_blend(ctx, (unsigned char*)p_pixels[0]);
+
+	/* the input time and frame rate are read before locking, libvlc takes its own locks */
+	time = vlcwrp_atomic_load(&ctx->cache) || vlcwrp_atomic_load(&ctx->seek) ? libvlc_media_player_get_time(ctx->mp) : -1;
+	fps = time >= 0 && !vlcwrp_atomic_load(&ctx->time_fps) ? libvlc_media_player_get_fps(ctx->mp) : 0;
 	log("unlockcb lock\n");
 	pthread_mutex_lock(ctx->mutex);
+	if (fps > 0)
+	{
+		/* the run goes on from the last frame with the media frame duration */
+		ctx->time_interval = (long long)(1000000 / fps);
+		ctx->time_base = ctx->time_last;
+		ctx->time_base_seq = ctx->time_last_seq;
+		vlcwrp_atomic_store(&ctx->time_fps, 1);
+	}
+
+	/* stamp the decoded frame */
+	idx = ctx->widx;
+	info = &ctx->frame_info[idx];
+	info->seq = seq = ctx->seq++;
+	info->timestamp = timestamp = vlcwrp_clock();
+	if (ctx->frame_seek_gen != ctx->seek_gen && time >= 0 && time != ctx->seek_input
+	 && llabs(time - ctx->seek_target) <= llabs(time - ctx->seek_input))
+	{
+		/* the input time moved nearer the seek target than the position the seek was issued at */
+		ctx->frame_seek_gen = ctx->seek_gen;
+		ctx->time_base = -1;
+		settled = 1;
+	}
+	info->seek_gen = ctx->frame_seek_gen;
+	if (time >= 0)
+		time = frame_time(ctx, seq, time);
+	info->time = time;
+	vlcwrp_playlist_frame(ctx, info);
+	info->analytics.analyzed = 0;
+	rec = vlcwrp_recorder_use(ctx);
+	cache = vlcwrp_cache_use(ctx);
+	pixels = ctx->frame_queue[idx];
+
+	/* the frame is kept in its slot until copied */
+	if (rec || cache)
+		vlcwrp_atomic_store(&ctx->copy_slot, idx + 1);
+
+	/* a decimated frame is not queued, the slot is written again by the next frame */
+	if (!ctx->adaptive || info->item_start || !vlcwrp_adaptive_skip(ctx))
+	{
+		if (ctx->analytics)
+		{
+			/* the frame is queued by the analytics workers when analysed */
+			ctx->npendingframes++;
+			vlcwrp_analytics_submit(ctx, ctx->widx);
+		}
+		else
+		{
+			vlcwrp_queue_frame(ctx);
+		}
 
-	/* advance queue write index */
-	ctx->widx = (ctx->widx + 1) % QUEUE_SIZE;
+		/* advance queue write index */
+		ctx->widx = (ctx->widx + 1) % QUEUE_SIZE;
+	}
 
-	/* increment queued frames number */
-	if (ctx->nqueuedframes < QUEUE_SIZE)
-		ctx->nqueuedframes++;
+	if (settled)
+		vlcwrp_seek_settled(ctx, ctx->frame_seek_gen);
 
-	/* signal the queue is not empty */
-	pthread_cond_signal(ctx->cond_full);
-	log("unlockcb signal cond_full qf=%d widx=%d\n", ctx->nqueuedframes, ctx->widx);
+	log("unlockcb qf=%d pf=%d widx=%d\n", ctx->nqueuedframes, ctx->npendingframes, ctx->widx);
 	pthread_mutex_unlock(ctx->mutex);
+
+	/* the slot is only written again by this thread, the copy runs unlocked */
+	if (rec)
+		vlcwrp_recorder_frame(rec, pixels, seq, timestamp);
+	if (cache)
+		vlcwrp_cache_insert(cache, pixels, seq, timestamp, time);
+	if (rec || cache)
+		vlcwrp_atomic_store(&ctx->copy_slot, 0);
 }
 
 /* displaycb called by VLC at the time ready to display a frame */
-static void displaycb(void *opaque, void *id)
+void vlcwrp_displaycb(void *opaque, void *id)
 {
+	struct vlcwrp_ctx_t *ctx = (struct vlcwrp_ctx_t *)opaque;
+	int idx = (int)(intptr_t)id - 1;
+	if (idx >= 0 && idx < QUEUE_SIZE)
+	{
+		/* VLC displays the frame when its presentation time is reached */
+		pthread_mutex_lock(ctx->mutex);
+		ctx->frame_info[idx].displayed = libvlc_clock();
+		pthread_mutex_unlock(ctx->mutex);
+	}
 }
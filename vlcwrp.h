@@ -32,11 +32,18 @@
 #define VLCWRP_API
 #endif
 
+#include <stdint.h>
+
+#include "vlcwrp_export.h"
+
 /**
  * VLC wrapper context type
  */
 struct vlcwrp_ctx_t;
 
+/** maximum number of audio channels delivered by the audio callbacks */
+#define VLCWRP_AUDIO_MAX_CHANNELS 8
+
 /**
  * VLC status enumeration
  */
@@ -50,9 +57,911 @@ typedef enum {
 	VLC_ERROR
 } vlc_state_t;
 
-/* get last VLC error message and clear the message, returns NULL if no error */
+/** number of luma histogram bins computed by the frame analytics */
+#define VLCWRP_HISTOGRAM_BINS 32
+
+/**
+ * frame analytics results
+ */
+typedef struct {
+	/* non zero if the frame has been analysed */
+	int analyzed;
+
+	/* mean and variance of the frame luma (0-255) */
+	float luma_mean;
+	float luma_variance;
+
+	/* mean absolute luma difference to the previous frame (0-255) */
+	float diff;
+
+	/* luma histogram distance to the previous frame (0-1) */
+	float hist_distance;
+
+	/* detection flags */
+	int black;
+	int frozen;
+	int scene_change;
+
+	/* subsampled luma histogram */
+	unsigned int histogram[VLCWRP_HISTOGRAM_BINS];
+} vlcwrp_frame_analytics_t;
+
+/**
+ * decoded frame information
+ */
+typedef struct {
+	/* frame sequence number since the last play */
+	unsigned int seq;
+
+	/* monotonic time in microseconds the frame was decoded */
+	long long timestamp;
+
+	/* libvlc clock time in microseconds VLC displayed the frame, 0 until displayed */
+	long long displayed;
+
+	/* media time of the frame in milliseconds, extrapolated per frame from the input time, -1 if unknown */
+	long long time;
+
+	/* playlist item of the frame, 0 without playlist */
+	int item;
+
+	/* non zero on the first frame of a playlist item or of a loop restart */
+	int item_start;
+
+	/* seek generation of the frame, incremented on the first frame at the position of a seek */
+	unsigned int seek_gen;
+
+	/* master clock time minus displayed when acquired by vlcwrp_frame_acquire_due */
+	long long due_delay;
+
+	/* analytics results, valid if analytics.analyzed is set */
+	vlcwrp_frame_analytics_t analytics;
+} vlcwrp_frame_info_t;
+
+/**
+ * audio callbacks configuration
+ */
+typedef struct {
+	/* sample rate in Hz */
+	unsigned int rate;
+
+	/* number of interleaved channels, up to VLCWRP_AUDIO_MAX_CHANNELS */
+	unsigned int channels;
+
+	/* capacity of one ring buffer in samples per channel */
+	unsigned int buffer_samples;
+
+	/* number of ring buffers */
+	unsigned int buffers;
+} vlcwrp_audio_config_t;
+
+/**
+ * audio ring buffer, the samples are interleaved signed 16 bit native endian
+ */
+typedef struct {
+	/* interleaved samples */
+	const short* samples;
+
+	/* number of samples per channel */
+	unsigned int nsamples;
+
+	/* number of channels */
+	unsigned int channels;
+
+	/* presentation time stamp of the first sample in microseconds, libvlc clock */
+	long long pts;
+
+	/* per channel peak and RMS levels (0-1) */
+	float peak[VLCWRP_AUDIO_MAX_CHANNELS];
+	float rms[VLCWRP_AUDIO_MAX_CHANNELS];
+} vlcwrp_audio_buffer_t;
+
+/**
+ * audio ring statistics
+ */
+typedef struct {
+	/* number of buffers written and read */
+	unsigned long written;
+	unsigned long read;
+
+	/* number of buffers dropped because the ring was full */
+	unsigned long dropped;
+
+	/* number of buffers waiting to be read */
+	unsigned int queued;
+
+	/* number of channels */
+	unsigned int channels;
+
+	/* levels of the last written buffer */
+	float peak[VLCWRP_AUDIO_MAX_CHANNELS];
+	float rms[VLCWRP_AUDIO_MAX_CHANNELS];
+} vlcwrp_audio_stats_t;
+
+/**
+ * master clock statistics, part of the frame ABI, fixed width fields only
+ */
+typedef struct {
+	/* VLCWRP_ABI_VERSION, set by the caller */
+	int32_t version;
+
+	/* non zero if the clock is driven by the audio consumer */
+	int32_t audio;
+
+	/* master clock time in microseconds, libvlc clock */
+	int64_t time;
+
+	/* audio presentation lag added to the monotonic clock */
+	int64_t audio_lag;
+
+	/* due delay of the last frame acquired by vlcwrp_frame_acquire_due */
+	int64_t due_delay;
+
+	/* number of due frames dropped in favour of a newer one */
+	uint64_t late_frames;
+} vlcwrp_clock_stats_t;
+
+/**
+ * custom media input statistics
+ */
+typedef struct {
+	/* size of the input in bytes */
+	unsigned long long size;
+
+	/* current read position */
+	unsigned long long position;
+
+	/* number of bytes read by VLC */
+	unsigned long long bytes_read;
+
+	/* number of read calls and seeks */
+	unsigned long reads;
+	unsigned long seeks;
+
+	/* total and maximum read latency in microseconds */
+	long long read_time;
+	long long max_read_time;
+} vlcwrp_input_stats_t;
+
+/**
+ * frame analytics configuration
+ */
+typedef struct {
+	/* number of worker threads */
+	int workers;
+
+	/* analyse each step-th row of the frame */
+	int step;
+
+	/* a pixel darker than black_luma is black, a frame with black_ratio black pixels is black */
+	float black_luma;
+	float black_ratio;
+
+	/* a frame differing less than freeze_diff from the previous one is frozen */
+	float freeze_diff;
+
+	/* a histogram distance above scene_distance is a scene change */
+	float scene_distance;
+} vlcwrp_analytics_config_t;
+
+/**
+ * aggregated frame analytics
+ */
+typedef struct {
+	/* number of analysed frames */
+	unsigned long frames;
+
+	/* number of black, frozen and scene change frames */
+	unsigned long black_frames;
+	unsigned long frozen_frames;
+	unsigned long scene_changes;
+
+	/* current number of consecutive black and frozen frames */
+	unsigned long black_run;
+	unsigned long frozen_run;
+
+	/* sequence number of the last scene change frame */
+	unsigned int last_scene_change;
+
+	/* results of the last analysed frame */
+	float luma_mean;
+	float luma_variance;
+	float diff;
+
+	/* total time in microseconds spent by the workers */
+	long long busy_time;
+} vlcwrp_analytics_t;
+
+/** size of the media information meta strings including the terminating NUL */
+#define VLCWRP_META_SIZE 128
+
+/**
+ * media probe status
+ */
+typedef enum {
+	VLCWRP_PROBE_MISSING, /* the file does not exist */
+	VLCWRP_PROBE_CACHED,  /* answered from the index */
+	VLCWRP_PROBE_PARSED,  /* parsed, the index is updated */
+	VLCWRP_PROBE_RETRY    /* the parse timed out or was skipped, not indexed so the next probe parses it again */
+} vlcwrp_probe_status_t;
+
+/**
+ * media probe configuration
+ */
+typedef struct {
+	/* path of the index file, NULL to parse without caching */
+	const char* index;
+
+	/* maximum number of media parsed concurrently */
+	int concurrency;
+
+	/* parse timeout in milliseconds, -1 for the VLC default */
+	int timeout;
+
+	/* additional arguments of the VLC instance used for parsing */
+	int argc;
+	const char* const* argv;
+} vlcwrp_probe_config_t;
+
+/**
+ * media information
+ */
+typedef struct {
+	vlcwrp_probe_status_t status;
+
+	/* non zero if the media could not be parsed */
+	int failed;
+
+	/* duration in milliseconds, -1 if unknown */
+	long long duration;
+
+	/* meta data */
+	char title[VLCWRP_META_SIZE];
+	char artist[VLCWRP_META_SIZE];
+	char album[VLCWRP_META_SIZE];
+
+	/* first video track */
+	unsigned int video_codec;
+	unsigned int width;
+	unsigned int height;
+	float fps;
+
+	/* first audio track */
+	unsigned int audio_codec;
+	unsigned int channels;
+	unsigned int rate;
+
+	/* number of tracks */
+	unsigned int tracks;
+} vlcwrp_media_info_t;
+
+/**
+ * batch thumbnail configuration
+ */
+typedef struct {
+	/* thumbnail size, the frames are RV32 with a pitch of width * 4 */
+	int width;
+	int height;
+
+	/* number of players decoding concurrently */
+	int workers;
+
+	/* maximum time in milliseconds to reach the position of a file */
+	int timeout;
+
+	/* PPM output path with %d replaced by the 1-based file index, NULL to keep the frames */
+	const char* output;
+
+	/* additional arguments of the VLC instance shared by the players */
+	int argc;
+	const char* const* argv;
+} vlcwrp_thumbnail_config_t;
+
+/**
+ * thumbnail of one file
+ */
+typedef struct {
+	/* 0 on success, -1 if no frame could be decoded */
+	int status;
+
+	/* non zero if the frame is at the requested position, otherwise it is the last decoded one */
+	int exact;
+
+	/* RV32 frame, NULL if written to the output path */
+	void* pixels;
+
+	/* time of the frame in milliseconds */
+	long long time;
+} vlcwrp_thumbnail_t;
+
+/** size of the event text including the terminating NUL */
+#define VLCWRP_EVENT_TEXT_SIZE 256
+
+/**
+ * event types
+ */
+typedef enum {
+	VLCWRP_EVENT_SNAPSHOT, /* snapshot encoded, value is the snapshot id and text the path */
+	VLCWRP_EVENT_SEEK, /* seek executed, value is the time seeked to, status -1 if no frame followed */
+	VLCWRP_EVENT_QUALITY, /* adaptive quality level changed, value is the new level and text the reason */
+	VLCWRP_EVENT_HEALTH /* health state changed, value is the new state and text the reason, status -1 if stalled or failed */
+} vlcwrp_event_type_t;
+
+/**
+ * event
+ */
+typedef struct {
+	vlcwrp_event_type_t type;
+
+	/* monotonic time in microseconds the event was posted */
+	long long time;
+
+	/* 0 on success, -1 on failure */
+	int status;
+
+	/* event specific value and text */
+	long long value;
+	char text[VLCWRP_EVENT_TEXT_SIZE];
+} vlcwrp_event_t;
+
+/**
+ * snapshot formats
+ */
+typedef enum {
+	VLCWRP_SNAPSHOT_PNG,
+	VLCWRP_SNAPSHOT_JPEG
+} vlcwrp_snapshot_format_t;
+
+/**
+ * snapshot encoder statistics
+ */
+typedef struct {
+	/* number of requested, rejected because the queue was full, encoded and failed snapshots */
+	unsigned long requested;
+	unsigned long rejected;
+	unsigned long encoded;
+	unsigned long failed;
+
+	/* number of snapshots waiting for a frame or for encoding */
+	unsigned int queued;
+
+	/* total encoding time in microseconds */
+	long long encode_time;
+} vlcwrp_snapshot_stats_t;
+
+/**
+ * frame recorder policy when the writer falls behind
+ */
+typedef enum {
+	VLCWRP_RECORD_DROP, /* the frames are dropped, the decoder never waits */
+	VLCWRP_RECORD_BLOCK /* the decoder waits for a free buffer */
+} vlcwrp_record_policy_t;
+
+/**
+ * frame recorder configuration
+ */
+typedef struct {
+	vlcwrp_record_policy_t policy;
+
+	/* number of frame buffers between the decoder and the writer */
+	int buffers;
+
+	/* number of frames written with one submission, at most 16 */
+	int batch;
+} vlcwrp_record_config_t;
+
+/**
+ * frame recorder statistics
+ */
+typedef struct {
+	/* number of written and dropped frames */
+	unsigned long written;
+	unsigned long dropped;
+
+	/* number of written bytes and total write time in microseconds */
+	unsigned long long bytes;
+	long long write_time;
+
+	/* number of frames waiting to be written */
+	unsigned int queued;
+
+	/* non zero if the frames are written through io_uring */
+	int io_uring;
+} vlcwrp_record_stats_t;
+
+/**
+ * memory mapped recording
+ */
+typedef struct {
+	const void* base;
+	unsigned long long size;
+
+	/* RV32 frame size and pitch */
+	int width;
+	int height;
+	int pitch;
+
+	/* number of frames */
+	unsigned long long count;
+} vlcwrp_recording_t;
+
+/**
+ * decoded frame cache configuration
+ */
+typedef struct {
+	/* memory budget of the cached frames in bytes */
+	unsigned long long max_bytes;
+
+	/* non zero to LZ4 compress the cached frames in the background */
+	int compress;
+} vlcwrp_cache_config_t;
+
+/**
+ * decoded frame cache statistics
+ */
+typedef struct {
+	/* number of cached frames and of frames waiting for compression */
+	int frames;
+	int pending;
+
+	/* memory used by the cached frames in bytes */
+	unsigned long long bytes;
+
+	/* media time range of the cached frames in milliseconds, -1 if empty */
+	long long first;
+	long long last;
+
+	/* number of steps and seeks served from the cache and missed */
+	unsigned long hits;
+	unsigned long misses;
+} vlcwrp_cache_stats_t;
+
+/**
+ * seek modes
+ */
+typedef enum {
+	VLCWRP_SEEK_FAST, /* snaps to the nearest keyframe when the keyframe index is available */
+	VLCWRP_SEEK_ACCURATE /* decodes from the previous keyframe up to the time */
+} vlcwrp_seek_mode_t;
+
+/**
+ * seek configuration
+ */
+typedef struct {
+	/* non zero to build the keyframe index of the played files in the background */
+	int index;
+
+	/* directory persisting the keyframe indexes, NULL to keep them in memory */
+	const char* index_dir;
+} vlcwrp_seek_config_t;
+
+/**
+ * seek statistics
+ */
+typedef struct {
+	/* number of requested, executed and coalesced seeks */
+	unsigned long requested;
+	unsigned long executed;
+	unsigned long coalesced;
+
+	/* total time in microseconds from the seeks to their first frame */
+	long long seek_time;
+
+	/* number of keyframes of the current media, 0 if not indexed */
+	int keyframes;
+
+	/* non zero while the keyframe index is being built */
+	int scanning;
+} vlcwrp_seek_stats_t;
+
+/**
+ * playlist modes
+ */
+typedef enum {
+	VLCWRP_PLAYLIST_ONCE, /* the items are played once */
+	VLCWRP_PLAYLIST_LOOP /* the playlist restarts after the last item */
+} vlcwrp_playlist_mode_t;
+
+/* row alignment in bytes suited to vectorized consumers, see vlcwrp_buffer_config_t.pitch_align */
+#define VLCWRP_PITCH_ALIGN 64
+
+/**
+ * huge page backing of the frame buffers
+ */
+typedef enum {
+	VLCWRP_HUGEPAGES_OFF, /* regular pages */
+	VLCWRP_HUGEPAGES_TRANSPARENT, /* transparent huge pages are advised for frame rings of 2MB and more */
+	VLCWRP_HUGEPAGES_EXPLICIT /* reserved huge pages, transparent ones if none are reserved */
+} vlcwrp_hugepages_t;
+
+/**
+ * frame buffers configuration
+ */
+typedef struct {
+	/* huge page backing */
+	vlcwrp_hugepages_t hugepages;
+
+	/* non zero to fault the pages at creation instead of during the first frames */
+	int prefault;
+
+	/* non zero to bind the buffers to the NUMA node of the decoder thread on each play */
+	int numa;
+
+	/* frames kept by the player while stopped, 1 to 3, the others return to the arena */
+	int reserve;
+
+	/* alignment in bytes of the frame rows, a power of two, 0 for packed rows of width * 4 bytes */
+	int pitch_align;
+} vlcwrp_buffer_config_t;
+
+/**
+ * process wide frame arena statistics
+ */
+typedef struct {
+	/* limit of the mapped bytes, 0 for no limit */
+	unsigned long long budget;
+
+	/* bytes mapped for frames */
+	unsigned long long mapped;
+
+	/* bytes of the frames not held by a player */
+	unsigned long long free_bytes;
+
+	/* frames refused because of the budget */
+	unsigned long failed;
+
+	/* distinct frame sizes */
+	int classes;
+
+	/* frames mapped */
+	int frames;
+
+	/* frames not held by a player */
+	int free_frames;
+} vlcwrp_arena_stats_t;
+
+/**
+ * adaptive quality configuration
+ */
+typedef struct {
+	/* sampling window in milliseconds, the level changes at most once per window */
+	int window;
+
+	/* fraction of a window the decoder may block on a full queue before the window is under pressure */
+	float block_ratio;
+
+	/* consecutive windows under pressure before degrading one level */
+	int degrade_windows;
+
+	/* consecutive windows with a drained queue before recovering one level */
+	int recover_windows;
+
+	/* highest level, at level n one decoded frame out of n + 1 is queued */
+	int max_level;
+
+	/* non zero to drop the oldest queued frame instead of blocking the decoder at the highest level */
+	int drop;
+} vlcwrp_adaptive_config_t;
+
+/**
+ * adaptive quality statistics
+ */
+typedef struct {
+	/* current and highest level, 0 queues every frame */
+	int level;
+	int max_level;
+
+	/* fraction of the last window the decoder was blocked */
+	float blocked;
+
+	/* mean queued and analysed frames over the last window */
+	float occupancy;
+
+	/* frames not queued because of the level */
+	unsigned long skipped;
+
+	/* queued frames dropped instead of blocking */
+	unsigned long dropped;
+
+	/* level changes */
+	unsigned long transitions;
+} vlcwrp_adaptive_stats_t;
+
+/**
+ * performance profiles, the options of the profile are added to each media
+ */
+typedef enum {
+	VLCWRP_PROFILE_DEFAULT, /* no option added */
+	VLCWRP_PROFILE_LOW_LATENCY, /* minimal caching and clock jitter, single threaded decoding, late frames skipped */
+	VLCWRP_PROFILE_THROUGHPUT, /* deep caching and frame threaded decoding, no frame skipped */
+	VLCWRP_PROFILE_THUMBNAIL /* no audio nor subtitles, fast seeks, single threaded software decoding */
+} vlcwrp_profile_t;
+
+/**
+ * latency probe configuration
+ */
+typedef struct {
+	/* profile of the measuring player */
+	vlcwrp_profile_t profile;
+
+	/* loopback UDP port of the generated stream */
+	int port;
+
+	/* emission time in milliseconds */
+	int duration;
+
+	/* generated frame size and rate, also the size of the measuring player frames */
+	int width;
+	int height;
+	int fps;
+
+	/* VLC video codec and bitrate in kbit/s of the generated stream */
+	const char* vcodec;
+	int bitrate;
+
+	/* arguments of the measuring player VLC instance as in vlcwrp_create */
+	int argc;
+	const char* const* argv;
+} vlcwrp_latency_config_t;
+
+/**
+ * latency probe result, times in microseconds
+ */
+typedef struct {
+	/* frames emitted and frames measured */
+	int emitted;
+	int frames;
+
+	/* from the start of the emission to the first measured frame */
+	long long first;
+
+	/* from the emission of a frame to its acquisition */
+	long long min;
+	long long mean;
+	long long p50;
+	long long p95;
+	long long max;
+} vlcwrp_latency_t;
+
+/**
+ * startup timestamps of a player, monotonic microseconds as vlcwrp_clock,
+ * 0 if the stage is not reached yet
+ */
+typedef struct {
+	/* vlcwrp_create called */
+	long long create;
+
+	/* VLC instance and media player created */
+	long long instance;
+	long long player;
+
+	/* media of the last play created and play called */
+	long long media;
+	long long play;
+
+	/* first opening, buffering and playing state since the play call */
+	long long opening;
+	long long buffering;
+	long long playing;
+
+	/* video output created */
+	long long vout;
+
+	/* first frame buffer requested and decoded */
+	long long first_lock;
+	long long first_unlock;
+
+	/* first frame acquired by the consumer */
+	long long first_acquire;
+} vlcwrp_startup_t;
+
+/**
+ * stream health states
+ */
+typedef enum {
+	VLCWRP_HEALTH_IDLE, /* not playing, or opening within the grace period */
+	VLCWRP_HEALTH_OK, /* playing within the thresholds */
+	VLCWRP_HEALTH_LOW_BITRATE, /* input bitrate under the minimum */
+	VLCWRP_HEALTH_DECODE_ERRORS, /* too many corrupted blocks and lost pictures in the last interval */
+	VLCWRP_HEALTH_STALLED, /* playing but no new frame, or no new input without video, for the stall timeout */
+	VLCWRP_HEALTH_FAILED /* the player is in the error state */
+} vlcwrp_health_state_t;
+
+/**
+ * stream health monitor configuration, times in milliseconds
+ */
+typedef struct {
+	/* sampling interval */
+	int interval;
+
+	/* time after play before the stream is judged */
+	int grace;
+
+	/* time without progress before the stream is stalled */
+	int stall_timeout;
+
+	/* minimum input bitrate in kbit/s, 0 disables */
+	int min_bitrate;
+
+	/* maximum corrupted blocks and lost pictures per interval, 0 disables */
+	int max_errors;
+
+	/*
+	 * play again a stalled or failed player, at most once per restart delay,
+	 * the thread driving the player restarts it on its next event poll or
+	 * frame acquire without an acquired frame
+	 */
+	int restart;
+	int restart_delay;
+} vlcwrp_health_config_t;
+
+/**
+ * stream health
+ */
+typedef struct {
+	vlcwrp_health_state_t state;
+
+	/* frames per second and input kbit/s over the last interval */
+	float fps;
+	float bitrate;
+
+	/* corrupted blocks and lost pictures since watched */
+	unsigned long corrupted;
+	unsigned long lost;
+
+	/* restarts requested by the monitor */
+	unsigned long restarts;
+
+	/* monotonic time in microseconds of the last state change */
+	long long since;
+} vlcwrp_health_t;
+
+/**
+ * threads entering the player callbacks
+ */
+typedef enum {
+	VLCWRP_THREAD_VIDEO, /* the VLC decoder thread calling the frame callbacks */
+	VLCWRP_THREAD_AUDIO, /* the VLC audio output thread calling the sample callbacks */
+	VLCWRP_THREAD_ROLES
+} vlcwrp_thread_role_t;
+
+/* nice value leaving the thread priority unchanged */
+#define VLCWRP_NICE_KEEP 0x7fff
+
+/**
+ * thread placement configuration
+ */
+typedef struct {
+	/* CPUs the thread may run on, bit n for CPU n, 0 leaves the affinity */
+	unsigned long long cpus;
+
+	/* nice value of the thread, -20 to 19, VLCWRP_NICE_KEEP leaves it */
+	int nice;
+
+	/* SCHED_FIFO priority 1 to 99, 0 leaves the policy, needs CAP_SYS_NICE or an rtprio limit */
+	int fifo;
+} vlcwrp_thread_config_t;
+
+/**
+ * thread statistics of a callback role
+ */
+typedef struct {
+	/* kernel thread id of the last thread entering the callbacks, 0 if none */
+	int tid;
+
+	/* CPU time of the threads entering the callbacks in microseconds, summed over the plays */
+	long long cpu_time;
+
+	/* CPU the callbacks last ran on, -1 if unknown */
+	int cpu;
+
+	/* changes of CPU between two callbacks */
+	unsigned long migrations;
+
+	/* 1 if the configuration is applied, -1 if any part failed, 0 if not applied yet */
+	int status;
+} vlcwrp_thread_stats_t;
+
+/**
+ * version of the frame ABI, the layout of vlcwrp_frame_t,
+ * vlcwrp_frame_stats_t and vlcwrp_clock_stats_t, increased on any change
+ * for the FFI bindings, the caller sets it in the version field of each
+ * and the library leaves a structure of another version unfilled
+ */
+#define VLCWRP_ABI_VERSION 2
+
+/**
+ * frame pixel formats
+ */
+typedef enum {
+	VLCWRP_FORMAT_RV32 /* VLC RV32 chroma, 4 bytes per pixel */
+} vlcwrp_format_t;
+
+/**
+ * acquired frame descriptor, part of the frame ABI, fixed width fields only
+ */
+typedef struct {
+	/* VLCWRP_ABI_VERSION, set by the caller */
+	int32_t version;
+
+	/* size in pixels and row pitch in bytes */
+	int32_t width;
+	int32_t height;
+	int32_t pitch;
+
+	/* a vlcwrp_format_t */
+	int32_t format;
+
+	/* frame sequence number since the last play */
+	uint32_t seq;
+
+	/* playlist item of the frame, 0 without playlist */
+	int32_t item;
+
+	/* first row of the frame, valid until vlcwrp_frame_release */
+	const unsigned char* pixels;
+
+	/* monotonic decode time and libvlc display time in microseconds, displayed 0 until displayed */
+	int64_t timestamp;
+	int64_t displayed;
+
+	/* media time of the frame in milliseconds, extrapolated per frame from the input time, -1 if unknown */
+	int64_t time;
+} vlcwrp_frame_t;
+
+/**
+ * frame queue statistics, part of the frame ABI, fixed width fields only
+ */
+typedef struct {
+	/* VLCWRP_ABI_VERSION, set by the caller */
+	int32_t version;
+
+	/* frames queued for the consumer */
+	int32_t queued;
+
+	/* sequence number of the next decoded frame */
+	uint32_t seq;
+
+	/* queued frames reused over the arena budget */
+	uint64_t dropped;
+
+	/* due frames dropped in favour of a newer one */
+	uint64_t late;
+} vlcwrp_frame_stats_t;
+
+/** number of overlay layers of a player, blended in layer order */
+#define VLCWRP_OVERLAY_LAYERS 8
+
+/**
+ * overlay compositing statistics
+ */
+typedef struct {
+	/* layers holding an image */
+	int layers;
+
+	/* frames with at least one visible layer and the time spent blending them in microseconds */
+	unsigned long frames;
+	long long blend_time;
+
+	/* tiles alpha blended, copied as opaque, and skipped as transparent */
+	unsigned long long tiles_blended;
+	unsigned long long tiles_copied;
+	unsigned long long tiles_skipped;
+} vlcwrp_overlay_stats_t;
+
+/**
+ * get last VLC error message of the calling thread and clear the message,
+ * returns NULL if no error
+ * the message stays valid until the next call on the same thread
+ */
 VLCWRP_API const char* vlcwrp_error(void);
 
+/**
+ * clear the VLC error message of the calling thread, called before an
+ * operation so vlcwrp_error reports only the errors of that operation
+ */
+VLCWRP_API void vlcwrp_error_clear(void);
+
 /**
  * create VLC player instance
  * argc number of string arguments to be passed to the VLC player instance
@@ -61,9 +970,36 @@ VLCWRP_API const char* vlcwrp_error(void);
  * height defines the frame height
  *
  * the pixel format is always 4 bytes - RGBA
+ *
+ * players are independent, separate threads may each drive their own
+ * players concurrently, a player is driven by one thread at a time
  */
 VLCWRP_API struct vlcwrp_ctx_t *vlcwrp_create(int argc, const char * const* argv, int width, int height);
 
+/* get the default frame buffers configuration */
+VLCWRP_API void vlcwrp_buffer_defaults(vlcwrp_buffer_config_t* config);
+
+/**
+ * create VLC player instance as vlcwrp_create with the frame buffers
+ * configuration, NULL for the defaults
+ */
+VLCWRP_API struct vlcwrp_ctx_t *vlcwrp_create_ex(int argc, const char * const* argv, int width, int height, const vlcwrp_buffer_config_t* buffers);
+
+/**
+ * get the row pitch of the frames in bytes, width * 4 unless the buffers
+ * configuration aligns the rows, the frames start 4096 byte aligned
+ */
+VLCWRP_API int vlcwrp_frame_pitch(struct vlcwrp_ctx_t* ctx);
+
+/**
+ * create VLC player instance without video
+ * no frame queue is allocated, no video callbacks are set and video
+ * decoding is disabled on the played media
+ * audio optionally sets the audio callbacks, see vlcwrp_audio_start,
+ * can be NULL to leave the audio to the VLC audio output
+ */
+VLCWRP_API struct vlcwrp_ctx_t *vlcwrp_create_no_video(int argc, const char * const* argv, const vlcwrp_audio_config_t* audio);
+
 /** destroy VLC player instance */
 VLCWRP_API void vlcwrp_destroy(struct vlcwrp_ctx_t* ctx);
 
@@ -93,4 +1029,424 @@ VLCWRP_API void* vlcwrp_frame_acquire(struct vlcwrp_ctx_t* ctx);
  */
 VLCWRP_API void vlcwrp_frame_release(struct vlcwrp_ctx_t* ctx);
 
+/**
+ * get the master clock time in microseconds, in the libvlc clock domain
+ * the clock follows the pts of the audio buffers as they are acquired when
+ * the audio callbacks are set, otherwise it is the monotonic clock
+ * audio is set to non zero if the clock is audio driven, can be NULL
+ */
+VLCWRP_API long long vlcwrp_clock_time(struct vlcwrp_ctx_t* ctx, int* audio);
+
+/**
+ * acquire the latest frame due according to the master clock, a frame is
+ * due once VLC displayed it at a time not after the master clock time
+ * older due frames and frames VLC dropped without displaying are skipped,
+ * returns NULL if no frame is due yet
+ * the frame must be released with vlcwrp_frame_release
+ */
+VLCWRP_API void* vlcwrp_frame_acquire_due(struct vlcwrp_ctx_t* ctx);
+
+/** get master clock statistics */
+VLCWRP_API void vlcwrp_clock_stats(struct vlcwrp_ctx_t* ctx, vlcwrp_clock_stats_t* stats);
+
+/**
+ * get information of the acquired frame
+ * must be called between vlcwrp_frame_acquire and vlcwrp_frame_release
+ */
+VLCWRP_API const vlcwrp_frame_info_t* vlcwrp_frame_info(struct vlcwrp_ctx_t* ctx);
+
+/** fill config with the default frame analytics configuration */
+VLCWRP_API void vlcwrp_analytics_defaults(vlcwrp_analytics_config_t* config);
+
+/**
+ * start analysing decoded frames on a pool of worker threads
+ * config can be NULL to use the defaults
+ * the player must be stopped, returns 0 on success
+ */
+VLCWRP_API int vlcwrp_analytics_start(struct vlcwrp_ctx_t* ctx, const vlcwrp_analytics_config_t* config);
+
+/** stop the frame analytics, the frames still in analysis are queued unanalysed */
+VLCWRP_API void vlcwrp_analytics_stop(struct vlcwrp_ctx_t* ctx);
+
+/** get the aggregated frame analytics, returns 0 if the analytics is not started */
+VLCWRP_API int vlcwrp_analytics(struct vlcwrp_ctx_t* ctx, vlcwrp_analytics_t* analytics);
+
+/** fill config with the default audio callbacks configuration */
+VLCWRP_API void vlcwrp_audio_defaults(vlcwrp_audio_config_t* config);
+
+/**
+ * deliver decoded audio to a lock-free ring instead of the audio output
+ * config can be NULL to use the defaults
+ * must be called before play, returns 0 on success
+ */
+VLCWRP_API int vlcwrp_audio_start(struct vlcwrp_ctx_t* ctx, const vlcwrp_audio_config_t* config);
+
+/**
+ * acquire the oldest audio buffer from the ring
+ * returns NULL if the ring is empty
+ * the buffer is valid until vlcwrp_audio_release
+ */
+VLCWRP_API const vlcwrp_audio_buffer_t* vlcwrp_audio_acquire(struct vlcwrp_ctx_t* ctx);
+
+/** release the acquired audio buffer */
+VLCWRP_API void vlcwrp_audio_release(struct vlcwrp_ctx_t* ctx);
+
+/** get audio ring statistics, returns 0 if the audio callbacks are not set */
+VLCWRP_API int vlcwrp_audio_stats(struct vlcwrp_ctx_t* ctx, vlcwrp_audio_stats_t* stats);
+
+/**
+ * play media from memory
+ * the data is read in place and must stay valid until the player plays
+ * another media or is destroyed, returns 0 on success
+ */
+VLCWRP_API int vlcwrp_play_memory(struct vlcwrp_ctx_t* ctx, const void* data, unsigned long long size);
+
+/**
+ * play local file through a sequential read-ahead memory mapping
+ * returns 0 on success
+ */
+VLCWRP_API int vlcwrp_play_mmap(struct vlcwrp_ctx_t* ctx, const char* path);
+
+/** get custom media input statistics, returns 0 if not playing a custom input */
+VLCWRP_API int vlcwrp_input_stats(struct vlcwrp_ctx_t* ctx, vlcwrp_input_stats_t* stats);
+
+/** fill config with the default media probe configuration */
+VLCWRP_API void vlcwrp_probe_defaults(vlcwrp_probe_config_t* config);
+
+/**
+ * probe media information of local files
+ * the information is answered from the memory mapped index while the file
+ * size and modification time match, the other files are parsed concurrently
+ * and the index is rewritten with the completed and the failed parses
+ * infos is an array of npaths media information filled in the paths order
+ * returns the number of parsed files or -1 on error
+ */
+VLCWRP_API int vlcwrp_probe(const vlcwrp_probe_config_t* config, const char* const* paths, int npaths, vlcwrp_media_info_t* infos);
+
+/** fill config with the default thumbnail configuration */
+VLCWRP_API void vlcwrp_thumbnail_defaults(vlcwrp_thumbnail_config_t* config);
+
+/**
+ * extract thumbnails of a batch of files on a pool of players
+ * positions holds the position of each file between 0 and 1
+ * thumbs is an array of count thumbnails filled in the files order
+ * returns the number of extracted thumbnails or -1 on error
+ */
+VLCWRP_API int vlcwrp_thumbnails(const vlcwrp_thumbnail_config_t* config, const char* const* files, const float* positions, int count, vlcwrp_thumbnail_t* thumbs);
+
+/** release the thumbnail frames */
+VLCWRP_API void vlcwrp_thumbnails_free(vlcwrp_thumbnail_t* thumbs, int count);
+
+/**
+ * poll the next event
+ * returns 1 and fills event if there is one, 0 otherwise
+ */
+VLCWRP_API int vlcwrp_event_poll(struct vlcwrp_ctx_t* ctx, vlcwrp_event_t* event);
+
+/** get the number of events dropped because the queue was full */
+VLCWRP_API unsigned long vlcwrp_events_dropped(struct vlcwrp_ctx_t* ctx);
+
+/**
+ * request a snapshot of the next released frame
+ * the frame is copied on vlcwrp_frame_release into a frame of the arena
+ * and encoded on a background thread, completion is posted as a
+ * VLCWRP_EVENT_SNAPSHOT event, over the arena budget the snapshot waits
+ * for a later frame while another copy is in use
+ * quality is from 0 to 100, the JPEG quality, or for the lossless PNG the
+ * compression effort, zlib level quality * 9 / 100 rounded, 100 is the
+ * smallest and slowest
+ * returns the snapshot id or -1 if the snapshot queue is full
+ */
+VLCWRP_API int vlcwrp_snapshot(struct vlcwrp_ctx_t* ctx, const char* path, vlcwrp_snapshot_format_t format, int quality);
+
+/** get snapshot encoder statistics, returns 0 if no snapshot was requested */
+VLCWRP_API int vlcwrp_snapshot_stats(struct vlcwrp_ctx_t* ctx, vlcwrp_snapshot_stats_t* stats);
+
+/** fill config with the default recorder configuration */
+VLCWRP_API void vlcwrp_record_defaults(vlcwrp_record_config_t* config);
+
+/**
+ * start recording the decoded frames to path
+ * the frames are copied on the decoder thread and written by a writer thread
+ * with O_DIRECT, batched through io_uring when available
+ * config can be NULL to use the defaults, returns 0 on success
+ * must not be called between vlcwrp_frame_acquire and vlcwrp_frame_release
+ */
+VLCWRP_API int vlcwrp_record_start(struct vlcwrp_ctx_t* ctx, const char* path, const vlcwrp_record_config_t* config);
+
+/**
+ * stop recording, the queued frames and the index are written
+ * returns 0 if the recording is complete
+ * must not be called between vlcwrp_frame_acquire and vlcwrp_frame_release
+ */
+VLCWRP_API int vlcwrp_record_stop(struct vlcwrp_ctx_t* ctx);
+
+/**
+ * get recorder statistics, returns 0 if not recording
+ * may be called between vlcwrp_frame_acquire and vlcwrp_frame_release
+ */
+VLCWRP_API int vlcwrp_record_stats(struct vlcwrp_ctx_t* ctx, vlcwrp_record_stats_t* stats);
+
+/** open a recording for replay, returns 0 on success */
+VLCWRP_API int vlcwrp_recording_open(const char* path, vlcwrp_recording_t* recording);
+
+/**
+ * get frame i of the recording with its sequence number and timestamp
+ * returns NULL if out of range, the frame is valid until the recording is closed
+ */
+VLCWRP_API const void* vlcwrp_recording_frame(const vlcwrp_recording_t* recording, unsigned long long i, unsigned int* seq, long long* timestamp);
+
+/** close a recording */
+VLCWRP_API void vlcwrp_recording_close(vlcwrp_recording_t* recording);
+
+/**
+ * export the frame ring in the POSIX shared memory segment name, see
+ * vlcwrp_export.h for the layout and the reader
+ * VLC decodes directly into the segment and the readers never block the
+ * player, the local frame queue is unchanged and paces the decoder, a
+ * player not consuming its frames locally drops them with the adaptive
+ * quality drop option
+ * an existing segment is only replaced if its player is gone
+ * the player must be stopped, returns 0 on success or -1 if the segment
+ * is in use
+ */
+VLCWRP_API int vlcwrp_export_start(struct vlcwrp_ctx_t* ctx, const char* name);
+
+/** stop the frame export and remove the segment, the player must be stopped */
+VLCWRP_API void vlcwrp_export_stop(struct vlcwrp_ctx_t* ctx);
+
+/** fill config with the default frame cache configuration */
+VLCWRP_API void vlcwrp_cache_defaults(vlcwrp_cache_config_t* config);
+
+/**
+ * start caching the decoded frames by media time for frame stepping and
+ * backward scrubbing, the cache is cleared when the media changes
+ * returns 0 on success
+ */
+VLCWRP_API int vlcwrp_cache_start(struct vlcwrp_ctx_t* ctx, const vlcwrp_cache_config_t* config);
+
+/** stop caching and release the cached frames */
+VLCWRP_API void vlcwrp_cache_stop(struct vlcwrp_ctx_t* ctx);
+
+/**
+ * step delta frames from the last decoded or served frame, the player should be paused
+ * returns the cached frame, valid until the next cache call, or NULL if not cached
+ * stepping forward past the newest cached frame decodes the next frame,
+ * it is delivered by vlcwrp_frame_acquire
+ * info is filled with the frame information if not NULL
+ */
+VLCWRP_API const void* vlcwrp_cache_step(struct vlcwrp_ctx_t* ctx, int delta, vlcwrp_frame_info_t* info);
+
+/**
+ * get the cached frame displayed at media time in milliseconds
+ * returns the frame, valid until the next cache call, or NULL if the time
+ * is not cached and the player has to seek
+ */
+VLCWRP_API const void* vlcwrp_cache_seek(struct vlcwrp_ctx_t* ctx, long long time, vlcwrp_frame_info_t* info);
+
+/** get frame cache statistics, returns 0 if the cache is not started */
+VLCWRP_API int vlcwrp_cache_stats(struct vlcwrp_ctx_t* ctx, vlcwrp_cache_stats_t* stats);
+
+/** fill config with the default seek configuration */
+VLCWRP_API void vlcwrp_seek_defaults(vlcwrp_seek_config_t* config);
+
+/**
+ * start the seek thread, the keyframe index is built when a file is played
+ * MP4 and MPEG-TS files are indexed, returns 0 on success
+ */
+VLCWRP_API int vlcwrp_seek_start(struct vlcwrp_ctx_t* ctx, const vlcwrp_seek_config_t* config);
+
+/** stop the seek thread and the keyframe scanner */
+VLCWRP_API void vlcwrp_seek_stop(struct vlcwrp_ctx_t* ctx);
+
+/**
+ * seek to time in milliseconds, the seek is executed asynchronously and
+ * a request made while a seek is in flight replaces the pending one
+ * the seek thread is started without keyframe index if not started
+ * returns 0 on success
+ */
+VLCWRP_API int vlcwrp_seek(struct vlcwrp_ctx_t* ctx, long long time, vlcwrp_seek_mode_t mode);
+
+/** get the indexed keyframe nearest to time in milliseconds, -1 if not indexed */
+VLCWRP_API long long vlcwrp_seek_keyframe(struct vlcwrp_ctx_t* ctx, long long time);
+
+/** get seek statistics, returns 0 if the seek thread is not started */
+VLCWRP_API int vlcwrp_seek_stats(struct vlcwrp_ctx_t* ctx, vlcwrp_seek_stats_t* stats);
+
+/**
+ * play the files of paths in order without gaps, the next item is prerolled
+ * paused in a second player that takes over the frame ring when the current
+ * item ends, the first frame of each item is marked in the frame information
+ * a single looping item is prerolled the same way and loops indefinitely
+ * the playlist is released by vlcwrp_stop, returns 0 on success
+ */
+VLCWRP_API int vlcwrp_play_playlist(struct vlcwrp_ctx_t* ctx, const char* const* paths, int npaths, vlcwrp_playlist_mode_t mode);
+
+/** get the playlist item of the decoded frames, -1 without playlist */
+VLCWRP_API int vlcwrp_playlist_item(struct vlcwrp_ctx_t* ctx);
+
+/**
+ * get the ready token of the player without blocking, the token changes
+ * on each decoded frame, posted event and stop
+ * ready is set non zero if a frame or an event is available already,
+ * taking the token before checking for frames does not miss a frame
+ */
+VLCWRP_API unsigned int vlcwrp_ready_token(struct vlcwrp_ctx_t* ctx, int* ready);
+
+/**
+ * wait until the ready token of any of the n players differs from tokens,
+ * NULL players are skipped
+ * timeout in milliseconds, 0 polls and negative waits forever
+ * returns the number of ready players, 0 on timeout
+ */
+VLCWRP_API int vlcwrp_wait_ready(struct vlcwrp_ctx_t* const* ctxs, const unsigned int* tokens, int n, int timeout);
+
+/**
+ * limit the bytes mapped for frames by all the players of the process,
+ * 0 for no limit, the default
+ * the players share the frames of the same size through the arena, a
+ * player over the budget reuses its oldest queued frame and creating a
+ * player fails if its reserved frames do not fit, the frames of a size
+ * are unmapped when the last player of that size is destroyed
+ */
+VLCWRP_API void vlcwrp_arena_configure(unsigned long long budget);
+
+/* get the process wide frame arena statistics */
+VLCWRP_API void vlcwrp_arena_stats(vlcwrp_arena_stats_t* stats);
+
+/** fill config with the default adaptive quality configuration */
+VLCWRP_API void vlcwrp_adaptive_defaults(vlcwrp_adaptive_config_t* config);
+
+/**
+ * start the adaptive quality controller, when the consumer does not keep
+ * up the decoder queues fewer frames instead of blocking VLC and recovers
+ * when the load drops, each level change is posted as a
+ * VLCWRP_EVENT_QUALITY event
+ * the vmem resolution and the codec frame skipping are fixed once the
+ * media is opened, the level decimates the decoded frames
+ * returns 0 on success
+ */
+VLCWRP_API int vlcwrp_adaptive_start(struct vlcwrp_ctx_t* ctx, const vlcwrp_adaptive_config_t* config);
+
+/** stop the adaptive quality controller, not while a frame is acquired */
+VLCWRP_API void vlcwrp_adaptive_stop(struct vlcwrp_ctx_t* ctx);
+
+/** get adaptive quality statistics, returns 0 if the controller is not started */
+VLCWRP_API int vlcwrp_adaptive_stats(struct vlcwrp_ctx_t* ctx, vlcwrp_adaptive_stats_t* stats);
+
+/**
+ * set the performance profile applied to the media played next,
+ * the media options of the profile override the VLC arguments
+ */
+VLCWRP_API void vlcwrp_set_profile(struct vlcwrp_ctx_t* ctx, vlcwrp_profile_t profile);
+
+/** fill config with the default latency probe configuration */
+VLCWRP_API void vlcwrp_latency_defaults(vlcwrp_latency_config_t* config);
+
+/**
+ * measure the glass-to-glass latency of a live stream, a generated clip
+ * carrying a frame counter is encoded and streamed over loopback UDP into
+ * a player created with the configured arguments and profile, the time
+ * from the emission of each frame to its acquisition is measured
+ * blocks for the emission time plus one second
+ * returns 0 on success, -1 if no frame was measured
+ */
+VLCWRP_API int vlcwrp_latency_probe(const vlcwrp_latency_config_t* config, vlcwrp_latency_t* result);
+
+/**
+ * get the startup timestamps of the player, the stages from the play call
+ * on are taken again on each play
+ */
+VLCWRP_API void vlcwrp_startup_profile(struct vlcwrp_ctx_t* ctx, vlcwrp_startup_t* startup);
+
+/** fill config with the default health monitor configuration */
+VLCWRP_API void vlcwrp_health_defaults(vlcwrp_health_config_t* config);
+
+/**
+ * monitor the health of the player, one background thread samples all the
+ * watched players against the thresholds, each state change is posted as
+ * a VLCWRP_EVENT_HEALTH event, the monitor never drives the player
+ * returns 0 on success
+ */
+VLCWRP_API int vlcwrp_health_watch(struct vlcwrp_ctx_t* ctx, const vlcwrp_health_config_t* config);
+
+/** stop monitoring the health of the player */
+VLCWRP_API void vlcwrp_health_unwatch(struct vlcwrp_ctx_t* ctx);
+
+/** get the health of the player, returns 0 if the player is not watched */
+VLCWRP_API int vlcwrp_health(struct vlcwrp_ctx_t* ctx, vlcwrp_health_t* health);
+
+/** get the name of a health state */
+VLCWRP_API const char* vlcwrp_health_name(vlcwrp_health_state_t state);
+
+/** fill config with a configuration leaving the thread unchanged */
+VLCWRP_API void vlcwrp_thread_defaults(vlcwrp_thread_config_t* config);
+
+/**
+ * set the CPU affinity and priority of the threads entering the player
+ * callbacks of role, applied by the thread on its next callback and again
+ * on each play
+ * VLC threads not entering the callbacks, such as the frame threaded
+ * decoder workers, are not placed
+ */
+VLCWRP_API void vlcwrp_thread_config(struct vlcwrp_ctx_t* ctx, vlcwrp_thread_role_t role, const vlcwrp_thread_config_t* config);
+
+/** get the thread statistics of a callback role of the player */
+VLCWRP_API void vlcwrp_thread_stats(struct vlcwrp_ctx_t* ctx, vlcwrp_thread_role_t role, vlcwrp_thread_stats_t* stats);
+
+/**
+ * set the CPU affinity and priority of the calling thread, as for the
+ * render thread
+ * returns 0 on success, -1 if any part failed, the other parts are applied
+ */
+VLCWRP_API int vlcwrp_thread_apply(const vlcwrp_thread_config_t* config);
+
+/** get the CPU time of the calling thread in microseconds */
+VLCWRP_API long long vlcwrp_thread_cpu_time(void);
+
+/** get VLCWRP_ABI_VERSION of the library, the FFI bindings check it once loaded */
+VLCWRP_API int vlcwrp_abi_version(void);
+
+/**
+ * acquire the next decoded frame without waiting for one and fill its
+ * descriptor
+ * returns 1 if a frame is acquired, to be released with
+ * vlcwrp_frame_release, 0 if no frame is queued, a frame is still
+ * acquired or the descriptor is of another ABI version
+ */
+VLCWRP_API int vlcwrp_frame_try_acquire(struct vlcwrp_ctx_t* ctx, vlcwrp_frame_t* frame);
+
+/** get the frame queue statistics, without locking */
+VLCWRP_API void vlcwrp_frame_stats(struct vlcwrp_ctx_t* ctx, vlcwrp_frame_stats_t* stats);
+
+/**
+ * set the image of an overlay layer, premultiplied RGBA with R first in
+ * memory, the image is copied and placed at 0, 0 fully visible unless the
+ * layer was placed before
+ * the layers are blended into each decoded frame before it is queued, so
+ * the snapshots, recordings and exports carry them
+ * returns 0 on success
+ */
+VLCWRP_API int vlcwrp_overlay_set(struct vlcwrp_ctx_t* ctx, int layer, const void* pixels, int width, int height, int pitch);
+
+/**
+ * update a rectangle of the image of an overlay layer, pixels points to
+ * the first pixel of the rectangle, only the tiles of the rectangle are
+ * classified again, the conversion does not hold the decoder
+ * returns 0 on success, -1 if the layer has no image or on no memory
+ */
+VLCWRP_API int vlcwrp_overlay_update(struct vlcwrp_ctx_t* ctx, int layer, const void* pixels, int pitch, int x, int y, int width, int height);
+
+/**
+ * place an overlay layer in the frame with a global alpha, 0 hides the
+ * layer, the position is bounded to 16777216 pixels off the frame origin
+ */
+VLCWRP_API void vlcwrp_overlay_place(struct vlcwrp_ctx_t* ctx, int layer, int x, int y, float alpha);
+
+/** remove an overlay layer */
+VLCWRP_API void vlcwrp_overlay_clear(struct vlcwrp_ctx_t* ctx, int layer);
+
+/** get overlay compositing statistics, returns 0 if no overlay was set */
+VLCWRP_API int vlcwrp_overlay_stats(struct vlcwrp_ctx_t* ctx, vlcwrp_overlay_stats_t* stats);
+
 #endif
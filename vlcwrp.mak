@@ -2,8 +2,8 @@
 
 TARGET=vlcwrp
 VERSION=1.0
-OBJS=vlcwrp.o
-EXTRA_DEFS=-DVLCWRP_BUILD -Wno-long-long -std=c99
-EXTRA_INCS=$(shell pkg-config libvlc --cflags)
-EXTRA_LIBS=$(shell pkg-config libvlc --libs) -lpthread-2
-INCLUDES=vlcwrp.h
+OBJS=vlcwrp.o vlcwrp_analytics.o vlcwrp_audio.o vlcwrp_input.o vlcwrp_probe.o vlcwrp_thumbnails.o vlcwrp_events.o vlcwrp_snapshot.o vlcwrp_recorder.o vlcwrp_export.o vlcwrp_export_reader.o vlcwrp_cache.o vlcwrp_seek.o vlcwrp_playlist.o vlcwrp_wait.o vlcwrp_buffers.o vlcwrp_arena.o vlcwrp_adaptive.o vlcwrp_profile.o vlcwrp_latency.o vlcwrp_health.o vlcwrp_threads.o vlcwrp_overlay.o
+EXTRA_DEFS=-DVLCWRP_BUILD -D_GNU_SOURCE -Wno-long-long -std=c99
+EXTRA_INCS=$(shell pkg-config libvlc libpng libjpeg liblz4 --cflags)
+EXTRA_LIBS=$(shell pkg-config libvlc libpng libjpeg liblz4 --libs) -lpthread-2 -lm -lrt
+INCLUDES=vlcwrp.h vlcwrp_export.h
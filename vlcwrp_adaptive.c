@@ -0,0 +1,211 @@
+/*********************************************************************/
+/*                                                                   */
+/* Copyright (C) 2010,  AVIQ Bulgaria Ltd                            */
+/*                                                                   */
+/* Project:       LRun                                               */
+/* Filename:      vlcwrp_adaptive.c                                  */
+/* Description:   VLC wrapper backpressure driven decode quality     */
+/*                                                                   */
+/*********************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "vlcwrp_priv.h"
+
+/**
+ * adaptive quality controller
+ *
+ * Runs on the decoder thread with ctx->mutex locked. Each window sums the
+ * time the decoder was blocked on a full queue and the queue occupancy
+ * seen on each frame. Consecutive windows under pressure raise the level,
+ * consecutive idle windows lower it. At level n one decoded frame out of
+ * n + 1 is queued, at the highest level the oldest queued frame may be
+ * dropped instead of blocking the decoder.
+ */
+struct vlcwrp_adaptive_ctx_t
+{
+	vlcwrp_adaptive_config_t config;
+
+	/* current level, read by other threads */
+	int level;
+
+	/* current window */
+	long long window_start;
+	long long blocked;
+	long long occupancy;
+	int samples;
+
+	/* consecutive windows under pressure and idle */
+	int pressured;
+	int idle;
+
+	/* frames since the last queued frame */
+	unsigned int phase;
+
+	/* last window in per mille, read by other threads */
+	int last_blocked;
+	int last_occupancy;
+
+	unsigned long skipped;
+	unsigned long dropped;
+	unsigned long transitions;
+};
+
+/* fill config with the default adaptive quality configuration */
+void vlcwrp_adaptive_defaults(vlcwrp_adaptive_config_t* config)
+{
+	config->window = 1000;
+	config->block_ratio = 0.1f;
+	config->degrade_windows = 2;
+	config->recover_windows = 5;
+	config->max_level = 3;
+	config->drop = 1;
+}
+
+/* start the adaptive quality controller */
+int vlcwrp_adaptive_start(struct vlcwrp_ctx_t* ctx, const vlcwrp_adaptive_config_t* config)
+{
+	struct vlcwrp_adaptive_ctx_t* ad;
+
+	if (!ctx->video || ctx->adaptive || config->window <= 0 || config->max_level < 1)
+		return -1;
+	ad = (struct vlcwrp_adaptive_ctx_t*)calloc(1, sizeof(struct vlcwrp_adaptive_ctx_t));
+	if (!ad)
+		return -1;
+	ad->config = *config;
+	if (ad->config.degrade_windows < 1)
+		ad->config.degrade_windows = 1;
+	if (ad->config.recover_windows < 1)
+		ad->config.recover_windows = 1;
+	pthread_mutex_lock(ctx->mutex);
+	ctx->adaptive = ad;
+	pthread_mutex_unlock(ctx->mutex);
+	return 0;
+}
+
+/* stop the adaptive quality controller, every frame is queued again */
+void vlcwrp_adaptive_stop(struct vlcwrp_ctx_t* ctx)
+{
+	struct vlcwrp_adaptive_ctx_t* ad = ctx->adaptive;
+	if (!ad)
+		return;
+	pthread_mutex_lock(ctx->mutex);
+	ctx->adaptive = NULL;
+	pthread_mutex_unlock(ctx->mutex);
+	free(ad);
+}
+
+/* starts a new window, called with ctx->mutex locked when the player starts */
+void vlcwrp_adaptive_reset(struct vlcwrp_ctx_t* ctx)
+{
+	struct vlcwrp_adaptive_ctx_t* ad = ctx->adaptive;
+
+	/* the level is kept, the load of the machine does not change with the media */
+	ad->window_start = 0;
+	ad->blocked = ad->occupancy = 0;
+	ad->samples = ad->pressured = ad->idle = 0;
+	ad->phase = 0;
+}
+
+/* moves to level and reports the transition */
+static void adaptive_set_level(struct vlcwrp_ctx_t* ctx, struct vlcwrp_adaptive_ctx_t* ad, int level, int blocked)
+{
+	char text[64];
+
+	snprintf(text, sizeof(text), "%s blocked=%d.%d%%", level > ad->level ? "degrade" : "recover", blocked / 10, blocked % 10);
+	vlcwrp_atomic_store(&ad->level, level);
+	vlcwrp_atomic_add(&ad->transitions, 1);
+	ad->pressured = ad->idle = 0;
+	ad->phase = 0;
+	vlcwrp_event_post(ctx, VLCWRP_EVENT_QUALITY, 0, level, text);
+}
+
+/* accounts a frame request, called with ctx->mutex locked by lockcb */
+void vlcwrp_adaptive_sample(struct vlcwrp_ctx_t* ctx, int occupancy, long long blocked)
+{
+	struct vlcwrp_adaptive_ctx_t* ad = ctx->adaptive;
+	long long now = vlcwrp_clock(), elapsed;
+	int blocked_pm, occupancy_pm;
+
+	if (!ad->window_start)
+		ad->window_start = now;
+	ad->blocked += blocked;
+	ad->occupancy += occupancy;
+	ad->samples++;
+	elapsed = now - ad->window_start;
+	if (elapsed < (long long)ad->config.window * 1000)
+		return;
+
+	blocked_pm = (int)(ad->blocked * 1000 / elapsed);
+	occupancy_pm = (int)(ad->occupancy * 1000 / ad->samples);
+	vlcwrp_atomic_store(&ad->last_blocked, blocked_pm);
+	vlcwrp_atomic_store(&ad->last_occupancy, occupancy_pm);
+
+	/* pressure is time lost blocked, idle is a drained queue and no block at all */
+	if (blocked_pm > (int)(ad->config.block_ratio * 1000))
+	{
+		ad->pressured++;
+		ad->idle = 0;
+	}
+	else if (!ad->blocked && occupancy_pm < 1000)
+	{
+		ad->idle++;
+		ad->pressured = 0;
+	}
+	else
+		ad->pressured = ad->idle = 0;
+
+	if (ad->pressured >= ad->config.degrade_windows && ad->level < ad->config.max_level)
+		adaptive_set_level(ctx, ad, ad->level + 1, blocked_pm);
+	else if (ad->idle >= ad->config.recover_windows && ad->level > 0)
+		adaptive_set_level(ctx, ad, ad->level - 1, blocked_pm);
+
+	ad->window_start = now;
+	ad->blocked = ad->occupancy = 0;
+	ad->samples = 0;
+}
+
+/* drops the oldest queued frame at the highest level instead of blocking, called with ctx->mutex locked */
+int vlcwrp_adaptive_drop(struct vlcwrp_ctx_t* ctx)
+{
+	struct vlcwrp_adaptive_ctx_t* ad = ctx->adaptive;
+
+	if (!ad->config.drop || ad->level < ad->config.max_level || ctx->nqueuedframes == 0 || ctx->read_copy)
+		return 0;
+
+	/* no frame is acquired while the mutex is not held by the consumer */
+	ctx->ridx = (ctx->ridx + 1) % QUEUE_SIZE;
+	ctx->nqueuedframes--;
+	vlcwrp_atomic_add(&ad->dropped, 1);
+	return 1;
+}
+
+/* non zero if the decoded frame is not queued at the current level, called with ctx->mutex locked */
+int vlcwrp_adaptive_skip(struct vlcwrp_ctx_t* ctx)
+{
+	struct vlcwrp_adaptive_ctx_t* ad = ctx->adaptive;
+
+	if (!ad->level || ad->phase++ % (unsigned int)(ad->level + 1) == 0)
+		return 0;
+	vlcwrp_atomic_add(&ad->skipped, 1);
+	return 1;
+}
+
+/* get adaptive quality statistics */
+int vlcwrp_adaptive_stats(struct vlcwrp_ctx_t* ctx, vlcwrp_adaptive_stats_t* stats)
+{
+	struct vlcwrp_adaptive_ctx_t* ad = ctx->adaptive;
+	if (!ad)
+		return 0;
+
+	/* not locking, the consumer may hold an acquired frame */
+	stats->level = vlcwrp_atomic_load(&ad->level);
+	stats->max_level = ad->config.max_level;
+	stats->blocked = vlcwrp_atomic_load(&ad->last_blocked) / 1000.0f;
+	stats->occupancy = vlcwrp_atomic_load(&ad->last_occupancy) / 1000.0f;
+	stats->skipped = vlcwrp_atomic_load(&ad->skipped);
+	stats->dropped = vlcwrp_atomic_load(&ad->dropped);
+	stats->transitions = vlcwrp_atomic_load(&ad->transitions);
+	return 1;
+}
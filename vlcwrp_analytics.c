@@ -0,0 +1,464 @@
+/*********************************************************************/
+/*                                                                   */
+/* Copyright (C) 2010,  AVIQ Bulgaria Ltd                            */
+/*                                                                   */
+/* Project:       LRun                                               */
+/* Filename:      vlcwrp_analytics.c                                 */
+/* Description:   VLC wrapper frame analytics                        */
+/*                                                                   */
+/*********************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "vlcwrp_priv.h"
+
+/* BT.601 luma weights scaled by 256 in the RV32 byte order (B, G, R, X) */
+#define LUMA_W0 29
+#define LUMA_W1 150
+#define LUMA_W2 77
+#define LUMA_W3 0
+
+/* number of pixels averaged horizontally into one thumbnail pixel */
+#define THUMB_DIV 4
+
+/**
+ * frame analytics worker
+ */
+struct vlcwrp_analytics_worker_t
+{
+	/* worker thread */
+	pthread_t thread;
+
+	/* the thread has been created */
+	int started;
+
+	/* luma thumbnail the worker analyses into */
+	unsigned char* thumb;
+
+	/* owning context */
+	struct vlcwrp_ctx_t* ctx;
+};
+
+/**
+ * frame analytics state
+ */
+struct vlcwrp_analytics_ctx_t
+{
+	/* configuration */
+	vlcwrp_analytics_config_t config;
+
+	/* worker threads */
+	struct vlcwrp_analytics_worker_t* workers;
+
+	/* flag requesting the workers to quit */
+	int quit;
+
+	/* condition there are frames to analyse */
+	pthread_cond_t cond_work;
+
+	/* queue of slot indecies waiting for analysis */
+	int work[QUEUE_SIZE];
+	int work_head, work_count;
+
+	/* set on slots analysed but not queued yet */
+	int done[QUEUE_SIZE];
+
+	/* analysis results of the slots */
+	vlcwrp_frame_analytics_t results[QUEUE_SIZE];
+
+	/* luma thumbnails of the slots and of the last queued frame */
+	unsigned char* thumb[QUEUE_SIZE];
+	unsigned char* prev_thumb;
+	int have_prev;
+
+	/* luma histogram of the last queued frame */
+	unsigned int prev_histogram[VLCWRP_HISTOGRAM_BINS];
+
+	/* thumbnail geometry */
+	int thumb_width, thumb_height;
+
+	/* aggregated results, guarded by stats_mutex */
+	vlcwrp_analytics_t stats;
+	pthread_mutex_t stats_mutex;
+};
+
+/* fill config with the default frame analytics configuration */
+void vlcwrp_analytics_defaults(vlcwrp_analytics_config_t* config)
+{
+	config->workers = 1;
+	config->step = 4;
+	config->black_luma = 32.0f;
+	config->black_ratio = 0.98f;
+	config->freeze_diff = 0.5f;
+	config->scene_distance = 0.35f;
+}
+
+/* averages each THUMB_DIV pixels of a row into one luma value */
+static void luma_row(const unsigned char* row, int width, unsigned char* out)
+{
+	int x = 0;
+#ifdef __SSE2__
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i w = _mm_setr_epi16(LUMA_W0, LUMA_W1, LUMA_W2, LUMA_W3, LUMA_W0, LUMA_W1, LUMA_W2, LUMA_W3);
+	/* 16 pixels into 4 luma values per iteration */
+	for (; x + 16 <= width; x += 16, row += 64, out += 4)
+	{
+		__m128i s[4], t01, t23, r;
+		int i;
+		for (i=0; i<4; i++)
+		{
+			__m128i v = _mm_loadu_si128((const __m128i*)(row + 16*i));
+			s[i] = _mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi8(v, zero), w),
+			                     _mm_madd_epi16(_mm_unpackhi_epi8(v, zero), w));
+		}
+		/* transpose and add, lane i holds the weighted sum of 4 pixels of group i */
+		t01 = _mm_add_epi32(_mm_unpacklo_epi32(s[0], s[1]), _mm_unpackhi_epi32(s[0], s[1]));
+		t23 = _mm_add_epi32(_mm_unpacklo_epi32(s[2], s[3]), _mm_unpackhi_epi32(s[2], s[3]));
+		r = _mm_add_epi32(_mm_unpacklo_epi64(t01, t23), _mm_unpackhi_epi64(t01, t23));
+		r = _mm_srli_epi32(r, 10);
+		r = _mm_packs_epi32(r, r);
+		r = _mm_packus_epi16(r, r);
+		i = _mm_cvtsi128_si32(r);
+		memcpy(out, &i, 4);
+	}
+#endif
+	for (; x + THUMB_DIV <= width; x += THUMB_DIV, row += THUMB_DIV*BPP, out++)
+	{
+		unsigned int sum = 0;
+		int i;
+		for (i=0; i<THUMB_DIV; i++)
+			sum += row[BPP*i]*LUMA_W0 + row[BPP*i+1]*LUMA_W1 + row[BPP*i+2]*LUMA_W2 + row[BPP*i+3]*LUMA_W3;
+		*out = (unsigned char)(sum >> 10);
+	}
+}
+
+/* sum of absolute differences of two buffers */
+static unsigned long long sad(const unsigned char* a, const unsigned char* b, int size)
+{
+	unsigned long long sum = 0;
+	int i = 0;
+#ifdef __SSE2__
+	__m128i acc = _mm_setzero_si128();
+	for (; i + 16 <= size; i += 16)
+	{
+		__m128i va = _mm_loadu_si128((const __m128i*)(a + i));
+		__m128i vb = _mm_loadu_si128((const __m128i*)(b + i));
+		acc = _mm_add_epi64(acc, _mm_sad_epu8(va, vb));
+	}
+	sum = (unsigned long long)_mm_cvtsi128_si32(acc) + (unsigned long long)_mm_cvtsi128_si32(_mm_srli_si128(acc, 8));
+#endif
+	for (; i < size; i++)
+		sum += a[i] > b[i] ? a[i] - b[i] : b[i] - a[i];
+	return sum;
+}
+
+/* computes the per frame results which do not depend on the previous frame */
+static void analyse_frame(struct vlcwrp_analytics_ctx_t* an, const unsigned char* pixels, int width, int pitch,
+                          unsigned char* thumb, vlcwrp_frame_analytics_t* res)
+{
+	int y, i, size = an->thumb_width * an->thumb_height;
+	int black_luma = (int)an->config.black_luma;
+	unsigned long long sum = 0, sumsq = 0;
+	unsigned long nblack = 0;
+	double mean;
+
+	for (y=0; y<an->thumb_height; y++)
+		luma_row(pixels + (size_t)y * an->config.step * pitch, width, thumb + y * an->thumb_width);
+
+	memset(res, 0, sizeof(vlcwrp_frame_analytics_t));
+	for (i=0; i<size; i++)
+	{
+		unsigned int l = thumb[i];
+		res->histogram[l * VLCWRP_HISTOGRAM_BINS / 256]++;
+		sum += l;
+		sumsq += l * l;
+		if ((int)l < black_luma)
+			nblack++;
+	}
+	mean = (double)sum / size;
+	res->luma_mean = (float)mean;
+	res->luma_variance = (float)((double)sumsq / size - mean * mean);
+	res->black = nblack >= an->config.black_ratio * size;
+	res->analyzed = 1;
+}
+
+/* computes the results relative to the previous queued frame */
+static void compare_frame(struct vlcwrp_analytics_ctx_t* an, const unsigned char* thumb, vlcwrp_frame_analytics_t* res)
+{
+	int i, size = an->thumb_width * an->thumb_height;
+	unsigned long dist = 0;
+
+	res->diff = (float)((double)sad(thumb, an->prev_thumb, size) / size);
+	for (i=0; i<VLCWRP_HISTOGRAM_BINS; i++)
+	{
+		unsigned int h = res->histogram[i], p = an->prev_histogram[i];
+		dist += h > p ? h - p : p - h;
+	}
+	res->hist_distance = (float)(0.5 * dist / size);
+	res->frozen = res->diff < an->config.freeze_diff;
+	res->scene_change = res->hist_distance > an->config.scene_distance;
+}
+
+/* queues the analysed frames in decoding order, called with ctx->mutex locked */
+static void publish_frames(struct vlcwrp_ctx_t* ctx)
+{
+	struct vlcwrp_analytics_ctx_t* an = ctx->analytics;
+
+	while (ctx->npendingframes > 0 && an->done[ctx->pidx])
+	{
+		int idx = ctx->pidx;
+		vlcwrp_frame_analytics_t* res = &an->results[idx];
+		unsigned char* thumb;
+
+		if (an->have_prev)
+			compare_frame(an, an->thumb[idx], res);
+
+		/* the queued frame becomes the reference for the next one */
+		memcpy(an->prev_histogram, res->histogram, sizeof(an->prev_histogram));
+		thumb = an->prev_thumb;
+		an->prev_thumb = an->thumb[idx];
+		an->thumb[idx] = thumb;
+		an->have_prev = 1;
+
+		ctx->frame_info[idx].analytics = *res;
+		an->done[idx] = 0;
+
+		pthread_mutex_lock(&an->stats_mutex);
+		an->stats.frames++;
+		if (res->black)
+		{
+			an->stats.black_frames++;
+			an->stats.black_run++;
+		}
+		else
+			an->stats.black_run = 0;
+		if (res->frozen)
+		{
+			an->stats.frozen_frames++;
+			an->stats.frozen_run++;
+		}
+		else
+			an->stats.frozen_run = 0;
+		if (res->scene_change)
+		{
+			an->stats.scene_changes++;
+			an->stats.last_scene_change = ctx->frame_info[idx].seq;
+		}
+		an->stats.luma_mean = res->luma_mean;
+		an->stats.luma_variance = res->luma_variance;
+		an->stats.diff = res->diff;
+		pthread_mutex_unlock(&an->stats_mutex);
+
+		ctx->npendingframes--;
+		vlcwrp_queue_frame(ctx);
+	}
+}
+
+/* frame analytics worker thread */
+static void* worker_main(void* arg)
+{
+	struct vlcwrp_analytics_worker_t* worker = (struct vlcwrp_analytics_worker_t*)arg;
+	struct vlcwrp_ctx_t* ctx = worker->ctx;
+	struct vlcwrp_analytics_ctx_t* an = ctx->analytics;
+
+	pthread_mutex_lock(ctx->mutex);
+	for (;;)
+	{
+		int idx;
+		unsigned int generation;
+		vlcwrp_frame_analytics_t res;
+		long long start;
+
+		while (!an->quit && an->work_count == 0)
+			pthread_cond_wait(&an->cond_work, ctx->mutex);
+		if (an->quit)
+			break;
+
+		/* take the next slot to analyse */
+		idx = an->work[an->work_head];
+		an->work_head = (an->work_head + 1) % QUEUE_SIZE;
+		an->work_count--;
+		generation = ctx->generation;
+		pthread_mutex_unlock(ctx->mutex);
+
+		start = vlcwrp_clock();
+		analyse_frame(an, ctx->frame_queue[idx], ctx->width, ctx->pitch, worker->thumb, &res);
+		pthread_mutex_lock(&an->stats_mutex);
+		an->stats.busy_time += vlcwrp_clock() - start;
+		pthread_mutex_unlock(&an->stats_mutex);
+
+		pthread_mutex_lock(ctx->mutex);
+		if (generation == ctx->generation)
+		{
+			/* hand over the thumbnail to the slot, keep the slot's one as scratch */
+			unsigned char* thumb = an->thumb[idx];
+			an->thumb[idx] = worker->thumb;
+			worker->thumb = thumb;
+			an->results[idx] = res;
+			an->done[idx] = 1;
+			publish_frames(ctx);
+		}
+	}
+	pthread_mutex_unlock(ctx->mutex);
+	return NULL;
+}
+
+/* hands the decoded frame at slot idx to the analytics workers, called with ctx->mutex locked */
+void vlcwrp_analytics_submit(struct vlcwrp_ctx_t* ctx, int idx)
+{
+	struct vlcwrp_analytics_ctx_t* an = ctx->analytics;
+	an->work[(an->work_head + an->work_count) % QUEUE_SIZE] = idx;
+	an->work_count++;
+	pthread_cond_signal(&an->cond_work);
+}
+
+/* drops frames still in analysis, called with ctx->mutex locked */
+void vlcwrp_analytics_reset(struct vlcwrp_ctx_t* ctx)
+{
+	struct vlcwrp_analytics_ctx_t* an = ctx->analytics;
+	memset(an->done, 0, sizeof(an->done));
+	an->work_head = an->work_count = 0;
+	an->have_prev = 0;
+	pthread_mutex_lock(&an->stats_mutex);
+	an->stats.black_run = an->stats.frozen_run = 0;
+	pthread_mutex_unlock(&an->stats_mutex);
+}
+
+/* releases the analytics state, the workers must be stopped */
+static void analytics_free(struct vlcwrp_analytics_ctx_t* an)
+{
+	int i;
+	if (an->workers)
+	{
+		for (i=0; i<an->config.workers; i++)
+			free(an->workers[i].thumb);
+		free(an->workers);
+	}
+	for (i=0; i<QUEUE_SIZE; i++)
+		free(an->thumb[i]);
+	free(an->prev_thumb);
+	pthread_cond_destroy(&an->cond_work);
+	pthread_mutex_destroy(&an->stats_mutex);
+	free(an);
+}
+
+/* start analysing decoded frames on a pool of worker threads */
+int vlcwrp_analytics_start(struct vlcwrp_ctx_t* ctx, const vlcwrp_analytics_config_t* config)
+{
+	struct vlcwrp_analytics_ctx_t* an;
+	int i, thumb_size;
+
+	if (ctx->analytics)
+		return 0;
+	if (!ctx->video)
+		return -1;
+
+	an = (struct vlcwrp_analytics_ctx_t*)calloc(1, sizeof(struct vlcwrp_analytics_ctx_t));
+	if (!an)
+		return -1;
+	pthread_cond_init(&an->cond_work, 0);
+	pthread_mutex_init(&an->stats_mutex, 0);
+
+	if (config)
+		an->config = *config;
+	else
+		vlcwrp_analytics_defaults(&an->config);
+	if (an->config.workers < 1)
+		an->config.workers = 1;
+	if (an->config.step < 1)
+		an->config.step = 1;
+
+	/* allocates the luma thumbnails */
+	an->thumb_width = ctx->width / THUMB_DIV;
+	an->thumb_height = (ctx->height + an->config.step - 1) / an->config.step;
+	thumb_size = an->thumb_width * an->thumb_height;
+	an->prev_thumb = (unsigned char*)malloc(thumb_size);
+	an->workers = (struct vlcwrp_analytics_worker_t*)calloc(an->config.workers, sizeof(struct vlcwrp_analytics_worker_t));
+	if (!an->prev_thumb || !an->workers)
+	{
+		analytics_free(an);
+		return -1;
+	}
+	for (i=0; i<QUEUE_SIZE; i++)
+	{
+		if (!(an->thumb[i] = (unsigned char*)malloc(thumb_size)))
+		{
+			analytics_free(an);
+			return -1;
+		}
+	}
+	for (i=0; i<an->config.workers; i++)
+	{
+		an->workers[i].ctx = ctx;
+		if (!(an->workers[i].thumb = (unsigned char*)malloc(thumb_size)))
+		{
+			analytics_free(an);
+			return -1;
+		}
+	}
+
+	/* starts the workers */
+	pthread_mutex_lock(ctx->mutex);
+	vlcwrp_atomic_store(&ctx->analytics, an);
+	pthread_mutex_unlock(ctx->mutex);
+	for (i=0; i<an->config.workers; i++)
+	{
+		if (pthread_create(&an->workers[i].thread, NULL, worker_main, &an->workers[i]))
+		{
+			vlcwrp_analytics_stop(ctx);
+			return -1;
+		}
+		an->workers[i].started = 1;
+	}
+	return 0;
+}
+
+/* stop the frame analytics */
+void vlcwrp_analytics_stop(struct vlcwrp_ctx_t* ctx)
+{
+	struct vlcwrp_analytics_ctx_t* an = ctx->analytics;
+	int i;
+
+	if (!an)
+		return;
+
+	pthread_mutex_lock(ctx->mutex);
+	an->quit = 1;
+	pthread_cond_broadcast(&an->cond_work);
+	pthread_mutex_unlock(ctx->mutex);
+
+	for (i=0; i<an->config.workers; i++)
+		if (an->workers[i].started)
+			pthread_join(an->workers[i].thread, NULL);
+
+	/* the frames left in analysis are queued unanalysed, in decoding order */
+	pthread_mutex_lock(ctx->mutex);
+	while (ctx->npendingframes > 0)
+	{
+		ctx->frame_info[ctx->pidx].analytics.analyzed = 0;
+		ctx->npendingframes--;
+		vlcwrp_queue_frame(ctx);
+	}
+	vlcwrp_atomic_store(&ctx->analytics, NULL);
+	pthread_mutex_unlock(ctx->mutex);
+	analytics_free(an);
+}
+
+/* get the aggregated frame analytics */
+int vlcwrp_analytics(struct vlcwrp_ctx_t* ctx, vlcwrp_analytics_t* analytics)
+{
+	/* not locking ctx->mutex, the caller may hold an acquired frame */
+	struct vlcwrp_analytics_ctx_t* an = vlcwrp_atomic_load(&ctx->analytics);
+	if (!an)
+		return 0;
+	pthread_mutex_lock(&an->stats_mutex);
+	*analytics = an->stats;
+	pthread_mutex_unlock(&an->stats_mutex);
+	return 1;
+}
@@ -0,0 +1,281 @@
+/*********************************************************************/
+/*                                                                   */
+/* Copyright (C) 2010,  AVIQ Bulgaria Ltd                            */
+/*                                                                   */
+/* Project:       LRun                                               */
+/* Filename:      vlcwrp_arena.c                                     */
+/* Description:   VLC wrapper process wide frame arena               */
+/*                                                                   */
+/*********************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <unistd.h>
+#else
+#include <malloc.h>
+#endif
+
+#include "vlcwrp_priv.h"
+
+/* number of distinct frame sizes */
+#define ARENA_MAX_CLASSES 16
+
+/* frames of one size */
+#define ARENA_MAX_BLOCKS 1024
+
+/* size of a transparent or explicit huge page */
+#define ARENA_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+/* the frames start on a page so no page is shared by two frames */
+#define ARENA_PAGE_SIZE 4096
+
+#define ALIGN_TO(x, a) (((x) + (a) - 1) / (a) * (a))
+
+/* free list head, the low half holds the top block plus one, the high half a tag against ABA */
+#define HEAD_TOP(h) ((unsigned int)((h) & 0xffffffffu))
+#define HEAD_MAKE(h, top) (((((h) >> 32) + 1) << 32) | (unsigned long long)(top))
+
+/**
+ * size class
+ *
+ * The frames of a class are mapped on demand, a frame given back by a
+ * player is pushed on the lock-free free list of its class for any player
+ * of the same geometry. The frames are unmapped and the class is reused
+ * once the last player of the geometry is destroyed.
+ */
+struct arena_class
+{
+	/* frame size in bytes, 0 if the class is not used */
+	size_t size;
+
+	/* players attached to the class, changed with arena_mutex locked */
+	int users;
+
+	/* mapped size of each frame */
+	size_t block_size;
+
+	/* number of frames mapped */
+	int count;
+
+	/* number of frames in the free list */
+	int nfree;
+
+	unsigned char* blocks[ARENA_MAX_BLOCKS];
+
+	/* next free block plus one for each block in the free list */
+	unsigned int next[ARENA_MAX_BLOCKS];
+
+	unsigned long long head;
+};
+
+static struct arena_class arena_classes[ARENA_MAX_CLASSES];
+
+/* serializes the creation and the release of the classes */
+static pthread_mutex_t arena_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* process wide limit of the mapped bytes, 0 for no limit */
+static unsigned long long arena_budget = 0;
+
+/* mapped bytes */
+static unsigned long long arena_mapped = 0;
+
+/* frames refused because of the budget */
+static unsigned long arena_failed = 0;
+
+/* limit the bytes mapped for frames by all players */
+void vlcwrp_arena_configure(unsigned long long budget)
+{
+	vlcwrp_atomic_store(&arena_budget, budget);
+}
+
+/* get the arena statistics */
+void vlcwrp_arena_stats(vlcwrp_arena_stats_t* stats)
+{
+	int i;
+	memset(stats, 0, sizeof(vlcwrp_arena_stats_t));
+	stats->budget = vlcwrp_atomic_load(&arena_budget);
+	stats->mapped = vlcwrp_atomic_load(&arena_mapped);
+	stats->failed = vlcwrp_atomic_load(&arena_failed);
+	for (i=0; i<ARENA_MAX_CLASSES; i++)
+	{
+		struct arena_class* c = &arena_classes[i];
+		if (!vlcwrp_atomic_load(&c->size))
+			continue;
+		stats->classes++;
+		stats->frames += vlcwrp_atomic_load(&c->count);
+		stats->free_frames += vlcwrp_atomic_load(&c->nfree);
+		stats->free_bytes += (unsigned long long)vlcwrp_atomic_load(&c->nfree) * c->block_size;
+	}
+}
+
+/* takes a reference on the arena class of the frames of size bytes, returns the class or -1 if none */
+int vlcwrp_arena_attach(size_t size)
+{
+	struct arena_class* c = NULL;
+	int i;
+
+	pthread_mutex_lock(&arena_mutex);
+	for (i=0; i<ARENA_MAX_CLASSES && !c; i++)
+		if (arena_classes[i].size == size)
+			c = &arena_classes[i];
+	for (i=0; i<ARENA_MAX_CLASSES && !c; i++)
+		if (!arena_classes[i].size)
+		{
+			c = &arena_classes[i];
+			c->block_size = ALIGN_TO(size, size >= ARENA_HUGE_PAGE_SIZE ? ARENA_HUGE_PAGE_SIZE : ARENA_PAGE_SIZE);
+			vlcwrp_atomic_store(&c->size, size);
+		}
+	if (c)
+		c->users++;
+	pthread_mutex_unlock(&arena_mutex);
+	return c ? (int)(c - arena_classes) : -1;
+}
+
+/* maps a frame of the class */
+static unsigned char* arena_map(struct arena_class* c, const vlcwrp_buffer_config_t* config)
+{
+	unsigned char* base = NULL;
+	size_t size = c->block_size;
+
+#ifndef _WIN32
+#ifdef MAP_HUGETLB
+	if (config->hugepages == VLCWRP_HUGEPAGES_EXPLICIT && size % ARENA_HUGE_PAGE_SIZE == 0)
+	{
+		/* fails without reserved huge pages, the transparent ones are used then */
+		base = (unsigned char*)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if (base == MAP_FAILED)
+			base = NULL;
+	}
+#endif
+	if (!base && config->hugepages != VLCWRP_HUGEPAGES_OFF && size % ARENA_HUGE_PAGE_SIZE == 0)
+	{
+		/* over allocated to start on a huge page, the unaligned head and the tail are returned */
+		unsigned char* map = (unsigned char*)mmap(NULL, size + ARENA_HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (map != MAP_FAILED)
+		{
+			size_t head = ALIGN_TO((size_t)map, ARENA_HUGE_PAGE_SIZE) - (size_t)map;
+			if (head)
+				munmap(map, head);
+			munmap(map + head + size, ARENA_HUGE_PAGE_SIZE - head);
+			base = map + head;
+#ifdef MADV_HUGEPAGE
+			madvise(base, size, MADV_HUGEPAGE);
+#endif
+		}
+	}
+	if (!base)
+	{
+		base = (unsigned char*)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (base == MAP_FAILED)
+			base = NULL;
+	}
+#else
+	base = (unsigned char*)_aligned_malloc(size, ARENA_PAGE_SIZE);
+#endif
+
+	/* the pages are faulted here rather than on the decoder thread during the first frames */
+	if (base && config->prefault)
+	{
+		size_t off;
+		for (off=0; off<size; off+=ARENA_PAGE_SIZE)
+			base[off] = 0;
+	}
+	return base;
+}
+
+/* unmaps a frame of the class */
+static void arena_unmap(struct arena_class* c, unsigned char* base)
+{
+#ifndef _WIN32
+	munmap(base, c->block_size);
+#else
+	(void)c;
+	_aligned_free(base);
+#endif
+}
+
+/* drops a reference on class cls, the frames of a class without players are unmapped */
+void vlcwrp_arena_detach(int cls)
+{
+	struct arena_class* c = &arena_classes[cls];
+	int i;
+
+	pthread_mutex_lock(&arena_mutex);
+	if (--c->users == 0)
+	{
+		/* without players no frame of the class is held nor taken */
+		for (i=0; i<c->count; i++)
+			arena_unmap(c, c->blocks[i]);
+		vlcwrp_atomic_add(&arena_mapped, -(unsigned long long)c->count * c->block_size);
+		vlcwrp_atomic_store(&c->nfree, 0);
+		vlcwrp_atomic_store(&c->count, 0);
+		vlcwrp_atomic_store(&c->head, 0);
+		vlcwrp_atomic_store(&c->size, 0);
+	}
+	pthread_mutex_unlock(&arena_mutex);
+}
+
+/* takes a frame of class cls, mapping a new one within the budget unless forced, returns -1 if none */
+int vlcwrp_arena_get(int cls, const vlcwrp_buffer_config_t* config, int forced, unsigned char** frame)
+{
+	struct arena_class* c = &arena_classes[cls];
+	unsigned long long head, budget, mapped;
+	unsigned int top;
+	int idx;
+
+	/* pop from the free list */
+	head = vlcwrp_atomic_load(&c->head);
+	while ((top = HEAD_TOP(head)))
+	{
+		if (__atomic_compare_exchange_n(&c->head, &head, HEAD_MAKE(head, vlcwrp_atomic_load(&c->next[top - 1])), 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+		{
+			vlcwrp_atomic_add(&c->nfree, -1);
+			idx = (int)(c - arena_classes) * ARENA_MAX_BLOCKS + (int)(top - 1);
+			*frame = c->blocks[top - 1];
+			return idx;
+		}
+	}
+
+	/* the budget is taken before mapping */
+	budget = vlcwrp_atomic_load(&arena_budget);
+	mapped = vlcwrp_atomic_add(&arena_mapped, c->block_size);
+	if ((budget && mapped > budget && !forced) || vlcwrp_atomic_load(&c->count) >= ARENA_MAX_BLOCKS)
+	{
+		vlcwrp_atomic_add(&arena_mapped, -(unsigned long long)c->block_size);
+		vlcwrp_atomic_add(&arena_failed, 1);
+		return -1;
+	}
+	*frame = arena_map(c, config);
+	if (!*frame)
+	{
+		vlcwrp_atomic_add(&arena_mapped, -(unsigned long long)c->block_size);
+		return -1;
+	}
+	idx = vlcwrp_atomic_add(&c->count, 1) - 1;
+	if (idx >= ARENA_MAX_BLOCKS)
+	{
+		/* lost the race for the last block */
+		vlcwrp_atomic_add(&c->count, -1);
+		arena_unmap(c, *frame);
+		vlcwrp_atomic_add(&arena_mapped, -(unsigned long long)c->block_size);
+		return -1;
+	}
+	c->blocks[idx] = *frame;
+	return (int)(c - arena_classes) * ARENA_MAX_BLOCKS + idx;
+}
+
+/* gives back the frame taken as block */
+void vlcwrp_arena_put(int block)
+{
+	struct arena_class* c = &arena_classes[block / ARENA_MAX_BLOCKS];
+	unsigned int idx = (unsigned int)(block % ARENA_MAX_BLOCKS);
+	unsigned long long head = vlcwrp_atomic_load(&c->head);
+
+	do
+		vlcwrp_atomic_store(&c->next[idx], HEAD_TOP(head));
+	while (!__atomic_compare_exchange_n(&c->head, &head, HEAD_MAKE(head, idx + 1), 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+	vlcwrp_atomic_add(&c->nfree, 1);
+}
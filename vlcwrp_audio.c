@@ -0,0 +1,321 @@
+/*********************************************************************/
+/*                                                                   */
+/* Copyright (C) 2010,  AVIQ Bulgaria Ltd                            */
+/*                                                                   */
+/* Project:       LRun                                               */
+/* Filename:      vlcwrp_audio.c                                     */
+/* Description:   VLC wrapper audio callbacks                        */
+/*                                                                   */
+/*********************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "vlcwrp_priv.h"
+
+/* audio sample format, signed 16 bit native endian */
+#define AUDIO_FORMAT "S16N"
+
+/* weight of the last audio lag sample in the master clock is 1/CLOCK_SMOOTHING */
+#define CLOCK_SMOOTHING 8
+
+/**
+ * audio ring slot
+ */
+struct vlcwrp_audio_slot_t
+{
+	/* buffer exposed to the consumer */
+	vlcwrp_audio_buffer_t buf;
+
+	/* flush epoch the samples belong to */
+	unsigned int epoch;
+};
+
+/**
+ * audio ring state
+ *
+ * The ring has a single producer, the VLC audio thread, and a single
+ * consumer. The producer owns head, the consumer owns tail, neither locks
+ * and all memory is allocated before playback starts.
+ */
+struct vlcwrp_audio_ctx_t
+{
+	/* configuration */
+	vlcwrp_audio_config_t config;
+
+	/* ring slots and their sample storage */
+	struct vlcwrp_audio_slot_t* slots;
+	short* data;
+
+	/* next slot to be written and read */
+	unsigned int head;
+	unsigned int tail;
+
+	/* incremented on flush, slots of older epochs are discarded */
+	unsigned int epoch;
+
+	/* the consumer holds the slot at tail */
+	int acquired;
+
+	/* statistics */
+	unsigned long written;
+	unsigned long read;
+	unsigned long dropped;
+};
+
+/* fill config with the default audio callbacks configuration */
+void vlcwrp_audio_defaults(vlcwrp_audio_config_t* config)
+{
+	config->rate = 48000;
+	config->channels = 2;
+	config->buffer_samples = 1024;
+	config->buffers = 64;
+}
+
+/* computes per channel peak and RMS levels of interleaved samples */
+static void audio_levels(const short* samples, unsigned int nsamples, unsigned int channels, float* peak, float* rms)
+{
+	unsigned int i = 0, c, total = nsamples * channels;
+	int maxabs[VLCWRP_AUDIO_MAX_CHANNELS];
+	double sumsq[VLCWRP_AUDIO_MAX_CHANNELS];
+
+	for (c=0; c<channels; c++)
+	{
+		maxabs[c] = 0;
+		sumsq[c] = 0;
+	}
+
+#ifdef __SSE2__
+	/* with 1, 2 or 4 channels vector lane i always holds channel i % channels */
+	if (4 % channels == 0)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		__m128i vmax = zero;
+		__m128 vsum = _mm_setzero_ps();
+		short lanes[8];
+		float sums[4];
+
+		for (; i + 8 <= total; i += 8)
+		{
+			__m128i v = _mm_loadu_si128((const __m128i*)(samples + i));
+			__m128 lo = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16));
+			__m128 hi = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16));
+			vmax = _mm_max_epi16(vmax, _mm_max_epi16(v, _mm_subs_epi16(zero, v)));
+			vsum = _mm_add_ps(vsum, _mm_add_ps(_mm_mul_ps(lo, lo), _mm_mul_ps(hi, hi)));
+		}
+		_mm_storeu_ps(sums, vsum);
+		_mm_storeu_si128((__m128i*)lanes, vmax);
+		for (c=0; c<8; c++)
+			if (lanes[c] > maxabs[c % channels])
+				maxabs[c % channels] = lanes[c];
+		for (c=0; c<4; c++)
+			sumsq[c % channels] += sums[c];
+	}
+#endif
+	for (; i < total; i++)
+	{
+		int s = samples[i];
+		c = i % channels;
+		if (s < 0) s = -s;
+		if (s > maxabs[c]) maxabs[c] = s;
+		sumsq[c] += (double)s * s;
+	}
+
+	for (c=0; c<channels; c++)
+	{
+		peak[c] = maxabs[c] / 32768.0f;
+		rms[c] = nsamples ? (float)(sqrt(sumsq[c] / nsamples) / 32768.0) : 0.0f;
+	}
+}
+
+/* called by VLC on the audio thread with decoded samples */
+void vlcwrp_audio_play(void* opaque, const void* samples, unsigned count, int64_t pts)
+{
+	struct vlcwrp_ctx_t* ctx = (struct vlcwrp_ctx_t*)opaque;
+	struct vlcwrp_audio_ctx_t* au = ctx->audio;
+	const short* src = (const short*)samples;
+	unsigned int channels = au->config.channels;
+	unsigned int epoch = vlcwrp_atomic_load(&au->epoch);
+
+	vlcwrp_threads_enter(ctx, VLCWRP_THREAD_AUDIO);
+
+	/* splits the samples into ring slots */
+	while (count > 0)
+	{
+		unsigned int n = count < au->config.buffer_samples ? count : au->config.buffer_samples;
+		unsigned int head = au->head;
+
+		if (head - vlcwrp_atomic_load(&au->tail) == au->config.buffers)
+		{
+			/* the consumer is too slow, never wait on the audio thread */
+			vlcwrp_atomic_store(&au->dropped, au->dropped + 1);
+		}
+		else
+		{
+			struct vlcwrp_audio_slot_t* slot = &au->slots[head % au->config.buffers];
+			memcpy((short*)slot->buf.samples, src, n * channels * sizeof(short));
+			slot->buf.nsamples = n;
+			slot->buf.pts = pts;
+			slot->epoch = epoch;
+			audio_levels(src, n, channels, slot->buf.peak, slot->buf.rms);
+			vlcwrp_atomic_store(&au->head, head + 1);
+			vlcwrp_atomic_store(&au->written, au->written + 1);
+		}
+		src += n * channels;
+		count -= n;
+		pts += (int64_t)n * 1000000 / au->config.rate;
+	}
+}
+
+/* called by VLC on seek or stop, the queued samples are obsolete */
+void vlcwrp_audio_flush(void* opaque, int64_t pts)
+{
+	struct vlcwrp_ctx_t* ctx = (struct vlcwrp_ctx_t*)opaque;
+	vlcwrp_atomic_add(&ctx->audio->epoch, 1);
+}
+
+/* deliver decoded audio to a lock-free ring instead of the audio output */
+int vlcwrp_audio_start(struct vlcwrp_ctx_t* ctx, const vlcwrp_audio_config_t* config)
+{
+	struct vlcwrp_audio_ctx_t* au;
+	unsigned int i;
+
+	if (ctx->audio)
+		return 0;
+
+	au = (struct vlcwrp_audio_ctx_t*)calloc(1, sizeof(struct vlcwrp_audio_ctx_t));
+	if (!au)
+		return -1;
+	if (config)
+		au->config = *config;
+	else
+		vlcwrp_audio_defaults(&au->config);
+	if (au->config.channels < 1 || au->config.channels > VLCWRP_AUDIO_MAX_CHANNELS
+	 || au->config.rate < 1 || au->config.buffer_samples < 1 || au->config.buffers < 2)
+	{
+		free(au);
+		return -1;
+	}
+
+	/* allocates all slots upfront, the audio thread never allocates */
+	au->slots = (struct vlcwrp_audio_slot_t*)calloc(au->config.buffers, sizeof(struct vlcwrp_audio_slot_t));
+	au->data = (short*)malloc((size_t)au->config.buffers * au->config.buffer_samples * au->config.channels * sizeof(short));
+	if (!au->slots || !au->data)
+	{
+		free(au->slots);
+		free(au->data);
+		free(au);
+		return -1;
+	}
+	for (i=0; i<au->config.buffers; i++)
+	{
+		au->slots[i].buf.samples = au->data + (size_t)i * au->config.buffer_samples * au->config.channels;
+		au->slots[i].buf.channels = au->config.channels;
+	}
+
+	ctx->audio = au;
+	vlcwrp_audio_setup(ctx, ctx->mp, vlcwrp_audio_play, vlcwrp_audio_flush, ctx);
+	return 0;
+}
+
+/* sets the audio callbacks and the sample format of ctx on player mp */
+void vlcwrp_audio_setup(struct vlcwrp_ctx_t* ctx, libvlc_media_player_t* mp, libvlc_audio_play_cb play, libvlc_audio_flush_cb flush, void* opaque)
+{
+	libvlc_audio_set_callbacks(mp, play, NULL, NULL, flush, NULL, opaque);
+	libvlc_audio_set_format(mp, AUDIO_FORMAT, ctx->audio->config.rate, ctx->audio->config.channels);
+}
+
+/* the consumer plays the buffer now, the master clock follows its pts */
+static void update_clock(struct vlcwrp_ctx_t* ctx, long long pts)
+{
+	long long lag = pts - libvlc_clock();
+	if (vlcwrp_atomic_load(&ctx->clock_audio))
+	{
+		/* smooths out the buffer granularity jitter */
+		long long prev = vlcwrp_atomic_load(&ctx->clock_audio_lag);
+		lag = prev + (lag - prev) / CLOCK_SMOOTHING;
+	}
+	vlcwrp_atomic_store(&ctx->clock_audio_lag, lag);
+	vlcwrp_atomic_store(&ctx->clock_audio, 1);
+}
+
+/* acquire the oldest audio buffer from the ring */
+const vlcwrp_audio_buffer_t* vlcwrp_audio_acquire(struct vlcwrp_ctx_t* ctx)
+{
+	struct vlcwrp_audio_ctx_t* au = ctx->audio;
+	unsigned int epoch;
+
+	if (!au)
+		return NULL;
+
+	epoch = vlcwrp_atomic_load(&au->epoch);
+	while (au->tail != vlcwrp_atomic_load(&au->head))
+	{
+		struct vlcwrp_audio_slot_t* slot = &au->slots[au->tail % au->config.buffers];
+		if (slot->epoch == epoch)
+		{
+			au->acquired = 1;
+			update_clock(ctx, slot->buf.pts);
+			return &slot->buf;
+		}
+		/* discards samples queued before the last flush */
+		vlcwrp_atomic_store(&au->tail, au->tail + 1);
+	}
+	return NULL;
+}
+
+/* release the acquired audio buffer */
+void vlcwrp_audio_release(struct vlcwrp_ctx_t* ctx)
+{
+	struct vlcwrp_audio_ctx_t* au = ctx->audio;
+	if (au && au->acquired)
+	{
+		au->acquired = 0;
+		au->read++;
+		vlcwrp_atomic_store(&au->tail, au->tail + 1);
+	}
+}
+
+/* get audio ring statistics */
+int vlcwrp_audio_stats(struct vlcwrp_ctx_t* ctx, vlcwrp_audio_stats_t* stats)
+{
+	struct vlcwrp_audio_ctx_t* au = ctx->audio;
+	unsigned int head;
+
+	if (!au)
+		return 0;
+
+	memset(stats, 0, sizeof(vlcwrp_audio_stats_t));
+	head = vlcwrp_atomic_load(&au->head);
+	stats->written = vlcwrp_atomic_load(&au->written);
+	stats->dropped = vlcwrp_atomic_load(&au->dropped);
+	stats->read = au->read;
+	stats->queued = head - au->tail;
+	stats->channels = au->config.channels;
+	if (head > 0)
+	{
+		/* the last written slot is only rewritten after a full ring turn */
+		const vlcwrp_audio_buffer_t* buf = &au->slots[(head - 1) % au->config.buffers].buf;
+		memcpy(stats->peak, buf->peak, sizeof(stats->peak));
+		memcpy(stats->rms, buf->rms, sizeof(stats->rms));
+	}
+	return 1;
+}
+
+/* releases the audio ring, the media player must be released */
+void vlcwrp_audio_free(struct vlcwrp_ctx_t* ctx)
+{
+	struct vlcwrp_audio_ctx_t* au = ctx->audio;
+	if (au)
+	{
+		free(au->slots);
+		free(au->data);
+		free(au);
+		ctx->audio = NULL;
+	}
+}
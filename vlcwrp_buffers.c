@@ -0,0 +1,186 @@
+/*********************************************************************/
+/*                                                                   */
+/* Copyright (C) 2010,  AVIQ Bulgaria Ltd                            */
+/*                                                                   */
+/* Project:       LRun                                               */
+/* Filename:      vlcwrp_buffers.c                                   */
+/* Description:   VLC wrapper frame ring buffers                     */
+/*                                                                   */
+/*********************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+
+#include "vlcwrp_priv.h"
+
+/* the frame slots start on a page so no page is shared by two frames */
+#define BUFFERS_PAGE_SIZE 4096
+
+/* NUMA nodes addressable by the bind mask */
+#define BUFFERS_MAX_NODES 1024
+
+/* from linux/mempolicy.h, not installed everywhere */
+#define BUFFERS_MPOL_BIND 2
+#define BUFFERS_MPOL_MF_MOVE (1 << 1)
+
+#define ALIGN_TO(x, a) (((x) + (a) - 1) / (a) * (a))
+
+/* get the default frame buffers configuration */
+void vlcwrp_buffer_defaults(vlcwrp_buffer_config_t* config)
+{
+	config->hugepages = VLCWRP_HUGEPAGES_TRANSPARENT;
+	config->prefault = 1;
+	config->numa = 0;
+	config->reserve = 1;
+	config->pitch_align = 0;
+}
+
+/* allocates the reserved frames, called on create */
+int vlcwrp_buffers_alloc(struct vlcwrp_ctx_t* ctx, const vlcwrp_buffer_config_t* config)
+{
+	int i;
+
+	/* the rows are packed unless aligned on request, the consumers may assume width * 4 */
+	if (config->pitch_align < 0 || (config->pitch_align & (config->pitch_align - 1)))
+		return -1;
+	ctx->pitch = config->pitch_align > BPP ? ALIGN_TO(ctx->width * BPP, config->pitch_align) : ctx->width * BPP;
+	ctx->frame_size = (size_t)ctx->pitch * ctx->height;
+	ctx->buffers_class = vlcwrp_arena_attach(ctx->frame_size) + 1;
+	if (!ctx->buffers_class)
+		return -1;
+	ctx->buffers_config = *config;
+	ctx->buffers_reserve = config->reserve < 1 ? 1 : (config->reserve > QUEUE_SIZE ? QUEUE_SIZE : config->reserve);
+	ctx->buffers_numa = config->numa;
+
+	/* the reserved frames are never given back to the arena */
+	for (i=0; i<ctx->buffers_reserve; i++)
+		if (vlcwrp_buffers_get(ctx, i, 0))
+			return -1;
+	return 0;
+}
+
+/* gives back all the frames to the arena */
+void vlcwrp_buffers_free(struct vlcwrp_ctx_t* ctx)
+{
+	int i;
+	for (i=0; i<QUEUE_SIZE; i++)
+		if (ctx->frame_block[i])
+		{
+			vlcwrp_arena_put(ctx->frame_block[i] - 1);
+			ctx->frame_block[i] = 0;
+			ctx->frame_queue[i] = NULL;
+		}
+	ctx->buffers_held = 0;
+
+	/* the class is unmapped once no player uses it */
+	if (ctx->buffers_class)
+		vlcwrp_arena_detach(ctx->buffers_class - 1);
+	ctx->buffers_class = 0;
+}
+
+/* moves the frame of slot from to slot to */
+static void buffers_move(struct vlcwrp_ctx_t* ctx, int from, int to)
+{
+	ctx->frame_queue[to] = ctx->frame_queue[from];
+	ctx->frame_block[to] = ctx->frame_block[from];
+	ctx->frame_queue[from] = NULL;
+	ctx->frame_block[from] = 0;
+}
+
+/* takes a frame from the arena for the empty slot idx, over the budget if stopping, called with ctx->mutex locked */
+int vlcwrp_buffers_get(struct vlcwrp_ctx_t* ctx, int idx, int stopping)
+{
+	int i, from, block;
+
+	if (ctx->frame_queue[idx])
+		return 0;
+
+	/* a stopping decoder never waits for a frame, the stop gives it back */
+	block = vlcwrp_arena_get(ctx->buffers_class - 1, &ctx->buffers_config, stopping, &ctx->frame_queue[idx]);
+	if (block >= 0)
+	{
+		ctx->frame_block[idx] = block + 1;
+		ctx->buffers_held++;
+		return 0;
+	}
+	ctx->frame_queue[idx] = NULL;
+
+	/* over budget a frame of an idle slot is moved */
+	for (i=ctx->nqueuedframes + ctx->npendingframes; i<QUEUE_SIZE; i++)
+	{
+		from = (ctx->ridx + i) % QUEUE_SIZE;
+		if (from != idx && ctx->frame_block[from])
+		{
+			buffers_move(ctx, from, idx);
+			return 0;
+		}
+	}
+
+	/* else the oldest queued frame is reused, no frame is acquired while the mutex is held */
+	if (ctx->nqueuedframes == 0 || ctx->ridx == idx || ctx->read_copy)
+		return -1;
+	buffers_move(ctx, ctx->ridx, idx);
+	ctx->ridx = (ctx->ridx + 1) % QUEUE_SIZE;
+	ctx->nqueuedframes--;
+	ctx->buffers_dropped++;
+	return 0;
+}
+
+/* gives back the frame of the idle slot idx beyond the reservation, called with ctx->mutex locked */
+static void buffers_trim(struct vlcwrp_ctx_t* ctx, int idx)
+{
+	/* the exported slots are not arena frames, a frame being copied by the decoder thread is kept */
+	if (ctx->export || !ctx->frame_block[idx] || ctx->buffers_held <= ctx->buffers_reserve
+	 || vlcwrp_atomic_load(&ctx->copy_slot) == idx + 1)
+		return;
+	vlcwrp_arena_put(ctx->frame_block[idx] - 1);
+	ctx->frame_block[idx] = 0;
+	ctx->frame_queue[idx] = NULL;
+	ctx->buffers_held--;
+}
+
+/*
+ * gives back the frames of all the idle slots, called with ctx->mutex locked once the player is stopped
+ * a playing player keeps the frames of its ring, giving one back per consumed frame would map it again
+ */
+void vlcwrp_buffers_trim_idle(struct vlcwrp_ctx_t* ctx)
+{
+	int i, busy = ctx->nqueuedframes + ctx->npendingframes;
+	for (i=busy; i<QUEUE_SIZE; i++)
+		buffers_trim(ctx, (ctx->ridx + i) % QUEUE_SIZE);
+}
+
+/* binds the frames to the NUMA node of the calling thread, called on the decoder thread */
+void vlcwrp_buffers_bind(struct vlcwrp_ctx_t* ctx)
+{
+#if defined(__linux__) && defined(SYS_mbind) && defined(SYS_getcpu)
+	unsigned long mask[BUFFERS_MAX_NODES / (8 * sizeof(unsigned long))];
+	unsigned int cpu, node;
+	int i;
+
+	if (syscall(SYS_getcpu, &cpu, &node, NULL) || node >= BUFFERS_MAX_NODES)
+		return;
+	memset(mask, 0, sizeof(mask));
+	mask[node / (8 * sizeof(unsigned long))] = 1UL << (node % (8 * sizeof(unsigned long)));
+
+	/* the pages already faulted on another node are migrated */
+	pthread_mutex_lock(ctx->mutex);
+	for (i=0; !ctx->export && i<QUEUE_SIZE; i++)
+		if (ctx->frame_block[i])
+			syscall(SYS_mbind, ctx->frame_queue[i], ALIGN_TO(ctx->frame_size, BUFFERS_PAGE_SIZE), BUFFERS_MPOL_BIND, mask, BUFFERS_MAX_NODES + 1, BUFFERS_MPOL_MF_MOVE);
+	pthread_mutex_unlock(ctx->mutex);
+#else
+	(void)ctx;
+#endif
+}
+
+/* get the row pitch of the frames in bytes */
+int vlcwrp_frame_pitch(struct vlcwrp_ctx_t* ctx)
+{
+	return ctx->pitch;
+}
@@ -0,0 +1,476 @@
+/*********************************************************************/
+/*                                                                   */
+/* Copyright (C) 2010,  AVIQ Bulgaria Ltd                            */
+/*                                                                   */
+/* Project:       LRun                                               */
+/* Filename:      vlcwrp_cache.c                                     */
+/* Description:   VLC wrapper decoded frame cache                    */
+/*                                                                   */
+/*********************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <lz4.h>
+
+#include "vlcwrp_priv.h"
+
+/* frames decoded less than this apart in milliseconds belong to the same run */
+#define CACHE_RUN_GAP 1000
+
+/* frame duration in milliseconds assumed until it is measured */
+#define CACHE_DEFAULT_INTERVAL 40
+
+/* number of raw frame buffers kept for reuse */
+#define CACHE_SPARES 2
+
+/**
+ * cached frame
+ */
+struct cache_entry
+{
+	long long time;
+	unsigned int seq;
+	long long timestamp;
+
+	/* frame data, LZ4 compressed if compressed is set */
+	unsigned char* data;
+	size_t size;
+	int compressed;
+
+	/* set while the raw frame waits for compression */
+	int pending;
+};
+
+/**
+ * decoded frame cache state
+ *
+ * The decoder thread copies each frame into the cache, the entries are kept
+ * sorted by the extrapolated frame time with one frame per time. When over budget the frame
+ * the farthest from the last decoded one is evicted so the cache holds a
+ * window around the playhead. With compression the compressor thread
+ * replaces the raw copies in the background, the decoder only pays a copy.
+ */
+struct vlcwrp_cache_ctx_t
+{
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	int stop;
+	int compress;
+
+	/* number of decoder threads copying a frame, signalled on cond_idle */
+	int active;
+	pthread_cond_t cond_idle;
+
+	size_t frame_size;
+	unsigned long long max_bytes;
+	unsigned long long bytes;
+
+	/* entries sorted by time */
+	struct cache_entry* entries;
+	int count;
+	int capacity;
+
+	/* number of entries waiting for compression */
+	int npending;
+
+	/* raw buffer being compressed, freed by the compressor if evicted meanwhile */
+	unsigned char* compressing;
+	int compressing_evicted;
+
+	/* raw frame buffers for reuse */
+	unsigned char* spares[CACHE_SPARES];
+	int nspares;
+
+	/* time of the last decoded frame, -1 if none */
+	long long last_time;
+
+	/* measured frame duration in milliseconds */
+	long long interval;
+
+	/* time of the frame last served or decoded, -1 if none */
+	long long cursor;
+
+	/* frame returned to the application */
+	unsigned char* output;
+
+	/* statistics */
+	unsigned long hits;
+	unsigned long misses;
+};
+
+/* fill config with the default cache configuration */
+void vlcwrp_cache_defaults(vlcwrp_cache_config_t* config)
+{
+	config->max_bytes = 512 * 1024 * 1024ULL;
+	config->compress = 0;
+}
+
+/* releases a frame buffer, raw buffers are kept for reuse, called with cache->mutex locked */
+static void cache_release_data(struct vlcwrp_cache_ctx_t* cache, unsigned char* data, int compressed)
+{
+	if (data == cache->compressing)
+		cache->compressing_evicted = 1;
+	else if (!compressed && cache->nspares < CACHE_SPARES)
+		cache->spares[cache->nspares++] = data;
+	else
+		free(data);
+}
+
+/* removes entry i, called with cache->mutex locked */
+static void cache_remove(struct vlcwrp_cache_ctx_t* cache, int i)
+{
+	struct cache_entry* e = &cache->entries[i];
+	cache->bytes -= e->size;
+	if (e->pending)
+		cache->npending--;
+	cache_release_data(cache, e->data, e->compressed);
+	memmove(e, e + 1, (cache->count - i - 1) * sizeof(struct cache_entry));
+	cache->count--;
+}
+
+/* index of the first entry not older than time */
+static int cache_lower_bound(const struct vlcwrp_cache_ctx_t* cache, long long time)
+{
+	int lo = 0, hi = cache->count;
+	while (lo < hi)
+	{
+		int mid = (lo + hi) / 2;
+		if (cache->entries[mid].time < time)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/* copies entry i to the output frame, called with cache->mutex locked */
+static const void* cache_emit(struct vlcwrp_cache_ctx_t* cache, int i, vlcwrp_frame_info_t* info)
+{
+	struct cache_entry* e = &cache->entries[i];
+	if (!e->compressed)
+		memcpy(cache->output, e->data, cache->frame_size);
+	else if (LZ4_decompress_safe((const char*)e->data, (char*)cache->output, (int)e->size, (int)cache->frame_size) != (int)cache->frame_size)
+		return NULL;
+	cache->cursor = e->time;
+	cache->hits++;
+	if (info)
+	{
+		memset(info, 0, sizeof(vlcwrp_frame_info_t));
+		info->seq = e->seq;
+		info->timestamp = e->timestamp;
+		info->time = e->time;
+	}
+	return cache->output;
+}
+
+static void* cache_run(void* arg)
+{
+	struct vlcwrp_cache_ctx_t* cache = (struct vlcwrp_cache_ctx_t*)arg;
+	int bound = LZ4_compressBound((int)cache->frame_size);
+	char* scratch = (char*)malloc(bound);
+	unsigned char* raw;
+	unsigned char* data;
+	long long time;
+	int i, size;
+
+	pthread_mutex_lock(&cache->mutex);
+	while (scratch)
+	{
+		while (!cache->stop && !cache->npending)
+			pthread_cond_wait(&cache->cond, &cache->mutex);
+		if (cache->stop)
+			break;
+
+		/* the latest frames are the most likely to be scrubbed, they are compressed first */
+		for (i=cache->count-1; !cache->entries[i].pending; i--);
+		raw = cache->compressing = cache->entries[i].data;
+		time = cache->entries[i].time;
+		cache->compressing_evicted = 0;
+		pthread_mutex_unlock(&cache->mutex);
+
+		size = LZ4_compress_default((const char*)raw, scratch, (int)cache->frame_size, bound);
+		data = size > 0 && (size_t)size < cache->frame_size ? (unsigned char*)malloc(size) : NULL;
+		if (data)
+			memcpy(data, scratch, size);
+
+		pthread_mutex_lock(&cache->mutex);
+		cache->compressing = NULL;
+		i = cache_lower_bound(cache, time);
+		if (cache->compressing_evicted || i == cache->count || cache->entries[i].data != raw)
+		{
+			/* the frame was evicted or replaced meanwhile */
+			free(data);
+			cache_release_data(cache, raw, 0);
+			continue;
+		}
+
+		/* incompressible frames stay raw */
+		cache->entries[i].pending = 0;
+		cache->npending--;
+		if (data)
+		{
+			cache->entries[i].data = data;
+			cache->entries[i].size = size;
+			cache->entries[i].compressed = 1;
+			cache->bytes -= cache->frame_size - size;
+			cache_release_data(cache, raw, 0);
+		}
+	}
+	pthread_mutex_unlock(&cache->mutex);
+	free(scratch);
+	return NULL;
+}
+
+/* releases the cache state, the compressor must be stopped */
+static void cache_free(struct vlcwrp_cache_ctx_t* cache)
+{
+	int i;
+	for (i=0; i<cache->count; i++)
+		free(cache->entries[i].data);
+	for (i=0; i<cache->nspares; i++)
+		free(cache->spares[i]);
+	pthread_cond_destroy(&cache->cond_idle);
+	pthread_cond_destroy(&cache->cond);
+	pthread_mutex_destroy(&cache->mutex);
+	free(cache->entries);
+	free(cache->output);
+	free(cache);
+}
+
+/* start caching the decoded frames */
+int vlcwrp_cache_start(struct vlcwrp_ctx_t* ctx, const vlcwrp_cache_config_t* config)
+{
+	struct vlcwrp_cache_ctx_t* cache;
+
+	if (!ctx->video || ctx->cache || !config->max_bytes)
+		return -1;
+	cache = (struct vlcwrp_cache_ctx_t*)calloc(1, sizeof(struct vlcwrp_cache_ctx_t));
+	if (!cache)
+		return -1;
+	cache->frame_size = (size_t)ctx->pitch * ctx->height;
+	cache->max_bytes = config->max_bytes;
+	cache->compress = config->compress;
+	cache->last_time = cache->cursor = -1;
+	cache->interval = CACHE_DEFAULT_INTERVAL;
+	pthread_mutex_init(&cache->mutex, 0);
+	pthread_cond_init(&cache->cond, 0);
+	pthread_cond_init(&cache->cond_idle, 0);
+	cache->output = (unsigned char*)malloc(cache->frame_size);
+	if (!cache->output)
+	{
+		cache_free(cache);
+		return -1;
+	}
+	if (cache->compress && pthread_create(&cache->thread, 0, cache_run, cache))
+	{
+		cache_free(cache);
+		return -1;
+	}
+	pthread_mutex_lock(ctx->mutex);
+	vlcwrp_atomic_store(&ctx->cache, cache);
+	pthread_mutex_unlock(ctx->mutex);
+	return 0;
+}
+
+/* stop caching and release the cached frames */
+void vlcwrp_cache_stop(struct vlcwrp_ctx_t* ctx)
+{
+	struct vlcwrp_cache_ctx_t* cache;
+
+	/* the cache is started and stopped by the thread driving the player */
+	if (!ctx->cache)
+		return;
+
+	/* the decoder thread takes no new copy, the copies in progress are waited for */
+	pthread_mutex_lock(ctx->mutex);
+	cache = ctx->cache;
+	vlcwrp_atomic_store(&ctx->cache, (struct vlcwrp_cache_ctx_t*)NULL);
+	pthread_mutex_unlock(ctx->mutex);
+	if (!cache)
+		return;
+	pthread_mutex_lock(&cache->mutex);
+	while (cache->active > 0)
+		pthread_cond_wait(&cache->cond_idle, &cache->mutex);
+	pthread_mutex_unlock(&cache->mutex);
+	if (cache->compress)
+	{
+		pthread_mutex_lock(&cache->mutex);
+		cache->stop = 1;
+		pthread_cond_signal(&cache->cond);
+		pthread_mutex_unlock(&cache->mutex);
+		pthread_join(cache->thread, NULL);
+	}
+	cache_free(cache);
+}
+
+/* drops the cached frames, called when the media changes */
+void vlcwrp_cache_clear(struct vlcwrp_ctx_t* ctx)
+{
+	struct vlcwrp_cache_ctx_t* cache = ctx->cache;
+	if (!cache)
+		return;
+	pthread_mutex_lock(&cache->mutex);
+	while (cache->count)
+		cache_remove(cache, cache->count - 1);
+	cache->last_time = cache->cursor = -1;
+	pthread_mutex_unlock(&cache->mutex);
+}
+
+/* takes the cache for a frame copy, called with ctx->mutex locked */
+struct vlcwrp_cache_ctx_t* vlcwrp_cache_use(struct vlcwrp_ctx_t* ctx)
+{
+	struct vlcwrp_cache_ctx_t* cache = ctx->cache;
+	if (cache)
+		vlcwrp_atomic_add(&cache->active, 1);
+	return cache;
+}
+
+/* inserts the frame copy data at time, called with cache->mutex locked */
+static void cache_insert_locked(struct vlcwrp_cache_ctx_t* cache, unsigned char* data, unsigned int seq, long long timestamp, long long time)
+{
+	struct cache_entry* e;
+	int i;
+
+	/* frames decoded again after a seek replace the cached ones */
+	if (cache->last_time >= 0 && time > cache->last_time && time - cache->last_time <= CACHE_RUN_GAP)
+	{
+		cache->interval = (3 * cache->interval + time - cache->last_time + 2) / 4;
+		i = cache_lower_bound(cache, cache->last_time + 1);
+	}
+	else
+		i = cache_lower_bound(cache, time - cache->interval / 2 + 1);
+	while (i < cache->count && cache->entries[i].time <= time)
+		cache_remove(cache, i);
+
+	if (cache->count == cache->capacity)
+	{
+		int capacity = cache->capacity ? 2 * cache->capacity : 64;
+		e = (struct cache_entry*)realloc(cache->entries, capacity * sizeof(struct cache_entry));
+		if (!e)
+		{
+			cache_release_data(cache, data, 0);
+			return;
+		}
+		cache->entries = e;
+		cache->capacity = capacity;
+	}
+	e = &cache->entries[i];
+	memmove(e + 1, e, (cache->count - i) * sizeof(struct cache_entry));
+	cache->count++;
+	e->time = time;
+	e->seq = seq;
+	e->timestamp = timestamp;
+	e->data = data;
+	e->size = cache->frame_size;
+	e->compressed = 0;
+	e->pending = cache->compress;
+	cache->bytes += cache->frame_size;
+	if (e->pending)
+	{
+		cache->npending++;
+		pthread_cond_signal(&cache->cond);
+	}
+	cache->last_time = cache->cursor = time;
+
+	/* evicts the frames the farthest from the playhead, never the new one */
+	while (cache->bytes > cache->max_bytes && cache->count > 1)
+	{
+		if (time - cache->entries[0].time > cache->entries[cache->count - 1].time - time)
+			cache_remove(cache, 0);
+		else
+			cache_remove(cache, cache->count - 1);
+	}
+}
+
+/* copies the decoded frame to the cache taken by vlcwrp_cache_use, called on the decoder thread */
+void vlcwrp_cache_insert(struct vlcwrp_cache_ctx_t* cache, const unsigned char* pixels, unsigned int seq, long long timestamp, long long time)
+{
+	unsigned char* data = NULL;
+
+	pthread_mutex_lock(&cache->mutex);
+	if (time >= 0 && cache->nspares)
+		data = cache->spares[--cache->nspares];
+	pthread_mutex_unlock(&cache->mutex);
+	if (time >= 0 && (data || (data = (unsigned char*)malloc(cache->frame_size))))
+		memcpy(data, pixels, cache->frame_size);
+
+	/* gives back the cache, vlcwrp_cache_stop waits for it */
+	pthread_mutex_lock(&cache->mutex);
+	if (data)
+		cache_insert_locked(cache, data, seq, timestamp, time);
+	if (vlcwrp_atomic_add(&cache->active, -1) == 0)
+		pthread_cond_broadcast(&cache->cond_idle);
+	pthread_mutex_unlock(&cache->mutex);
+}
+
+/* step delta frames from the current cached frame */
+const void* vlcwrp_cache_step(struct vlcwrp_ctx_t* ctx, int delta, vlcwrp_frame_info_t* info)
+{
+	struct vlcwrp_cache_ctx_t* cache = ctx->cache;
+	const void* frame = NULL;
+	int i, decode = 0;
+
+	if (!cache)
+		return NULL;
+	pthread_mutex_lock(&cache->mutex);
+	i = cache_lower_bound(cache, cache->cursor);
+
+	/* an evicted current frame counts as the next newer one */
+	if ((i == cache->count || cache->entries[i].time != cache->cursor) && delta > 0)
+		delta--;
+	i += delta;
+	if (i >= 0 && i < cache->count)
+		frame = cache_emit(cache, i, info);
+	if (!frame)
+	{
+		cache->misses++;
+		decode = delta > 0 && i >= cache->count;
+	}
+	pthread_mutex_unlock(&cache->mutex);
+
+	/* stepping forward past the cache decodes the next frame */
+	if (decode)
+		libvlc_media_player_next_frame(ctx->mp);
+	return frame;
+}
+
+/* get the cached frame displayed at time */
+const void* vlcwrp_cache_seek(struct vlcwrp_ctx_t* ctx, long long time, vlcwrp_frame_info_t* info)
+{
+	struct vlcwrp_cache_ctx_t* cache = ctx->cache;
+	const void* frame = NULL;
+	int i;
+
+	if (!cache)
+		return NULL;
+	pthread_mutex_lock(&cache->mutex);
+
+	/* the frame starting the latest before time covers it for a frame duration */
+	i = cache_lower_bound(cache, time + 1) - 1;
+	if (i >= 0 && time - cache->entries[i].time < cache->interval)
+		frame = cache_emit(cache, i, info);
+	if (!frame)
+		cache->misses++;
+	pthread_mutex_unlock(&cache->mutex);
+	return frame;
+}
+
+/* get cache statistics */
+int vlcwrp_cache_stats(struct vlcwrp_ctx_t* ctx, vlcwrp_cache_stats_t* stats)
+{
+	struct vlcwrp_cache_ctx_t* cache = ctx->cache;
+	if (!cache)
+		return 0;
+	pthread_mutex_lock(&cache->mutex);
+	stats->frames = cache->count;
+	stats->pending = cache->npending;
+	stats->bytes = cache->bytes;
+	stats->first = cache->count ? cache->entries[0].time : -1;
+	stats->last = cache->count ? cache->entries[cache->count - 1].time : -1;
+	stats->hits = cache->hits;
+	stats->misses = cache->misses;
+	pthread_mutex_unlock(&cache->mutex);
+	return 1;
+}
@@ -0,0 +1,127 @@
+/*********************************************************************/
+/*                                                                   */
+/* Copyright (C) 2010,  AVIQ Bulgaria Ltd                            */
+/*                                                                   */
+/* Project:       LRun                                               */
+/* Filename:      vlcwrp_events.c                                    */
+/* Description:   VLC wrapper event queue                            */
+/*                                                                   */
+/*********************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "vlcwrp_priv.h"
+
+/* maximum number of queued events, the oldest are dropped beyond */
+#define EVENT_QUEUE_SIZE 64
+
+/**
+ * event queue state
+ *
+ * Events are posted by the wrapper threads and polled by the application.
+ * The queue has its own mutex so events can be posted and polled while the
+ * application holds an acquired frame.
+ */
+struct vlcwrp_events_ctx_t
+{
+	pthread_mutex_t mutex;
+	vlcwrp_event_t queue[EVENT_QUEUE_SIZE];
+
+	/* next event to be written and read */
+	unsigned int head;
+	unsigned int tail;
+
+	/* number of events dropped because the queue was full */
+	unsigned long dropped;
+};
+
+/* creates the event queue */
+int vlcwrp_events_init(struct vlcwrp_ctx_t* ctx)
+{
+	struct vlcwrp_events_ctx_t* ev = (struct vlcwrp_events_ctx_t*)calloc(1, sizeof(struct vlcwrp_events_ctx_t));
+	if (!ev)
+		return -1;
+	pthread_mutex_init(&ev->mutex, 0);
+	ctx->events = ev;
+	return 0;
+}
+
+/* releases the event queue, no thread may post anymore */
+void vlcwrp_events_free(struct vlcwrp_ctx_t* ctx)
+{
+	struct vlcwrp_events_ctx_t* ev = ctx->events;
+	if (ev)
+	{
+		pthread_mutex_destroy(&ev->mutex);
+		free(ev);
+		ctx->events = NULL;
+	}
+}
+
+/* posts an event, called from any thread */
+void vlcwrp_event_post(struct vlcwrp_ctx_t* ctx, vlcwrp_event_type_t type, int status, long long value, const char* text)
+{
+	struct vlcwrp_events_ctx_t* ev = ctx->events;
+	vlcwrp_event_t* e;
+
+	pthread_mutex_lock(&ev->mutex);
+	if (ev->head - ev->tail == EVENT_QUEUE_SIZE)
+	{
+		/* the application is not polling, the oldest event is lost */
+		ev->tail++;
+		ev->dropped++;
+	}
+	e = &ev->queue[ev->head % EVENT_QUEUE_SIZE];
+	e->type = type;
+	e->time = vlcwrp_clock();
+	e->status = status;
+	e->value = value;
+	strncpy(e->text, text ? text : "", VLCWRP_EVENT_TEXT_SIZE - 1);
+	e->text[VLCWRP_EVENT_TEXT_SIZE - 1] = '\0';
+	ev->head++;
+	pthread_mutex_unlock(&ev->mutex);
+	vlcwrp_wait_notify(ctx);
+}
+
+/* non zero if events are waiting to be polled */
+int vlcwrp_events_pending(struct vlcwrp_ctx_t* ctx)
+{
+	struct vlcwrp_events_ctx_t* ev = ctx->events;
+	int pending;
+
+	pthread_mutex_lock(&ev->mutex);
+	pending = ev->tail != ev->head;
+	pthread_mutex_unlock(&ev->mutex);
+	return pending;
+}
+
+/* poll the next event */
+int vlcwrp_event_poll(struct vlcwrp_ctx_t* ctx, vlcwrp_event_t* event)
+{
+	struct vlcwrp_events_ctx_t* ev = ctx->events;
+	int res = 0;
+
+	vlcwrp_health_apply(ctx);
+	pthread_mutex_lock(&ev->mutex);
+	if (ev->tail != ev->head)
+	{
+		*event = ev->queue[ev->tail % EVENT_QUEUE_SIZE];
+		ev->tail++;
+		res = 1;
+	}
+	pthread_mutex_unlock(&ev->mutex);
+	return res;
+}
+
+/* get the number of events dropped because the queue was full */
+unsigned long vlcwrp_events_dropped(struct vlcwrp_ctx_t* ctx)
+{
+	struct vlcwrp_events_ctx_t* ev = ctx->events;
+	unsigned long dropped;
+
+	pthread_mutex_lock(&ev->mutex);
+	dropped = ev->dropped;
+	pthread_mutex_unlock(&ev->mutex);
+	return dropped;
+}
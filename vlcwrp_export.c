@@ -0,0 +1,227 @@
+/*********************************************************************/
+/*                                                                   */
+/* Copyright (C) 2010,  AVIQ Bulgaria Ltd                            */
+/*                                                                   */
+/* Project:       LRun                                               */
+/* Filename:      vlcwrp_export.c                                    */
+/* Description:   VLC wrapper shared memory frame export             */
+/*                                                                   */
+/*********************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <limits.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
+
+#include "vlcwrp_priv.h"
+#include "vlcwrp_export.h"
+
+/* alignment of the exported slots */
+#define EXPORT_ALIGN 4096
+
+#define ALIGN_UP(x) (((x) + EXPORT_ALIGN - 1) / EXPORT_ALIGN * EXPORT_ALIGN)
+
+/**
+ * frame export state
+ */
+struct vlcwrp_export_ctx_t
+{
+	char* name;
+	void* base;
+	size_t size;
+	vlcwrp_export_header_t* header;
+
+	/* private frame buffers replaced by the exported slots */
+	unsigned char* frames[QUEUE_SIZE];
+};
+
+#ifndef _WIN32
+/* non zero if the existing segment name was left by a player no longer exporting */
+static int export_stale(const char* name)
+{
+	const vlcwrp_export_header_t* header;
+	struct stat st;
+	void* base;
+	int fd, stale = 0;
+
+	fd = shm_open(name, O_RDONLY, 0);
+	if (fd < 0)
+		return errno == ENOENT;
+	if (fstat(fd, &st) || (size_t)st.st_size < sizeof(vlcwrp_export_header_t))
+	{
+		close(fd);
+		return 0;
+	}
+	base = mmap(NULL, sizeof(vlcwrp_export_header_t), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (base == MAP_FAILED)
+		return 0;
+
+	/* a segment of another format is never removed */
+	header = (const vlcwrp_export_header_t*)base;
+	if (vlcwrp_atomic_load(&header->magic) == VLCWRP_EXPORT_MAGIC)
+		stale = !vlcwrp_atomic_load(&header->alive)
+		     || (kill((pid_t)header->writer_pid, 0) && errno == ESRCH);
+	munmap(base, sizeof(vlcwrp_export_header_t));
+	return stale;
+}
+#endif
+
+/* export the frame ring in a named shared memory segment */
+int vlcwrp_export_start(struct vlcwrp_ctx_t* ctx, const char* name)
+{
+#ifndef _WIN32
+	struct vlcwrp_export_ctx_t* ex;
+	vlcwrp_export_header_t* header;
+	size_t slot_size, data_offset;
+	int fd, i;
+
+	if (!ctx->video || ctx->export)
+		return -1;
+	ex = (struct vlcwrp_export_ctx_t*)calloc(1, sizeof(struct vlcwrp_export_ctx_t));
+	if (!ex)
+		return -1;
+	ex->name = (char*)malloc(strlen(name) + 1);
+	if (!ex->name)
+	{
+		free(ex);
+		return -1;
+	}
+	strcpy(ex->name, name);
+
+	slot_size = ALIGN_UP((size_t)ctx->pitch * ctx->height);
+	data_offset = ALIGN_UP(sizeof(vlcwrp_export_header_t));
+	ex->size = data_offset + QUEUE_SIZE * slot_size;
+
+	/* a segment in use by another player or its readers is never truncated, a stale one is replaced */
+	fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0644);
+	if (fd < 0 && errno == EEXIST && export_stale(name))
+	{
+		shm_unlink(name);
+		fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0644);
+	}
+	if (fd < 0)
+	{
+		free(ex->name);
+		free(ex);
+		return -1;
+	}
+	if (ftruncate(fd, (off_t)ex->size))
+	{
+		close(fd);
+		shm_unlink(name);
+		free(ex->name);
+		free(ex);
+		return -1;
+	}
+	ex->base = mmap(NULL, ex->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (ex->base == MAP_FAILED)
+	{
+		shm_unlink(name);
+		free(ex->name);
+		free(ex);
+		return -1;
+	}
+
+	header = ex->header = (vlcwrp_export_header_t*)ex->base;
+	header->width = ctx->width;
+	header->height = ctx->height;
+	header->pitch = ctx->pitch;
+	header->nslots = QUEUE_SIZE;
+	header->slot_size = slot_size;
+	header->data_offset = data_offset;
+	header->writer_pid = (uint32_t)getpid();
+	header->alive = 1;
+	header->version = VLCWRP_EXPORT_VERSION;
+	vlcwrp_atomic_store(&header->magic, VLCWRP_EXPORT_MAGIC);
+
+	/* VLC decodes directly into the exported slots */
+	pthread_mutex_lock(ctx->mutex);
+	for (i=0; i<QUEUE_SIZE; i++)
+	{
+		ex->frames[i] = ctx->frame_queue[i];
+		ctx->frame_queue[i] = (unsigned char*)ex->base + data_offset + i * slot_size;
+	}
+	ctx->export = ex;
+	pthread_mutex_unlock(ctx->mutex);
+	return 0;
+#else
+	return -1;
+#endif
+}
+
+/* wakes the readers waiting on the published counter */
+static void export_wake(vlcwrp_export_header_t* header)
+{
+#ifdef __linux__
+	syscall(SYS_futex, &header->published, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+#endif
+}
+
+/* stop the frame export and remove the shared memory segment */
+void vlcwrp_export_stop(struct vlcwrp_ctx_t* ctx)
+{
+#ifndef _WIN32
+	struct vlcwrp_export_ctx_t* ex;
+	int i;
+
+	pthread_mutex_lock(ctx->mutex);
+	ex = ctx->export;
+	if (ex)
+	{
+		for (i=0; i<QUEUE_SIZE; i++)
+			ctx->frame_queue[i] = ex->frames[i];
+		ctx->export = NULL;
+	}
+	pthread_mutex_unlock(ctx->mutex);
+	if (!ex)
+		return;
+
+	/* attached readers keep their mapping, they see the export stopped */
+	vlcwrp_atomic_store(&ex->header->alive, 0);
+	export_wake(ex->header);
+	munmap(ex->base, ex->size);
+	shm_unlink(ex->name);
+	free(ex->name);
+	free(ex);
+#endif
+}
+
+/* marks the slot as being written, called with ctx->mutex locked */
+void vlcwrp_export_begin(struct vlcwrp_ctx_t* ctx, int idx)
+{
+	vlcwrp_export_slot_t* slot = &ctx->export->header->slots[idx];
+	uint32_t seq = slot->seq;
+
+	/* a slot dropped before being published is still odd */
+	vlcwrp_atomic_store(&slot->seq, seq + ((seq & 1) ? 2 : 1));
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+/* publishes the frame in the slot, called with ctx->mutex locked */
+void vlcwrp_export_publish(struct vlcwrp_ctx_t* ctx, int idx)
+{
+	vlcwrp_export_header_t* header = ctx->export->header;
+	vlcwrp_export_slot_t* slot = &header->slots[idx];
+
+	slot->frame_seq = ctx->frame_info[idx].seq;
+	slot->timestamp = ctx->frame_info[idx].timestamp;
+	vlcwrp_atomic_store(&slot->seq, slot->seq + 1);
+	vlcwrp_atomic_store(&header->latest, (uint32_t)idx);
+	vlcwrp_atomic_add(&header->published, 1);
+	export_wake(header);
+}
@@ -0,0 +1,153 @@
+/*********************************************************************/
+/*                                                                   */
+/* Copyright (C) 2010,  AVIQ Bulgaria Ltd                            */
+/*                                                                   */
+/* Project:       LRun                                               */
+/* Filename:      vlcwrp_export.h                                    */
+/* Description:   VLC wrapper shared memory frame export reader      */
+/*                                                                   */
+/*********************************************************************/
+
+#ifndef __VLCWRP_EXPORT_H
+#define __VLCWRP_EXPORT_H
+
+#include <stdint.h>
+
+#ifndef VLCWRP_API
+#ifdef _WIN32
+  #include <windows.h>
+  #ifdef VLCWRP_BUILD
+    #ifdef VLCWRP_DLL
+      #define VLCWRP_API __declspec(dllexport)
+    #endif
+  #else
+    #ifdef VLCWRP_DLL
+      #define VLCWRP_API __declspec(dllimport)
+    #endif
+  #endif
+#else
+  #ifdef VLCWRP_BUILD
+    #define VLCWRP_API extern
+  #endif
+#endif
+#endif
+
+#ifndef VLCWRP_API
+#define VLCWRP_API
+#endif
+
+/*
+ * The frame export is a POSIX shared memory segment holding the player
+ * frame ring. It starts with the header, the RV32 frames of the slots
+ * follow from data_offset every slot_size bytes.
+ *
+ * Each slot is a sequence lock, its seq is odd while VLC decodes into the
+ * slot and even when the slot holds a complete frame. A reader reads the
+ * latest slot and checks afterwards that seq did not change, the writer
+ * never waits for the readers. The published counter is incremented on
+ * each new frame and is the futex word readers wait on.
+ *
+ * vlcwrp_export_reader.c only depends on this header, out-of-process
+ * consumers can build it without VLC.
+ */
+
+/** export segment identification */
+#define VLCWRP_EXPORT_MAGIC 0x58505756 /* "VWPX" */
+#define VLCWRP_EXPORT_VERSION 1
+
+/** maximum number of exported slots */
+#define VLCWRP_EXPORT_MAX_SLOTS 8
+
+/**
+ * exported slot state and metadata
+ */
+typedef struct {
+	/* sequence lock, odd while the slot is written */
+	uint32_t seq;
+
+	/* sequence number of the frame in the slot */
+	uint32_t frame_seq;
+
+	/* monotonic time in microseconds the frame was decoded */
+	int64_t timestamp;
+
+	/* keeps the slots on separate cache lines */
+	uint8_t reserved[48];
+} vlcwrp_export_slot_t;
+
+/**
+ * export segment header
+ */
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+
+	/* RV32 frame geometry */
+	uint32_t width;
+	uint32_t height;
+	uint32_t pitch;
+
+	/* number of slots, size of a slot and offset of the first slot */
+	uint32_t nslots;
+	uint64_t slot_size;
+	uint64_t data_offset;
+
+	/* incremented on each published frame, futex word */
+	uint32_t published;
+
+	/* slot of the last published frame */
+	uint32_t latest;
+
+	/* cleared when the export stops */
+	uint32_t alive;
+
+	/* process id of the player */
+	uint32_t writer_pid;
+
+	vlcwrp_export_slot_t slots[VLCWRP_EXPORT_MAX_SLOTS];
+} vlcwrp_export_header_t;
+
+/**
+ * frame export reader type
+ */
+typedef struct vlcwrp_export_reader_t vlcwrp_export_reader_t;
+
+/**
+ * exported frame information
+ */
+typedef struct {
+	unsigned int seq;
+	long long timestamp;
+	int width;
+	int height;
+	int pitch;
+} vlcwrp_export_frame_t;
+
+/** attach to the frame export name, returns NULL on error */
+VLCWRP_API vlcwrp_export_reader_t* vlcwrp_export_open(const char* name);
+
+/**
+ * wait for a frame newer than the last acquired one
+ * timeout in milliseconds, negative to wait forever
+ * returns 1 if there is a new frame, 0 on timeout, -1 if the export stopped
+ */
+VLCWRP_API int vlcwrp_export_wait(vlcwrp_export_reader_t* reader, int timeout);
+
+/**
+ * acquire the latest exported frame, zero-copy
+ * returns NULL if there is no complete frame
+ * the frame must be validated with vlcwrp_export_release once processed
+ */
+VLCWRP_API const void* vlcwrp_export_acquire(vlcwrp_export_reader_t* reader, vlcwrp_export_frame_t* frame);
+
+/**
+ * release the acquired frame
+ * returns 0 if the frame was intact while it was processed, -1 if the
+ * player overwrote it and the results must be discarded
+ */
+VLCWRP_API int vlcwrp_export_release(vlcwrp_export_reader_t* reader);
+
+/** detach from the frame export */
+VLCWRP_API void vlcwrp_export_close(vlcwrp_export_reader_t* reader);
+
+#endif
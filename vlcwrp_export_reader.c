@@ -0,0 +1,216 @@
+/*********************************************************************/
+/*                                                                   */
+/* Copyright (C) 2010,  AVIQ Bulgaria Ltd                            */
+/*                                                                   */
+/* Project:       LRun                                               */
+/* Filename:      vlcwrp_export_reader.c                             */
+/* Description:   VLC wrapper shared memory frame export reader      */
+/*                                                                   */
+/*********************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <limits.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
+
+#include "vlcwrp_export.h"
+
+/* number of attempts to read a slot the player is rewriting */
+#define ACQUIRE_RETRIES 4
+
+/* polling period in microseconds without futex */
+#define POLL_PERIOD 1000
+
+/**
+ * frame export reader state
+ */
+struct vlcwrp_export_reader_t
+{
+	/* mapped segment */
+	void* base;
+	size_t size;
+	vlcwrp_export_header_t* header;
+
+	/* published counter of the last acquired frame */
+	uint32_t seen;
+
+	/* acquired slot and its sequence lock, slot is -1 if none */
+	int slot;
+	uint32_t slot_seq;
+};
+
+/* attach to the frame export */
+vlcwrp_export_reader_t* vlcwrp_export_open(const char* name)
+{
+#ifndef _WIN32
+	vlcwrp_export_reader_t* reader;
+	vlcwrp_export_header_t* header;
+	struct stat st;
+	void* base;
+	int fd;
+
+	fd = shm_open(name, O_RDONLY, 0);
+	if (fd < 0)
+		return NULL;
+	if (fstat(fd, &st) || (size_t)st.st_size < sizeof(vlcwrp_export_header_t))
+	{
+		close(fd);
+		return NULL;
+	}
+	base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (base == MAP_FAILED)
+		return NULL;
+
+	header = (vlcwrp_export_header_t*)base;
+	if (header->magic != VLCWRP_EXPORT_MAGIC || header->version != VLCWRP_EXPORT_VERSION
+	 || header->nslots > VLCWRP_EXPORT_MAX_SLOTS
+	 || header->data_offset + header->nslots * header->slot_size > (uint64_t)st.st_size)
+	{
+		munmap(base, (size_t)st.st_size);
+		return NULL;
+	}
+
+	reader = (vlcwrp_export_reader_t*)calloc(1, sizeof(vlcwrp_export_reader_t));
+	if (!reader)
+	{
+		munmap(base, (size_t)st.st_size);
+		return NULL;
+	}
+	reader->base = base;
+	reader->size = (size_t)st.st_size;
+	reader->header = header;
+	reader->slot = -1;
+
+	/* the frame published before attaching counts as new */
+	reader->seen = __atomic_load_n(&header->published, __ATOMIC_ACQUIRE) - 1;
+	return reader;
+#else
+	return NULL;
+#endif
+}
+
+/* wait for a frame newer than the last acquired one */
+int vlcwrp_export_wait(vlcwrp_export_reader_t* reader, int timeout)
+{
+#ifndef _WIN32
+	vlcwrp_export_header_t* header = reader->header;
+	struct timespec now, deadline;
+
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	if (timeout > 0)
+	{
+		deadline.tv_sec += timeout / 1000;
+		deadline.tv_nsec += (long)(timeout % 1000) * 1000000;
+		if (deadline.tv_nsec >= 1000000000)
+		{
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000;
+		}
+	}
+
+	for (;;)
+	{
+		struct timespec left;
+		if (__atomic_load_n(&header->published, __ATOMIC_ACQUIRE) != reader->seen)
+			return 1;
+		if (!__atomic_load_n(&header->alive, __ATOMIC_ACQUIRE))
+			return -1;
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		if (timeout >= 0)
+		{
+			left.tv_sec = deadline.tv_sec - now.tv_sec;
+			left.tv_nsec = deadline.tv_nsec - now.tv_nsec;
+			if (left.tv_nsec < 0)
+			{
+				left.tv_sec--;
+				left.tv_nsec += 1000000000;
+			}
+			if (left.tv_sec < 0)
+				return 0;
+		}
+#ifdef __linux__
+		/* the segment is shared between processes, the futex is not private */
+		if (syscall(SYS_futex, &header->published, FUTEX_WAIT, reader->seen, timeout >= 0 ? &left : NULL, NULL, 0) < 0
+		 && errno != EAGAIN && errno != EINTR && errno != ETIMEDOUT)
+			usleep(POLL_PERIOD);
+#else
+		usleep(POLL_PERIOD);
+#endif
+	}
+#else
+	return -1;
+#endif
+}
+
+/* acquire the latest exported frame */
+const void* vlcwrp_export_acquire(vlcwrp_export_reader_t* reader, vlcwrp_export_frame_t* frame)
+{
+	vlcwrp_export_header_t* header = reader->header;
+	int i;
+
+	for (i=0; i<ACQUIRE_RETRIES; i++)
+	{
+		uint32_t published = __atomic_load_n(&header->published, __ATOMIC_ACQUIRE);
+		uint32_t slot = __atomic_load_n(&header->latest, __ATOMIC_ACQUIRE);
+		vlcwrp_export_slot_t* s;
+		uint32_t seq;
+
+		if (!published || slot >= header->nslots)
+			return NULL;
+		s = &header->slots[slot];
+		seq = __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE);
+		if (seq & 1)
+			continue; /* the player already reuses the slot, a newer frame follows */
+
+		reader->seen = published;
+		reader->slot = (int)slot;
+		reader->slot_seq = seq;
+		if (frame)
+		{
+			frame->seq = s->frame_seq;
+			frame->timestamp = s->timestamp;
+			frame->width = header->width;
+			frame->height = header->height;
+			frame->pitch = header->pitch;
+		}
+		return (const char*)reader->base + header->data_offset + slot * header->slot_size;
+	}
+	return NULL;
+}
+
+/* release the acquired frame, checking it was not overwritten */
+int vlcwrp_export_release(vlcwrp_export_reader_t* reader)
+{
+	uint32_t seq;
+	if (reader->slot < 0)
+		return -1;
+	/* the frame reads complete before the sequence lock is checked */
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	seq = __atomic_load_n(&reader->header->slots[reader->slot].seq, __ATOMIC_RELAXED);
+	reader->slot = -1;
+	return seq == reader->slot_seq ? 0 : -1;
+}
+
+/* detach from the frame export */
+void vlcwrp_export_close(vlcwrp_export_reader_t* reader)
+{
+#ifndef _WIN32
+	munmap(reader->base, reader->size);
+#endif
+	free(reader);
+}
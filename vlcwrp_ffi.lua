@@ -0,0 +1,176 @@
+-----------------------------------------------------------------------
+--                                                                   --
+-- Copyright (C) 2010,  AVIQ Bulgaria Ltd                            --
+--                                                                   --
+-- Project:       LRun                                               --
+-- Filename:      vlcwrp_ffi.lua                                     --
+-- Description:   LuaJIT FFI bindings of the VLC wrapper frame API   --
+--                                                                   --
+-----------------------------------------------------------------------
+
+-- The frame loop calls the library directly, the calls are compiled by
+-- the JIT instead of crossing the Lua C API on each frame.
+--
+--   local vlcffi = require "vlcwrp_ffi"
+--   local vpl = VLC.new{...}              -- player of the C module
+--   local ctx = vlcffi.from(vpl)          -- or vlcffi.new(args, w, h)
+--   local frame = vlcffi.new_frame()
+--   if ctx:frame_acquire(frame) then
+--       upload(frame.pixels, frame.pitch, frame.height)
+--       ctx:frame_release()
+--   end
+
+local ffi = require "ffi"
+
+-- must match VLCWRP_ABI_VERSION of vlcwrp.h
+local ABI_VERSION = 2
+
+ffi.cdef[[
+struct vlcwrp_ctx_t;
+
+typedef enum {
+	VLC_OPENING,
+	VLC_BUFFERING,
+	VLC_PLAYING,
+	VLC_PAUSED,
+	VLC_STOPPED,
+	VLC_ENDED,
+	VLC_ERROR
+} vlc_state_t;
+
+typedef enum {
+	VLCWRP_FORMAT_RV32
+} vlcwrp_format_t;
+
+typedef struct {
+	int32_t version;
+	int32_t width;
+	int32_t height;
+	int32_t pitch;
+	int32_t format;
+	uint32_t seq;
+	int32_t item;
+	const unsigned char* pixels;
+	int64_t timestamp;
+	int64_t displayed;
+	int64_t time;
+} vlcwrp_frame_t;
+
+typedef struct {
+	int32_t version;
+	int32_t queued;
+	uint32_t seq;
+	uint64_t dropped;
+	uint64_t late;
+} vlcwrp_frame_stats_t;
+
+typedef struct {
+	int32_t version;
+	int32_t audio;
+	int64_t time;
+	int64_t audio_lag;
+	int64_t due_delay;
+	uint64_t late_frames;
+} vlcwrp_clock_stats_t;
+
+int vlcwrp_abi_version(void);
+const char* vlcwrp_error(void);
+struct vlcwrp_ctx_t* vlcwrp_create(int argc, const char* const* argv, int width, int height);
+void vlcwrp_destroy(struct vlcwrp_ctx_t* ctx);
+vlc_state_t vlcwrp_get_state(struct vlcwrp_ctx_t* ctx);
+void vlcwrp_play(struct vlcwrp_ctx_t* ctx, const char* url);
+void vlcwrp_stop(struct vlcwrp_ctx_t* ctx);
+void vlcwrp_pause(struct vlcwrp_ctx_t* ctx);
+int vlcwrp_frame_try_acquire(struct vlcwrp_ctx_t* ctx, vlcwrp_frame_t* frame);
+void vlcwrp_frame_release(struct vlcwrp_ctx_t* ctx);
+void vlcwrp_frame_stats(struct vlcwrp_ctx_t* ctx, vlcwrp_frame_stats_t* stats);
+long long vlcwrp_clock_time(struct vlcwrp_ctx_t* ctx, int* audio);
+void vlcwrp_clock_stats(struct vlcwrp_ctx_t* ctx, vlcwrp_clock_stats_t* stats);
+]]
+
+-- VLCWRP_LIB overrides the library searched in the default paths
+local C = ffi.load(os.getenv("VLCWRP_LIB") or "vlcwrp-1.0")
+assert(C.vlcwrp_abi_version() == ABI_VERSION, "vlcwrp_ffi: library ABI version "..C.vlcwrp_abi_version()..", expected "..ABI_VERSION)
+
+local state_names = { [0] = "Opening", "Buffering", "Playing", "Paused", "Stopped", "Ended", "Error" }
+
+local player = {}
+player.__index = player
+
+function player:play(url)
+	C.vlcwrp_play(self, url)
+end
+
+function player:stop()
+	C.vlcwrp_stop(self)
+end
+
+function player:pause()
+	C.vlcwrp_pause(self)
+end
+
+function player:get_state()
+	return state_names[tonumber(C.vlcwrp_get_state(self))]
+end
+
+-- fills frame, from new_frame(), with the next queued frame without blocking, returns frame or nil
+function player:frame_acquire(frame)
+	if C.vlcwrp_frame_try_acquire(self, frame) ~= 0 then
+		return frame
+	end
+end
+
+function player:frame_release()
+	C.vlcwrp_frame_release(self)
+end
+
+-- fills stats if given, a new vlcwrp_frame_stats_t otherwise
+function player:frame_stats(stats)
+	stats = stats or ffi.new("vlcwrp_frame_stats_t")
+	stats.version = ABI_VERSION
+	C.vlcwrp_frame_stats(self, stats)
+	return stats
+end
+
+function player:clock_time()
+	return C.vlcwrp_clock_time(self, nil)
+end
+
+function player:clock_stats(stats)
+	stats = stats or ffi.new("vlcwrp_clock_stats_t")
+	stats.version = ABI_VERSION
+	C.vlcwrp_clock_stats(self, stats)
+	return stats
+end
+
+ffi.metatype("struct vlcwrp_ctx_t", player)
+
+local M = { C = C, ABI_VERSION = ABI_VERSION }
+
+-- creates a player owned by the FFI, destroyed when collected
+function M.new(args, width, height)
+	local argv = ffi.new("const char*[?]", #args)
+	for i, a in ipairs(args) do
+		argv[i - 1] = a
+	end
+	local ctx = C.vlcwrp_create(#args, argv, width, height)
+	if ctx == nil then
+		local err = C.vlcwrp_error()
+		return nil, err ~= nil and ffi.string(err) or "VLC init error"
+	end
+	return ffi.gc(ctx, C.vlcwrp_destroy)
+end
+
+-- the context of a player of the C module, valid while that player is referenced
+function M.from(vpl)
+	return ffi.cast("struct vlcwrp_ctx_t*", vpl:handle())
+end
+
+-- a frame descriptor to reuse across frame_acquire calls
+function M.new_frame()
+	local frame = ffi.new("vlcwrp_frame_t")
+	frame.version = ABI_VERSION
+	return frame
+end
+
+return M
@@ -0,0 +1,359 @@
+/*********************************************************************/
+/*                                                                   */
+/* Copyright (C) 2010,  AVIQ Bulgaria Ltd                            */
+/*                                                                   */
+/* Project:       LRun                                               */
+/* Filename:      vlcwrp_health.c                                    */
+/* Description:   VLC wrapper stream health monitor                  */
+/*                                                                   */
+/*********************************************************************/
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "vlcwrp_priv.h"
+
+/* monitor period in milliseconds, each player is sampled at its own interval */
+#define HEALTH_TICK 100
+
+/* size of the event text */
+#define HEALTH_TEXT_SIZE 96
+
+/**
+ * per player health state
+ *
+ * Owned by the monitor thread while the player is watched, the public
+ * health is copied under health_mutex. The monitor never drives the
+ * player, a restart is requested from the thread driving it.
+ */
+struct vlcwrp_health_ctx_t
+{
+	vlcwrp_health_config_t config;
+	vlcwrp_health_t health;
+
+	/* next sample time */
+	long long next;
+
+	/* baseline of the last sample */
+	unsigned int generation;
+	unsigned int seq;
+	long long read_bytes;
+	int corrupted;
+	int lost;
+	long long sampled;
+
+	/* last progress, a new frame or new input bytes */
+	long long progress;
+
+	/* last restart requested */
+	long long restarted;
+};
+
+/**
+ * A single thread samples all the watched players, a player costs one
+ * libvlc_media_get_stats call per interval and no thread of its own.
+ */
+static pthread_mutex_t health_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t health_cond = PTHREAD_COND_INITIALIZER;
+static struct vlcwrp_ctx_t** health_players = NULL;
+static int health_count = 0;
+static int health_capacity = 0;
+
+/* the monitor thread runs while its generation is current */
+static pthread_t health_thread;
+static int health_running = 0;
+static unsigned int health_generation = 0;
+
+static const char* const health_names[] = { "idle", "ok", "low_bitrate", "decode_errors", "stalled", "failed" };
+
+/* fill config with the default health monitor configuration */
+void vlcwrp_health_defaults(vlcwrp_health_config_t* config)
+{
+	config->interval = 1000;
+	config->grace = 5000;
+	config->stall_timeout = 3000;
+	config->min_bitrate = 0;
+	config->max_errors = 10;
+	config->restart = 0;
+	config->restart_delay = 10000;
+}
+
+/* get the name of a health state */
+const char* vlcwrp_health_name(vlcwrp_health_state_t state)
+{
+	if ((unsigned int)state >= sizeof(health_names) / sizeof(health_names[0]))
+		return "unknown";
+	return health_names[state];
+}
+
+/* takes a new baseline, the media changed or the player restarted */
+static void health_baseline(struct vlcwrp_health_ctx_t* h, unsigned int generation, unsigned int seq, const libvlc_media_stats_t* st, long long now)
+{
+	h->generation = generation;
+	h->seq = seq;
+	h->read_bytes = st->i_read_bytes;
+	h->corrupted = st->i_demux_corrupted;
+	h->lost = st->i_lost_pictures;
+	h->sampled = now;
+	h->progress = now;
+}
+
+/* samples one player, called by the monitor thread with health_mutex locked */
+static void health_sample(struct vlcwrp_ctx_t* ctx, long long now)
+{
+	struct vlcwrp_health_ctx_t* h = ctx->health;
+	const vlcwrp_health_config_t* config = &h->config;
+	libvlc_media_stats_t st;
+	libvlc_media_t* m;
+	libvlc_state_t vlc_state;
+	vlcwrp_health_state_t state;
+	unsigned int generation, seq;
+	long long elapsed, since_play;
+	int errors = 0, full, judged = 1;
+	char text[HEALTH_TEXT_SIZE];
+
+	memset(&st, 0, sizeof(st));
+	m = libvlc_media_player_get_media(ctx->mp);
+	if (m)
+	{
+		libvlc_media_get_stats(m, &st);
+		libvlc_media_release(m);
+	}
+	vlc_state = libvlc_media_player_get_state(ctx->mp);
+	generation = vlcwrp_atomic_load(&ctx->generation);
+	seq = vlcwrp_atomic_load(&ctx->seq);
+	full = vlcwrp_atomic_load(&ctx->nqueuedframes) + vlcwrp_atomic_load(&ctx->npendingframes) == QUEUE_SIZE;
+
+	/* the counters restart with a new play or a new media */
+	if (generation != h->generation || seq < h->seq || st.i_read_bytes < h->read_bytes
+	 || st.i_demux_corrupted < h->corrupted || st.i_lost_pictures < h->lost)
+		health_baseline(h, generation, seq, &st, now);
+
+	elapsed = now - h->sampled;
+	if (elapsed > 0)
+	{
+		h->health.fps = (float)(seq - h->seq) * 1000000.0f / (float)elapsed;
+		h->health.bitrate = (float)(st.i_read_bytes - h->read_bytes) * 8000.0f / (float)elapsed;
+	}
+	errors = (st.i_demux_corrupted - h->corrupted) + (st.i_lost_pictures - h->lost);
+	h->health.corrupted += st.i_demux_corrupted - h->corrupted;
+	h->health.lost += st.i_lost_pictures - h->lost;
+
+	/* a player waiting on a full queue is held by its consumer, not by the stream */
+	if ((ctx->video ? seq != h->seq : st.i_read_bytes != h->read_bytes) || full)
+		h->progress = now;
+	h->seq = seq;
+	h->read_bytes = st.i_read_bytes;
+	h->corrupted = st.i_demux_corrupted;
+	h->lost = st.i_lost_pictures;
+	h->sampled = now;
+
+	since_play = now - vlcwrp_atomic_load(&ctx->startup.play);
+	text[0] = '\0';
+	switch (vlc_state)
+	{
+	case libvlc_Error:
+		state = VLCWRP_HEALTH_FAILED;
+		snprintf(text, sizeof(text), "failed");
+		break;
+	case libvlc_Opening:
+	case libvlc_Buffering:
+	case libvlc_Playing:
+		if (since_play < (long long)config->grace * 1000)
+		{
+			/* opening and prebuffering are not judged, nor restarted again */
+			state = vlc_state == libvlc_Playing ? VLCWRP_HEALTH_OK : h->health.state;
+			judged = 0;
+		}
+		else if (now - h->progress >= (long long)config->stall_timeout * 1000)
+		{
+			state = VLCWRP_HEALTH_STALLED;
+			snprintf(text, sizeof(text), "stalled no %s for %lld ms", ctx->video ? "frame" : "input", (now - h->progress) / 1000);
+		}
+		else if (config->max_errors > 0 && errors >= config->max_errors)
+		{
+			state = VLCWRP_HEALTH_DECODE_ERRORS;
+			snprintf(text, sizeof(text), "decode_errors %d in %lld ms", errors, elapsed / 1000);
+		}
+		else if (config->min_bitrate > 0 && h->health.bitrate < config->min_bitrate)
+		{
+			state = VLCWRP_HEALTH_LOW_BITRATE;
+			snprintf(text, sizeof(text), "low_bitrate %.0f kbit/s", h->health.bitrate);
+		}
+		else
+			state = VLCWRP_HEALTH_OK;
+		break;
+	default:
+		/* paused, stopped or ended by the application or the media */
+		state = VLCWRP_HEALTH_IDLE;
+		h->progress = now;
+		break;
+	}
+
+	if (state != h->health.state)
+	{
+		h->health.state = state;
+		h->health.since = now;
+		if (!text[0])
+			snprintf(text, sizeof(text), "%s", vlcwrp_health_name(state));
+		vlcwrp_event_post(ctx, VLCWRP_EVENT_HEALTH, state >= VLCWRP_HEALTH_STALLED ? -1 : 0, state, text);
+	}
+
+	/* stalled or failed players are played again by their driving thread, at most once per restart delay */
+	if (config->restart && judged && state >= VLCWRP_HEALTH_STALLED
+	 && (!h->restarted || now - h->restarted >= (long long)config->restart_delay * 1000))
+	{
+		h->restarted = now;
+		h->health.restarts++;
+		vlcwrp_atomic_store(&ctx->restart_requested, 1);
+		vlcwrp_wait_notify(ctx);
+	}
+}
+
+/* restarts the player if the monitor requested it, called by the thread driving the player */
+void vlcwrp_health_apply(struct vlcwrp_ctx_t* ctx)
+{
+	if (!vlcwrp_atomic_load(&ctx->restart_requested))
+		return;
+
+	/* the caller holds ctx->mutex with an acquired frame, the restart waits for its release */
+	if (pthread_mutex_trylock(ctx->mutex))
+		return;
+	pthread_mutex_unlock(ctx->mutex);
+	if (vlcwrp_atomic_exchange(&ctx->restart_requested, 0))
+		vlcwrp_restart(ctx);
+}
+
+/* sets the media player of ctx, the health monitor samples ctx->mp with health_mutex locked */
+void vlcwrp_health_player(struct vlcwrp_ctx_t* ctx, libvlc_media_player_t* mp)
+{
+	pthread_mutex_lock(&health_mutex);
+	vlcwrp_atomic_store(&ctx->mp, mp);
+	pthread_mutex_unlock(&health_mutex);
+}
+
+static void* health_run(void* arg)
+{
+	unsigned int generation = (unsigned int)(intptr_t)arg;
+	struct timespec deadline;
+	long long now;
+	int i;
+
+	pthread_mutex_lock(&health_mutex);
+	while (generation == health_generation)
+	{
+		now = vlcwrp_clock();
+		for (i=0; i<health_count; i++)
+		{
+			struct vlcwrp_health_ctx_t* h = health_players[i]->health;
+			if (now >= h->next)
+			{
+				h->next = now + (long long)h->config.interval * 1000;
+				health_sample(health_players[i], now);
+			}
+		}
+
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_nsec += HEALTH_TICK * 1000000L;
+		if (deadline.tv_nsec >= 1000000000)
+		{
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000;
+		}
+		pthread_cond_timedwait(&health_cond, &health_mutex, &deadline);
+	}
+	pthread_mutex_unlock(&health_mutex);
+	return NULL;
+}
+
+/* start monitoring the health of the player */
+int vlcwrp_health_watch(struct vlcwrp_ctx_t* ctx, const vlcwrp_health_config_t* config)
+{
+	struct vlcwrp_health_ctx_t* h;
+
+	if (ctx->health || config->interval <= 0)
+		return -1;
+	h = (struct vlcwrp_health_ctx_t*)calloc(1, sizeof(struct vlcwrp_health_ctx_t));
+	if (!h)
+		return -1;
+	h->config = *config;
+	h->health.state = VLCWRP_HEALTH_IDLE;
+	h->health.since = vlcwrp_clock();
+	h->generation = (unsigned int)-1;
+
+	pthread_mutex_lock(&health_mutex);
+	if (health_count == health_capacity)
+	{
+		int capacity = health_capacity ? health_capacity * 2 : 16;
+		struct vlcwrp_ctx_t** players = (struct vlcwrp_ctx_t**)realloc(health_players, capacity * sizeof(struct vlcwrp_ctx_t*));
+		if (!players)
+		{
+			pthread_mutex_unlock(&health_mutex);
+			free(h);
+			return -1;
+		}
+		health_players = players;
+		health_capacity = capacity;
+	}
+	if (!health_running)
+	{
+		if (pthread_create(&health_thread, 0, health_run, (void*)(intptr_t)health_generation))
+		{
+			pthread_mutex_unlock(&health_mutex);
+			free(h);
+			return -1;
+		}
+		health_running = 1;
+	}
+	ctx->health = h;
+	health_players[health_count++] = ctx;
+	pthread_mutex_unlock(&health_mutex);
+	return 0;
+}
+
+/* stop monitoring the health of the player */
+void vlcwrp_health_unwatch(struct vlcwrp_ctx_t* ctx)
+{
+	struct vlcwrp_health_ctx_t* h = ctx->health;
+	pthread_t thread;
+	int i, join = 0;
+
+	if (!h)
+		return;
+	pthread_mutex_lock(&health_mutex);
+	for (i=0; i<health_count && health_players[i] != ctx; i++);
+	if (i < health_count)
+		health_players[i] = health_players[--health_count];
+	ctx->health = NULL;
+
+	/* the last player stops the thread, a later watch starts a new one */
+	if (!health_count && health_running)
+	{
+		health_generation++;
+		health_running = 0;
+		thread = health_thread;
+		join = 1;
+		pthread_cond_broadcast(&health_cond);
+	}
+	pthread_mutex_unlock(&health_mutex);
+	if (join)
+		pthread_join(thread, NULL);
+	free(h);
+}
+
+/* get the health of the player */
+int vlcwrp_health(struct vlcwrp_ctx_t* ctx, vlcwrp_health_t* health)
+{
+	int rc = 0;
+	pthread_mutex_lock(&health_mutex);
+	if (ctx->health)
+	{
+		*health = ctx->health->health;
+		rc = 1;
+	}
+	pthread_mutex_unlock(&health_mutex);
+	return rc;
+}
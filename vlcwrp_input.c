@@ -0,0 +1,232 @@
+/*********************************************************************/
+/*                                                                   */
+/* Copyright (C) 2010,  AVIQ Bulgaria Ltd                            */
+/*                                                                   */
+/* Project:       LRun                                               */
+/* Filename:      vlcwrp_input.c                                     */
+/* Description:   VLC wrapper custom media input                     */
+/*                                                                   */
+/*********************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "vlcwrp_priv.h"
+
+/* size of the window advised to be read ahead of the mapped file position */
+#define READAHEAD_SIZE (8*1024*1024)
+
+/**
+ * custom media input state
+ *
+ * The input is read by the VLC input thread through the media callbacks
+ * while the statistics are read by the application, the counters are
+ * therefore accessed atomically.
+ */
+struct vlcwrp_input_ctx_t
+{
+	/* input data */
+	const unsigned char* data;
+	unsigned long long size;
+
+	/* non zero if data is a file mapping to be unmapped */
+	int mapped;
+
+	/* end of the range advised to be read ahead */
+	unsigned long long advised;
+
+	/* current read position */
+	unsigned long long position;
+
+	/* statistics */
+	unsigned long long bytes_read;
+	unsigned long reads;
+	unsigned long seeks;
+	long long read_time;
+	long long max_read_time;
+};
+
+/* advises the kernel to read ahead the mapped window following the read position */
+static void advise_readahead(struct vlcwrp_input_ctx_t* in)
+{
+#ifndef _WIN32
+	if (in->mapped && in->position + READAHEAD_SIZE / 2 >= in->advised && in->advised < in->size)
+	{
+		unsigned long long page = (unsigned long long)sysconf(_SC_PAGESIZE);
+		unsigned long long start = in->position > in->advised ? in->position : in->advised;
+		unsigned long long len;
+		start -= start % page;
+		len = in->size - start < READAHEAD_SIZE ? in->size - start : READAHEAD_SIZE;
+		madvise((void*)(in->data + start), (size_t)len, MADV_WILLNEED);
+		in->advised = start + len;
+	}
+#endif
+}
+
+/* media callbacks, called on the VLC input thread */
+
+static int input_open(void* opaque, void** datap, uint64_t* sizep)
+{
+	struct vlcwrp_input_ctx_t* in = (struct vlcwrp_input_ctx_t*)opaque;
+	in->position = 0;
+	in->advised = 0;
+	advise_readahead(in);
+	*datap = in;
+	*sizep = in->size;
+	return 0;
+}
+
+static ssize_t input_read(void* opaque, unsigned char* buf, size_t len)
+{
+	struct vlcwrp_input_ctx_t* in = (struct vlcwrp_input_ctx_t*)opaque;
+	long long start, elapsed;
+
+	if (in->position >= in->size)
+		return 0;
+	if (len > in->size - in->position)
+		len = (size_t)(in->size - in->position);
+
+	/* with a mapped file the page faults of the copy are the read latency */
+	start = vlcwrp_clock();
+	memcpy(buf, in->data + in->position, len);
+	elapsed = vlcwrp_clock() - start;
+
+	vlcwrp_atomic_store(&in->position, in->position + len);
+	advise_readahead(in);
+
+	vlcwrp_atomic_store(&in->bytes_read, in->bytes_read + len);
+	vlcwrp_atomic_store(&in->reads, in->reads + 1);
+	vlcwrp_atomic_store(&in->read_time, in->read_time + elapsed);
+	if (elapsed > in->max_read_time)
+		vlcwrp_atomic_store(&in->max_read_time, elapsed);
+	return (ssize_t)len;
+}
+
+static int input_seek(void* opaque, uint64_t offset)
+{
+	struct vlcwrp_input_ctx_t* in = (struct vlcwrp_input_ctx_t*)opaque;
+	if (offset > in->size)
+		return -1;
+	vlcwrp_atomic_store(&in->position, offset);
+	in->advised = offset;
+	advise_readahead(in);
+	vlcwrp_atomic_store(&in->seeks, in->seeks + 1);
+	return 0;
+}
+
+static void input_close(void* opaque)
+{
+	/* the input is owned by the context until the next play */
+}
+
+/* releases the custom input, the player must be stopped */
+void vlcwrp_input_free(struct vlcwrp_ctx_t* ctx)
+{
+	struct vlcwrp_input_ctx_t* in = ctx->input;
+	if (in)
+	{
+#ifndef _WIN32
+		if (in->mapped && in->size > 0)
+			munmap((void*)in->data, (size_t)in->size);
+#endif
+		free(in);
+		ctx->input = NULL;
+	}
+}
+
+/* plays the custom input, takes over in */
+static int play_input(struct vlcwrp_ctx_t* ctx, struct vlcwrp_input_ctx_t* in)
+{
+	libvlc_media_t* m;
+	ctx->input = in;
+	m = libvlc_media_new_callbacks(ctx->libvlc, input_open, input_read, input_seek, input_close, in);
+	if (!m)
+	{
+		vlcwrp_input_free(ctx);
+		return -1;
+	}
+	vlcwrp_play_media(ctx, m);
+	return 0;
+}
+
+/* play media from memory */
+int vlcwrp_play_memory(struct vlcwrp_ctx_t* ctx, const void* data, unsigned long long size)
+{
+	struct vlcwrp_input_ctx_t* in;
+
+	vlcwrp_stop(ctx);
+	vlcwrp_input_free(ctx);
+
+	in = (struct vlcwrp_input_ctx_t*)calloc(1, sizeof(struct vlcwrp_input_ctx_t));
+	if (!in)
+		return -1;
+	in->data = (const unsigned char*)data;
+	in->size = size;
+	return play_input(ctx, in);
+}
+
+/* play local file through a sequential read-ahead memory mapping */
+int vlcwrp_play_mmap(struct vlcwrp_ctx_t* ctx, const char* path)
+{
+#ifndef _WIN32
+	struct vlcwrp_input_ctx_t* in;
+	struct stat st;
+	void* data;
+	int fd;
+
+	vlcwrp_stop(ctx);
+	vlcwrp_input_free(ctx);
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -1;
+	if (fstat(fd, &st) || st.st_size == 0)
+	{
+		close(fd);
+		return -1;
+	}
+	data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED)
+		return -1;
+	madvise(data, (size_t)st.st_size, MADV_SEQUENTIAL);
+
+	in = (struct vlcwrp_input_ctx_t*)calloc(1, sizeof(struct vlcwrp_input_ctx_t));
+	if (!in)
+	{
+		munmap(data, (size_t)st.st_size);
+		return -1;
+	}
+	in->data = (const unsigned char*)data;
+	in->size = (unsigned long long)st.st_size;
+	in->mapped = 1;
+	return play_input(ctx, in);
+#else
+	return -1;
+#endif
+}
+
+/* get custom media input statistics */
+int vlcwrp_input_stats(struct vlcwrp_ctx_t* ctx, vlcwrp_input_stats_t* stats)
+{
+	struct vlcwrp_input_ctx_t* in = ctx->input;
+	if (!in)
+		return 0;
+	stats->size = in->size;
+	stats->position = vlcwrp_atomic_load(&in->position);
+	stats->bytes_read = vlcwrp_atomic_load(&in->bytes_read);
+	stats->reads = vlcwrp_atomic_load(&in->reads);
+	stats->seeks = vlcwrp_atomic_load(&in->seeks);
+	stats->read_time = vlcwrp_atomic_load(&in->read_time);
+	stats->max_read_time = vlcwrp_atomic_load(&in->max_read_time);
+	return 1;
+}
@@ -0,0 +1,349 @@
+/*********************************************************************/
+/*                                                                   */
+/* Copyright (C) 2010,  AVIQ Bulgaria Ltd                            */
+/*                                                                   */
+/* Project:       LRun                                               */
+/* Filename:      vlcwrp_latency.c                                   */
+/* Description:   VLC wrapper glass-to-glass latency probe           */
+/*                                                                   */
+/*********************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "vlcwrp_priv.h"
+
+/* emitted frames remembered for matching, 1024 divides the 16 bit counter range */
+#define LATENCY_RING 1024
+
+/* counter cells, 16 bits of counter followed by the complement of its low byte */
+#define LATENCY_COLS 6
+#define LATENCY_ROWS 4
+
+/* frames still arriving after the emission ends in milliseconds */
+#define LATENCY_GRACE 1000
+
+/* maximum time in milliseconds for the player to open the stream */
+#define LATENCY_OPEN_TIMEOUT 2000
+
+/* size of the option strings */
+#define LATENCY_OPTION_SIZE 256
+
+/**
+ * latency probe
+ *
+ * A second VLC instance reads generated RV32 frames from imem, encodes
+ * them and streams them as MPEG-TS over loopback UDP to a wrapper player.
+ * Each frame carries its counter as a grid of black and white cells large
+ * enough to survive the encoding, the time it was handed to the encoder
+ * is matched with the time the player acquires the frame carrying the
+ * same counter.
+ */
+struct latency_probe
+{
+	const vlcwrp_latency_config_t* config;
+
+	/* generated frame */
+	unsigned char* frame;
+	size_t frame_size;
+
+	/* emission start, frames emitted and to emit */
+	long long start;
+	unsigned int count;
+	unsigned int nframes;
+	int abort;
+
+	/* paces the emission and wakes it on abort */
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+
+	/* emission time of the frames by counter */
+	unsigned int emitted_counter[LATENCY_RING];
+	long long emitted_time[LATENCY_RING];
+};
+
+/* fill config with the default latency probe configuration */
+void vlcwrp_latency_defaults(vlcwrp_latency_config_t* config)
+{
+	config->profile = VLCWRP_PROFILE_LOW_LATENCY;
+	config->port = 19004;
+	config->duration = 5000;
+	config->width = 320;
+	config->height = 240;
+	config->fps = 25;
+	config->vcodec = "mp2v";
+	config->bitrate = 2000;
+	config->argc = 0;
+	config->argv = NULL;
+}
+
+/* waits until the monotonic time until or the abort of the probe */
+static void latency_sleep(struct latency_probe* p, long long until)
+{
+	struct timespec deadline;
+	long long delay = until - vlcwrp_clock();
+
+	if (delay <= 0)
+		return;
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	deadline.tv_sec += delay / 1000000;
+	deadline.tv_nsec += (long)(delay % 1000000) * 1000;
+	if (deadline.tv_nsec >= 1000000000)
+	{
+		deadline.tv_sec++;
+		deadline.tv_nsec -= 1000000000;
+	}
+	pthread_mutex_lock(&p->mutex);
+	if (!p->abort)
+		pthread_cond_timedwait(&p->cond, &p->mutex, &deadline);
+	pthread_mutex_unlock(&p->mutex);
+}
+
+/* the cells encode the counter and the complement of its low byte */
+static unsigned int latency_code(unsigned int counter)
+{
+	return (counter & 0xffff) | ((~counter & 0xff) << 16);
+}
+
+/* draws the counter cells of frame n */
+static void latency_draw(struct latency_probe* p, unsigned int n)
+{
+	int width = p->config->width, height = p->config->height;
+	unsigned int code = latency_code(n);
+	int y, col, row, x0, x1;
+
+	for (y=0; y<height; y++)
+	{
+		unsigned char* line = p->frame + (size_t)y * width * BPP;
+		row = y * LATENCY_ROWS / height;
+		for (col=0; col<LATENCY_COLS; col++)
+		{
+			x0 = col * width / LATENCY_COLS;
+			x1 = (col + 1) * width / LATENCY_COLS;
+			memset(line + x0 * BPP, (code >> (row * LATENCY_COLS + col)) & 1 ? 0xff : 0x00, (size_t)(x1 - x0) * BPP);
+		}
+	}
+}
+
+/* reads the counter from the centers of the cells, -1 if the check fails */
+static int latency_read(const unsigned char* frame, int width, int height, int pitch)
+{
+	unsigned int code = 0;
+	int col, row;
+
+	for (row=0; row<LATENCY_ROWS; row++)
+		for (col=0; col<LATENCY_COLS; col++)
+		{
+			const unsigned char* px = frame + (size_t)((2 * row + 1) * height / (2 * LATENCY_ROWS)) * pitch
+			                                + (size_t)((2 * col + 1) * width / (2 * LATENCY_COLS)) * BPP;
+			if (px[0] + px[1] + px[2] > 3 * 128)
+				code |= 1u << (row * LATENCY_COLS + col);
+		}
+	if (((code >> 16) & 0xff) != (~code & 0xff))
+		return -1;
+	return (int)(code & 0xffff);
+}
+
+/* imem callbacks, called on the input thread of the emitting instance */
+
+static int latency_get(void* data, const char* cookie, int64_t* dts, int64_t* pts, unsigned* flags, size_t* len, void** buffer)
+{
+	struct latency_probe* p = (struct latency_probe*)data;
+	unsigned int n = p->count;
+	long long due;
+
+	(void)cookie;
+	if (n >= p->nframes || vlcwrp_atomic_load(&p->abort))
+		return 1;
+
+	/* emitted in real time as a live source would */
+	due = p->start + (long long)n * 1000000 / p->config->fps;
+	latency_sleep(p, due);
+	if (vlcwrp_atomic_load(&p->abort))
+		return 1;
+	latency_draw(p, n);
+	*dts = *pts = (int64_t)n * 1000000 / p->config->fps;
+	*flags = 0;
+	*len = p->frame_size;
+	*buffer = p->frame;
+
+	vlcwrp_atomic_store(&p->emitted_time[n % LATENCY_RING], vlcwrp_clock());
+	vlcwrp_atomic_store(&p->emitted_counter[n % LATENCY_RING], n);
+	vlcwrp_atomic_store(&p->count, n + 1);
+	return 0;
+}
+
+static void latency_release(void* data, const char* cookie, size_t len, void* buffer)
+{
+	/* imem copies the frame, the buffer is drawn again for the next one */
+	(void)data; (void)cookie; (void)len; (void)buffer;
+}
+
+static int compare_latency(const void* a, const void* b)
+{
+	long long x = *(const long long*)a, y = *(const long long*)b;
+	return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+/* starts the emitting instance, returns its media player */
+static libvlc_media_player_t* latency_emit(struct latency_probe* p, libvlc_instance_t* libvlc)
+{
+	const vlcwrp_latency_config_t* config = p->config;
+	char option[LATENCY_OPTION_SIZE];
+	libvlc_media_player_t* mp;
+	libvlc_media_t* m;
+
+	m = libvlc_media_new_location(libvlc, "imem://");
+	if (!m)
+		return NULL;
+	snprintf(option, sizeof(option), ":imem-get=%lld", (long long)(intptr_t)latency_get);
+	libvlc_media_add_option(m, option);
+	snprintf(option, sizeof(option), ":imem-release=%lld", (long long)(intptr_t)latency_release);
+	libvlc_media_add_option(m, option);
+	snprintf(option, sizeof(option), ":imem-data=%lld", (long long)(intptr_t)p);
+	libvlc_media_add_option(m, option);
+	libvlc_media_add_option(m, ":imem-cookie=latency");
+	libvlc_media_add_option(m, ":imem-cat=2");
+	libvlc_media_add_option(m, ":imem-codec=" CHROMA);
+	libvlc_media_add_option(m, ":imem-caching=20");
+	snprintf(option, sizeof(option), ":imem-width=%d", config->width);
+	libvlc_media_add_option(m, option);
+	snprintf(option, sizeof(option), ":imem-height=%d", config->height);
+	libvlc_media_add_option(m, option);
+	snprintf(option, sizeof(option), ":imem-fps=%d/1", config->fps);
+	libvlc_media_add_option(m, option);
+
+	/* one keyframe per second, the stream is muxed and sent without added delay */
+	snprintf(option, sizeof(option),
+	         ":sout=#transcode{vcodec=%s,vb=%d,venc=avcodec{keyint=%d}}:std{access=udp,mux=ts{dts-delay=50},dst=127.0.0.1:%d}",
+	         config->vcodec, config->bitrate, config->fps, config->port);
+	libvlc_media_add_option(m, option);
+	libvlc_media_add_option(m, ":sout-mux-caching=20");
+
+	mp = libvlc_media_player_new_from_media(m);
+	libvlc_media_release(m);
+	if (!mp)
+		return NULL;
+	p->start = vlcwrp_clock();
+	libvlc_media_player_play(mp);
+	return mp;
+}
+
+/* measure the latency of a generated live stream from emission to frame acquisition */
+int vlcwrp_latency_probe(const vlcwrp_latency_config_t* config, vlcwrp_latency_t* result)
+{
+	static const char* const emit_args[] = { "--ignore-config", "-q", "--no-audio" };
+	struct latency_probe* p;
+	struct vlcwrp_ctx_t* ctx;
+	libvlc_instance_t* emitter = NULL;
+	libvlc_media_player_t* emit_mp = NULL;
+	libvlc_media_t* m;
+	long long* samples;
+	long long deadline, now, sum = 0;
+	char url[64];
+	int i, n = 0, last = -1, rc = -1;
+
+	memset(result, 0, sizeof(vlcwrp_latency_t));
+	if (config->width <= 0 || config->height <= 0 || config->fps <= 0 || config->duration <= 0)
+		return -1;
+	p = (struct latency_probe*)calloc(1, sizeof(struct latency_probe));
+	if (!p)
+		return -1;
+	p->config = config;
+	p->nframes = (unsigned int)((long long)config->duration * config->fps / 1000);
+	p->frame_size = (size_t)config->width * config->height * BPP;
+	p->frame = (unsigned char*)malloc(p->frame_size);
+	samples = (long long*)malloc((p->nframes + 1) * sizeof(long long));
+	pthread_mutex_init(&p->mutex, 0);
+	pthread_cond_init(&p->cond, 0);
+	for (i=0; i<LATENCY_RING; i++)
+		p->emitted_counter[i] = (unsigned int)-1;
+
+	/* the measuring player runs with the arguments and the profile under test */
+	ctx = p->frame && samples ? vlcwrp_create(config->argc, config->argv, config->width, config->height) : NULL;
+	if (!ctx)
+		goto done;
+	ctx->profile = config->profile;
+	snprintf(url, sizeof(url), "udp://@127.0.0.1:%d", config->port);
+	m = libvlc_media_new_location(ctx->libvlc, url);
+	if (!m)
+		goto done;
+	vlcwrp_play_media(ctx, m);
+
+	/* the player listens before the first frame is sent */
+	deadline = vlcwrp_clock() + LATENCY_OPEN_TIMEOUT * 1000LL;
+	while (vlcwrp_get_state(ctx) == VLC_OPENING && vlcwrp_clock() < deadline)
+		latency_sleep(p, vlcwrp_clock() + 10000);
+
+	emitter = libvlc_new(sizeof(emit_args) / sizeof(emit_args[0]), emit_args);
+	if (!emitter || !(emit_mp = latency_emit(p, emitter)))
+		goto done;
+
+	deadline = p->start + config->duration * 1000LL + LATENCY_GRACE * 1000LL;
+	while ((now = vlcwrp_clock()) < deadline)
+	{
+		unsigned int token;
+		const unsigned char* frame;
+		int ready, counter, slot;
+
+		token = vlcwrp_ready_token(ctx, &ready);
+		if (!ready)
+			vlcwrp_wait_ready(&ctx, &token, 1, (int)((deadline - now) / 1000) + 1);
+		frame = (const unsigned char*)vlcwrp_frame_acquire(ctx);
+		if (!frame)
+			continue;
+		now = vlcwrp_clock();
+		counter = latency_read(frame, ctx->width, ctx->height, ctx->pitch);
+		vlcwrp_frame_release(ctx);
+
+		/* a frame repeated by the decoder is measured once */
+		if (counter < 0 || counter == last)
+			continue;
+		last = counter;
+		slot = counter % LATENCY_RING;
+		if ((vlcwrp_atomic_load(&p->emitted_counter[slot]) & 0xffff) != (unsigned int)counter || n > (int)p->nframes)
+			continue;
+		samples[n] = now - vlcwrp_atomic_load(&p->emitted_time[slot]);
+		if (!n)
+			result->first = now - p->start;
+		sum += samples[n++];
+	}
+
+	result->emitted = (int)vlcwrp_atomic_load(&p->count);
+	result->frames = n;
+	if (n)
+	{
+		qsort(samples, n, sizeof(long long), compare_latency);
+		result->min = samples[0];
+		result->max = samples[n - 1];
+		result->mean = sum / n;
+		result->p50 = samples[n / 2];
+		result->p95 = samples[(n * 95) / 100 < n ? (n * 95) / 100 : n - 1];
+		rc = 0;
+	}
+
+done:
+	/* the emission is woken before the instance stops */
+	pthread_mutex_lock(&p->mutex);
+	vlcwrp_atomic_store(&p->abort, 1);
+	pthread_cond_broadcast(&p->cond);
+	pthread_mutex_unlock(&p->mutex);
+	if (emit_mp)
+	{
+		libvlc_media_player_stop(emit_mp);
+		libvlc_media_player_release(emit_mp);
+	}
+	if (emitter)
+		libvlc_release(emitter);
+	if (ctx)
+		vlcwrp_destroy(ctx);
+	pthread_cond_destroy(&p->cond);
+	pthread_mutex_destroy(&p->mutex);
+	free(samples);
+	free(p->frame);
+	free(p);
+	return rc;
+}
@@ -0,0 +1,509 @@
+/*********************************************************************/
+/*                                                                   */
+/* Copyright (C) 2010,  AVIQ Bulgaria Ltd                            */
+/*                                                                   */
+/* Project:       LRun                                               */
+/* Filename:      vlcwrp_overlay.c                                   */
+/* Description:   VLC wrapper overlay compositing into the frames    */
+/*                                                                   */
+/*********************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#include "vlcwrp_priv.h"
+
+/* side in pixels of the tiles classified as transparent, partial or opaque */
+#define OVERLAY_TILE 16
+
+/* tile classes */
+#define TILE_TRANSPARENT 0
+#define TILE_PARTIAL 1
+#define TILE_OPAQUE 2
+
+/* global alpha of a fully visible layer */
+#define ALPHA_ONE 256
+
+/* bound of the layer position, the blend arithmetic on it does not overflow */
+#define OVERLAY_MAX_POS 0x1000000
+
+/* x / 255 rounded, exact for x up to 255 * 255 */
+#define DIV255(x) (((x) + 128 + (((x) + 128) >> 8)) >> 8)
+
+struct overlay_layer
+{
+	/* premultiplied pixels in the frame byte order, pitch is width * BPP */
+	unsigned char* pixels;
+	int width;
+	int height;
+
+	/* position in the frame and global alpha, 0 to ALPHA_ONE */
+	int x;
+	int y;
+	int alpha;
+
+	/* class of each tile, updated over the dirty rectangles only */
+	unsigned char* tiles;
+	int tiles_x;
+	int tiles_y;
+
+	/* image change, an update converted outside the lock applies to the image it started from */
+	unsigned int serial;
+};
+
+/**
+ * overlay layers of a player
+ *
+ * Blended by the decoder thread into each decoded frame before it is
+ * queued, so the frames of the consumer, the snapshots, the recordings and
+ * the exports all carry the overlays. The mutex is held by the blend and by
+ * the updates of the application.
+ */
+struct vlcwrp_overlay_ctx_t
+{
+	pthread_mutex_t mutex;
+	struct overlay_layer layers[VLCWRP_OVERLAY_LAYERS];
+	unsigned int serial;
+
+	unsigned long frames;
+	long long blend_time;
+	unsigned long long tiles_blended;
+	unsigned long long tiles_copied;
+	unsigned long long tiles_skipped;
+};
+
+/* blends n premultiplied pixels of src over dst with the global alpha */
+static void blend_row(unsigned char* dst, const unsigned char* src, int n, int alpha)
+{
+	int i = 0, c;
+#ifdef __AVX2__
+	{
+		const __m256i zero = _mm256_setzero_si256();
+		const __m256i ga = _mm256_set1_epi16((short)alpha);
+		const __m256i c255 = _mm256_set1_epi16(255);
+		const __m256i c128 = _mm256_set1_epi16(128);
+		/* 8 pixels per iteration, unpack and pack both work within the 128 bit lanes */
+		for (; i + 8 <= n; i += 8)
+		{
+			__m256i s = _mm256_loadu_si256((const __m256i*)(src + BPP*i));
+			__m256i d = _mm256_loadu_si256((const __m256i*)(dst + BPP*i));
+			__m256i r[2];
+			int h;
+			for (h=0; h<2; h++)
+			{
+				__m256i s16 = h ? _mm256_unpackhi_epi8(s, zero) : _mm256_unpacklo_epi8(s, zero);
+				__m256i d16 = h ? _mm256_unpackhi_epi8(d, zero) : _mm256_unpacklo_epi8(d, zero);
+				__m256i a, t;
+				s16 = _mm256_srli_epi16(_mm256_mullo_epi16(s16, ga), 8);
+				a = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(s16, 0xff), 0xff);
+				t = _mm256_add_epi16(_mm256_mullo_epi16(d16, _mm256_sub_epi16(c255, a)), c128);
+				t = _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+				r[h] = _mm256_add_epi16(s16, t);
+			}
+			_mm256_storeu_si256((__m256i*)(dst + BPP*i), _mm256_packus_epi16(r[0], r[1]));
+		}
+	}
+#endif
+#ifdef __SSE2__
+	{
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i ga = _mm_set1_epi16((short)alpha);
+		const __m128i c255 = _mm_set1_epi16(255);
+		const __m128i c128 = _mm_set1_epi16(128);
+		/* 4 pixels per iteration, the alpha of each pixel is broadcast to its 4 channels */
+		for (; i + 4 <= n; i += 4)
+		{
+			__m128i s = _mm_loadu_si128((const __m128i*)(src + BPP*i));
+			__m128i d = _mm_loadu_si128((const __m128i*)(dst + BPP*i));
+			__m128i r[2];
+			int h;
+			for (h=0; h<2; h++)
+			{
+				__m128i s16 = h ? _mm_unpackhi_epi8(s, zero) : _mm_unpacklo_epi8(s, zero);
+				__m128i d16 = h ? _mm_unpackhi_epi8(d, zero) : _mm_unpacklo_epi8(d, zero);
+				__m128i a, t;
+				s16 = _mm_srli_epi16(_mm_mullo_epi16(s16, ga), 8);
+				a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s16, 0xff), 0xff);
+				t = _mm_add_epi16(_mm_mullo_epi16(d16, _mm_sub_epi16(c255, a)), c128);
+				t = _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+				r[h] = _mm_add_epi16(s16, t);
+			}
+			_mm_storeu_si128((__m128i*)(dst + BPP*i), _mm_packus_epi16(r[0], r[1]));
+		}
+	}
+#endif
+	for (; i < n; i++)
+	{
+		const unsigned char* s = src + BPP*i;
+		unsigned char* d = dst + BPP*i;
+		int a = (s[3] * alpha) >> 8;
+		for (c=0; c<BPP; c++)
+		{
+			int v = ((s[c] * alpha) >> 8) + DIV255(d[c] * (255 - a));
+			d[c] = (unsigned char)(v > 255 ? 255 : v);
+		}
+	}
+}
+
+/* classifies the tiles of the layer intersecting the rectangle */
+static void overlay_classify(struct overlay_layer* l, int x0, int y0, int x1, int y1)
+{
+	int tx, ty, x, y;
+
+	for (ty=y0 / OVERLAY_TILE; ty*OVERLAY_TILE < y1; ty++)
+		for (tx=x0 / OVERLAY_TILE; tx*OVERLAY_TILE < x1; tx++)
+		{
+			int xe = (tx + 1) * OVERLAY_TILE < l->width ? (tx + 1) * OVERLAY_TILE : l->width;
+			int ye = (ty + 1) * OVERLAY_TILE < l->height ? (ty + 1) * OVERLAY_TILE : l->height;
+			int opaque = 1, transparent = 1;
+			for (y=ty*OVERLAY_TILE; y<ye && (opaque || transparent); y++)
+			{
+				const unsigned char* p = l->pixels + ((size_t)y * l->width + tx*OVERLAY_TILE) * BPP + 3;
+				for (x=tx*OVERLAY_TILE; x<xe; x++, p+=BPP)
+				{
+					opaque &= *p == 255;
+					transparent &= *p == 0;
+				}
+			}
+			l->tiles[ty * l->tiles_x + tx] = transparent ? TILE_TRANSPARENT : (opaque ? TILE_OPAQUE : TILE_PARTIAL);
+		}
+}
+
+/* copies premultiplied RGBA rows into the layer in the frame byte order */
+static void overlay_copy(struct overlay_layer* l, const unsigned char* src, int pitch, int x0, int y0, int width, int height)
+{
+	int x, y;
+	for (y=0; y<height; y++)
+	{
+		const unsigned char* s = src + (size_t)y * pitch;
+		unsigned char* d = l->pixels + ((size_t)(y0 + y) * l->width + x0) * BPP;
+		for (x=0; x<width; x++, s+=4, d+=BPP)
+		{
+			/* RV32 is B G R X in memory */
+			d[0] = s[2];
+			d[1] = s[1];
+			d[2] = s[0];
+			d[3] = s[3];
+		}
+	}
+}
+
+/* frees the image of the layer, called with the overlay mutex locked */
+static void overlay_release(struct overlay_layer* l)
+{
+	free(l->pixels);
+	free(l->tiles);
+	l->pixels = l->tiles = NULL;
+	l->width = l->height = 0;
+}
+
+/* creates the overlay layers on first use */
+static struct vlcwrp_overlay_ctx_t* overlay_get(struct vlcwrp_ctx_t* ctx)
+{
+	struct vlcwrp_overlay_ctx_t* ov = ctx->overlay;
+	if (ov)
+		return ov;
+	ov = (struct vlcwrp_overlay_ctx_t*)calloc(1, sizeof(struct vlcwrp_overlay_ctx_t));
+	if (!ov)
+		return NULL;
+	if (pthread_mutex_init(&ov->mutex, 0))
+	{
+		free(ov);
+		return NULL;
+	}
+	/* the decoder thread reads the pointer without locking */
+	vlcwrp_atomic_store(&ctx->overlay, ov);
+	return ov;
+}
+
+/* set the image of an overlay layer */
+int vlcwrp_overlay_set(struct vlcwrp_ctx_t* ctx, int layer, const void* pixels, int width, int height, int pitch)
+{
+	struct vlcwrp_overlay_ctx_t* ov;
+	struct overlay_layer l, old;
+
+	if (!ctx->video || layer < 0 || layer >= VLCWRP_OVERLAY_LAYERS || width <= 0 || height <= 0 || pitch < width * 4)
+		return -1;
+	ov = overlay_get(ctx);
+	if (!ov)
+		return -1;
+
+	/* the image is converted outside the lock, the decoder keeps blending the previous one */
+	memset(&l, 0, sizeof(l));
+	l.width = width;
+	l.height = height;
+	l.tiles_x = (width + OVERLAY_TILE - 1) / OVERLAY_TILE;
+	l.tiles_y = (height + OVERLAY_TILE - 1) / OVERLAY_TILE;
+	l.pixels = (unsigned char*)malloc((size_t)width * height * BPP);
+	l.tiles = (unsigned char*)malloc((size_t)l.tiles_x * l.tiles_y);
+	if (!l.pixels || !l.tiles)
+	{
+		overlay_release(&l);
+		return -1;
+	}
+	overlay_copy(&l, (const unsigned char*)pixels, pitch, 0, 0, width, height);
+	overlay_classify(&l, 0, 0, width, height);
+
+	pthread_mutex_lock(&ov->mutex);
+	old = ov->layers[layer];
+	l.x = old.pixels ? old.x : 0;
+	l.y = old.pixels ? old.y : 0;
+	l.alpha = old.pixels ? old.alpha : ALPHA_ONE;
+	l.serial = ++ov->serial;
+	ov->layers[layer] = l;
+	pthread_mutex_unlock(&ov->mutex);
+	overlay_release(&old);
+	return 0;
+}
+
+/* update a rectangle of the image of an overlay layer */
+int vlcwrp_overlay_update(struct vlcwrp_ctx_t* ctx, int layer, const void* pixels, int pitch, int x, int y, int width, int height)
+{
+	struct vlcwrp_overlay_ctx_t* ov = ctx->overlay;
+	struct overlay_layer* l;
+	struct overlay_layer patch;
+	const unsigned char* src = (const unsigned char*)pixels;
+	unsigned int serial;
+	int x0, y0, x1, y1, row, applied;
+
+	if (!ov || layer < 0 || layer >= VLCWRP_OVERLAY_LAYERS || pitch < width * 4)
+		return -1;
+	l = &ov->layers[layer];
+
+	/* the rectangle is clipped to the image */
+	pthread_mutex_lock(&ov->mutex);
+	patch.width = l->width;
+	patch.height = l->height;
+	pthread_mutex_unlock(&ov->mutex);
+	if (!patch.width)
+		return -1;
+	if (width <= 0 || height <= 0 || x >= patch.width || y >= patch.height
+	 || (x < 0 && x + width <= 0) || (y < 0 && y + height <= 0))
+		return 0;
+	if (x < 0)
+	{
+		src += (size_t)-x * 4;
+		width += x;
+		x = 0;
+	}
+	if (y < 0)
+	{
+		src += (size_t)-y * pitch;
+		height += y;
+		y = 0;
+	}
+	if (width > patch.width - x)
+		width = patch.width - x;
+	if (height > patch.height - y)
+		height = patch.height - y;
+
+	/* the patch spans the whole tiles of the rectangle, their classes depend on the pixels around it */
+	x0 = x / OVERLAY_TILE * OVERLAY_TILE;
+	y0 = y / OVERLAY_TILE * OVERLAY_TILE;
+	x1 = (x + width + OVERLAY_TILE - 1) / OVERLAY_TILE * OVERLAY_TILE;
+	y1 = (y + height + OVERLAY_TILE - 1) / OVERLAY_TILE * OVERLAY_TILE;
+	x1 = x1 < patch.width ? x1 : patch.width;
+	y1 = y1 < patch.height ? y1 : patch.height;
+	memset(&patch, 0, sizeof(patch));
+	patch.width = x1 - x0;
+	patch.height = y1 - y0;
+	patch.tiles_x = (patch.width + OVERLAY_TILE - 1) / OVERLAY_TILE;
+	patch.tiles_y = (patch.height + OVERLAY_TILE - 1) / OVERLAY_TILE;
+	patch.pixels = (unsigned char*)malloc((size_t)patch.width * patch.height * BPP);
+	patch.tiles = (unsigned char*)malloc((size_t)patch.tiles_x * patch.tiles_y);
+	if (!patch.pixels || !patch.tiles)
+	{
+		overlay_release(&patch);
+		return -1;
+	}
+
+	/* only copies are made under the lock, the decoder is not held by the conversion */
+	do
+	{
+		pthread_mutex_lock(&ov->mutex);
+		if (l->width < x1 || l->height < y1)
+		{
+			pthread_mutex_unlock(&ov->mutex);
+			overlay_release(&patch);
+			return -1;
+		}
+		serial = l->serial;
+		for (row=0; row<patch.height; row++)
+			memcpy(patch.pixels + (size_t)row * patch.width * BPP, l->pixels + ((size_t)(y0 + row) * l->width + x0) * BPP, (size_t)patch.width * BPP);
+		pthread_mutex_unlock(&ov->mutex);
+
+		overlay_copy(&patch, src, pitch, x - x0, y - y0, width, height);
+		overlay_classify(&patch, 0, 0, patch.width, patch.height);
+
+		/* applied unless the image changed meanwhile, then converted again over the new one */
+		pthread_mutex_lock(&ov->mutex);
+		applied = l->serial == serial;
+		if (applied)
+		{
+			for (row=0; row<patch.height; row++)
+				memcpy(l->pixels + ((size_t)(y0 + row) * l->width + x0) * BPP, patch.pixels + (size_t)row * patch.width * BPP, (size_t)patch.width * BPP);
+			for (row=0; row<patch.tiles_y; row++)
+				memcpy(l->tiles + (y0 / OVERLAY_TILE + row) * l->tiles_x + x0 / OVERLAY_TILE, patch.tiles + row * patch.tiles_x, patch.tiles_x);
+			l->serial = ++ov->serial;
+		}
+		pthread_mutex_unlock(&ov->mutex);
+	} while (!applied);
+
+	overlay_release(&patch);
+	return 0;
+}
+
+/* place an overlay layer in the frame */
+void vlcwrp_overlay_place(struct vlcwrp_ctx_t* ctx, int layer, int x, int y, float alpha)
+{
+	struct vlcwrp_overlay_ctx_t* ov = ctx->overlay;
+
+	if (!ov || layer < 0 || layer >= VLCWRP_OVERLAY_LAYERS)
+		return;
+	x = x < -OVERLAY_MAX_POS ? -OVERLAY_MAX_POS : (x > OVERLAY_MAX_POS ? OVERLAY_MAX_POS : x);
+	y = y < -OVERLAY_MAX_POS ? -OVERLAY_MAX_POS : (y > OVERLAY_MAX_POS ? OVERLAY_MAX_POS : y);
+	pthread_mutex_lock(&ov->mutex);
+	ov->layers[layer].x = x;
+	ov->layers[layer].y = y;
+	ov->layers[layer].alpha = alpha <= 0.0f ? 0 : (alpha >= 1.0f ? ALPHA_ONE : (int)(alpha * ALPHA_ONE + 0.5f));
+	pthread_mutex_unlock(&ov->mutex);
+}
+
+/* remove an overlay layer */
+void vlcwrp_overlay_clear(struct vlcwrp_ctx_t* ctx, int layer)
+{
+	struct vlcwrp_overlay_ctx_t* ov = ctx->overlay;
+	struct overlay_layer old;
+
+	if (!ov || layer < 0 || layer >= VLCWRP_OVERLAY_LAYERS)
+		return;
+	pthread_mutex_lock(&ov->mutex);
+	old = ov->layers[layer];
+	memset(&ov->layers[layer], 0, sizeof(struct overlay_layer));
+	pthread_mutex_unlock(&ov->mutex);
+	overlay_release(&old);
+}
+
+/* blends one layer into the frame */
+static void overlay_blend_layer(struct vlcwrp_ctx_t* ctx, struct vlcwrp_overlay_ctx_t* ov, const struct overlay_layer* l, unsigned char* frame)
+{
+	/* visible part of the layer in layer coordinates */
+	int cx0 = l->x < 0 ? -l->x : 0;
+	int cy0 = l->y < 0 ? -l->y : 0;
+	int cx1 = ctx->width - l->x < l->width ? ctx->width - l->x : l->width;
+	int cy1 = ctx->height - l->y < l->height ? ctx->height - l->y : l->height;
+	int tx, ty, run, y;
+
+	if (cx0 >= cx1 || cy0 >= cy1)
+		return;
+	for (ty=cy0 / OVERLAY_TILE; ty*OVERLAY_TILE < cy1; ty++)
+	{
+		const unsigned char* tiles = l->tiles + ty * l->tiles_x;
+		int y0 = ty*OVERLAY_TILE > cy0 ? ty*OVERLAY_TILE : cy0;
+		int y1 = (ty + 1)*OVERLAY_TILE < cy1 ? (ty + 1)*OVERLAY_TILE : cy1;
+
+		/* consecutive tiles of the same class are handled as one run */
+		for (tx=cx0 / OVERLAY_TILE; tx*OVERLAY_TILE < cx1; tx=run)
+		{
+			int kind = tiles[tx], x0, x1;
+			if (kind == TILE_OPAQUE && l->alpha < ALPHA_ONE)
+				kind = TILE_PARTIAL;
+			for (run=tx + 1; run*OVERLAY_TILE < cx1; run++)
+			{
+				int next = tiles[run];
+				if (next == TILE_OPAQUE && l->alpha < ALPHA_ONE)
+					next = TILE_PARTIAL;
+				if (next != kind)
+					break;
+			}
+			x0 = tx*OVERLAY_TILE > cx0 ? tx*OVERLAY_TILE : cx0;
+			x1 = run*OVERLAY_TILE < cx1 ? run*OVERLAY_TILE : cx1;
+
+			if (kind == TILE_TRANSPARENT)
+			{
+				ov->tiles_skipped += run - tx;
+				continue;
+			}
+			for (y=y0; y<y1; y++)
+			{
+				unsigned char* dst = frame + (size_t)(l->y + y) * ctx->pitch + (size_t)(l->x + x0) * BPP;
+				const unsigned char* src = l->pixels + ((size_t)y * l->width + x0) * BPP;
+				if (kind == TILE_OPAQUE)
+					memcpy(dst, src, (size_t)(x1 - x0) * BPP);
+				else
+					blend_row(dst, src, x1 - x0, l->alpha);
+			}
+			if (kind == TILE_OPAQUE)
+				ov->tiles_copied += run - tx;
+			else
+				ov->tiles_blended += run - tx;
+		}
+	}
+}
+
+/* blends the overlay layers into the decoded frame, called by the decoder thread before the frame is queued */
+void vlcwrp_overlay_blend(struct vlcwrp_ctx_t* ctx, unsigned char* frame)
+{
+	struct vlcwrp_overlay_ctx_t* ov = ctx->overlay;
+	long long start;
+	int i, blended = 0;
+
+	pthread_mutex_lock(&ov->mutex);
+	start = vlcwrp_clock();
+	for (i=0; i<VLCWRP_OVERLAY_LAYERS; i++)
+		if (ov->layers[i].pixels && ov->layers[i].alpha > 0)
+		{
+			overlay_blend_layer(ctx, ov, &ov->layers[i], frame);
+			blended = 1;
+		}
+	if (blended)
+	{
+		ov->frames++;
+		ov->blend_time += vlcwrp_clock() - start;
+	}
+	pthread_mutex_unlock(&ov->mutex);
+}
+
+/* discards the overlay layers, called on destroy once no frame is decoded */
+void vlcwrp_overlay_free(struct vlcwrp_ctx_t* ctx)
+{
+	struct vlcwrp_overlay_ctx_t* ov = ctx->overlay;
+	int i;
+
+	if (!ov)
+		return;
+	for (i=0; i<VLCWRP_OVERLAY_LAYERS; i++)
+		overlay_release(&ov->layers[i]);
+	pthread_mutex_destroy(&ov->mutex);
+	free(ov);
+	ctx->overlay = NULL;
+}
+
+/* get overlay compositing statistics */
+int vlcwrp_overlay_stats(struct vlcwrp_ctx_t* ctx, vlcwrp_overlay_stats_t* stats)
+{
+	struct vlcwrp_overlay_ctx_t* ov = ctx->overlay;
+	int i;
+
+	if (!ov)
+		return 0;
+	pthread_mutex_lock(&ov->mutex);
+	stats->layers = 0;
+	for (i=0; i<VLCWRP_OVERLAY_LAYERS; i++)
+		if (ov->layers[i].pixels)
+			stats->layers++;
+	stats->frames = ov->frames;
+	stats->blend_time = ov->blend_time;
+	stats->tiles_blended = ov->tiles_blended;
+	stats->tiles_copied = ov->tiles_copied;
+	stats->tiles_skipped = ov->tiles_skipped;
+	pthread_mutex_unlock(&ov->mutex);
+	return 1;
+}
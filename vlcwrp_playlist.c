@@ -0,0 +1,442 @@
+/*********************************************************************/
+/*                                                                   */
+/* Copyright (C) 2010,  AVIQ Bulgaria Ltd                            */
+/*                                                                   */
+/* Project:       LRun                                               */
+/* Filename:      vlcwrp_playlist.c                                  */
+/* Description:   VLC wrapper gapless playlist                       */
+/*                                                                   */
+/*********************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "vlcwrp_priv.h"
+
+/* the prerolled item opens its input and decodes its first frame paused */
+#define PLAYLIST_PREROLL ":start-paused"
+
+struct vlcwrp_playlist_ctx_t;
+
+/**
+ * one of the two players of the playlist
+ */
+struct playlist_player
+{
+	struct vlcwrp_playlist_ctx_t* pl;
+	libvlc_media_player_t* mp;
+	int index;
+
+	/* item loaded in the player, -1 if none */
+	int item;
+
+	/* the prerolled item failed to open */
+	int failed;
+
+	/* the prerolled item pauses itself once opened, it is resumed when switched to */
+	int preroll;
+
+	/* the player is being stopped, its frames and samples are discarded */
+	int released;
+};
+
+/**
+ * playlist state
+ *
+ * Two players decode into the frame ring of the wrapper: the active one
+ * plays the current item while the other one prerolls the next item,
+ * paused with its input opened and its first frame decoded. The vmem and
+ * audio callbacks of a player wait until it is the active one. When the
+ * current item ends the switch thread resumes the prerolled player, which
+ * becomes the wrapper media player, and prerolls the item after it in the
+ * ended player. A single looping item is prerolled in the other player
+ * too. The first frame of each item is marked in its frame information.
+ */
+struct vlcwrp_playlist_ctx_t
+{
+	struct vlcwrp_ctx_t* ctx;
+
+	/* the wrapper media player and the second player */
+	struct playlist_player players[2];
+
+	/* paths in playlist order */
+	char** paths;
+	int count;
+	vlcwrp_playlist_mode_t mode;
+
+	/* frame a player not feeding the ring decodes into */
+	unsigned char* scratch;
+
+	/* switch thread */
+	pthread_t thread;
+	int thread_running;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	int stop;
+
+	/* player feeding the ring, set when its item ended, and set when it paused after the switch */
+	int active;
+	int ended;
+	int resume;
+
+	/* item switched to plus one, consumed by the next frame */
+	int pending;
+
+	/* item of the decoded frames */
+	int item;
+};
+
+/* item following item, -1 at the end of the playlist */
+static int next_item(const struct vlcwrp_playlist_ctx_t* pl, int item)
+{
+	if (item + 1 < pl->count)
+		return item + 1;
+	return pl->mode == VLCWRP_PLAYLIST_LOOP ? 0 : -1;
+}
+
+/* waits until p is the active player, returns 0 if it is released or the playlist stops first */
+static int player_wait(struct playlist_player* p)
+{
+	struct vlcwrp_playlist_ctx_t* pl = p->pl;
+	int active;
+
+	if (vlcwrp_atomic_load(&pl->active) == p->index && !vlcwrp_atomic_load(&pl->stop))
+		return 1;
+	pthread_mutex_lock(&pl->mutex);
+	while (!pl->stop && !p->released && pl->active != p->index)
+		pthread_cond_wait(&pl->cond, &pl->mutex);
+	active = !pl->stop && !p->released;
+	pthread_mutex_unlock(&pl->mutex);
+	return active;
+}
+
+/* the prerolled player keeps its first frame until it is switched to */
+static void* player_lock(void* opaque, void** p_pixels)
+{
+	struct playlist_player* p = (struct playlist_player*)opaque;
+	if (player_wait(p))
+		return vlcwrp_lockcb(p->pl->ctx, p_pixels);
+	*p_pixels = p->pl->scratch;
+	return NULL;
+}
+
+static void player_unlock(void* opaque, void* id, void* const* p_pixels)
+{
+	struct playlist_player* p = (struct playlist_player*)opaque;
+	if (p_pixels[0] != p->pl->scratch)
+		vlcwrp_unlockcb(p->pl->ctx, id, p_pixels);
+}
+
+static void player_display(void* opaque, void* id)
+{
+	struct playlist_player* p = (struct playlist_player*)opaque;
+	vlcwrp_displaycb(p->pl->ctx, id);
+}
+
+static void player_play(void* opaque, const void* samples, unsigned count, int64_t pts)
+{
+	struct playlist_player* p = (struct playlist_player*)opaque;
+	if (player_wait(p))
+		vlcwrp_audio_play(p->pl->ctx, samples, count, pts);
+}
+
+static void player_flush(void* opaque, int64_t pts)
+{
+	struct playlist_player* p = (struct playlist_player*)opaque;
+	if (vlcwrp_atomic_load(&p->pl->active) == p->index)
+		vlcwrp_audio_flush(p->pl->ctx, pts);
+}
+
+/* called by the VLC event thread when the item of a player pauses, ends or fails */
+static void player_event(const struct libvlc_event_t* ev, void* opaque)
+{
+	struct playlist_player* p = (struct playlist_player*)opaque;
+	struct vlcwrp_playlist_ctx_t* pl = p->pl;
+
+	pthread_mutex_lock(&pl->mutex);
+	if (ev->type == libvlc_MediaPlayerPaused)
+	{
+		/* the player was switched to before its preroll paused */
+		if (pl->active == p->index && p->preroll)
+		{
+			p->preroll = 0;
+			pl->resume = 1;
+			pthread_cond_broadcast(&pl->cond);
+		}
+	}
+	else if (pl->active == p->index)
+	{
+		pl->ended = 1;
+		pthread_cond_broadcast(&pl->cond);
+	}
+	else if (ev->type == libvlc_MediaPlayerEncounteredError)
+		p->failed = 1;
+	pthread_mutex_unlock(&pl->mutex);
+}
+
+/* loads item in player p and plays it, prerolled paused if preroll is set */
+static void player_load(struct vlcwrp_playlist_ctx_t* pl, struct playlist_player* p, int item, int preroll)
+{
+	struct vlcwrp_ctx_t* ctx = pl->ctx;
+	libvlc_media_t* m = libvlc_media_new_path(ctx->libvlc, pl->paths[item]);
+
+	pthread_mutex_lock(&pl->mutex);
+	p->item = item;
+	p->failed = !m;
+	p->preroll = preroll;
+	p->released = 0;
+	pthread_mutex_unlock(&pl->mutex);
+	if (!m)
+		return;
+	if (!ctx->video)
+		libvlc_media_add_option(m, ":no-video");
+	vlcwrp_profile_apply(m, ctx->profile);
+	if (preroll)
+		libvlc_media_add_option(m, PLAYLIST_PREROLL);
+	libvlc_media_player_set_media(p->mp, m);
+	libvlc_media_release(m);
+	if (libvlc_media_player_play(p->mp))
+	{
+		pthread_mutex_lock(&pl->mutex);
+		p->failed = 1;
+		pthread_mutex_unlock(&pl->mutex);
+	}
+}
+
+/* switches to the prerolled player when the current item ends */
+static void* playlist_run(void* arg)
+{
+	struct vlcwrp_playlist_ctx_t* pl = (struct vlcwrp_playlist_ctx_t*)arg;
+	struct playlist_player *cur, *next;
+	int item = next_item(pl, 0), resume;
+
+	if (item >= 0)
+		player_load(pl, &pl->players[1], item, 1);
+
+	pthread_mutex_lock(&pl->mutex);
+	for (;;)
+	{
+		while (!pl->stop && !pl->ended && !pl->resume)
+			pthread_cond_wait(&pl->cond, &pl->mutex);
+		if (pl->stop)
+			break;
+		if (pl->resume)
+		{
+			pl->resume = 0;
+			pthread_mutex_unlock(&pl->mutex);
+			libvlc_media_player_set_pause(pl->players[pl->active].mp, 0);
+			pthread_mutex_lock(&pl->mutex);
+			continue;
+		}
+		pl->ended = 0;
+		cur = &pl->players[pl->active];
+		next = &pl->players[!pl->active];
+		if (next->item < 0)
+			continue;
+
+		/* the prerolled player feeds the ring from its first frame, a failed item is skipped */
+		vlcwrp_atomic_store(&pl->active, next->index);
+		vlcwrp_atomic_store(&pl->pending, next->item + 1);
+		cur->released = 1;
+		if (next->failed)
+			pl->ended = 1;
+		pthread_cond_broadcast(&pl->cond);
+		pthread_mutex_unlock(&pl->mutex);
+
+		vlcwrp_health_player(pl->ctx, next->mp);
+
+		/* a prerolled player still opening is resumed on its pause event */
+		if (libvlc_media_player_get_state(next->mp) == libvlc_Paused)
+		{
+			pthread_mutex_lock(&pl->mutex);
+			resume = next->preroll;
+			next->preroll = 0;
+			pthread_mutex_unlock(&pl->mutex);
+			if (resume)
+				libvlc_media_player_set_pause(next->mp, 0);
+		}
+
+		/* the ended player prerolls the item after */
+		libvlc_media_player_stop(cur->mp);
+		item = next_item(pl, next->item);
+		if (item >= 0 && !vlcwrp_atomic_load(&pl->stop))
+			player_load(pl, cur, item, 1);
+
+		pthread_mutex_lock(&pl->mutex);
+		if (item < 0)
+			cur->item = -1;
+	}
+	pthread_mutex_unlock(&pl->mutex);
+	return NULL;
+}
+
+static void playlist_free(struct vlcwrp_playlist_ctx_t* pl)
+{
+	struct vlcwrp_ctx_t* ctx = pl->ctx;
+	int i;
+
+	if (pl->thread_running)
+	{
+		pthread_mutex_lock(&pl->mutex);
+		pl->stop = 1;
+		pthread_cond_broadcast(&pl->cond);
+		pthread_mutex_unlock(&pl->mutex);
+		pthread_join(pl->thread, NULL);
+	}
+
+	/* the callbacks of both players reference the playlist until they are stopped */
+	for (i=0; i<2; i++)
+	{
+		libvlc_media_player_t* mp = pl->players[i].mp;
+		if (!mp)
+			continue;
+		libvlc_event_detach(libvlc_media_player_event_manager(mp), libvlc_MediaPlayerPaused, player_event, &pl->players[i]);
+		libvlc_event_detach(libvlc_media_player_event_manager(mp), libvlc_MediaPlayerEndReached, player_event, &pl->players[i]);
+		libvlc_event_detach(libvlc_media_player_event_manager(mp), libvlc_MediaPlayerEncounteredError, player_event, &pl->players[i]);
+		libvlc_media_player_stop(mp);
+	}
+
+	/* the wrapper media player gets its own callbacks back, the health monitor stops sampling the second one */
+	vlcwrp_health_player(ctx, pl->players[0].mp);
+	if (ctx->video)
+		libvlc_video_set_callbacks(ctx->mp, vlcwrp_lockcb, vlcwrp_unlockcb, vlcwrp_displaycb, ctx);
+	if (ctx->audio)
+		vlcwrp_audio_setup(ctx, ctx->mp, vlcwrp_audio_play, vlcwrp_audio_flush, ctx);
+	if (pl->players[1].mp)
+	{
+		vlcwrp_startup_detach(ctx, pl->players[1].mp);
+		libvlc_media_player_release(pl->players[1].mp);
+	}
+
+	for (i=0; i<pl->count; i++)
+		free(pl->paths[i]);
+	free(pl->paths);
+	free(pl->scratch);
+	pthread_cond_destroy(&pl->cond);
+	pthread_mutex_destroy(&pl->mutex);
+	free(pl);
+}
+
+/* the callbacks of player p go through the playlist */
+static void player_init(struct vlcwrp_playlist_ctx_t* pl, int index, libvlc_media_player_t* mp)
+{
+	struct vlcwrp_ctx_t* ctx = pl->ctx;
+	struct playlist_player* p = &pl->players[index];
+
+	p->pl = pl;
+	p->mp = mp;
+	p->index = index;
+	p->item = -1;
+	if (ctx->video)
+	{
+		libvlc_video_set_callbacks(mp, player_lock, player_unlock, player_display, p);
+		libvlc_video_set_format(mp, CHROMA, ctx->width, ctx->height, ctx->pitch);
+	}
+	if (ctx->audio)
+		vlcwrp_audio_setup(ctx, mp, player_play, player_flush, p);
+	libvlc_event_attach(libvlc_media_player_event_manager(mp), libvlc_MediaPlayerPaused, player_event, p);
+	libvlc_event_attach(libvlc_media_player_event_manager(mp), libvlc_MediaPlayerEndReached, player_event, p);
+	libvlc_event_attach(libvlc_media_player_event_manager(mp), libvlc_MediaPlayerEncounteredError, player_event, p);
+
+	/* the wrapper media player is timed since its creation */
+	if (mp != ctx->mp)
+		vlcwrp_startup_attach(ctx, mp);
+}
+
+/* play the files of paths in order without gaps */
+int vlcwrp_play_playlist(struct vlcwrp_ctx_t* ctx, const char* const* paths, int npaths, vlcwrp_playlist_mode_t mode)
+{
+	struct vlcwrp_playlist_ctx_t* pl;
+	libvlc_media_player_t* mp;
+
+	if (npaths <= 0)
+		return -1;
+
+	/* stop before start playing */
+	vlcwrp_stop(ctx);
+
+	pl = (struct vlcwrp_playlist_ctx_t*)calloc(1, sizeof(struct vlcwrp_playlist_ctx_t));
+	if (!pl)
+		return -1;
+	pl->ctx = ctx;
+	pl->mode = mode;
+	pthread_mutex_init(&pl->mutex, 0);
+	pthread_cond_init(&pl->cond, 0);
+	pl->players[0].mp = ctx->mp;
+	pl->paths = (char**)calloc(npaths, sizeof(char*));
+	pl->scratch = ctx->video ? (unsigned char*)malloc(ctx->frame_size) : NULL;
+	mp = libvlc_media_player_new(ctx->libvlc);
+	if (!mp || !pl->paths || (ctx->video && !pl->scratch))
+	{
+		if (mp)
+			libvlc_media_player_release(mp);
+		playlist_free(pl);
+		return -1;
+	}
+	for (pl->count=0; pl->count<npaths; pl->count++)
+	{
+		pl->paths[pl->count] = (char*)malloc(strlen(paths[pl->count]) + 1);
+		if (!pl->paths[pl->count])
+		{
+			libvlc_media_player_release(mp);
+			playlist_free(pl);
+			return -1;
+		}
+		strcpy(pl->paths[pl->count], paths[pl->count]);
+	}
+	player_init(pl, 0, ctx->mp);
+	player_init(pl, 1, mp);
+
+	/* the previous media is no longer referenced */
+	vlcwrp_input_free(ctx);
+	vlcwrp_cache_clear(ctx);
+	vlcwrp_seek_media(ctx, NULL);
+	ctx->playlist = pl;
+	ctx->startup.media = vlcwrp_clock();
+	vlcwrp_play_reset(ctx);
+	vlcwrp_atomic_store(&pl->pending, 1);
+	player_load(pl, &pl->players[0], 0, 0);
+
+	/* the next item is prerolled by the switch thread */
+	pl->thread_running = !pthread_create(&pl->thread, 0, playlist_run, pl);
+	return 0;
+}
+
+/* get the playlist item of the decoded frames */
+int vlcwrp_playlist_item(struct vlcwrp_ctx_t* ctx)
+{
+	struct vlcwrp_playlist_ctx_t* pl = ctx->playlist;
+
+	/* not locking, the consumer may hold an acquired frame */
+	return pl ? vlcwrp_atomic_load(&pl->item) : -1;
+}
+
+/* stamps the playlist item of the decoded frame, called with ctx->mutex locked */
+void vlcwrp_playlist_frame(struct vlcwrp_ctx_t* ctx, vlcwrp_frame_info_t* info)
+{
+	struct vlcwrp_playlist_ctx_t* pl = ctx->playlist;
+	int pending;
+
+	info->item = 0;
+	info->item_start = 0;
+	if (!pl)
+		return;
+	pending = vlcwrp_atomic_exchange(&pl->pending, 0);
+	if (pending)
+	{
+		vlcwrp_atomic_store(&pl->item, pending - 1);
+		info->item_start = 1;
+	}
+	info->item = pl->item;
+}
+
+/* stops and releases the playlist */
+void vlcwrp_playlist_free(struct vlcwrp_ctx_t* ctx)
+{
+	if (ctx->playlist)
+	{
+		/* the switch thread is stopped before the players */
+		playlist_free(ctx->playlist);
+		ctx->playlist = NULL;
+	}
+}
@@ -0,0 +1,447 @@
+/*********************************************************************/
+/*                                                                   */
+/* Copyright (C) 2010,  AVIQ Bulgaria Ltd                            */
+/*                                                                   */
+/* Project:       LRun                                               */
+/* Filename:      vlcwrp_priv.h                                      */
+/* Description:   VLC wrapper library internals                      */
+/*                                                                   */
+/*********************************************************************/ 
+
+#ifndef __VLCWRP_PRIV_H
+#define __VLCWRP_PRIV_H
+
+#include <vlc/vlc.h>
+#include <pthread.h>
+
+#include "vlcwrp.h"
+
+#define BPP 4
+#define CHROMA "RV32"
+
+/* must be >= 3 */
+#define QUEUE_SIZE 3
+
+#define log
+//printf
+
+/* lock-free access to values shared with the VLC threads */
+#define vlcwrp_atomic_load(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define vlcwrp_atomic_store(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define vlcwrp_atomic_add(p, v) __atomic_add_fetch((p), (v), __ATOMIC_ACQ_REL)
+#define vlcwrp_atomic_exchange(p, v) __atomic_exchange_n((p), (v), __ATOMIC_ACQ_REL)
+#define vlcwrp_atomic_fence() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+
+/* frame analytics state, see vlcwrp_analytics.c */
+struct vlcwrp_analytics_ctx_t;
+
+/* audio ring state, see vlcwrp_audio.c */
+struct vlcwrp_audio_ctx_t;
+
+/* custom media input state, see vlcwrp_input.c */
+struct vlcwrp_input_ctx_t;
+
+/* event queue state, see vlcwrp_events.c */
+struct vlcwrp_events_ctx_t;
+
+/* snapshot encoder state, see vlcwrp_snapshot.c */
+struct vlcwrp_snapshot_ctx_t;
+
+/* frame recorder state, see vlcwrp_recorder.c */
+struct vlcwrp_recorder_ctx_t;
+
+/* shared memory frame export state, see vlcwrp_export.c */
+struct vlcwrp_export_ctx_t;
+
+/* decoded frame cache state, see vlcwrp_cache.c */
+struct vlcwrp_cache_ctx_t;
+
+/* seek thread and keyframe index state, see vlcwrp_seek.c */
+struct vlcwrp_seek_ctx_t;
+
+/* gapless playlist state, see vlcwrp_playlist.c */
+struct vlcwrp_playlist_ctx_t;
+
+/* adaptive quality controller state, see vlcwrp_adaptive.c */
+struct vlcwrp_adaptive_ctx_t;
+
+/* stream health monitor state, see vlcwrp_health.c */
+struct vlcwrp_health_ctx_t;
+
+/* overlay layers, see vlcwrp_overlay.c */
+struct vlcwrp_overlay_ctx_t;
+
+/**
+ * placement of the threads of a callback role, see vlcwrp_threads.c
+ *
+ * Written by the thread entering the callbacks, the statistics are read
+ * atomically by other threads.
+ */
+struct vlcwrp_thread_ctx_t
+{
+	/* configuration, each field set atomically */
+	vlcwrp_thread_config_t config;
+	int configured;
+
+	/* set when the configuration is to be applied by the next callback */
+	int apply;
+	int status;
+
+	/* last thread entering the callbacks */
+	pthread_t self;
+	int entered;
+	int tid;
+
+	/* CPU time of the previous threads and of the last one */
+	long long cpu_base;
+	long long cpu_last;
+
+	/* CPU of the last callback plus one, 0 if unknown */
+	int cpu;
+	unsigned long migrations;
+};
+
+/**
+ * VLC wrapper context
+ */
+struct vlcwrp_ctx_t
+{
+	/* VLC instance */
+    libvlc_instance_t *libvlc;
+
+	/* VLC media player instance */
+    libvlc_media_player_t *mp;
+
+	/* queue of frames */
+	unsigned char* frame_queue[QUEUE_SIZE];
+
+	/* per frame information of the queued frames */
+	vlcwrp_frame_info_t frame_info[QUEUE_SIZE];
+
+	/* non zero if the vmem video path is installed */
+	int video;
+
+	/* frame width */
+	int width;
+
+	/* frame height */
+	int height;
+
+	/* frame row pitch in bytes */
+	int pitch;
+
+	/* frame size in bytes */
+	size_t frame_size;
+
+	/* arena block of each slot plus one, 0 if the slot has no frame, see vlcwrp_buffers.c */
+	int frame_block[QUEUE_SIZE];
+
+	/* arena size class of the frames plus one, 0 before the frames are allocated */
+	int buffers_class;
+
+	/* frames held, never less than the reserved frames */
+	int buffers_held;
+	int buffers_reserve;
+	vlcwrp_buffer_config_t buffers_config;
+
+	/* slot plus one copied by the decoder thread outside the lock */
+	int copy_slot;
+
+	/* set while the acquired frame is copied by the consumer outside the lock, it is not dropped */
+	int read_copy;
+
+	/* set while a frame of vlcwrp_frame_try_acquire is held, owned by the consumer */
+	int try_acquired;
+
+	/* queued frames reused over the arena budget */
+	unsigned long buffers_dropped;
+
+	/* non zero to bind the frame ring to the NUMA node of the decoder thread */
+	int buffers_numa;
+
+	/* set on play, the decoder thread binds the frame ring on its first frame */
+	int buffers_bind;
+
+	/* number of decoded frames queued */
+	int nqueuedframes;
+
+	/* number of decoded frames waiting for analysis before being queued */
+	int npendingframes;
+
+	/* read, publish and write queue indecies */
+	int ridx, pidx, widx;
+
+	/* sequence number of the next decoded frame */
+	unsigned int seq;
+
+	/* media time in milliseconds and sequence number the frame times are extrapolated from, -1 if none */
+	long long time_base;
+	unsigned int time_base_seq;
+
+	/* time and sequence number of the last timed frame */
+	long long time_last;
+	unsigned int time_last_seq;
+
+	/* input time at the first advance of the run, -1 before it, and at the last frame, the frame duration is measured from them */
+	long long time_run;
+	unsigned int time_run_seq;
+	long long time_input;
+
+	/* frame duration in microseconds, 0 until known, set if given by the media */
+	long long time_interval;
+	int time_fps;
+
+	/* incremented on each play, invalidates frames still in analysis */
+	unsigned int generation;
+
+	/* condition the queue is empty */
+	pthread_cond_t* cond_empty;
+
+	/* condition the queue is full */
+	pthread_cond_t* cond_full;
+
+	/* synchronizing mutex */
+	pthread_mutex_t* mutex;
+
+	/* flag indicating request stopping */
+	int requested_stop;
+
+	/* ready token, advanced on each queued frame, posted event and stop */
+	unsigned int ready;
+
+	/* frame analytics, NULL if disabled */
+	struct vlcwrp_analytics_ctx_t* analytics;
+
+	/* audio ring, NULL if audio callbacks are not set */
+	struct vlcwrp_audio_ctx_t* audio;
+
+	/* custom media input, NULL when playing a path */
+	struct vlcwrp_input_ctx_t* input;
+
+	/* event queue */
+	struct vlcwrp_events_ctx_t* events;
+
+	/* snapshot encoder, NULL until the first snapshot */
+	struct vlcwrp_snapshot_ctx_t* snapshot;
+
+	/* frame recorder, NULL if not recording */
+	struct vlcwrp_recorder_ctx_t* recorder;
+
+	/* statistics readers pinning the recorder without ctx->mutex, record stop waits for them */
+	int recorder_readers;
+
+	/* shared memory frame export, NULL if the frame ring is private */
+	struct vlcwrp_export_ctx_t* export;
+
+	/* decoded frame cache, NULL if disabled */
+	struct vlcwrp_cache_ctx_t* cache;
+
+	/* seek thread, NULL until the first seek */
+	struct vlcwrp_seek_ctx_t* seek;
+
+	/* generation, target and input time of the last seek, and generation of the decoded frames */
+	unsigned int seek_gen;
+	long long seek_target;
+	long long seek_input;
+	unsigned int frame_seek_gen;
+
+	/* playlist, NULL when playing a single media */
+	struct vlcwrp_playlist_ctx_t* playlist;
+
+	/* adaptive quality controller, NULL if every frame is queued */
+	struct vlcwrp_adaptive_ctx_t* adaptive;
+
+	/* stream health state, NULL if not watched */
+	struct vlcwrp_health_ctx_t* health;
+
+	/* set by the health monitor, the thread driving the player restarts it */
+	int restart_requested;
+
+	/* overlay layers blended into the decoded frames, NULL until an overlay is set */
+	struct vlcwrp_overlay_ctx_t* overlay;
+
+	/* placement of the threads entering the callbacks */
+	struct vlcwrp_thread_ctx_t threads[VLCWRP_THREAD_ROLES];
+
+	/* performance profile applied to the played media */
+	vlcwrp_profile_t profile;
+
+	/* startup timestamps, the later stages are taken by the VLC threads */
+	vlcwrp_startup_t startup;
+
+	/* set once the audio consumer drives the master clock */
+	int clock_audio;
+
+	/* smoothed audio presentation lag in microseconds */
+	long long clock_audio_lag;
+
+	/* due delay of the last frame acquired by the clock */
+	long long clock_due_delay;
+
+	/* number of due frames dropped in favour of a newer one */
+	unsigned long clock_late_frames;
+};
+
+/* monotonic clock in microseconds */
+long long vlcwrp_clock(void);
+
+/* allocates the reserved frames, called on create */
+int vlcwrp_buffers_alloc(struct vlcwrp_ctx_t* ctx, const vlcwrp_buffer_config_t* config);
+
+/* gives back all the frames to the arena */
+void vlcwrp_buffers_free(struct vlcwrp_ctx_t* ctx);
+
+/* takes a frame from the arena for the empty slot idx, over the budget if stopping, called with ctx->mutex locked */
+int vlcwrp_buffers_get(struct vlcwrp_ctx_t* ctx, int idx, int stopping);
+
+/* gives back the frames of all the idle slots, called with ctx->mutex locked once the player is stopped */
+void vlcwrp_buffers_trim_idle(struct vlcwrp_ctx_t* ctx);
+
+/* binds the frames to the NUMA node of the calling thread, called on the decoder thread */
+void vlcwrp_buffers_bind(struct vlcwrp_ctx_t* ctx);
+
+/* takes a reference on the arena class of the frames of size bytes, returns the class or -1 if none */
+int vlcwrp_arena_attach(size_t size);
+
+/* drops a reference on class cls taken by vlcwrp_arena_attach, its frames must be given back */
+void vlcwrp_arena_detach(int cls);
+
+/* takes a frame of class cls from the process wide arena, over the budget if forced, returns the block or -1 if none */
+int vlcwrp_arena_get(int cls, const vlcwrp_buffer_config_t* config, int forced, unsigned char** frame);
+
+/* gives back the frame taken as block */
+void vlcwrp_arena_put(int block);
+
+/* queues the frame at the publish index, called with ctx->mutex locked */
+void vlcwrp_queue_frame(struct vlcwrp_ctx_t* ctx);
+
+/* hands the decoded frame at slot idx to the analytics workers, called with ctx->mutex locked */
+void vlcwrp_analytics_submit(struct vlcwrp_ctx_t* ctx, int idx);
+
+/* drops frames still in analysis, called with ctx->mutex locked */
+void vlcwrp_analytics_reset(struct vlcwrp_ctx_t* ctx);
+
+/* releases the audio ring, the media player must be released */
+void vlcwrp_audio_free(struct vlcwrp_ctx_t* ctx);
+
+/* audio callbacks of the wrapper, opaque is the player context */
+void vlcwrp_audio_play(void* opaque, const void* samples, unsigned count, int64_t pts);
+void vlcwrp_audio_flush(void* opaque, int64_t pts);
+
+/* sets the audio callbacks and the sample format of ctx on player mp */
+void vlcwrp_audio_setup(struct vlcwrp_ctx_t* ctx, libvlc_media_player_t* mp, libvlc_audio_play_cb play, libvlc_audio_flush_cb flush, void* opaque);
+
+/* vmem callbacks of the wrapper, opaque is the player context */
+void* vlcwrp_lockcb(void* opaque, void** p_pixels);
+void vlcwrp_unlockcb(void* opaque, void* id, void* const* p_pixels);
+void vlcwrp_displaycb(void* opaque, void* id);
+
+/* plays media m or the current media if m is NULL, takes over the reference to m */
+void vlcwrp_play_media(struct vlcwrp_ctx_t* ctx, libvlc_media_t* m);
+
+/* resets the frame queue before the player starts */
+void vlcwrp_play_reset(struct vlcwrp_ctx_t* ctx);
+
+/* releases the custom input, the player must be stopped */
+void vlcwrp_input_free(struct vlcwrp_ctx_t* ctx);
+
+/* creates the event queue */
+int vlcwrp_events_init(struct vlcwrp_ctx_t* ctx);
+
+/* releases the event queue, no thread may post anymore */
+void vlcwrp_events_free(struct vlcwrp_ctx_t* ctx);
+
+/* posts an event, called from any thread */
+void vlcwrp_event_post(struct vlcwrp_ctx_t* ctx, vlcwrp_event_type_t type, int status, long long value, const char* text);
+
+/* non zero if events are waiting to be polled */
+int vlcwrp_events_pending(struct vlcwrp_ctx_t* ctx);
+
+/* non zero if snapshots wait for the next released frame */
+int vlcwrp_snapshot_pending(struct vlcwrp_ctx_t* ctx);
+
+/* copies the frame for the waiting snapshots, called on frame release without ctx->mutex */
+void vlcwrp_snapshot_capture(struct vlcwrp_ctx_t* ctx, const unsigned char* pixels);
+
+/* stops the snapshot encoder, pending snapshots are discarded */
+void vlcwrp_snapshot_free(struct vlcwrp_ctx_t* ctx);
+
+/* takes the recorder for a frame copy, called with ctx->mutex locked */
+struct vlcwrp_recorder_ctx_t* vlcwrp_recorder_use(struct vlcwrp_ctx_t* ctx);
+
+/* copies the decoded frame to the recorder taken by vlcwrp_recorder_use */
+void vlcwrp_recorder_frame(struct vlcwrp_recorder_ctx_t* rec, const unsigned char* pixels, unsigned int seq, long long timestamp);
+
+/* marks the slot as being written, called with ctx->mutex locked */
+void vlcwrp_export_begin(struct vlcwrp_ctx_t* ctx, int idx);
+
+/* publishes the frame in the slot, called with ctx->mutex locked */
+void vlcwrp_export_publish(struct vlcwrp_ctx_t* ctx, int idx);
+
+/* takes the cache for a frame copy, called with ctx->mutex locked */
+struct vlcwrp_cache_ctx_t* vlcwrp_cache_use(struct vlcwrp_ctx_t* ctx);
+
+/* copies the decoded frame to the cache taken by vlcwrp_cache_use, called on the decoder thread */
+void vlcwrp_cache_insert(struct vlcwrp_cache_ctx_t* cache, const unsigned char* pixels, unsigned int seq, long long timestamp, long long time);
+
+/* drops the cached frames, called when the media changes */
+void vlcwrp_cache_clear(struct vlcwrp_ctx_t* ctx);
+
+/* indexes the keyframes of the played media path, NULL if not a file */
+void vlcwrp_seek_media(struct vlcwrp_ctx_t* ctx, const char* path);
+
+/* wakes the seek thread on the first frame of seek generation gen, called with ctx->mutex locked */
+void vlcwrp_seek_settled(struct vlcwrp_ctx_t* ctx, unsigned int gen);
+
+/* stamps the playlist item of the decoded frame, called with ctx->mutex locked */
+void vlcwrp_playlist_frame(struct vlcwrp_ctx_t* ctx, vlcwrp_frame_info_t* info);
+
+/* stops and releases the playlist */
+void vlcwrp_playlist_free(struct vlcwrp_ctx_t* ctx);
+
+/* advances the ready token and wakes the waiters, called from any thread */
+void vlcwrp_wait_notify(struct vlcwrp_ctx_t* ctx);
+
+/* starts a new window, called with ctx->mutex locked when the player starts */
+void vlcwrp_adaptive_reset(struct vlcwrp_ctx_t* ctx);
+
+/* accounts a frame request, called with ctx->mutex locked by lockcb */
+void vlcwrp_adaptive_sample(struct vlcwrp_ctx_t* ctx, int occupancy, long long blocked);
+
+/* drops the oldest queued frame at the highest level instead of blocking, called with ctx->mutex locked */
+int vlcwrp_adaptive_drop(struct vlcwrp_ctx_t* ctx);
+
+/* non zero if the decoded frame is not queued at the current level, called with ctx->mutex locked */
+int vlcwrp_adaptive_skip(struct vlcwrp_ctx_t* ctx);
+
+/* adds the options of profile to media m */
+void vlcwrp_profile_apply(libvlc_media_t* m, vlcwrp_profile_t profile);
+
+/* plays the current media again, called by the thread driving the player */
+void vlcwrp_restart(struct vlcwrp_ctx_t* ctx);
+
+/* restarts the player if the health monitor requested it, called by the thread driving the player */
+void vlcwrp_health_apply(struct vlcwrp_ctx_t* ctx);
+
+/* sets the media player of ctx, the health monitor no longer samples the previous one once it returns */
+void vlcwrp_health_player(struct vlcwrp_ctx_t* ctx, libvlc_media_player_t* mp);
+
+/* times the state transitions and the video output creation of mp */
+void vlcwrp_startup_attach(struct vlcwrp_ctx_t* ctx, libvlc_media_player_t* mp);
+
+/* stops timing the state transitions of mp */
+void vlcwrp_startup_detach(struct vlcwrp_ctx_t* ctx, libvlc_media_player_t* mp);
+
+/* applies the thread placement of role and accounts the thread time, called on each callback */
+void vlcwrp_threads_enter(struct vlcwrp_ctx_t* ctx, vlcwrp_thread_role_t role);
+
+/* the threads apply their placement again on their next callback, called on play */
+void vlcwrp_threads_reset(struct vlcwrp_ctx_t* ctx);
+
+/* blends the overlay layers into the decoded frame, called by the decoder thread before the frame is queued */
+void vlcwrp_overlay_blend(struct vlcwrp_ctx_t* ctx, unsigned char* frame);
+
+/* discards the overlay layers, called on destroy once no frame is decoded */
+void vlcwrp_overlay_free(struct vlcwrp_ctx_t* ctx);
+
+#endif
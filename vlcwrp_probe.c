@@ -0,0 +1,636 @@
+/*********************************************************************/
+/*                                                                   */
+/* Copyright (C) 2010,  AVIQ Bulgaria Ltd                            */
+/*                                                                   */
+/* Project:       LRun                                               */
+/* Filename:      vlcwrp_probe.c                                     */
+/* Description:   VLC wrapper media information cache                */
+/*                                                                   */
+/*********************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <pthread.h>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "vlcwrp_priv.h"
+
+/* index file identification */
+#define INDEX_MAGIC 0x49505756 /* "VWPI" */
+#define INDEX_VERSION 1
+
+/* index entry flags */
+#define ENTRY_FAILED 1
+
+/* maximum number of additional VLC arguments */
+#define PROBE_MAX_ARGS 32
+
+/**
+ * index file header, followed by the entries sorted by hash and the
+ * string pool holding NUL terminated strings referenced by offset
+ */
+struct index_header
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t count;
+	uint32_t strings_size;
+};
+
+/**
+ * index file entry
+ */
+struct index_entry
+{
+	/* key */
+	uint64_t hash;
+	uint64_t size;
+	int64_t mtime;
+
+	/* media information */
+	int64_t duration;
+	uint32_t flags;
+	uint32_t path, title, artist, album;
+	uint32_t video_codec, audio_codec;
+	uint32_t width, height;
+	uint32_t channels, rate;
+	uint32_t tracks;
+	float fps;
+};
+
+/**
+ * entry of the index being written
+ */
+struct index_record
+{
+	struct index_entry entry;
+	const char* path;
+	const char* title;
+	const char* artist;
+	const char* album;
+};
+
+/**
+ * path of the batch to parse, sorted by hash and path
+ */
+struct stale_path
+{
+	uint64_t hash;
+	const char* path;
+	int index;
+};
+
+/**
+ * memory mapped index
+ */
+struct index_map
+{
+	void* base;
+	size_t size;
+	const struct index_header* header;
+	const struct index_entry* entries;
+	const char* strings;
+};
+
+/**
+ * concurrent parses state
+ */
+struct parse_state
+{
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+
+	/* number of finished parses not collected yet */
+	int completed;
+};
+
+/**
+ * asynchronous parse of one media
+ */
+struct parse_job
+{
+	libvlc_media_t* m;
+	int index;
+	int done;
+	struct parse_state* state;
+};
+
+/* fill config with the default probe configuration */
+void vlcwrp_probe_defaults(vlcwrp_probe_config_t* config)
+{
+	config->index = NULL;
+	config->concurrency = 4;
+	config->timeout = 5000;
+	config->argc = 0;
+	config->argv = NULL;
+}
+
+/* FNV-1a hash of the media path */
+static uint64_t path_hash(const char* path)
+{
+	uint64_t h = 14695981039346656037ULL;
+	while (*path)
+	{
+		h ^= (unsigned char)*path++;
+		h *= 1099511628211ULL;
+	}
+	return h;
+}
+
+/* maps the index file, returns 0 if there is no valid index */
+static int index_open(const char* path, struct index_map* map)
+{
+#ifndef _WIN32
+	struct stat st;
+	int fd;
+
+	memset(map, 0, sizeof(struct index_map));
+	if (!path || (fd = open(path, O_RDONLY)) < 0)
+		return 0;
+	if (fstat(fd, &st) || (size_t)st.st_size < sizeof(struct index_header))
+	{
+		close(fd);
+		return 0;
+	}
+	map->base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map->base == MAP_FAILED)
+	{
+		map->base = NULL;
+		return 0;
+	}
+	map->size = (size_t)st.st_size;
+	map->header = (const struct index_header*)map->base;
+	if (map->header->magic != INDEX_MAGIC || map->header->version != INDEX_VERSION
+	 || sizeof(struct index_header) + (size_t)map->header->count * sizeof(struct index_entry) + map->header->strings_size != map->size)
+	{
+		munmap(map->base, map->size);
+		memset(map, 0, sizeof(struct index_map));
+		return 0;
+	}
+	map->entries = (const struct index_entry*)(map->header + 1);
+	map->strings = (const char*)(map->entries + map->header->count);
+
+	/* any offset into the pool must reach a NUL */
+	if (map->header->strings_size && map->strings[map->header->strings_size - 1])
+	{
+		munmap(map->base, map->size);
+		memset(map, 0, sizeof(struct index_map));
+		return 0;
+	}
+	return 1;
+#else
+	memset(map, 0, sizeof(struct index_map));
+	return 0;
+#endif
+}
+
+static void index_close(struct index_map* map)
+{
+#ifndef _WIN32
+	if (map->base)
+		munmap(map->base, map->size);
+#endif
+	memset(map, 0, sizeof(struct index_map));
+}
+
+static const char* index_string(const struct index_map* map, uint32_t offset)
+{
+	return offset < map->header->strings_size ? map->strings + offset : "";
+}
+
+/* finds the index entry of path, returns NULL if not found */
+static const struct index_entry* index_find(const struct index_map* map, const char* path, uint64_t hash)
+{
+	unsigned int lo = 0, hi;
+	if (!map->header)
+		return NULL;
+	hi = map->header->count;
+	while (lo < hi)
+	{
+		unsigned int mid = (lo + hi) / 2;
+		if (map->entries[mid].hash < hash)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	for (; lo < map->header->count && map->entries[lo].hash == hash; lo++)
+		if (!strcmp(index_string(map, map->entries[lo].path), path))
+			return &map->entries[lo];
+	return NULL;
+}
+
+static void copy_string(char* dst, const char* src)
+{
+	strncpy(dst, src ? src : "", VLCWRP_META_SIZE - 1);
+	dst[VLCWRP_META_SIZE - 1] = '\0';
+}
+
+/* fills media information from an index entry */
+static void info_from_entry(const struct index_map* map, const struct index_entry* e, vlcwrp_media_info_t* info)
+{
+	info->status = VLCWRP_PROBE_CACHED;
+	info->failed = (e->flags & ENTRY_FAILED) != 0;
+	info->duration = e->duration;
+	copy_string(info->title, index_string(map, e->title));
+	copy_string(info->artist, index_string(map, e->artist));
+	copy_string(info->album, index_string(map, e->album));
+	info->video_codec = e->video_codec;
+	info->audio_codec = e->audio_codec;
+	info->width = e->width;
+	info->height = e->height;
+	info->fps = e->fps;
+	info->channels = e->channels;
+	info->rate = e->rate;
+	info->tracks = e->tracks;
+}
+
+/* fills media information from a parsed media */
+static void info_from_media(libvlc_media_t* m, vlcwrp_media_info_t* info)
+{
+	libvlc_media_track_t** tracks;
+	unsigned int i, ntracks;
+	char* meta;
+
+	/* a parse timed out or skipped may succeed later, only its outcome is indexed */
+	switch (libvlc_media_get_parsed_status(m))
+	{
+	case libvlc_media_parsed_status_done:
+		info->status = VLCWRP_PROBE_PARSED;
+		break;
+	case libvlc_media_parsed_status_failed:
+		info->status = VLCWRP_PROBE_PARSED;
+		info->failed = 1;
+		break;
+	default:
+		info->status = VLCWRP_PROBE_RETRY;
+		info->failed = 1;
+		break;
+	}
+	info->duration = libvlc_media_get_duration(m);
+
+	meta = libvlc_media_get_meta(m, libvlc_meta_Title);
+	copy_string(info->title, meta);
+	libvlc_free(meta);
+	meta = libvlc_media_get_meta(m, libvlc_meta_Artist);
+	copy_string(info->artist, meta);
+	libvlc_free(meta);
+	meta = libvlc_media_get_meta(m, libvlc_meta_Album);
+	copy_string(info->album, meta);
+	libvlc_free(meta);
+
+	ntracks = libvlc_media_tracks_get(m, &tracks);
+	info->tracks = ntracks;
+	for (i=0; i<ntracks; i++)
+	{
+		/* the first track of each type describes the media */
+		if (tracks[i]->i_type == libvlc_track_video && !info->video_codec)
+		{
+			info->video_codec = tracks[i]->i_codec;
+			info->width = tracks[i]->video->i_width;
+			info->height = tracks[i]->video->i_height;
+			if (tracks[i]->video->i_frame_rate_den)
+				info->fps = (float)tracks[i]->video->i_frame_rate_num / tracks[i]->video->i_frame_rate_den;
+		}
+		else if (tracks[i]->i_type == libvlc_track_audio && !info->audio_codec)
+		{
+			info->audio_codec = tracks[i]->i_codec;
+			info->channels = tracks[i]->audio->i_channels;
+			info->rate = tracks[i]->audio->i_rate;
+		}
+	}
+	if (ntracks)
+		libvlc_media_tracks_release(tracks, ntracks);
+}
+
+/* called by VLC when a media parsing finishes */
+static void parsed_cb(const struct libvlc_event_t* event, void* opaque)
+{
+	struct parse_job* job = (struct parse_job*)opaque;
+	pthread_mutex_lock(&job->state->mutex);
+	job->done = 1;
+	job->state->completed++;
+	pthread_cond_signal(&job->state->cond);
+	pthread_mutex_unlock(&job->state->mutex);
+}
+
+/* parses the media at the given paths, at most concurrency at a time */
+static int parse_stale(const vlcwrp_probe_config_t* config, const char* const* paths, const int* stale, int nstale, vlcwrp_media_info_t* infos)
+{
+	const char* argv[PROBE_MAX_ARGS + 3];
+	char threads[32];
+	libvlc_instance_t* libvlc;
+	struct parse_job* jobs;
+	struct parse_state state;
+	int i, argc = 0, next = 0, running = 0, concurrency = config->concurrency > 0 ? config->concurrency : 1;
+
+	/* the preparser threads bound the concurrent parses */
+	argv[argc++] = "--ignore-config";
+	argv[argc++] = "-q";
+	snprintf(threads, sizeof(threads), "--preparse-threads=%d", concurrency);
+	argv[argc++] = threads;
+	for (i=0; i<config->argc && i<PROBE_MAX_ARGS; i++)
+		argv[argc++] = config->argv[i];
+	libvlc = libvlc_new(argc, argv);
+	if (!libvlc)
+		return -1;
+
+	jobs = (struct parse_job*)calloc(nstale, sizeof(struct parse_job));
+	if (!jobs)
+	{
+		libvlc_release(libvlc);
+		return -1;
+	}
+	pthread_mutex_init(&state.mutex, 0);
+	pthread_cond_init(&state.cond, 0);
+	state.completed = 0;
+
+	while (next < nstale || running > 0)
+	{
+		/* starts parses up to the concurrency limit */
+		while (next < nstale && running < concurrency)
+		{
+			struct parse_job* job = &jobs[next];
+			job->index = stale[next++];
+			job->state = &state;
+			job->m = libvlc_media_new_path(libvlc, paths[job->index]);
+			if (!job->m)
+			{
+				infos[job->index].status = VLCWRP_PROBE_RETRY;
+				infos[job->index].failed = 1;
+				continue;
+			}
+			libvlc_event_attach(libvlc_media_event_manager(job->m), libvlc_MediaParsedChanged, parsed_cb, job);
+			if (libvlc_media_parse_with_options(job->m, libvlc_media_parse_local, config->timeout))
+			{
+				libvlc_event_detach(libvlc_media_event_manager(job->m), libvlc_MediaParsedChanged, parsed_cb, job);
+				libvlc_media_release(job->m);
+				job->m = NULL;
+				infos[job->index].status = VLCWRP_PROBE_RETRY;
+				infos[job->index].failed = 1;
+				continue;
+			}
+			running++;
+		}
+		if (running == 0)
+			continue;
+
+		/* takes the finished parses, VLC sends the events under its own lock
+		 * so the media are released without holding the state mutex */
+		pthread_mutex_lock(&state.mutex);
+		while (!state.completed)
+			pthread_cond_wait(&state.cond, &state.mutex);
+		for (i=0; i<next; i++)
+			if (jobs[i].m && jobs[i].done == 1)
+			{
+				jobs[i].done = 2;
+				state.completed--;
+			}
+		pthread_mutex_unlock(&state.mutex);
+
+		for (i=0; i<next; i++)
+		{
+			struct parse_job* job = &jobs[i];
+			if (job->m && job->done == 2)
+			{
+				libvlc_event_detach(libvlc_media_event_manager(job->m), libvlc_MediaParsedChanged, parsed_cb, job);
+				info_from_media(job->m, &infos[job->index]);
+				libvlc_media_release(job->m);
+				job->m = NULL;
+				running--;
+			}
+		}
+	}
+
+	pthread_cond_destroy(&state.cond);
+	pthread_mutex_destroy(&state.mutex);
+	free(jobs);
+	libvlc_release(libvlc);
+	return 0;
+}
+
+static int compare_stale(const void* a, const void* b)
+{
+	const struct stale_path* sa = (const struct stale_path*)a;
+	const struct stale_path* sb = (const struct stale_path*)b;
+	if (sa->hash != sb->hash)
+		return sa->hash < sb->hash ? -1 : 1;
+	return strcmp(sa->path, sb->path);
+}
+
+static int compare_records(const void* a, const void* b)
+{
+	uint64_t ha = ((const struct index_record*)a)->entry.hash;
+	uint64_t hb = ((const struct index_record*)b)->entry.hash;
+	return ha < hb ? -1 : ha > hb;
+}
+
+/* adds a string to the pool being written, returns its offset */
+static uint32_t pool_add(FILE* f, uint32_t* size, const char* s)
+{
+	uint32_t offset = *size;
+	size_t len = strlen(s ? s : "") + 1;
+	fwrite(s ? s : "", 1, len, f);
+	*size += (uint32_t)len;
+	return offset;
+}
+
+/* writes the index with the records, replaced atomically */
+static int index_write(const char* path, struct index_record* records, unsigned int count)
+{
+	struct index_header header;
+	char* tmp;
+	FILE* f;
+	unsigned int i;
+	int rc = 0;
+
+	tmp = (char*)malloc(strlen(path) + 5);
+	if (!tmp)
+		return -1;
+	sprintf(tmp, "%s.tmp", path);
+	f = fopen(tmp, "wb");
+	if (!f)
+	{
+		free(tmp);
+		return -1;
+	}
+
+	qsort(records, count, sizeof(struct index_record), compare_records);
+
+	/* the string pool follows the entries, written first to get the offsets */
+	header.magic = INDEX_MAGIC;
+	header.version = INDEX_VERSION;
+	header.count = count;
+	header.strings_size = 0;
+	fseek(f, (long)(sizeof(struct index_header) + count * sizeof(struct index_entry)), SEEK_SET);
+	for (i=0; i<count; i++)
+	{
+		records[i].entry.path = pool_add(f, &header.strings_size, records[i].path);
+		records[i].entry.title = pool_add(f, &header.strings_size, records[i].title);
+		records[i].entry.artist = pool_add(f, &header.strings_size, records[i].artist);
+		records[i].entry.album = pool_add(f, &header.strings_size, records[i].album);
+	}
+	fseek(f, 0, SEEK_SET);
+	fwrite(&header, sizeof(header), 1, f);
+	for (i=0; i<count; i++)
+		fwrite(&records[i].entry, sizeof(struct index_entry), 1, f);
+	if (ferror(f))
+		rc = -1;
+	if (fclose(f))
+		rc = -1;
+	if (!rc && rename(tmp, path))
+		rc = -1;
+	if (rc)
+		remove(tmp);
+	free(tmp);
+	return rc;
+}
+
+/* probe media information, answering from the index where it is fresh */
+int vlcwrp_probe(const vlcwrp_probe_config_t* config, const char* const* paths, int npaths, vlcwrp_media_info_t* infos)
+{
+	struct index_map map;
+	struct stat* st;
+	struct stale_path* sorted;
+	int* stale;
+	int* same;
+	int i, nstale = 0, nsorted = 0;
+
+	st = (struct stat*)calloc(npaths ? npaths : 1, sizeof(struct stat));
+	stale = (int*)calloc(npaths ? npaths : 1, sizeof(int));
+	same = (int*)calloc(npaths ? npaths : 1, sizeof(int));
+	sorted = (struct stale_path*)calloc(npaths ? npaths : 1, sizeof(struct stale_path));
+	if (!st || !stale || !same || !sorted)
+	{
+		free(st);
+		free(stale);
+		free(same);
+		free(sorted);
+		return -1;
+	}
+
+	/* answers from the index the entries whose size and mtime still match */
+	index_open(config->index, &map);
+	for (i=0; i<npaths; i++)
+	{
+		const struct index_entry* e;
+		uint64_t hash = path_hash(paths[i]);
+		memset(&infos[i], 0, sizeof(vlcwrp_media_info_t));
+		same[i] = -1;
+		if (stat(paths[i], &st[i]))
+		{
+			infos[i].status = VLCWRP_PROBE_MISSING;
+			continue;
+		}
+		e = index_find(&map, paths[i], hash);
+		if (e && e->size == (uint64_t)st[i].st_size && e->mtime == (int64_t)st[i].st_mtime)
+			info_from_entry(&map, e, &infos[i]);
+		else
+		{
+			sorted[nsorted].hash = hash;
+			sorted[nsorted].path = paths[i];
+			sorted[nsorted].index = i;
+			nsorted++;
+		}
+	}
+
+	/* a path given more than once is parsed and indexed once */
+	qsort(sorted, nsorted, sizeof(struct stale_path), compare_stale);
+	for (i=0; i<nsorted; i++)
+		if (!nstale || compare_stale(&sorted[nstale - 1], &sorted[i]))
+			sorted[nstale++] = sorted[i];
+		else
+			same[sorted[i].index] = sorted[nstale - 1].index;
+	for (i=0; i<nstale; i++)
+		stale[i] = sorted[i].index;
+
+	if (nstale > 0)
+	{
+		if (parse_stale(config, paths, stale, nstale, infos))
+		{
+			index_close(&map);
+			free(st);
+			free(stale);
+			free(same);
+			free(sorted);
+			return -1;
+		}
+
+		/* rewrites the index with the old entries not reparsed and the parsed ones */
+		if (config->index)
+		{
+			unsigned int nold = map.header ? map.header->count : 0, count = 0, j;
+			struct index_record* records = (struct index_record*)calloc(nold + nstale, sizeof(struct index_record));
+			if (records)
+			{
+				/* both lists are sorted by hash, the paths are compared on equal hashes only */
+				int first = 0;
+				for (j=0; j<nold; j++)
+				{
+					const struct index_entry* e = &map.entries[j];
+					const char* path = index_string(&map, e->path);
+					int m;
+					while (first < nstale && sorted[first].hash < e->hash)
+						first++;
+					for (m=first; m<nstale && sorted[m].hash == e->hash && strcmp(sorted[m].path, path); m++);
+					if (m < nstale && sorted[m].hash == e->hash)
+						continue;
+					records[count].entry = *e;
+					records[count].path = path;
+					records[count].title = index_string(&map, e->title);
+					records[count].artist = index_string(&map, e->artist);
+					records[count].album = index_string(&map, e->album);
+					count++;
+				}
+				for (i=0; i<nstale; i++)
+				{
+					int k = stale[i];
+					struct index_record* r;
+					if (infos[k].status == VLCWRP_PROBE_RETRY)
+						continue;
+					r = &records[count++];
+					r->entry.hash = sorted[i].hash;
+					r->entry.size = (uint64_t)st[k].st_size;
+					r->entry.mtime = (int64_t)st[k].st_mtime;
+					r->entry.duration = infos[k].duration;
+					r->entry.flags = infos[k].failed ? ENTRY_FAILED : 0;
+					r->entry.video_codec = infos[k].video_codec;
+					r->entry.audio_codec = infos[k].audio_codec;
+					r->entry.width = infos[k].width;
+					r->entry.height = infos[k].height;
+					r->entry.channels = infos[k].channels;
+					r->entry.rate = infos[k].rate;
+					r->entry.tracks = infos[k].tracks;
+					r->entry.fps = infos[k].fps;
+					r->path = paths[k];
+					r->title = infos[k].title;
+					r->artist = infos[k].artist;
+					r->album = infos[k].album;
+				}
+				index_write(config->index, records, count);
+				free(records);
+			}
+		}
+
+		/* the repeated paths get the information of the parsed one */
+		for (i=0; i<npaths; i++)
+			if (same[i] >= 0)
+				infos[i] = infos[same[i]];
+	}
+
+	index_close(&map);
+	free(st);
+	free(stale);
+	free(same);
+	free(sorted);
+	return nstale;
+}
@@ -0,0 +1,78 @@
+/*********************************************************************/
+/*                                                                   */
+/* Copyright (C) 2010,  AVIQ Bulgaria Ltd                            */
+/*                                                                   */
+/* Project:       LRun                                               */
+/* Filename:      vlcwrp_profile.c                                   */
+/* Description:   VLC wrapper per media performance profiles         */
+/*                                                                   */
+/*********************************************************************/
+
+#include <stdlib.h>
+
+#include "vlcwrp_priv.h"
+
+/* the default profile adds no option, the VLC arguments apply as given */
+static const char* const profile_default[] = { NULL };
+
+/* minimal buffering and no frame threading, late frames are dropped rather than delaying the next ones */
+static const char* const profile_low_latency[] =
+{
+	":network-caching=50",
+	":live-caching=50",
+	":clock-jitter=0",
+	":clock-synchro=0",
+	":avcodec-threads=1",
+	":avcodec-fast",
+	":avcodec-hurry-up",
+	":drop-late-frames",
+	":skip-frames",
+	NULL
+};
+
+/* deep buffering and all cores decoding, every frame is decoded */
+static const char* const profile_throughput[] =
+{
+	":network-caching=2000",
+	":live-caching=2000",
+	":avcodec-threads=0",
+	":no-drop-late-frames",
+	":no-skip-frames",
+	NULL
+};
+
+/* video only with the cheapest seeks, many such players run side by side */
+static const char* const profile_thumbnail[] =
+{
+	":no-audio",
+	":no-spu",
+	":input-fast-seek",
+	":avcodec-threads=1",
+	":avcodec-hw=none",
+	NULL
+};
+
+static const char* const* const profiles[] =
+{
+	profile_default,
+	profile_low_latency,
+	profile_throughput,
+	profile_thumbnail
+};
+
+/* adds the options of profile to media m */
+void vlcwrp_profile_apply(libvlc_media_t* m, vlcwrp_profile_t profile)
+{
+	const char* const* option;
+
+	if ((unsigned int)profile >= sizeof(profiles) / sizeof(profiles[0]))
+		return;
+	for (option = profiles[profile]; *option; option++)
+		libvlc_media_add_option(m, *option);
+}
+
+/* set the performance profile applied to the media played next */
+void vlcwrp_set_profile(struct vlcwrp_ctx_t* ctx, vlcwrp_profile_t profile)
+{
+	ctx->profile = profile;
+}
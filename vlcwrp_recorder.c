@@ -0,0 +1,716 @@
+/*********************************************************************/
+/*                                                                   */
+/* Copyright (C) 2010,  AVIQ Bulgaria Ltd                            */
+/*                                                                   */
+/* Project:       LRun                                               */
+/* Filename:      vlcwrp_recorder.c                                  */
+/* Description:   VLC wrapper raw frame recorder                     */
+/*                                                                   */
+/*********************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <sched.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+
+#include "vlcwrp_priv.h"
+
+/* recording file identification */
+#define RECORDING_MAGIC 0x46525756 /* "VWRF" */
+#define RECORDING_VERSION 1
+
+/* maximum number of frames written with one submission */
+#define RECORDING_MAX_BATCH 16
+
+/* alignment of the file blocks and the write buffers, as required by O_DIRECT */
+#define RECORDING_ALIGN 4096
+
+#define ALIGN_UP(x) (((x) + RECORDING_ALIGN - 1) / RECORDING_ALIGN * RECORDING_ALIGN)
+
+/**
+ * recording file header, padded to RECORDING_ALIGN
+ * the frames follow at data_offset every frame_stride bytes, then the index
+ */
+struct recording_header
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t width;
+	uint32_t height;
+	uint32_t pitch;
+	char chroma[4];
+	uint64_t frame_size;
+	uint64_t frame_stride;
+	uint64_t data_offset;
+	uint64_t count;
+	uint64_t index_offset;
+};
+
+/**
+ * recording index entry
+ */
+struct recording_entry
+{
+	uint32_t seq;
+	uint32_t reserved;
+	int64_t timestamp;
+};
+
+/**
+ * recorder buffer holding one frame
+ */
+struct record_buffer
+{
+	unsigned char* pixels;
+	unsigned int seq;
+	long long timestamp;
+};
+
+#ifdef __linux__
+/**
+ * io_uring submission and completion rings
+ */
+struct uring
+{
+	int fd;
+	unsigned int entries;
+
+	unsigned int* sq_head;
+	unsigned int* sq_tail;
+	unsigned int* sq_mask;
+	unsigned int* sq_array;
+	struct io_uring_sqe* sqes;
+
+	unsigned int* cq_head;
+	unsigned int* cq_tail;
+	unsigned int* cq_mask;
+	struct io_uring_cqe* cqes;
+
+	/* set if the kernel does not support IORING_OP_WRITE or the ring failed */
+	int unsupported;
+
+	void* sq_ptr;
+	size_t sq_size;
+	void* cq_ptr;
+	size_t cq_size;
+	size_t sqes_size;
+};
+#endif
+
+/**
+ * frame recorder state
+ *
+ * The decoder thread copies each frame into a free buffer, the writer
+ * thread writes the filled buffers in batches. The buffers form a ring
+ * filled at tail by the decoder and written from head by the writer.
+ */
+struct vlcwrp_recorder_ctx_t
+{
+	vlcwrp_record_config_t config;
+
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond_filled;
+	pthread_cond_t cond_free;
+	int stopping;
+
+	/* number of decoder threads copying a frame */
+	int active;
+
+	/* output file */
+	int fd;
+	struct recording_header* header;
+
+	/* frame buffers */
+	struct record_buffer* buffers;
+	unsigned int head;
+	unsigned int tail;
+
+	/* index of the written frames, owned by the writer */
+	struct recording_entry* index;
+	unsigned long long index_size;
+
+#ifdef __linux__
+	/* io_uring, fd is -1 if not available */
+	struct uring ring;
+#endif
+
+	/* statistics */
+	unsigned long written;
+	unsigned long dropped;
+	unsigned long long bytes;
+	long long write_time;
+	int write_error;
+};
+
+/* fill config with the default recorder configuration */
+void vlcwrp_record_defaults(vlcwrp_record_config_t* config)
+{
+	config->policy = VLCWRP_RECORD_DROP;
+	config->buffers = 16;
+	config->batch = 4;
+}
+
+#ifdef __linux__
+static int uring_init(struct uring* ring, unsigned int entries)
+{
+	struct io_uring_params p;
+
+	memset(ring, 0, sizeof(struct uring));
+	memset(&p, 0, sizeof(p));
+	ring->fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+	if (ring->fd < 0)
+		return -1;
+	ring->entries = p.sq_entries;
+
+	ring->sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+	ring->cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	ring->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+	{
+		if (ring->cq_size > ring->sq_size)
+			ring->sq_size = ring->cq_size;
+		ring->cq_size = ring->sq_size;
+	}
+	ring->sq_ptr = mmap(NULL, ring->sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+	if (ring->sq_ptr == MAP_FAILED)
+		goto fail;
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+		ring->cq_ptr = ring->sq_ptr;
+	else
+	{
+		ring->cq_ptr = mmap(NULL, ring->cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+		if (ring->cq_ptr == MAP_FAILED)
+			goto fail;
+	}
+	ring->sqes = (struct io_uring_sqe*)mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+	if (ring->sqes == MAP_FAILED)
+		goto fail;
+
+	ring->sq_head = (unsigned int*)((char*)ring->sq_ptr + p.sq_off.head);
+	ring->sq_tail = (unsigned int*)((char*)ring->sq_ptr + p.sq_off.tail);
+	ring->sq_mask = (unsigned int*)((char*)ring->sq_ptr + p.sq_off.ring_mask);
+	ring->sq_array = (unsigned int*)((char*)ring->sq_ptr + p.sq_off.array);
+	ring->cq_head = (unsigned int*)((char*)ring->cq_ptr + p.cq_off.head);
+	ring->cq_tail = (unsigned int*)((char*)ring->cq_ptr + p.cq_off.tail);
+	ring->cq_mask = (unsigned int*)((char*)ring->cq_ptr + p.cq_off.ring_mask);
+	ring->cqes = (struct io_uring_cqe*)((char*)ring->cq_ptr + p.cq_off.cqes);
+	return 0;
+
+fail:
+	if (ring->sq_ptr && ring->sq_ptr != MAP_FAILED)
+		munmap(ring->sq_ptr, ring->sq_size);
+	if (ring->cq_ptr && ring->cq_ptr != MAP_FAILED && ring->cq_ptr != ring->sq_ptr)
+		munmap(ring->cq_ptr, ring->cq_size);
+	close(ring->fd);
+	ring->fd = -1;
+	return -1;
+}
+
+static void uring_free(struct uring* ring)
+{
+	if (ring->fd < 0)
+		return;
+	munmap(ring->sqes, ring->sqes_size);
+	if (ring->cq_ptr != ring->sq_ptr)
+		munmap(ring->cq_ptr, ring->cq_size);
+	munmap(ring->sq_ptr, ring->sq_size);
+	close(ring->fd);
+	ring->fd = -1;
+}
+
+/*
+ * writes the buffers with one submission, returns a bit mask of the
+ * buffers not written completely
+ */
+static unsigned int uring_write(struct uring* ring, int fd, void* const* bufs, size_t len, unsigned long long offset, unsigned int n)
+{
+	unsigned int i, tail, reaped = 0, failed = 0;
+
+	tail = *ring->sq_tail;
+	for (i=0; i<n; i++)
+	{
+		unsigned int idx = tail & *ring->sq_mask;
+		struct io_uring_sqe* sqe = &ring->sqes[idx];
+		memset(sqe, 0, sizeof(struct io_uring_sqe));
+		sqe->opcode = IORING_OP_WRITE;
+		sqe->fd = fd;
+		sqe->addr = (unsigned long long)(uintptr_t)bufs[i];
+		sqe->len = (unsigned int)len;
+		sqe->off = offset + (unsigned long long)i * len;
+		sqe->user_data = i;
+		ring->sq_array[idx] = idx;
+		tail++;
+	}
+	vlcwrp_atomic_store(ring->sq_tail, tail);
+
+	if (syscall(__NR_io_uring_enter, ring->fd, n, n, IORING_ENTER_GETEVENTS, NULL, 0) < 0)
+	{
+		/* the entries left in the ring must not be submitted later */
+		ring->unsupported = 1;
+		return (1u << n) - 1;
+	}
+
+	while (reaped < n)
+	{
+		unsigned int head = *ring->cq_head;
+		if (head == vlcwrp_atomic_load(ring->cq_tail))
+		{
+			if (syscall(__NR_io_uring_enter, ring->fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0 && errno != EINTR)
+			{
+				ring->unsupported = 1;
+				return (1u << n) - 1;
+			}
+			continue;
+		}
+		{
+			struct io_uring_cqe* cqe = &ring->cqes[head & *ring->cq_mask];
+			if (cqe->res != (int)len)
+				failed |= 1u << cqe->user_data;
+			if (cqe->res == -EINVAL)
+				ring->unsupported = 1;
+			vlcwrp_atomic_store(ring->cq_head, head + 1);
+			reaped++;
+		}
+	}
+	return failed;
+}
+#endif
+
+/* writes a block at offset, returns 0 on success */
+static int write_block(int fd, const void* buf, size_t len, unsigned long long offset)
+{
+	while (len > 0)
+	{
+		ssize_t n = pwrite(fd, buf, len, (off_t)offset);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return -1;
+		buf = (const char*)buf + n;
+		len -= (size_t)n;
+		offset += (unsigned long long)n;
+	}
+	return 0;
+}
+
+/* writes the frames at buffers head to head + n - 1 */
+static void write_frames(struct vlcwrp_recorder_ctx_t* rec, unsigned int head, unsigned int n)
+{
+	void* bufs[RECORDING_MAX_BATCH];
+	size_t stride = (size_t)rec->header->frame_stride;
+	unsigned long long offset = rec->header->data_offset + rec->header->count * stride;
+	unsigned int i, failed = (1u << n) - 1;
+	long long start = vlcwrp_clock();
+
+	/* the index grows before the frames are written, a batch is either indexed or dropped */
+	if (rec->header->count + n > rec->index_size)
+	{
+		unsigned long long size = rec->index_size ? rec->index_size * 2 : 1024;
+		struct recording_entry* index = (struct recording_entry*)realloc(rec->index, (size_t)size * sizeof(struct recording_entry));
+		if (!index)
+		{
+			rec->write_error = 1;
+			vlcwrp_atomic_store(&rec->dropped, rec->dropped + n);
+			return;
+		}
+		rec->index = index;
+		rec->index_size = size;
+	}
+
+	for (i=0; i<n; i++)
+		bufs[i] = rec->buffers[(head + i) % rec->config.buffers].pixels;
+#ifdef __linux__
+	if (rec->ring.fd >= 0)
+	{
+		failed = uring_write(&rec->ring, rec->fd, bufs, stride, offset, n);
+		if (rec->ring.unsupported)
+			uring_free(&rec->ring);
+	}
+#endif
+	/* the frames io_uring could not write are written synchronously */
+	for (i=0; i<n; i++)
+		if ((failed & (1u << i)) && write_block(rec->fd, bufs[i], stride, offset + (unsigned long long)i * stride))
+			rec->write_error = 1;
+
+	for (i=0; i<n; i++)
+	{
+		struct record_buffer* buf = &rec->buffers[(head + i) % rec->config.buffers];
+		struct recording_entry* e = &rec->index[rec->header->count + i];
+		e->seq = buf->seq;
+		e->reserved = 0;
+		e->timestamp = buf->timestamp;
+	}
+	rec->header->count += n;
+	vlcwrp_atomic_store(&rec->write_time, rec->write_time + vlcwrp_clock() - start);
+	vlcwrp_atomic_store(&rec->bytes, rec->bytes + (unsigned long long)n * stride);
+	vlcwrp_atomic_store(&rec->written, rec->written + n);
+}
+
+static void* recorder_run(void* arg)
+{
+	struct vlcwrp_recorder_ctx_t* rec = (struct vlcwrp_recorder_ctx_t*)arg;
+	unsigned int head, n;
+
+	pthread_mutex_lock(&rec->mutex);
+	for (;;)
+	{
+		while (!rec->stopping && rec->tail - rec->head < (unsigned int)rec->config.batch)
+			pthread_cond_wait(&rec->cond_filled, &rec->mutex);
+		if (rec->tail == rec->head)
+			break;
+
+		/* writes a full batch, or what is left when stopping */
+		head = rec->head;
+		n = rec->tail - rec->head;
+		if (n > (unsigned int)rec->config.batch)
+			n = rec->config.batch;
+		pthread_mutex_unlock(&rec->mutex);
+
+		write_frames(rec, head, n);
+
+		pthread_mutex_lock(&rec->mutex);
+		rec->head += n;
+		pthread_cond_signal(&rec->cond_free);
+	}
+	pthread_mutex_unlock(&rec->mutex);
+	return NULL;
+}
+
+/* releases the recorder, the writer thread must not be running */
+static void recorder_free(struct vlcwrp_recorder_ctx_t* rec)
+{
+	int i;
+#ifdef __linux__
+	uring_free(&rec->ring);
+#endif
+	if (rec->fd >= 0)
+		close(rec->fd);
+	for (i=0; rec->buffers && i<rec->config.buffers; i++)
+		free(rec->buffers[i].pixels);
+	free(rec->buffers);
+	free(rec->header);
+	free(rec->index);
+	free(rec);
+}
+
+/* start recording the decoded frames */
+int vlcwrp_record_start(struct vlcwrp_ctx_t* ctx, const char* path, const vlcwrp_record_config_t* config)
+{
+#ifndef _WIN32
+	struct vlcwrp_recorder_ctx_t* rec;
+	size_t frame_size = (size_t)ctx->pitch * ctx->height;
+	int i;
+
+	if (!ctx->video || ctx->recorder)
+		return -1;
+	rec = (struct vlcwrp_recorder_ctx_t*)calloc(1, sizeof(struct vlcwrp_recorder_ctx_t));
+	if (!rec)
+		return -1;
+	rec->fd = -1;
+#ifdef __linux__
+	rec->ring.fd = -1;
+#endif
+	if (config)
+		rec->config = *config;
+	else
+		vlcwrp_record_defaults(&rec->config);
+	if (rec->config.buffers < 2 || rec->config.batch < 1 || rec->config.batch > RECORDING_MAX_BATCH || rec->config.batch > rec->config.buffers)
+	{
+		recorder_free(rec);
+		return -1;
+	}
+
+	/* the aligned frames are written without copy through the page cache when possible */
+	rec->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC
+#ifdef O_DIRECT
+		| O_DIRECT
+#endif
+		, 0644);
+	if (rec->fd < 0)
+		rec->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (rec->fd < 0 || posix_memalign((void**)&rec->header, RECORDING_ALIGN, RECORDING_ALIGN))
+	{
+		rec->header = NULL;
+		recorder_free(rec);
+		return -1;
+	}
+	memset(rec->header, 0, RECORDING_ALIGN);
+	rec->header->magic = RECORDING_MAGIC;
+	rec->header->version = RECORDING_VERSION;
+	rec->header->width = ctx->width;
+	rec->header->height = ctx->height;
+	rec->header->pitch = ctx->pitch;
+	memcpy(rec->header->chroma, CHROMA, 4);
+	rec->header->frame_size = frame_size;
+	rec->header->frame_stride = ALIGN_UP(frame_size);
+	rec->header->data_offset = RECORDING_ALIGN;
+
+	rec->buffers = (struct record_buffer*)calloc(rec->config.buffers, sizeof(struct record_buffer));
+	if (!rec->buffers)
+	{
+		recorder_free(rec);
+		return -1;
+	}
+	for (i=0; i<rec->config.buffers; i++)
+	{
+		if (posix_memalign((void**)&rec->buffers[i].pixels, RECORDING_ALIGN, (size_t)rec->header->frame_stride))
+		{
+			rec->buffers[i].pixels = NULL;
+			recorder_free(rec);
+			return -1;
+		}
+		/* the padding is written too, it is zeroed once */
+		memset(rec->buffers[i].pixels, 0, (size_t)rec->header->frame_stride);
+	}
+	if (write_block(rec->fd, rec->header, RECORDING_ALIGN, 0))
+	{
+		recorder_free(rec);
+		return -1;
+	}
+#ifdef __linux__
+	uring_init(&rec->ring, (unsigned int)rec->config.batch);
+#endif
+
+	pthread_mutex_init(&rec->mutex, 0);
+	pthread_cond_init(&rec->cond_filled, 0);
+	pthread_cond_init(&rec->cond_free, 0);
+	if (pthread_create(&rec->thread, 0, recorder_run, rec))
+	{
+		pthread_cond_destroy(&rec->cond_free);
+		pthread_cond_destroy(&rec->cond_filled);
+		pthread_mutex_destroy(&rec->mutex);
+		recorder_free(rec);
+		return -1;
+	}
+
+	pthread_mutex_lock(ctx->mutex);
+	vlcwrp_atomic_store(&ctx->recorder, rec);
+	pthread_mutex_unlock(ctx->mutex);
+	return 0;
+#else
+	return -1;
+#endif
+}
+
+/* takes the recorder for a frame copy, called with ctx->mutex locked */
+struct vlcwrp_recorder_ctx_t* vlcwrp_recorder_use(struct vlcwrp_ctx_t* ctx)
+{
+	struct vlcwrp_recorder_ctx_t* rec = ctx->recorder;
+	if (rec)
+		vlcwrp_atomic_add(&rec->active, 1);
+	return rec;
+}
+
+/* copies the decoded frame to the recorder taken by vlcwrp_recorder_use */
+void vlcwrp_recorder_frame(struct vlcwrp_recorder_ctx_t* rec, const unsigned char* pixels, unsigned int seq, long long timestamp)
+{
+	struct record_buffer* buf = NULL;
+
+	pthread_mutex_lock(&rec->mutex);
+	if (rec->config.policy == VLCWRP_RECORD_BLOCK)
+	{
+		/* backpressure, the decoder waits for the writer */
+		while (!rec->stopping && rec->tail - rec->head == (unsigned int)rec->config.buffers)
+			pthread_cond_wait(&rec->cond_free, &rec->mutex);
+	}
+	if (!rec->stopping && rec->tail - rec->head < (unsigned int)rec->config.buffers)
+		buf = &rec->buffers[rec->tail % rec->config.buffers];
+	else
+		vlcwrp_atomic_store(&rec->dropped, rec->dropped + 1);
+	pthread_mutex_unlock(&rec->mutex);
+
+	if (buf)
+	{
+		/* the buffer at tail is only read by the writer once published */
+		memcpy(buf->pixels, pixels, (size_t)rec->header->frame_size);
+		buf->seq = seq;
+		buf->timestamp = timestamp;
+		pthread_mutex_lock(&rec->mutex);
+		rec->tail++;
+		if (rec->tail - rec->head >= (unsigned int)rec->config.batch)
+			pthread_cond_signal(&rec->cond_filled);
+		pthread_mutex_unlock(&rec->mutex);
+	}
+
+	pthread_mutex_lock(&rec->mutex);
+	rec->active--;
+	pthread_cond_broadcast(&rec->cond_free);
+	pthread_mutex_unlock(&rec->mutex);
+}
+
+/* stop recording, the queued frames and the index are written */
+int vlcwrp_record_stop(struct vlcwrp_ctx_t* ctx)
+{
+	struct vlcwrp_recorder_ctx_t* rec;
+	unsigned long long index_bytes;
+	unsigned char* block;
+	int rc;
+
+	pthread_mutex_lock(ctx->mutex);
+	rec = ctx->recorder;
+	vlcwrp_atomic_store(&ctx->recorder, (struct vlcwrp_recorder_ctx_t*)NULL);
+	pthread_mutex_unlock(ctx->mutex);
+	if (!rec)
+		return -1;
+
+	/* the statistics readers that found the recorder are done with it shortly */
+	vlcwrp_atomic_fence();
+	while (vlcwrp_atomic_load(&ctx->recorder_readers) > 0)
+		sched_yield();
+
+	/* waits for the frame copies in progress, then for the writer */
+	pthread_mutex_lock(&rec->mutex);
+	while (vlcwrp_atomic_load(&rec->active) > 0)
+		pthread_cond_wait(&rec->cond_free, &rec->mutex);
+	rec->stopping = 1;
+	pthread_cond_broadcast(&rec->cond_filled);
+	pthread_cond_broadcast(&rec->cond_free);
+	pthread_mutex_unlock(&rec->mutex);
+	pthread_join(rec->thread, NULL);
+
+	/* the index follows the frames, padded to the alignment */
+	rc = rec->write_error ? -1 : 0;
+	rec->header->index_offset = rec->header->data_offset + rec->header->count * rec->header->frame_stride;
+	index_bytes = ALIGN_UP(rec->header->count * sizeof(struct recording_entry));
+	if (index_bytes > 0)
+	{
+		if (posix_memalign((void**)&block, RECORDING_ALIGN, (size_t)index_bytes))
+			rc = -1;
+		else
+		{
+			memset(block, 0, (size_t)index_bytes);
+			memcpy(block, rec->index, (size_t)(rec->header->count * sizeof(struct recording_entry)));
+			if (write_block(rec->fd, block, (size_t)index_bytes, rec->header->index_offset))
+				rc = -1;
+			free(block);
+		}
+	}
+	if (write_block(rec->fd, rec->header, RECORDING_ALIGN, 0) || fsync(rec->fd))
+		rc = -1;
+
+	pthread_cond_destroy(&rec->cond_free);
+	pthread_cond_destroy(&rec->cond_filled);
+	pthread_mutex_destroy(&rec->mutex);
+	recorder_free(rec);
+	return rc;
+}
+
+/* get recorder statistics */
+int vlcwrp_record_stats(struct vlcwrp_ctx_t* ctx, vlcwrp_record_stats_t* stats)
+{
+	struct vlcwrp_recorder_ctx_t* rec;
+	int res = 0;
+
+	/* not locking ctx->mutex, the caller may hold an acquired frame, the reader count pins the recorder */
+	vlcwrp_atomic_add(&ctx->recorder_readers, 1);
+	vlcwrp_atomic_fence();
+	rec = vlcwrp_atomic_load(&ctx->recorder);
+	if (rec)
+	{
+		stats->written = vlcwrp_atomic_load(&rec->written);
+		stats->dropped = vlcwrp_atomic_load(&rec->dropped);
+		stats->bytes = vlcwrp_atomic_load(&rec->bytes);
+		stats->write_time = vlcwrp_atomic_load(&rec->write_time);
+		stats->queued = vlcwrp_atomic_load(&rec->tail) - vlcwrp_atomic_load(&rec->head);
+#ifdef __linux__
+		stats->io_uring = rec->ring.fd >= 0;
+#else
+		stats->io_uring = 0;
+#endif
+		res = 1;
+	}
+	vlcwrp_atomic_add(&ctx->recorder_readers, -1);
+	return res;
+}
+
+/* open a recording for replay */
+int vlcwrp_recording_open(const char* path, vlcwrp_recording_t* recording)
+{
+#ifndef _WIN32
+	const struct recording_header* header;
+	unsigned long long size;
+	struct stat st;
+	void* base;
+	int fd;
+
+	memset(recording, 0, sizeof(vlcwrp_recording_t));
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -1;
+	if (fstat(fd, &st) || (size_t)st.st_size < RECORDING_ALIGN)
+	{
+		close(fd);
+		return -1;
+	}
+	base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (base == MAP_FAILED)
+		return -1;
+
+	/* a recording not stopped cleanly has no index and is rejected, as is a truncated one */
+	header = (const struct recording_header*)base;
+	size = (unsigned long long)st.st_size;
+	if (header->magic != RECORDING_MAGIC || header->version != RECORDING_VERSION
+	 || (unsigned long long)header->pitch < (unsigned long long)header->width * BPP
+	 || header->frame_size < (unsigned long long)header->pitch * header->height
+	 || !header->frame_stride || header->frame_stride < header->frame_size
+	 || header->data_offset < RECORDING_ALIGN
+	 || header->index_offset < header->data_offset || header->index_offset > size
+	 || (header->count && header->count > (header->index_offset - header->data_offset) / header->frame_stride)
+	 || header->count > (size - header->index_offset) / sizeof(struct recording_entry))
+	{
+		munmap(base, (size_t)st.st_size);
+		return -1;
+	}
+	recording->base = base;
+	recording->size = size;
+	recording->width = header->width;
+	recording->height = header->height;
+	recording->pitch = header->pitch;
+	recording->count = header->count;
+	return 0;
+#else
+	return -1;
+#endif
+}
+
+/* get a frame of the recording */
+const void* vlcwrp_recording_frame(const vlcwrp_recording_t* recording, unsigned long long i, unsigned int* seq, long long* timestamp)
+{
+	const struct recording_header* header = (const struct recording_header*)recording->base;
+	const struct recording_entry* index;
+
+	if (!header || i >= header->count)
+		return NULL;
+	index = (const struct recording_entry*)((const char*)recording->base + header->index_offset);
+	if (seq)
+		*seq = index[i].seq;
+	if (timestamp)
+		*timestamp = index[i].timestamp;
+	return (const char*)recording->base + header->data_offset + i * header->frame_stride;
+}
+
+/* close a recording */
+void vlcwrp_recording_close(vlcwrp_recording_t* recording)
+{
+#ifndef _WIN32
+	if (recording->base)
+		munmap((void*)recording->base, (size_t)recording->size);
+#endif
+	memset(recording, 0, sizeof(vlcwrp_recording_t));
+}
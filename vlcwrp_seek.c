@@ -0,0 +1,779 @@
+/*********************************************************************/
+/*                                                                   */
+/* Copyright (C) 2010,  AVIQ Bulgaria Ltd                            */
+/*                                                                   */
+/* Project:       LRun                                               */
+/* Filename:      vlcwrp_seek.c                                      */
+/* Description:   VLC wrapper keyframe index and coalesced seeking   */
+/*                                                                   */
+/*********************************************************************/
+
+#define _FILE_OFFSET_BITS 64
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "vlcwrp_priv.h"
+
+/* keyframe index file identification */
+#define KEYFRAMES_MAGIC 0x494b5756 /* "VWKI" */
+#define KEYFRAMES_VERSION 2
+
+/* time in milliseconds a seek waits for the first frame at the new position */
+#define SEEK_SETTLE_TIMEOUT 500
+
+/* size of the transport stream scan buffer in packets */
+#define TS_PACKET_SIZE 188
+#define TS_SCAN_PACKETS 4096
+
+/* largest MP4 movie box loaded for indexing */
+#define MP4_MAX_MOOV (256 * 1024 * 1024)
+
+/**
+ * keyframe index file header, followed by the keyframe times in milliseconds
+ */
+struct keyframes_header
+{
+	uint32_t magic;
+	uint32_t version;
+	uint64_t size;
+	int64_t mtime;
+	uint64_t count;
+};
+
+/**
+ * growing list of keyframe times
+ */
+struct keyframe_list
+{
+	long long* times;
+	int count;
+	int capacity;
+};
+
+/**
+ * seek state
+ *
+ * Seeks are executed by the seek thread. A request made while a seek is
+ * in flight replaces the pending one, so rapid scrubbing only executes the
+ * latest target once the previous seek delivered its first frame. The
+ * keyframe index of the played file is built by the scanner thread.
+ */
+struct vlcwrp_seek_ctx_t
+{
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	int stop;
+
+	/* latest requested seek */
+	int pending;
+	long long target;
+	vlcwrp_seek_mode_t mode;
+
+	/* generation of the last seek that delivered a frame */
+	unsigned int settled;
+
+	/* keyframe index configuration */
+	int index;
+	char* index_dir;
+
+	/* keyframe index of the current media, sorted, NULL if not available */
+	long long* keyframes;
+	int nkeyframes;
+
+	/* keyframe scanner of the current media path */
+	pthread_t scanner;
+	int scanner_running;
+	int scanning;
+	int abort;
+	char* path;
+
+	/* statistics */
+	unsigned long requested;
+	unsigned long executed;
+	unsigned long coalesced;
+	long long seek_time;
+};
+
+/* fill config with the default seek configuration */
+void vlcwrp_seek_defaults(vlcwrp_seek_config_t* config)
+{
+	config->index = 1;
+	config->index_dir = NULL;
+}
+
+static int keyframes_add(struct keyframe_list* list, long long time)
+{
+	if (list->count == list->capacity)
+	{
+		int capacity = list->capacity ? 2 * list->capacity : 1024;
+		long long* times = (long long*)realloc(list->times, capacity * sizeof(long long));
+		if (!times)
+			return -1;
+		list->times = times;
+		list->capacity = capacity;
+	}
+	list->times[list->count++] = time;
+	return 0;
+}
+
+static int compare_times(const void* a, const void* b)
+{
+	long long ta = *(const long long*)a;
+	long long tb = *(const long long*)b;
+	return ta < tb ? -1 : ta > tb;
+}
+
+static uint32_t rd32(const unsigned char* p)
+{
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static uint64_t rd64(const unsigned char* p)
+{
+	return ((uint64_t)rd32(p) << 32) | rd32(p + 4);
+}
+
+/* finds the next box of type in [*p, end), returns its payload and advances *p past it */
+static const unsigned char* mp4_next(const unsigned char** p, const unsigned char* end, const char* type, size_t* size)
+{
+	while (end - *p >= 8)
+	{
+		const unsigned char* box = *p;
+		uint64_t len = rd32(box);
+		size_t hdr = 8;
+		if (len == 1)
+		{
+			if (end - box < 16)
+				return NULL;
+			len = rd64(box + 8);
+			hdr = 16;
+		}
+		else if (len == 0)
+			len = end - box;
+		if (len < hdr || len > (uint64_t)(end - box))
+			return NULL;
+		*p = box + len;
+		if (!memcmp(box + 4, type, 4))
+		{
+			*size = (size_t)len - hdr;
+			return box + hdr;
+		}
+	}
+	return NULL;
+}
+
+static const unsigned char* mp4_find(const unsigned char* p, size_t size, const char* type, size_t* found)
+{
+	return p ? mp4_next(&p, p + size, type, found) : NULL;
+}
+
+/* presentation delay of a track in its media timescale, from the leading empty edits and the media start of its edit list */
+static long long mp4_edit_offset(const unsigned char* trak, size_t trak_size, uint32_t movie_timescale, uint32_t timescale)
+{
+	const unsigned char *edts, *elst, *e;
+	size_t edts_size, elst_size, entry;
+	uint32_t n, i;
+	long long empty = 0;
+
+	edts = mp4_find(trak, trak_size, "edts", &edts_size);
+	elst = mp4_find(edts, edts_size, "elst", &elst_size);
+	if (!elst || elst_size < 8)
+		return 0;
+	entry = elst[0] == 1 ? 20 : 12;
+	n = rd32(elst + 4);
+	if (n > (elst_size - 8) / entry)
+		return 0;
+	for (i=0, e=elst+8; i<n; i++, e+=entry)
+	{
+		uint64_t duration = entry == 20 ? rd64(e) : rd32(e);
+		int64_t media_time = entry == 20 ? (int64_t)rd64(e + 8) : (int32_t)rd32(e + 4);
+
+		/* the empty edits delay the track in the movie timescale */
+		if (media_time == -1)
+		{
+			if (movie_timescale)
+				empty += (long long)(duration * timescale / movie_timescale);
+			continue;
+		}
+		return empty - media_time;
+	}
+	return empty;
+}
+
+/* indexes the sync samples of the first video track of a MP4 movie box */
+static int mp4_keyframes(const unsigned char* moov, size_t moov_size, struct keyframe_list* list)
+{
+	const unsigned char* p = moov;
+	const unsigned char *trak, *mvhd;
+	size_t trak_size, mvhd_size;
+	uint32_t movie_timescale = 0;
+
+	mvhd = mp4_find(moov, moov_size, "mvhd", &mvhd_size);
+	if (mvhd && mvhd_size >= 24)
+		movie_timescale = rd32(mvhd + (mvhd[0] == 1 ? 20 : 12));
+
+	while ((trak = mp4_next(&p, moov + moov_size, "trak", &trak_size)))
+	{
+		const unsigned char *mdia, *hdlr, *mdhd, *minf, *stbl, *stts, *stss, *ctts;
+		size_t mdia_size, hdlr_size, mdhd_size, minf_size, stbl_size, stts_size, stss_size = 0, ctts_size = 0;
+		uint32_t timescale, nstts, nsync, nctts, e, k, c;
+		uint64_t sample, dts, ctts_sample;
+		long long offset, pts;
+
+		mdia = mp4_find(trak, trak_size, "mdia", &mdia_size);
+		hdlr = mp4_find(mdia, mdia_size, "hdlr", &hdlr_size);
+		if (!hdlr || hdlr_size < 12 || memcmp(hdlr + 8, "vide", 4))
+			continue;
+		mdhd = mp4_find(mdia, mdia_size, "mdhd", &mdhd_size);
+		if (!mdhd || mdhd_size < 24)
+			continue;
+		timescale = rd32(mdhd + (mdhd[0] == 1 ? 20 : 12));
+		minf = mp4_find(mdia, mdia_size, "minf", &minf_size);
+		stbl = mp4_find(minf, minf_size, "stbl", &stbl_size);
+		stts = mp4_find(stbl, stbl_size, "stts", &stts_size);
+		if (!timescale || !stts || stts_size < 8)
+			continue;
+		nstts = rd32(stts + 4);
+		if (nstts > (stts_size - 8) / 8)
+			continue;
+
+		/* without a sync sample table all samples are sync samples */
+		stss = mp4_find(stbl, stbl_size, "stss", &stss_size);
+		nsync = stss && stss_size >= 8 ? rd32(stss + 4) : 0xffffffff;
+		if (stss && nsync > (stss_size - 8) / 4)
+			continue;
+
+		/* the keyframes are indexed at their presentation time, the decoding time plus the composition offset and the edit */
+		ctts = mp4_find(stbl, stbl_size, "ctts", &ctts_size);
+		nctts = ctts && ctts_size >= 8 ? rd32(ctts + 4) : 0;
+		if (nctts > (ctts_size - 8) / 8)
+			nctts = 0;
+		offset = mp4_edit_offset(trak, trak_size, movie_timescale, timescale);
+
+		for (e=0, k=0, c=0, sample=1, dts=0, ctts_sample=1; e<nstts && k<nsync; e++)
+		{
+			uint32_t count = rd32(stts + 8 + 8 * e);
+			uint32_t delta = rd32(stts + 12 + 8 * e);
+			while (k < nsync)
+			{
+				uint64_t s = stss ? rd32(stss + 8 + 4 * k) : sample + k;
+				if (s >= sample + count)
+					break;
+				if (s >= sample)
+				{
+					/* the sync samples are increasing, the composition offset runs are walked once */
+					while (c < nctts && s >= ctts_sample + rd32(ctts + 8 + 8 * c))
+						ctts_sample += rd32(ctts + 8 + 8 * c++);
+					pts = (long long)(dts + (s - sample) * delta) + offset;
+					if (c < nctts)
+						pts += ctts[0] == 1 ? (int32_t)rd32(ctts + 12 + 8 * c) : (long long)rd32(ctts + 12 + 8 * c);
+					if (keyframes_add(list, pts > 0 ? pts * 1000 / timescale : 0))
+						return -1;
+				}
+				k++;
+			}
+			if (!stss)
+				k = 0;
+			sample += count;
+			dts += (uint64_t)count * delta;
+		}
+		return 0;
+	}
+	return -1;
+}
+
+/* scans the top level boxes of a MP4 file for the movie box */
+static int mp4_scan(FILE* f, struct keyframe_list* list)
+{
+	unsigned char hdr[16];
+	unsigned char* moov;
+	off_t off = 0;
+	uint64_t len;
+	int rc;
+
+	for (;;)
+	{
+		if (fseeko(f, off, SEEK_SET) || fread(hdr, 1, 8, f) != 8)
+			return -1;
+		len = rd32(hdr);
+		if (len == 1)
+		{
+			if (fread(hdr + 8, 1, 8, f) != 8)
+				return -1;
+			len = rd64(hdr + 8);
+		}
+		if (len < 8)
+			return -1;
+		if (!memcmp(hdr + 4, "moov", 4))
+			break;
+		off += (off_t)len;
+	}
+	if (len > MP4_MAX_MOOV || !(moov = (unsigned char*)malloc((size_t)len)))
+		return -1;
+	rc = fseeko(f, off, SEEK_SET) || fread(moov, 1, (size_t)len, f) != len ? -1 : 0;
+	if (!rc)
+	{
+		const unsigned char* p = moov;
+		size_t size;
+		const unsigned char* payload = mp4_next(&p, moov + len, "moov", &size);
+		rc = payload ? mp4_keyframes(payload, size, list) : -1;
+	}
+	free(moov);
+	return rc;
+}
+
+/* non zero if the H.264 payload starts an IDR picture or a sequence parameter set */
+static int h264_key(const unsigned char* p, int n)
+{
+	int i;
+	for (i=0; i+3<n; i++)
+		if (!p[i] && !p[i+1] && p[i+2] == 1)
+		{
+			int type = p[i+3] & 0x1f;
+			if (type == 5 || type == 7)
+				return 1;
+		}
+	return 0;
+}
+
+/* indexes the random access points of the first video stream of a transport stream */
+static int ts_scan(struct vlcwrp_seek_ctx_t* seek, FILE* f, struct keyframe_list* list)
+{
+	unsigned char* buf = (unsigned char*)malloc(TS_SCAN_PACKETS * TS_PACKET_SIZE);
+	size_t len = 0, pos = 0, n;
+	long long base = -1, last = 0, wraps = 0;
+	int video_pid = -1;
+
+	if (!buf)
+		return -1;
+	while (!vlcwrp_atomic_load(&seek->abort))
+	{
+		memmove(buf, buf + pos, len - pos);
+		len -= pos;
+		pos = 0;
+		n = fread(buf + len, 1, TS_SCAN_PACKETS * TS_PACKET_SIZE - len, f);
+		if (!n)
+			break;
+		len += n;
+
+		for (; len - pos >= TS_PACKET_SIZE; pos += TS_PACKET_SIZE)
+		{
+			const unsigned char* p = buf + pos;
+			const unsigned char* pes;
+			int pid, off = 4, rai = 0, size, hlen;
+			long long pts;
+
+			/* resynchronizes byte by byte on a lost packet */
+			while (p[0] != 0x47 && len - pos > TS_PACKET_SIZE)
+				p = buf + ++pos;
+			if (p[0] != 0x47)
+				break;
+			pid = ((p[1] & 0x1f) << 8) | p[2];
+			if (p[3] & 0x20)
+			{
+				rai = p[4] > 0 && (p[5] & 0x40);
+				off = 5 + p[4];
+			}
+			if (!(p[1] & 0x40) || !(p[3] & 0x10) || off > TS_PACKET_SIZE - 14)
+				continue;
+
+			/* video PES packets with a PTS */
+			pes = p + off;
+			size = TS_PACKET_SIZE - off;
+			if (pes[0] || pes[1] || pes[2] != 1 || (pes[3] & 0xf0) != 0xe0 || !(pes[7] & 0x80))
+				continue;
+			if (video_pid < 0)
+				video_pid = pid;
+			else if (pid != video_pid)
+				continue;
+			hlen = 9 + pes[8];
+			if (!rai && (hlen >= size || !h264_key(pes + hlen, size - hlen)))
+				continue;
+
+			pts = ((long long)(pes[9] & 0x0e) << 29) | (pes[10] << 22) | ((pes[11] & 0xfe) << 14) | (pes[12] << 7) | (pes[13] >> 1);
+			if (base < 0)
+				base = last = pts;
+			if (pts + (1LL << 32) < last)
+				wraps += 1LL << 33;
+			last = pts;
+			if (keyframes_add(list, (pts + wraps - base) / 90))
+			{
+				free(buf);
+				return -1;
+			}
+		}
+	}
+	free(buf);
+	return list->count ? 0 : -1;
+}
+
+/* path of the persisted keyframe index of a media path */
+static char* index_path(const char* dir, const char* path)
+{
+	uint64_t h = 14695981039346656037ULL;
+	char* file = (char*)malloc(strlen(dir) + 22);
+	if (!file)
+		return NULL;
+	while (*path)
+	{
+		h ^= (unsigned char)*path++;
+		h *= 1099511628211ULL;
+	}
+	sprintf(file, "%s/%016llx.vwk", dir, (unsigned long long)h);
+	return file;
+}
+
+/* loads the persisted keyframe index if the media did not change */
+static int index_load(const char* file, const struct stat* st, struct keyframe_list* list)
+{
+	struct keyframes_header header;
+	struct stat fst;
+	FILE* f = fopen(file, "rb");
+	int rc = -1;
+	if (!f)
+		return -1;
+
+	/* the count is bounded by the index file size before allocating */
+	if (!fstat(fileno(f), &fst) && (uint64_t)fst.st_size >= sizeof(header)
+	 && fread(&header, sizeof(header), 1, f) == 1 && header.magic == KEYFRAMES_MAGIC
+	 && header.version == KEYFRAMES_VERSION && header.size == (uint64_t)st->st_size
+	 && header.mtime == (int64_t)st->st_mtime && header.count && header.count < 0x7fffffff
+	 && header.count <= ((uint64_t)fst.st_size - sizeof(header)) / sizeof(long long))
+	{
+		list->times = (long long*)malloc((size_t)header.count * sizeof(long long));
+		if (list->times && fread(list->times, sizeof(long long), (size_t)header.count, f) == header.count)
+		{
+			list->count = list->capacity = (int)header.count;
+			rc = 0;
+		}
+	}
+	fclose(f);
+	return rc;
+}
+
+/* persists the keyframe index */
+static void index_save(const char* file, const struct stat* st, const struct keyframe_list* list)
+{
+	struct keyframes_header header;
+	char* tmp = (char*)malloc(strlen(file) + 5);
+	FILE* f;
+	int rc;
+	if (!tmp)
+		return;
+	sprintf(tmp, "%s.tmp", file);
+	f = fopen(tmp, "wb");
+	if (f)
+	{
+		header.magic = KEYFRAMES_MAGIC;
+		header.version = KEYFRAMES_VERSION;
+		header.size = (uint64_t)st->st_size;
+		header.mtime = (int64_t)st->st_mtime;
+		header.count = list->count;
+		fwrite(&header, sizeof(header), 1, f);
+		fwrite(list->times, sizeof(long long), list->count, f);
+		rc = ferror(f);
+		if (fclose(f) || rc || rename(tmp, file))
+			remove(tmp);
+	}
+	free(tmp);
+}
+
+static void* scanner_run(void* arg)
+{
+	struct vlcwrp_seek_ctx_t* seek = (struct vlcwrp_seek_ctx_t*)arg;
+	struct keyframe_list list = { NULL, 0, 0 };
+	char* file = seek->index_dir ? index_path(seek->index_dir, seek->path) : NULL;
+	unsigned char probe[TS_PACKET_SIZE + 1];
+	struct stat st;
+	FILE* f;
+	int rc = -1;
+
+	if (stat(seek->path, &st))
+		rc = -1;
+	else if (file && !index_load(file, &st, &list))
+		rc = 0;
+	else if ((f = fopen(seek->path, "rb")))
+	{
+		if (fread(probe, 1, sizeof(probe), f) == sizeof(probe))
+		{
+			rewind(f);
+			if (probe[0] == 0x47 && probe[TS_PACKET_SIZE] == 0x47)
+				rc = ts_scan(seek, f, &list);
+			else if (!memcmp(probe + 4, "ftyp", 4) || !memcmp(probe + 4, "moov", 4))
+				rc = mp4_scan(f, &list);
+		}
+		fclose(f);
+		if (!rc && !vlcwrp_atomic_load(&seek->abort))
+		{
+			qsort(list.times, list.count, sizeof(long long), compare_times);
+			if (file)
+				index_save(file, &st, &list);
+		}
+	}
+	free(file);
+
+	pthread_mutex_lock(&seek->mutex);
+	if (!rc && !seek->abort)
+	{
+		seek->keyframes = list.times;
+		seek->nkeyframes = list.count;
+		list.times = NULL;
+	}
+	seek->scanning = 0;
+	pthread_mutex_unlock(&seek->mutex);
+	free(list.times);
+	return NULL;
+}
+
+/* nearest keyframe to time, called with seek->mutex locked */
+static long long nearest_keyframe(const struct vlcwrp_seek_ctx_t* seek, long long time)
+{
+	int lo = 0, hi = seek->nkeyframes;
+	if (!seek->nkeyframes)
+		return -1;
+	while (lo < hi)
+	{
+		int mid = (lo + hi) / 2;
+		if (seek->keyframes[mid] < time)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (lo == seek->nkeyframes || (lo > 0 && time - seek->keyframes[lo - 1] <= seek->keyframes[lo] - time))
+		lo--;
+	return seek->keyframes[lo];
+}
+
+static void* seek_run(void* arg)
+{
+	struct vlcwrp_ctx_t* ctx = (struct vlcwrp_ctx_t*)arg;
+	struct vlcwrp_seek_ctx_t* seek = ctx->seek;
+	long long target, start, elapsed;
+	struct timespec deadline;
+	unsigned int gen;
+	int settled;
+
+	pthread_mutex_lock(&seek->mutex);
+	for (;;)
+	{
+		while (!seek->stop && !seek->pending)
+			pthread_cond_wait(&seek->cond, &seek->mutex);
+		if (seek->stop)
+			break;
+		target = seek->target;
+		if (seek->mode == VLCWRP_SEEK_FAST && seek->nkeyframes)
+			target = nearest_keyframe(seek, target);
+		seek->pending = 0;
+		pthread_mutex_unlock(&seek->mutex);
+
+		/* the frames decoded at the new position get the generation of the seek */
+		pthread_mutex_lock(ctx->mutex);
+		gen = ++ctx->seek_gen;
+		ctx->seek_target = target;
+		ctx->seek_input = ctx->time_input;
+		pthread_mutex_unlock(ctx->mutex);
+
+		/* the next request waits for the first frame at the new position */
+		start = vlcwrp_clock();
+		libvlc_media_player_set_time(ctx->mp, target);
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_sec += SEEK_SETTLE_TIMEOUT / 1000;
+		deadline.tv_nsec += (SEEK_SETTLE_TIMEOUT % 1000) * 1000000L;
+		if (deadline.tv_nsec >= 1000000000L)
+		{
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000L;
+		}
+		pthread_mutex_lock(&seek->mutex);
+		while (ctx->video && !seek->stop && seek->settled != gen)
+			if (pthread_cond_timedwait(&seek->cond, &seek->mutex, &deadline) == ETIMEDOUT)
+				break;
+		settled = !ctx->video || seek->settled == gen;
+		pthread_mutex_unlock(&seek->mutex);
+		elapsed = vlcwrp_clock() - start;
+		vlcwrp_event_post(ctx, VLCWRP_EVENT_SEEK, settled ? 0 : -1, target, NULL);
+
+		pthread_mutex_lock(&seek->mutex);
+		seek->executed++;
+		seek->seek_time += elapsed;
+	}
+	pthread_mutex_unlock(&seek->mutex);
+	return NULL;
+}
+
+/* wakes the seek thread on the first frame of seek generation gen, called with ctx->mutex locked */
+void vlcwrp_seek_settled(struct vlcwrp_ctx_t* ctx, unsigned int gen)
+{
+	struct vlcwrp_seek_ctx_t* seek = ctx->seek;
+	if (!seek)
+		return;
+	pthread_mutex_lock(&seek->mutex);
+	seek->settled = gen;
+	pthread_cond_broadcast(&seek->cond);
+	pthread_mutex_unlock(&seek->mutex);
+}
+
+/* start the seek thread */
+int vlcwrp_seek_start(struct vlcwrp_ctx_t* ctx, const vlcwrp_seek_config_t* config)
+{
+	struct vlcwrp_seek_ctx_t* seek;
+
+	if (ctx->seek)
+		return -1;
+	seek = (struct vlcwrp_seek_ctx_t*)calloc(1, sizeof(struct vlcwrp_seek_ctx_t));
+	if (!seek)
+		return -1;
+	seek->index = config->index;
+	if (config->index_dir)
+	{
+		seek->index_dir = (char*)malloc(strlen(config->index_dir) + 1);
+		if (!seek->index_dir)
+		{
+			free(seek);
+			return -1;
+		}
+		strcpy(seek->index_dir, config->index_dir);
+	}
+	pthread_mutex_init(&seek->mutex, 0);
+	pthread_cond_init(&seek->cond, 0);
+	vlcwrp_atomic_store(&ctx->seek, seek);
+	if (pthread_create(&seek->thread, 0, seek_run, ctx))
+	{
+		pthread_mutex_lock(ctx->mutex);
+		ctx->seek = NULL;
+		pthread_mutex_unlock(ctx->mutex);
+		pthread_cond_destroy(&seek->cond);
+		pthread_mutex_destroy(&seek->mutex);
+		free(seek->index_dir);
+		free(seek);
+		return -1;
+	}
+	return 0;
+}
+
+/* aborts the keyframe scanner and drops the index */
+static void seek_reset(struct vlcwrp_seek_ctx_t* seek)
+{
+	if (seek->scanner_running)
+	{
+		vlcwrp_atomic_store(&seek->abort, 1);
+		pthread_join(seek->scanner, NULL);
+		seek->scanner_running = 0;
+	}
+	pthread_mutex_lock(&seek->mutex);
+	free(seek->keyframes);
+	seek->keyframes = NULL;
+	seek->nkeyframes = 0;
+	seek->abort = 0;
+	pthread_mutex_unlock(&seek->mutex);
+	free(seek->path);
+	seek->path = NULL;
+}
+
+/* stop the seek thread and the keyframe scanner */
+void vlcwrp_seek_stop(struct vlcwrp_ctx_t* ctx)
+{
+	struct vlcwrp_seek_ctx_t* seek = ctx->seek;
+	if (!seek)
+		return;
+
+	/* the decoder wakes the seek thread with ctx->mutex locked */
+	pthread_mutex_lock(ctx->mutex);
+	ctx->seek = NULL;
+	pthread_mutex_unlock(ctx->mutex);
+	seek_reset(seek);
+	pthread_mutex_lock(&seek->mutex);
+	seek->stop = 1;
+	pthread_cond_signal(&seek->cond);
+	pthread_mutex_unlock(&seek->mutex);
+	pthread_join(seek->thread, NULL);
+	pthread_cond_destroy(&seek->cond);
+	pthread_mutex_destroy(&seek->mutex);
+	free(seek->index_dir);
+	free(seek);
+}
+
+/* indexes the keyframes of the played media path, NULL if not a file */
+void vlcwrp_seek_media(struct vlcwrp_ctx_t* ctx, const char* path)
+{
+	struct vlcwrp_seek_ctx_t* seek = ctx->seek;
+	if (!seek)
+		return;
+	seek_reset(seek);
+	if (!path || !seek->index)
+		return;
+	seek->path = (char*)malloc(strlen(path) + 1);
+	if (!seek->path)
+		return;
+	strcpy(seek->path, path);
+	seek->scanning = 1;
+	seek->scanner_running = !pthread_create(&seek->scanner, 0, scanner_run, seek);
+	if (!seek->scanner_running)
+		seek->scanning = 0;
+}
+
+/* request a seek to time */
+int vlcwrp_seek(struct vlcwrp_ctx_t* ctx, long long time, vlcwrp_seek_mode_t mode)
+{
+	struct vlcwrp_seek_ctx_t* seek = ctx->seek;
+	if (time < 0)
+		return -1;
+	if (!seek)
+	{
+		/* seeking without a keyframe index until configured */
+		vlcwrp_seek_config_t config;
+		vlcwrp_seek_defaults(&config);
+		config.index = 0;
+		if (vlcwrp_seek_start(ctx, &config))
+			return -1;
+		seek = ctx->seek;
+	}
+	pthread_mutex_lock(&seek->mutex);
+	seek->requested++;
+	if (seek->pending)
+		seek->coalesced++;
+	seek->pending = 1;
+	seek->target = time;
+	seek->mode = mode;
+	pthread_cond_signal(&seek->cond);
+	pthread_mutex_unlock(&seek->mutex);
+	return 0;
+}
+
+/* get the keyframe nearest to time */
+long long vlcwrp_seek_keyframe(struct vlcwrp_ctx_t* ctx, long long time)
+{
+	struct vlcwrp_seek_ctx_t* seek = ctx->seek;
+	long long keyframe;
+	if (!seek)
+		return -1;
+	pthread_mutex_lock(&seek->mutex);
+	keyframe = nearest_keyframe(seek, time);
+	pthread_mutex_unlock(&seek->mutex);
+	return keyframe;
+}
+
+/* get seek statistics */
+int vlcwrp_seek_stats(struct vlcwrp_ctx_t* ctx, vlcwrp_seek_stats_t* stats)
+{
+	struct vlcwrp_seek_ctx_t* seek = ctx->seek;
+	if (!seek)
+		return 0;
+	pthread_mutex_lock(&seek->mutex);
+	stats->requested = seek->requested;
+	stats->executed = seek->executed;
+	stats->coalesced = seek->coalesced;
+	stats->seek_time = seek->seek_time;
+	stats->keyframes = seek->nkeyframes;
+	stats->scanning = seek->scanning;
+	pthread_mutex_unlock(&seek->mutex);
+	return 1;
+}
@@ -0,0 +1,442 @@
+/*********************************************************************/
+/*                                                                   */
+/* Copyright (C) 2010,  AVIQ Bulgaria Ltd                            */
+/*                                                                   */
+/* Project:       LRun                                               */
+/* Filename:      vlcwrp_snapshot.c                                  */
+/* Description:   VLC wrapper background snapshot encoder            */
+/*                                                                   */
+/*********************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <setjmp.h>
+
+#include <png.h>
+#include <jpeglib.h>
+
+#include "vlcwrp_priv.h"
+
+/* maximum number of snapshots queued for encoding */
+#define SNAPSHOT_QUEUE_SIZE 8
+
+/* maximum snapshot path length */
+#define SNAPSHOT_PATH_SIZE 1024
+
+/* frame copies kept for the next snapshots once encoded, the others go back to the arena */
+#define SNAPSHOT_SPARES 1
+
+/**
+ * copied frame shared by the snapshots requested before it was displayed
+ */
+struct snapshot_frame
+{
+	/* packed copy in an arena frame, block plus one, 0 if not taken yet */
+	unsigned char* pixels;
+	int block;
+
+	/* number of snapshots referencing the frame, a copy in progress holds one */
+	int refs;
+};
+
+/**
+ * requested snapshot
+ */
+struct snapshot_job
+{
+	char path[SNAPSHOT_PATH_SIZE];
+	vlcwrp_snapshot_format_t format;
+	int quality;
+	unsigned int id;
+
+	/* the frame to be encoded, NULL until the next frame is released */
+	struct snapshot_frame* frame;
+};
+
+/**
+ * snapshot encoder state
+ *
+ * Snapshots are requested by the application and take a copy of the next
+ * released frame on the render thread. The copy is encoded on the encoder
+ * thread, the copies are taken from the frame arena on demand within its
+ * budget and the queue is bounded so a burst of requests costs the render
+ * thread no more than a frame copy.
+ */
+struct vlcwrp_snapshot_ctx_t
+{
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	int stop;
+
+	/* requested snapshots, head is the next one to be encoded */
+	struct snapshot_job jobs[SNAPSHOT_QUEUE_SIZE];
+	unsigned int head;
+	unsigned int tail;
+
+	/* number of requested snapshots waiting for a frame */
+	int nwaiting;
+
+	/* frame copies, spares is the number of unreferenced ones */
+	struct snapshot_frame frames[SNAPSHOT_QUEUE_SIZE];
+	int spares;
+
+	/* last snapshot id */
+	unsigned int id;
+
+	/* statistics */
+	unsigned long requested;
+	unsigned long rejected;
+	unsigned long encoded;
+	unsigned long failed;
+	long long encode_time;
+};
+
+/* libjpeg error manager returning to the encoder instead of exiting */
+struct jpeg_error
+{
+	struct jpeg_error_mgr mgr;
+	jmp_buf env;
+};
+
+static void jpeg_error_exit(j_common_ptr cinfo)
+{
+	longjmp(((struct jpeg_error*)cinfo->err)->env, 1);
+}
+
+/* encodes a RV32 frame as JPEG */
+static int encode_jpeg(const char* path, const unsigned char* pixels, int width, int height, int quality)
+{
+	struct jpeg_compress_struct cinfo;
+	struct jpeg_error err;
+	unsigned char* volatile row = NULL;
+	FILE* volatile f;
+
+	f = fopen(path, "wb");
+	if (!f)
+		return -1;
+
+	cinfo.err = jpeg_std_error(&err.mgr);
+	err.mgr.error_exit = jpeg_error_exit;
+	if (setjmp(err.env))
+	{
+		jpeg_destroy_compress(&cinfo);
+		fclose(f);
+		free(row);
+		remove(path);
+		return -1;
+	}
+	jpeg_create_compress(&cinfo);
+	jpeg_stdio_dest(&cinfo, f);
+	cinfo.image_width = width;
+	cinfo.image_height = height;
+#ifdef JCS_EXTENSIONS
+	/* libjpeg-turbo reads the RV32 rows in place */
+	cinfo.input_components = BPP;
+	cinfo.in_color_space = JCS_EXT_BGRX;
+#else
+	cinfo.input_components = 3;
+	cinfo.in_color_space = JCS_RGB;
+	row = (unsigned char*)malloc((size_t)width * 3);
+	if (!row)
+		longjmp(err.env, 1);
+#endif
+	jpeg_set_defaults(&cinfo);
+	jpeg_set_quality(&cinfo, quality, TRUE);
+	jpeg_start_compress(&cinfo, TRUE);
+	while (cinfo.next_scanline < cinfo.image_height)
+	{
+		JSAMPROW rowp = (JSAMPROW)(pixels + (size_t)cinfo.next_scanline * width * BPP);
+		if (row)
+		{
+			/* RV32 pixels are stored B, G, R, X */
+			const unsigned char* src = rowp;
+			int x;
+			for (x=0; x<width; x++)
+			{
+				row[3*x]   = src[BPP*x+2];
+				row[3*x+1] = src[BPP*x+1];
+				row[3*x+2] = src[BPP*x];
+			}
+			rowp = row;
+		}
+		jpeg_write_scanlines(&cinfo, &rowp, 1);
+	}
+	jpeg_finish_compress(&cinfo);
+	jpeg_destroy_compress(&cinfo);
+	free(row);
+	if (fclose(f))
+	{
+		remove(path);
+		return -1;
+	}
+	return 0;
+}
+
+/* encodes a RV32 frame as PNG, quality 0-100 selects the zlib level 0-9, higher is smaller and slower */
+static int encode_png(const char* path, const unsigned char* pixels, int width, int height, int quality)
+{
+	png_structp png;
+	png_infop info;
+	FILE* volatile f;
+	int y;
+
+	f = fopen(path, "wb");
+	if (!f)
+		return -1;
+	png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+	info = png ? png_create_info_struct(png) : NULL;
+	if (!info || setjmp(png_jmpbuf(png)))
+	{
+		png_destroy_write_struct(&png, &info);
+		fclose(f);
+		remove(path);
+		return -1;
+	}
+	png_init_io(png, f);
+	png_set_compression_level(png, (quality * 9 + 50) / 100);
+	png_set_IHDR(png, info, width, height, 8, PNG_COLOR_TYPE_RGB, PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+	png_write_info(png, info);
+
+	/* the RV32 rows are written in place, B, G, R order with a filler byte */
+	png_set_bgr(png);
+	png_set_filler(png, 0, PNG_FILLER_AFTER);
+	for (y=0; y<height; y++)
+		png_write_row(png, (png_bytep)(pixels + (size_t)y * width * BPP));
+	png_write_end(png, NULL);
+	png_destroy_write_struct(&png, &info);
+	if (fclose(f))
+	{
+		remove(path);
+		return -1;
+	}
+	return 0;
+}
+
+static void* snapshot_run(void* arg)
+{
+	struct vlcwrp_ctx_t* ctx = (struct vlcwrp_ctx_t*)arg;
+	struct vlcwrp_snapshot_ctx_t* snap = ctx->snapshot;
+	struct snapshot_job job;
+	long long start, elapsed;
+	int rc;
+
+	pthread_mutex_lock(&snap->mutex);
+	for (;;)
+	{
+		while (!snap->stop && (snap->head == snap->tail || !snap->jobs[snap->head % SNAPSHOT_QUEUE_SIZE].frame))
+			pthread_cond_wait(&snap->cond, &snap->mutex);
+		if (snap->stop)
+			break;
+		job = snap->jobs[snap->head % SNAPSHOT_QUEUE_SIZE];
+		snap->head++;
+		pthread_mutex_unlock(&snap->mutex);
+
+		start = vlcwrp_clock();
+		if (job.format == VLCWRP_SNAPSHOT_PNG)
+			rc = encode_png(job.path, job.frame->pixels, ctx->width, ctx->height, job.quality);
+		else
+			rc = encode_jpeg(job.path, job.frame->pixels, ctx->width, ctx->height, job.quality);
+		elapsed = vlcwrp_clock() - start;
+		vlcwrp_event_post(ctx, VLCWRP_EVENT_SNAPSHOT, rc, job.id, job.path);
+
+		pthread_mutex_lock(&snap->mutex);
+		if (!--job.frame->refs && ++snap->spares > SNAPSHOT_SPARES)
+		{
+			vlcwrp_arena_put(job.frame->block - 1);
+			job.frame->block = 0;
+			job.frame->pixels = NULL;
+			snap->spares--;
+		}
+		snap->encode_time += elapsed;
+		if (rc)
+			snap->failed++;
+		else
+			snap->encoded++;
+	}
+	pthread_mutex_unlock(&snap->mutex);
+	return NULL;
+}
+
+/* creates the snapshot encoder on the first request */
+static struct vlcwrp_snapshot_ctx_t* snapshot_create(struct vlcwrp_ctx_t* ctx)
+{
+	struct vlcwrp_snapshot_ctx_t* snap;
+
+	snap = (struct vlcwrp_snapshot_ctx_t*)calloc(1, sizeof(struct vlcwrp_snapshot_ctx_t));
+	if (!snap)
+		return NULL;
+	pthread_mutex_init(&snap->mutex, 0);
+	pthread_cond_init(&snap->cond, 0);
+
+	/* the capture on the render thread only sees a fully created encoder */
+	vlcwrp_atomic_store(&ctx->snapshot, snap);
+	if (pthread_create(&snap->thread, 0, snapshot_run, ctx))
+	{
+		vlcwrp_atomic_store(&ctx->snapshot, (struct vlcwrp_snapshot_ctx_t*)NULL);
+		pthread_cond_destroy(&snap->cond);
+		pthread_mutex_destroy(&snap->mutex);
+		free(snap);
+		return NULL;
+	}
+	return snap;
+}
+
+/* request a snapshot of the next released frame */
+int vlcwrp_snapshot(struct vlcwrp_ctx_t* ctx, const char* path, vlcwrp_snapshot_format_t format, int quality)
+{
+	struct vlcwrp_snapshot_ctx_t* snap = ctx->snapshot;
+	struct snapshot_job* job;
+	int id;
+
+	if (!ctx->video || strlen(path) >= SNAPSHOT_PATH_SIZE || quality < 0 || quality > 100)
+		return -1;
+	if (!snap && !(snap = snapshot_create(ctx)))
+		return -1;
+
+	pthread_mutex_lock(&snap->mutex);
+	snap->requested++;
+	if (snap->tail - snap->head == SNAPSHOT_QUEUE_SIZE)
+	{
+		/* the encoder is behind, the request is rejected rather than queued */
+		snap->rejected++;
+		pthread_mutex_unlock(&snap->mutex);
+		return -1;
+	}
+	job = &snap->jobs[snap->tail % SNAPSHOT_QUEUE_SIZE];
+	strcpy(job->path, path);
+	job->format = format;
+	job->quality = quality;
+	job->id = ++snap->id;
+	job->frame = NULL;
+	id = (int)job->id;
+	snap->tail++;
+	vlcwrp_atomic_store(&snap->nwaiting, snap->nwaiting + 1);
+	pthread_mutex_unlock(&snap->mutex);
+	return id;
+}
+
+/* non zero if snapshots wait for the next released frame */
+int vlcwrp_snapshot_pending(struct vlcwrp_ctx_t* ctx)
+{
+	struct vlcwrp_snapshot_ctx_t* snap = vlcwrp_atomic_load(&ctx->snapshot);
+	return snap && vlcwrp_atomic_load(&snap->nwaiting);
+}
+
+/* copies the frame for the waiting snapshots, called on frame release */
+void vlcwrp_snapshot_capture(struct vlcwrp_ctx_t* ctx, const unsigned char* pixels)
+{
+	struct vlcwrp_snapshot_ctx_t* snap = vlcwrp_atomic_load(&ctx->snapshot);
+	struct snapshot_frame* frame = NULL;
+	unsigned int i;
+	int refs = 0, used = 0, block;
+
+	if (!snap || !vlcwrp_atomic_load(&snap->nwaiting))
+		return;
+
+	/* reserves a spare frame copy, or an unused slot for a new one */
+	pthread_mutex_lock(&snap->mutex);
+	for (i=0; i<SNAPSHOT_QUEUE_SIZE; i++)
+	{
+		struct snapshot_frame* f = &snap->frames[i];
+		if (f->refs)
+			used = 1;
+		else if (f->block && (!frame || !frame->block))
+			frame = f;
+		else if (!f->block && !frame)
+			frame = f;
+	}
+	if (frame)
+	{
+		if (frame->block)
+			snap->spares--;
+		frame->refs = 1;
+	}
+	pthread_mutex_unlock(&snap->mutex);
+	if (!frame)
+		return;
+
+	/* the copy is a frame of the player arena class, over the budget only if no other copy is in use */
+	if (!frame->block)
+	{
+		block = vlcwrp_arena_get(ctx->buffers_class - 1, &ctx->buffers_config, !used, &frame->pixels);
+		if (block < 0)
+		{
+			/* the snapshots wait for the next frame */
+			frame->pixels = NULL;
+			pthread_mutex_lock(&snap->mutex);
+			frame->refs = 0;
+			pthread_mutex_unlock(&snap->mutex);
+			return;
+		}
+		frame->block = block + 1;
+	}
+
+	/* the copy is packed, the encoders read width * BPP byte rows */
+	if (ctx->pitch == ctx->width * BPP)
+		memcpy(frame->pixels, pixels, (size_t)ctx->width * ctx->height * BPP);
+	else
+	{
+		int y;
+		for (y=0; y<ctx->height; y++)
+			memcpy(frame->pixels + (size_t)y * ctx->width * BPP, pixels + (size_t)y * ctx->pitch, (size_t)ctx->width * BPP);
+	}
+
+	/* hands the copy to all snapshots waiting for a frame */
+	pthread_mutex_lock(&snap->mutex);
+	for (i=snap->head; i!=snap->tail; i++)
+	{
+		struct snapshot_job* job = &snap->jobs[i % SNAPSHOT_QUEUE_SIZE];
+		if (!job->frame)
+		{
+			job->frame = frame;
+			refs++;
+		}
+	}
+	frame->refs = refs;
+	if (!refs)
+		snap->spares++;
+	vlcwrp_atomic_store(&snap->nwaiting, 0);
+	pthread_cond_signal(&snap->cond);
+	pthread_mutex_unlock(&snap->mutex);
+}
+
+/* get snapshot encoder statistics */
+int vlcwrp_snapshot_stats(struct vlcwrp_ctx_t* ctx, vlcwrp_snapshot_stats_t* stats)
+{
+	struct vlcwrp_snapshot_ctx_t* snap = ctx->snapshot;
+	if (!snap)
+		return 0;
+	pthread_mutex_lock(&snap->mutex);
+	stats->requested = snap->requested;
+	stats->rejected = snap->rejected;
+	stats->encoded = snap->encoded;
+	stats->failed = snap->failed;
+	stats->queued = snap->tail - snap->head;
+	stats->encode_time = snap->encode_time;
+	pthread_mutex_unlock(&snap->mutex);
+	return 1;
+}
+
+/* stops the snapshot encoder, pending snapshots are discarded */
+void vlcwrp_snapshot_free(struct vlcwrp_ctx_t* ctx)
+{
+	struct vlcwrp_snapshot_ctx_t* snap = ctx->snapshot;
+	int i;
+	if (snap)
+	{
+		pthread_mutex_lock(&snap->mutex);
+		snap->stop = 1;
+		pthread_cond_signal(&snap->cond);
+		pthread_mutex_unlock(&snap->mutex);
+		pthread_join(snap->thread, NULL);
+		pthread_cond_destroy(&snap->cond);
+		pthread_mutex_destroy(&snap->mutex);
+		for (i=0; i<SNAPSHOT_QUEUE_SIZE; i++)
+			if (snap->frames[i].block)
+				vlcwrp_arena_put(snap->frames[i].block - 1);
+		free(snap);
+		ctx->snapshot = NULL;
+	}
+}
@@ -0,0 +1,169 @@
+/*********************************************************************/
+/*                                                                   */
+/* Copyright (C) 2010,  AVIQ Bulgaria Ltd                            */
+/*                                                                   */
+/* Project:       LRun                                               */
+/* Filename:      vlcwrp_threads.c                                   */
+/* Description:   VLC wrapper thread placement and CPU time          */
+/*                                                                   */
+/*********************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef __linux__
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/resource.h>
+#endif
+
+#include "vlcwrp_priv.h"
+
+/* CPUs addressable by the configuration mask */
+#define THREADS_MAX_CPUS 64
+
+/* fill config with a configuration leaving the thread unchanged */
+void vlcwrp_thread_defaults(vlcwrp_thread_config_t* config)
+{
+	config->cpus = 0;
+	config->nice = VLCWRP_NICE_KEEP;
+	config->fifo = 0;
+}
+
+/* set the CPU affinity and priority of the calling thread */
+int vlcwrp_thread_apply(const vlcwrp_thread_config_t* config)
+{
+#ifdef __linux__
+	int rc = 0, i;
+
+	if (config->cpus)
+	{
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		for (i=0; i<THREADS_MAX_CPUS; i++)
+			if (config->cpus & (1ULL << i))
+				CPU_SET(i, &set);
+		if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set))
+			rc = -1;
+	}
+
+	/* on Linux the nice value is per thread */
+	if (config->nice != VLCWRP_NICE_KEEP && setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), config->nice))
+		rc = -1;
+
+	/* without the privilege the thread keeps its policy and the nice value above */
+	if (config->fifo > 0)
+	{
+		struct sched_param param;
+		memset(&param, 0, sizeof(param));
+		param.sched_priority = config->fifo;
+		if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param))
+			rc = -1;
+	}
+	return rc;
+#else
+	return config->cpus || config->nice != VLCWRP_NICE_KEEP || config->fifo > 0 ? -1 : 0;
+#endif
+}
+
+/* get the CPU time of the calling thread in microseconds */
+long long vlcwrp_thread_cpu_time(void)
+{
+	struct timespec ts;
+	if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts))
+		return 0;
+	return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* set the placement of the threads entering the player callbacks of role */
+void vlcwrp_thread_config(struct vlcwrp_ctx_t* ctx, vlcwrp_thread_role_t role, const vlcwrp_thread_config_t* config)
+{
+	struct vlcwrp_thread_ctx_t* t;
+
+	if ((unsigned int)role >= VLCWRP_THREAD_ROLES)
+		return;
+	t = &ctx->threads[role];
+
+	/* not locking, the audio thread never waits, the apply flag is set after the fields */
+	vlcwrp_atomic_store(&t->config.cpus, config->cpus);
+	vlcwrp_atomic_store(&t->config.nice, config->nice);
+	vlcwrp_atomic_store(&t->config.fifo, config->fifo);
+	vlcwrp_atomic_store(&t->configured, 1);
+	vlcwrp_atomic_store(&t->status, 0);
+	vlcwrp_atomic_store(&t->apply, 1);
+}
+
+/* the threads apply their placement again on their next callback, called on play */
+void vlcwrp_threads_reset(struct vlcwrp_ctx_t* ctx)
+{
+	int i;
+
+	/* VLC may start new threads, or reuse the pthread_t of the previous ones */
+	for (i=0; i<VLCWRP_THREAD_ROLES; i++)
+		if (vlcwrp_atomic_load(&ctx->threads[i].configured))
+			vlcwrp_atomic_store(&ctx->threads[i].apply, 1);
+}
+
+/* applies the thread placement of role and accounts the thread time, called on each callback */
+void vlcwrp_threads_enter(struct vlcwrp_ctx_t* ctx, vlcwrp_thread_role_t role)
+{
+	struct vlcwrp_thread_ctx_t* t = &ctx->threads[role];
+	pthread_t self = pthread_self();
+	long long cpu_time = vlcwrp_thread_cpu_time();
+	int cpu = -1;
+
+	/* the time of a new thread starts from zero */
+	if (!t->entered || !pthread_equal(t->self, self) || cpu_time < t->cpu_last)
+	{
+		vlcwrp_atomic_store(&t->cpu_base, t->cpu_base + t->cpu_last);
+		vlcwrp_atomic_store(&t->cpu_last, 0);
+		t->self = self;
+		t->entered = 1;
+#ifdef __linux__
+		vlcwrp_atomic_store(&t->tid, (int)syscall(SYS_gettid));
+#endif
+		if (vlcwrp_atomic_load(&t->configured))
+			vlcwrp_atomic_store(&t->apply, 1);
+	}
+	vlcwrp_atomic_store(&t->cpu_last, cpu_time);
+
+	if (vlcwrp_atomic_load(&t->apply) && vlcwrp_atomic_exchange(&t->apply, 0))
+	{
+		vlcwrp_thread_config_t config;
+		config.cpus = vlcwrp_atomic_load(&t->config.cpus);
+		config.nice = vlcwrp_atomic_load(&t->config.nice);
+		config.fifo = vlcwrp_atomic_load(&t->config.fifo);
+		vlcwrp_atomic_store(&t->status, vlcwrp_thread_apply(&config) ? -1 : 1);
+	}
+
+#ifdef __linux__
+	cpu = sched_getcpu();
+#endif
+	if (cpu >= 0)
+	{
+		if (t->cpu && t->cpu != cpu + 1)
+			vlcwrp_atomic_add(&t->migrations, 1);
+		vlcwrp_atomic_store(&t->cpu, cpu + 1);
+	}
+}
+
+/* get the thread statistics of a callback role of the player */
+void vlcwrp_thread_stats(struct vlcwrp_ctx_t* ctx, vlcwrp_thread_role_t role, vlcwrp_thread_stats_t* stats)
+{
+	struct vlcwrp_thread_ctx_t* t;
+
+	memset(stats, 0, sizeof(*stats));
+	stats->cpu = -1;
+	if ((unsigned int)role >= VLCWRP_THREAD_ROLES)
+		return;
+
+	/* not locking, the consumer may hold an acquired frame, the time sum may be off by a play */
+	t = &ctx->threads[role];
+	stats->tid = vlcwrp_atomic_load(&t->tid);
+	stats->cpu_time = vlcwrp_atomic_load(&t->cpu_base) + vlcwrp_atomic_load(&t->cpu_last);
+	stats->cpu = vlcwrp_atomic_load(&t->cpu) - 1;
+	stats->migrations = vlcwrp_atomic_load(&t->migrations);
+	stats->status = vlcwrp_atomic_load(&t->status);
+}
@@ -0,0 +1,357 @@
+/*********************************************************************/
+/*                                                                   */
+/* Copyright (C) 2010,  AVIQ Bulgaria Ltd                            */
+/*                                                                   */
+/* Project:       LRun                                               */
+/* Filename:      vlcwrp_thumbnails.c                                */
+/* Description:   VLC wrapper batch thumbnail extraction             */
+/*                                                                   */
+/*********************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#include "vlcwrp_priv.h"
+
+/* a frame within SEEK_TOLERANCE of the requested position is taken */
+#define SEEK_TOLERANCE 0.02f
+
+/* maximum number of additional VLC arguments */
+#define THUMB_MAX_ARGS 32
+
+/**
+ * thumbnail batch shared by the workers
+ */
+struct thumb_batch
+{
+	const vlcwrp_thumbnail_config_t* config;
+	libvlc_instance_t* libvlc;
+	const char* const* files;
+	const float* positions;
+	int count;
+	vlcwrp_thumbnail_t* thumbs;
+
+	/* next file to be taken by a worker */
+	int next;
+};
+
+/**
+ * thumbnail worker, one lightweight player decoding into a small frame
+ */
+struct thumb_worker
+{
+	pthread_t thread;
+	struct thumb_batch* batch;
+	libvlc_media_player_t* mp;
+
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+
+	/* vmem frame, VLC keeps a single picture so it is never written while displayed */
+	unsigned char* frame;
+
+	/* current thumbnail */
+	vlcwrp_thumbnail_t* thumb;
+	float position;
+
+	/* a frame was copied, the frame is at the requested position, the media failed */
+	int displayed;
+	int captured;
+	int failed;
+};
+
+/* fill config with the default thumbnail configuration */
+void vlcwrp_thumbnail_defaults(vlcwrp_thumbnail_config_t* config)
+{
+	long ncpu = 1;
+#ifndef _WIN32
+	ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+	config->width = 160;
+	config->height = 90;
+	config->workers = ncpu > 0 ? (int)ncpu : 1;
+	config->timeout = 5000;
+	config->output = NULL;
+	config->argc = 0;
+	config->argv = NULL;
+}
+
+/* vmem callbacks, called on the VLC video output thread */
+
+static void* thumb_lock(void* opaque, void** p_pixels)
+{
+	struct thumb_worker* w = (struct thumb_worker*)opaque;
+	*p_pixels = w->frame;
+	return NULL;
+}
+
+static void thumb_display(void* opaque, void* picture)
+{
+	struct thumb_worker* w = (struct thumb_worker*)opaque;
+	float position = libvlc_media_player_get_position(w->mp);
+	const vlcwrp_thumbnail_config_t* config = w->batch->config;
+
+	pthread_mutex_lock(&w->mutex);
+	if (w->thumb && !w->captured)
+	{
+		/* keeps the last frame in case the requested position is never reached */
+		memcpy(w->thumb->pixels, w->frame, (size_t)config->width * config->height * BPP);
+		w->thumb->time = libvlc_media_player_get_time(w->mp);
+		w->displayed = 1;
+		if (w->position <= 0 || position >= w->position - SEEK_TOLERANCE)
+		{
+			w->captured = 1;
+			pthread_cond_signal(&w->cond);
+		}
+	}
+	pthread_mutex_unlock(&w->mutex);
+}
+
+static void thumb_event(const struct libvlc_event_t* event, void* opaque)
+{
+	struct thumb_worker* w = (struct thumb_worker*)opaque;
+	pthread_mutex_lock(&w->mutex);
+	w->failed = 1;
+	pthread_cond_signal(&w->cond);
+	pthread_mutex_unlock(&w->mutex);
+}
+
+/* writes a RV32 frame as binary PPM */
+static int write_ppm(const char* path, const unsigned char* pixels, int width, int height)
+{
+	unsigned char* row;
+	FILE* f;
+	int x, y, rc = 0;
+
+	row = (unsigned char*)malloc((size_t)width * 3);
+	if (!row)
+		return -1;
+	f = fopen(path, "wb");
+	if (!f)
+	{
+		free(row);
+		return -1;
+	}
+	fprintf(f, "P6\n%d %d\n255\n", width, height);
+	for (y=0; y<height; y++)
+	{
+		const unsigned char* src = pixels + (size_t)y * width * BPP;
+		for (x=0; x<width; x++)
+		{
+			/* RV32 pixels are stored B, G, R, X */
+			row[3*x]   = src[BPP*x+2];
+			row[3*x+1] = src[BPP*x+1];
+			row[3*x+2] = src[BPP*x];
+		}
+		fwrite(row, 3, (size_t)width, f);
+	}
+	if (ferror(f))
+		rc = -1;
+	if (fclose(f))
+		rc = -1;
+	free(row);
+	return rc;
+}
+
+/* formats the output path, the first %d of the pattern is replaced by index */
+static void output_path(char* path, size_t size, const char* pattern, int index)
+{
+	const char* p = strstr(pattern, "%d");
+	if (p)
+		snprintf(path, size, "%.*s%d%s", (int)(p - pattern), pattern, index, p + 2);
+	else
+		snprintf(path, size, "%s%d", pattern, index);
+}
+
+/* extracts the thumbnail of one file */
+static void thumb_extract(struct thumb_worker* w, int index)
+{
+	struct thumb_batch* batch = w->batch;
+	const vlcwrp_thumbnail_config_t* config = batch->config;
+	vlcwrp_thumbnail_t* thumb = &batch->thumbs[index];
+	libvlc_media_t* m;
+	struct timespec deadline;
+	int rc = 0;
+
+	thumb->pixels = malloc((size_t)config->width * config->height * BPP);
+	if (!thumb->pixels)
+		return;
+	m = libvlc_media_new_path(batch->libvlc, batch->files[index]);
+	if (!m)
+		return;
+	/* decoding starts at the keyframe before the position, no audio */
+	vlcwrp_profile_apply(m, VLCWRP_PROFILE_THUMBNAIL);
+	libvlc_media_player_set_media(w->mp, m);
+	libvlc_media_release(m);
+
+	pthread_mutex_lock(&w->mutex);
+	w->thumb = thumb;
+	w->position = batch->positions[index];
+	w->displayed = w->captured = w->failed = 0;
+	pthread_mutex_unlock(&w->mutex);
+
+	if (!libvlc_media_player_play(w->mp))
+	{
+		if (w->position > 0)
+			libvlc_media_player_set_position(w->mp, w->position);
+
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_sec += config->timeout / 1000;
+		deadline.tv_nsec += (long)(config->timeout % 1000) * 1000000;
+		if (deadline.tv_nsec >= 1000000000)
+		{
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000;
+		}
+
+		pthread_mutex_lock(&w->mutex);
+		while (!w->captured && !w->failed && rc != ETIMEDOUT)
+			rc = pthread_cond_timedwait(&w->cond, &w->mutex, &deadline);
+		pthread_mutex_unlock(&w->mutex);
+	}
+
+	/* no more frames are copied to the thumbnail */
+	pthread_mutex_lock(&w->mutex);
+	w->thumb = NULL;
+	thumb->status = w->displayed ? 0 : -1;
+	thumb->exact = w->captured;
+	pthread_mutex_unlock(&w->mutex);
+	libvlc_media_player_stop(w->mp);
+
+	if (!thumb->status && config->output)
+	{
+		char path[4096];
+		output_path(path, sizeof(path), config->output, index + 1);
+		if (write_ppm(path, (const unsigned char*)thumb->pixels, config->width, config->height))
+			thumb->status = -1;
+		free(thumb->pixels);
+		thumb->pixels = NULL;
+	}
+}
+
+static void* thumb_worker_run(void* arg)
+{
+	struct thumb_worker* w = (struct thumb_worker*)arg;
+	int index;
+	while ((index = vlcwrp_atomic_add(&w->batch->next, 1) - 1) < w->batch->count)
+		thumb_extract(w, index);
+	return NULL;
+}
+
+/* extract thumbnails of a batch of files on a pool of players */
+int vlcwrp_thumbnails(const vlcwrp_thumbnail_config_t* config, const char* const* files, const float* positions, int count, vlcwrp_thumbnail_t* thumbs)
+{
+	const char* argv[THUMB_MAX_ARGS + 8];
+	struct thumb_batch batch;
+	struct thumb_worker* workers;
+	int i, argc = 0, nworkers, nstarted = 0, nok = 0;
+
+	if (config->width < 1 || config->height < 1 || config->timeout < 1)
+		return -1;
+	for (i=0; i<count; i++)
+	{
+		thumbs[i].status = -1;
+		thumbs[i].exact = 0;
+		thumbs[i].pixels = NULL;
+		thumbs[i].time = -1;
+	}
+	if (count < 1)
+		return 0;
+	nworkers = config->workers < 1 ? 1 : (config->workers > count ? count : config->workers);
+
+	/* each player decodes on a single thread, the pool scales with the workers */
+	argv[argc++] = "--ignore-config";
+	argv[argc++] = "-q";
+	argv[argc++] = "--no-audio";
+	argv[argc++] = "--no-osd";
+	argv[argc++] = "--avcodec-threads=1";
+	argv[argc++] = "--avcodec-hw=none";
+	for (i=0; i<config->argc && i<THUMB_MAX_ARGS; i++)
+		argv[argc++] = config->argv[i];
+
+	batch.config = config;
+	batch.files = files;
+	batch.positions = positions;
+	batch.count = count;
+	batch.thumbs = thumbs;
+	batch.next = 0;
+	batch.libvlc = libvlc_new(argc, argv);
+	if (!batch.libvlc)
+		return -1;
+
+	workers = (struct thumb_worker*)calloc(nworkers, sizeof(struct thumb_worker));
+	if (!workers)
+	{
+		libvlc_release(batch.libvlc);
+		return -1;
+	}
+	for (i=0; i<nworkers; i++)
+	{
+		struct thumb_worker* w = &workers[i];
+		w->batch = &batch;
+		w->frame = (unsigned char*)malloc((size_t)config->width * config->height * BPP);
+		w->mp = libvlc_media_player_new(batch.libvlc);
+		if (!w->frame || !w->mp)
+			break;
+		pthread_mutex_init(&w->mutex, 0);
+		pthread_cond_init(&w->cond, 0);
+		libvlc_video_set_callbacks(w->mp, thumb_lock, NULL, thumb_display, w);
+		libvlc_video_set_format(w->mp, CHROMA, config->width, config->height, config->width * BPP);
+		libvlc_event_attach(libvlc_media_player_event_manager(w->mp), libvlc_MediaPlayerEncounteredError, thumb_event, w);
+		libvlc_event_attach(libvlc_media_player_event_manager(w->mp), libvlc_MediaPlayerEndReached, thumb_event, w);
+		if (pthread_create(&w->thread, 0, thumb_worker_run, w))
+		{
+			pthread_cond_destroy(&w->cond);
+			pthread_mutex_destroy(&w->mutex);
+			break;
+		}
+		nstarted++;
+	}
+	for (i=0; i<nstarted; i++)
+	{
+		pthread_join(workers[i].thread, NULL);
+		pthread_cond_destroy(&workers[i].cond);
+		pthread_mutex_destroy(&workers[i].mutex);
+	}
+	for (i=0; i<nworkers; i++)
+	{
+		if (workers[i].mp)
+			libvlc_media_player_release(workers[i].mp);
+		free(workers[i].frame);
+	}
+	free(workers);
+	libvlc_release(batch.libvlc);
+	if (!nstarted)
+		return -1;
+
+	for (i=0; i<count; i++)
+	{
+		if (thumbs[i].status)
+		{
+			free(thumbs[i].pixels);
+			thumbs[i].pixels = NULL;
+		}
+		else
+			nok++;
+	}
+	return nok;
+}
+
+/* release the thumbnail frames */
+void vlcwrp_thumbnails_free(vlcwrp_thumbnail_t* thumbs, int count)
+{
+	int i;
+	for (i=0; i<count; i++)
+	{
+		free(thumbs[i].pixels);
+		thumbs[i].pixels = NULL;
+	}
+}
@@ -0,0 +1,93 @@
+/*********************************************************************/
+/*                                                                   */
+/* Copyright (C) 2010,  AVIQ Bulgaria Ltd                            */
+/*                                                                   */
+/* Project:       LRun                                               */
+/* Filename:      vlcwrp_wait.c                                      */
+/* Description:   VLC wrapper multiplexed wait over players          */
+/*                                                                   */
+/*********************************************************************/
+
+#include <time.h>
+
+#include "vlcwrp_priv.h"
+
+/**
+ * Each player counts its queued frames, posted events and stops in a ready
+ * token. A single process wide condition is broadcast on a token change
+ * when somebody waits, so one thread can wait on any number of players.
+ */
+static pthread_mutex_t wait_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wait_cond = PTHREAD_COND_INITIALIZER;
+
+/* number of threads in vlcwrp_wait_ready */
+static int wait_waiters = 0;
+
+/* advances the ready token and wakes the waiters, called from any thread */
+void vlcwrp_wait_notify(struct vlcwrp_ctx_t* ctx)
+{
+	vlcwrp_atomic_add(&ctx->ready, 1);
+
+	/* pairs with the fence in vlcwrp_wait_ready, either the waiter sees the new token or we see the waiter */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (vlcwrp_atomic_load(&wait_waiters))
+	{
+		pthread_mutex_lock(&wait_mutex);
+		pthread_cond_broadcast(&wait_cond);
+		pthread_mutex_unlock(&wait_mutex);
+	}
+}
+
+/* get the ready token of the player */
+unsigned int vlcwrp_ready_token(struct vlcwrp_ctx_t* ctx, int* ready)
+{
+	unsigned int token = vlcwrp_atomic_load(&ctx->ready);
+
+	/* checked after the token is taken, a later frame changes the token */
+	if (ready)
+		*ready = vlcwrp_atomic_load(&ctx->nqueuedframes) > 0 || vlcwrp_events_pending(ctx);
+	return token;
+}
+
+/* counts the players whose token changed */
+static int count_ready(struct vlcwrp_ctx_t* const* ctxs, const unsigned int* tokens, int n)
+{
+	int i, nready = 0;
+	for (i=0; i<n; i++)
+		if (ctxs[i] && vlcwrp_atomic_load(&ctxs[i]->ready) != tokens[i])
+			nready++;
+	return nready;
+}
+
+/* wait until the token of any of the players changes */
+int vlcwrp_wait_ready(struct vlcwrp_ctx_t* const* ctxs, const unsigned int* tokens, int n, int timeout)
+{
+	struct timespec deadline;
+	int nready, rc = 0;
+
+	if (timeout > 0)
+	{
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_sec += timeout / 1000;
+		deadline.tv_nsec += (long)(timeout % 1000) * 1000000;
+		if (deadline.tv_nsec >= 1000000000)
+		{
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000;
+		}
+	}
+
+	pthread_mutex_lock(&wait_mutex);
+	vlcwrp_atomic_add(&wait_waiters, 1);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	while (!(nready = count_ready(ctxs, tokens, n)) && timeout != 0 && rc == 0)
+	{
+		if (timeout < 0)
+			pthread_cond_wait(&wait_cond, &wait_mutex);
+		else
+			rc = pthread_cond_timedwait(&wait_cond, &wait_mutex, &deadline);
+	}
+	vlcwrp_atomic_add(&wait_waiters, -1);
+	pthread_mutex_unlock(&wait_mutex);
+	return nready;
+}